@@ -0,0 +1,1173 @@
+// Copyright (c) 2013, kt.d <kt@kt.d>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+//! \file
+//!
+//! kstr benchmark program implementation
+//!
+//! each benchmark runs an operation many times and reports the average time
+//! and number of heap allocations per operation as one csv line on stdout.
+//! allocations are counted by wrapping the allocator functions at link time
+//! (see the `bench` target in the makefile).
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <kstr.h>
+#include <kstr_inline.h>
+
+//! benchmark function type
+//!
+//! \param iterations number of operations to run
+typedef void bench_fn(size_t iterations);
+
+//! benchmark table entry
+struct bench
+{
+   char const * name; //!< benchmark name
+   bench_fn * fn; //!< benchmark function
+   size_t iterations; //!< default number of operations
+};
+
+//! allocate memory with the real `calloc()`
+void * __real_calloc(size_t count, size_t size);
+
+//! free memory with the real `free()`
+void __real_free(void * ptr);
+
+//! allocate memory with the real `malloc()`
+void * __real_malloc(size_t size);
+
+//! resize memory with the real `realloc()`
+void * __real_realloc(void * ptr, size_t size);
+
+//! count an allocation and allocate memory with `calloc()`
+void * __wrap_calloc(size_t count, size_t size);
+
+//! free memory with `free()`
+void __wrap_free(void * ptr);
+
+//! count an allocation and allocate memory with `malloc()`
+void * __wrap_malloc(size_t size);
+
+//! count an allocation and resize memory with `realloc()`
+void * __wrap_realloc(void * ptr, size_t size);
+
+//! benchmark appending all ansi control codes
+static void bench_add_codes(size_t iterations);
+
+//! benchmark appending the same text as bench_add_fmt() with a compiled
+//! format
+static void bench_add_compiled(size_t iterations);
+
+//! benchmark appending a number with kstr_add_double()
+static void bench_add_double(size_t iterations);
+
+//! benchmark appending a number in its shortest exact form with
+//! kstr_add_double()
+static void bench_add_double_shortest(size_t iterations);
+
+//! benchmark appending formatted text
+static void bench_add_fmt(size_t iterations);
+
+//! benchmark appending the same numbers as bench_add_int() and
+//! bench_add_double() with kstr_add_fmt()
+static void bench_add_fmt_numbers(size_t iterations);
+
+//! benchmark appending an integer with kstr_add_int()
+static void bench_add_int(size_t iterations);
+
+//! benchmark appending a line of text and control codes with kstr_add_iov()
+static void bench_add_iov(size_t iterations);
+
+//! benchmark appending the same line as bench_add_iov() one piece at a time
+static void bench_add_pieces(size_t iterations);
+
+//! benchmark appending 1024 bytes of text
+static void bench_add_text_1024(size_t iterations);
+
+//! benchmark building a 256 MiB string from long text using
+//! ::kstr_growth_chunked
+static void bench_add_text_chunked(size_t iterations);
+
+//! benchmark building a 256 MiB string from long text
+static void bench_add_text_large(size_t iterations);
+
+//! benchmark appending 64 bytes of text
+static void bench_add_text_64(size_t iterations);
+
+//! benchmark appending 8 bytes of text
+static void bench_add_text_8(size_t iterations);
+
+//! benchmark appending utf-8 text with wide characters
+static void bench_add_text_utf8(size_t iterations);
+
+//! benchmark appending 8 bytes at a time with kstr_add_text_inline()
+static void bench_add_text_inline(size_t iterations);
+
+//! benchmark reading the size and width of a string with the inline methods
+static void bench_size_width_inline(size_t iterations);
+
+//! benchmark reading the size and width of a string with library calls
+static void bench_size_width(size_t iterations);
+
+//! benchmark creating and destroying strings in an arena
+static void bench_arena_new_free(size_t iterations);
+
+//! benchmark getting the basename of a path
+static void bench_basename(size_t iterations);
+
+//! benchmark getting the basename of a path with a trailing slash
+static void bench_basename_trailing(size_t iterations);
+
+//! benchmark cloning and destroying a long string
+static void bench_clone_long(size_t iterations);
+
+//! benchmark copying and destroying a long string
+static void bench_copy_long(size_t iterations);
+
+//! benchmark copying and destroying a short string
+static void bench_copy_short(size_t iterations);
+
+//! benchmark searching a long string for a missing needle with frequent
+//! false starts
+static void bench_find_long(size_t iterations);
+
+//! benchmark hashing a long string
+static void bench_hash_long(size_t iterations);
+
+//! benchmark interning a few thousand distinct short values repeatedly
+static void bench_intern_labels(size_t iterations);
+
+//! benchmark creating and destroying a long string with the string cache
+static void bench_new_free_cached(size_t iterations);
+
+//! benchmark creating and destroying a long string
+static void bench_new_free_long(size_t iterations);
+
+//! benchmark creating and destroying a short string
+static void bench_new_free_short(size_t iterations);
+
+//! benchmark writing colored lines to `/dev/null` one by one
+static void bench_write_lines(size_t iterations);
+
+//! benchmark writing colored lines to `/dev/null` 64 at a time
+static void bench_writev_lines(size_t iterations);
+
+//! benchmark writing colored lines to `/dev/null` without control codes
+static void bench_write_plain_lines(size_t iterations);
+
+//! benchmark replacing every 16th byte of a long string with two bytes
+static void bench_replace_all(size_t iterations);
+
+//! benchmark styling words with three separate control codes each
+static void bench_style_separate(size_t iterations);
+
+//! benchmark styling words with one combined control code each
+static void bench_style_combined(size_t iterations);
+
+//! benchmark splitting a line of fields into views with kstr_split()
+static void bench_split_fields(size_t iterations);
+
+//! benchmark splitting a copy of a line of fields with `strtok()`
+static void bench_split_strtok(size_t iterations);
+
+//! benchmark formatting rows into one string in a single thread
+static void bench_build_rows(size_t iterations);
+
+//! benchmark formatting rows into one string in four threads with a builder
+static void bench_build_rows_threads(size_t iterations);
+
+//! append text to a string repeatedly, clearing it now and then
+//!
+//! \param iterations number of appends
+//! \param text text to append
+static void bench_add_text(size_t iterations, char const * text);
+
+//! append long text to a string repeatedly, starting over at 256 MiB
+//!
+//! \param iterations number of appends
+//! \param growth growth policy of the string
+static void bench_add_large(size_t iterations, kstr_growth growth);
+
+//! format rows into a string, starting over every 256 Ki rows
+//!
+//! with a bulk builder, each batch of rows is split evenly between the
+//! builder's slices, which are formatted in threads of their own and then
+//! appended with kstr_builder_finish().
+//!
+//! \param iterations number of rows
+//! \param threads number of threads, or 0 to format without a builder
+static void bench_build(size_t iterations, size_t threads);
+
+//! format rows into a builder's slice
+//!
+//! \param job pointer to a ::bench_rows
+//!
+//! \return `NULL`
+static void * bench_add_rows(void * job);
+
+//! get the current time in nanoseconds
+//!
+//! \return the value of the monotonic clock in nanoseconds
+static double bench_now(void);
+
+//! run the benchmark program
+//!
+//! \param argc number of arguments
+//! \param argv arguments: an optional iteration count multiplier, followed by
+//!        optional benchmark names to run
+//!
+//! \return `EXIT_SUCCESS` on success, `EXIT_FAILURE` on error
+int main(int argc, char ** argv);
+
+//! number of allocations since the program started
+static atomic_size_t allocs;
+
+//! a value for benchmarks to update so their work isn't optimized away
+static size_t volatile sink;
+
+//! a long (1 KiB) text value
+static char text_long[1025];
+
+//! rows formatted into one slice by bench_add_rows()
+struct bench_rows
+{
+   kstr * slice; //!< slice to format the rows in
+   size_t start; //!< number of the first row
+   size_t count; //!< number of rows
+};
+
+//! all benchmarks
+static struct bench const benches[] =
+{
+   { "new_free_short", bench_new_free_short, 2000000 },
+   { "new_free_long", bench_new_free_long, 1000000 },
+   { "new_free_cached", bench_new_free_cached, 1000000 },
+   { "arena_new_free", bench_arena_new_free, 2000000 },
+   { "add_text_8", bench_add_text_8, 10000000 },
+   { "add_text_64", bench_add_text_64, 5000000 },
+   { "add_text_1024", bench_add_text_1024, 1000000 },
+   { "add_text_large", bench_add_text_large, 1000000 },
+   { "add_text_chunked", bench_add_text_chunked, 1000000 },
+   { "add_text_utf8", bench_add_text_utf8, 2000000 },
+   { "add_text_inline", bench_add_text_inline, 10000000 },
+   { "size_width", bench_size_width, 20000000 },
+   { "size_width_inline", bench_size_width_inline, 20000000 },
+   { "add_fmt", bench_add_fmt, 2000000 },
+   { "add_fmt_numbers", bench_add_fmt_numbers, 2000000 },
+   { "add_compiled", bench_add_compiled, 2000000 },
+   { "add_int", bench_add_int, 5000000 },
+   { "add_double", bench_add_double, 5000000 },
+   { "add_double_shortest", bench_add_double_shortest, 5000000 },
+   { "add_codes", bench_add_codes, 2000000 },
+   { "add_iov", bench_add_iov, 2000000 },
+   { "add_pieces", bench_add_pieces, 2000000 },
+   { "copy_short", bench_copy_short, 2000000 },
+   { "copy_long", bench_copy_long, 1000000 },
+   { "clone_long", bench_clone_long, 2000000 },
+   { "basename", bench_basename, 5000000 },
+   { "basename_trailing", bench_basename_trailing, 5000000 },
+   { "find_long", bench_find_long, 2000000 },
+   { "hash_long", bench_hash_long, 5000000 },
+   { "intern_labels", bench_intern_labels, 5000000 },
+   { "replace_all", bench_replace_all, 1000000 },
+   { "split_fields", bench_split_fields, 2000000 },
+   { "style_separate", bench_style_separate, 5000000 },
+   { "style_combined", bench_style_combined, 5000000 },
+   { "split_strtok", bench_split_strtok, 2000000 },
+   { "write_lines", bench_write_lines, 1000000 },
+   { "writev_lines", bench_writev_lines, 1000000 },
+   { "write_plain_lines", bench_write_plain_lines, 1000000 },
+   { "build_rows", bench_build_rows, 2000000 },
+   { "build_rows_threads", bench_build_rows_threads, 2000000 }
+};
+
+void *
+__wrap_calloc(
+      size_t count,
+      size_t size)
+{
+   allocs++;
+   return __real_calloc(count, size);
+}
+
+void
+__wrap_free(
+      void * ptr)
+{
+   __real_free(ptr);
+}
+
+void *
+__wrap_malloc(
+      size_t size)
+{
+   allocs++;
+   return __real_malloc(size);
+}
+
+void *
+__wrap_realloc(
+      void * ptr,
+      size_t size)
+{
+   allocs++;
+   return __real_realloc(ptr, size);
+}
+
+static
+void
+bench_add_codes(
+      size_t iterations)
+{
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 64 == 0)
+         kstr_set_text(str, NULL);
+
+      kstr_add_fg(str, kstr_color_red);
+      kstr_add_bg(str, kstr_color_blue);
+      kstr_add_bold(str, true);
+      kstr_add_reset(str);
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void
+bench_add_compiled(
+      size_t iterations)
+{
+   kstr_fmt * fmt = kstr_fmt_compile("%zu:%s:%.2f ");
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 64 == 0)
+         kstr_set_text(str, NULL);
+
+      kstr_add_compiled(str, fmt, i, "label", (double) i / 7);
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+   kstr_fmt_free(&fmt);
+}
+
+static
+void
+bench_add_double(
+      size_t iterations)
+{
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 64 == 0)
+         kstr_set_text(str, NULL);
+
+      kstr_add_double(str, (double) i / 7, 2);
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void
+bench_add_double_shortest(
+      size_t iterations)
+{
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 64 == 0)
+         kstr_set_text(str, NULL);
+
+      kstr_add_double(str, (double) i / 7, -1);
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void
+bench_add_fmt(
+      size_t iterations)
+{
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 64 == 0)
+         kstr_set_text(str, NULL);
+
+      kstr_add_fmt(str, "%zu:%s:%.2f ", i, "label", (double) i / 7);
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void
+bench_add_fmt_numbers(
+      size_t iterations)
+{
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 64 == 0)
+         kstr_set_text(str, NULL);
+
+      kstr_add_fmt(str, "%zu%.2f", i * 7919, (double) i / 7);
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void
+bench_add_int(
+      size_t iterations)
+{
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 64 == 0)
+         kstr_set_text(str, NULL);
+
+      kstr_add_uint(str, i * 7919);
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void
+bench_add_iov(
+      size_t iterations)
+{
+   static kstr_piece const pieces[] =
+   {
+      { .kind = kstr_piece_fg, .color = kstr_color_green },
+      { .kind = kstr_piece_bold, .bold = true },
+      { .kind = kstr_piece_text, .chars = "label" },
+      { .kind = kstr_piece_reset },
+      { .kind = kstr_piece_text, .chars = ": " },
+      { .kind = kstr_piece_fg, .color = kstr_color_cyan },
+      { .kind = kstr_piece_text, .chars = "some value" },
+      { .kind = kstr_piece_reset },
+      { .kind = kstr_piece_bytes, .chars = "\n", .count = 1 }
+   };
+
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 64 == 0)
+         kstr_set_text(str, NULL);
+
+      kstr_add_iov(str, pieces, sizeof(pieces) / sizeof(*pieces));
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void
+bench_add_large(
+      size_t iterations,
+      kstr_growth growth)
+{
+   kstr * str = NULL;
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % (256 * 1024) == 0)
+      {
+         kstr_free(&str);
+         str = kstr_set_growth(kstr_new(NULL), growth);
+      }
+
+      kstr_add_text(str, text_long);
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void
+bench_add_pieces(
+      size_t iterations)
+{
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 64 == 0)
+         kstr_set_text(str, NULL);
+
+      kstr_add_fg(str, kstr_color_green);
+      kstr_add_bold(str, true);
+      kstr_add_text(str, "label");
+      kstr_add_reset(str);
+      kstr_add_text(str, ": ");
+      kstr_add_fg(str, kstr_color_cyan);
+      kstr_add_text(str, "some value");
+      kstr_add_reset(str);
+      kstr_add_bytes(str, "\n", 1);
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void *
+bench_add_rows(
+      void * job)
+{
+   struct bench_rows const * const rows = job;
+   for (size_t i = rows->start; i < rows->start + rows->count; i++)
+      kstr_add_fmt(rows->slice, "%zu:%s:%.2f\n", i, "label", (double) i / 7);
+
+   return NULL;
+}
+
+static
+void
+bench_add_text(
+      size_t iterations,
+      char const * text)
+{
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 64 == 0)
+         kstr_set_text(str, NULL);
+
+      kstr_add_text(str, text);
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void
+bench_add_text_1024(
+      size_t iterations)
+{
+   bench_add_text(iterations, text_long);
+}
+
+static
+void
+bench_add_text_64(
+      size_t iterations)
+{
+   bench_add_text(iterations, text_long + sizeof(text_long) - 65);
+}
+
+static
+void
+bench_add_text_8(
+      size_t iterations)
+{
+   bench_add_text(iterations, text_long + sizeof(text_long) - 9);
+}
+
+static
+void
+bench_add_text_chunked(
+      size_t iterations)
+{
+   bench_add_large(iterations, kstr_growth_chunked);
+}
+
+static
+void
+bench_add_text_inline(
+      size_t iterations)
+{
+   char const * const text = text_long + sizeof(text_long) - 9;
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 64 == 0)
+         kstr_set_text(str, NULL);
+
+      kstr_add_text_inline(str, text);
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void
+bench_add_text_large(
+      size_t iterations)
+{
+   bench_add_large(iterations, kstr_growth_double);
+}
+
+static
+void
+bench_add_text_utf8(
+      size_t iterations)
+{
+   bench_add_text(iterations, "\xe6\x96\x87\xe6\x9c\xac text \xc3\xa9t\xc3\xa9");
+}
+
+static
+void
+bench_arena_new_free(
+      size_t iterations)
+{
+   kstr_arena * arena = kstr_arena_new(0);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 1024 == 0)
+         kstr_arena_reset(arena);
+
+      kstr * str = kstr_new_in(arena, "status");
+      sink += kstr_size(str);
+      kstr_free(&str);
+   }
+
+   kstr_arena_free(&arena);
+}
+
+static
+void
+bench_basename(
+      size_t iterations)
+{
+   kstr * str = kstr_new("/usr/local/share/kstr/file.txt");
+   for (size_t i = 0; i < iterations; i++)
+   {
+      kstr_add_text(str, "x");
+      sink += strlen(kstr_basename(str));
+      kstr_set_text(str, "/usr/local/share/kstr/file.txt");
+   }
+
+   kstr_free(&str);
+}
+
+static
+void
+bench_basename_trailing(
+      size_t iterations)
+{
+   kstr * str = kstr_new("/usr/local/share/kstr/dir/");
+   for (size_t i = 0; i < iterations; i++)
+   {
+      kstr_add_text(str, "x/");
+      sink += strlen(kstr_basename(str));
+      kstr_set_text(str, "/usr/local/share/kstr/dir/");
+   }
+
+   kstr_free(&str);
+}
+
+
+static
+void
+bench_build(
+      size_t iterations,
+      size_t threads)
+{
+   static size_t const batch = 256 * 1024;
+
+   kstr * str = kstr_new(NULL);
+   kstr_builder * builder =
+      (threads == 0) ? NULL : kstr_builder_new(str, threads);
+   for (size_t start = 0; start < iterations; start += batch)
+   {
+      size_t const count =
+         (iterations - start < batch) ? iterations - start : batch;
+      kstr_set_text(str, NULL);
+
+      if (builder == NULL)
+      {
+         struct bench_rows rows = { str, start, count };
+         bench_add_rows(&rows);
+         continue;
+      }
+
+      // the last slice takes the rows left over
+      struct bench_rows rows[threads];
+      pthread_t thread[threads];
+      for (size_t i = 0; i < threads; i++)
+      {
+         rows[i] = (struct bench_rows) {
+            kstr_builder_slice(builder, i),
+            start + count / threads * i,
+            (i == threads - 1) ? count - count / threads * i : count / threads
+         };
+         if (pthread_create(&thread[i], NULL, bench_add_rows, &rows[i]) != 0)
+         {
+            fputs("can't create thread\n", stderr);
+            exit(EXIT_FAILURE);
+         }
+      }
+
+      for (size_t i = 0; i < threads; i++)
+         pthread_join(thread[i], NULL);
+      kstr_builder_finish(builder, threads);
+   }
+
+   sink += kstr_size(str);
+   kstr_builder_free(&builder);
+   kstr_free(&str);
+}
+
+static
+void
+bench_build_rows(
+      size_t iterations)
+{
+   bench_build(iterations, 0);
+}
+
+static
+void
+bench_build_rows_threads(
+      size_t iterations)
+{
+   bench_build(iterations, 4);
+}
+
+static
+void
+bench_clone_long(
+      size_t iterations)
+{
+   kstr * str = kstr_new(text_long);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      kstr * str_clone = kstr_clone(str);
+      sink += kstr_size(str_clone);
+      kstr_free(&str_clone);
+   }
+
+   kstr_free(&str);
+}
+
+static
+void
+bench_copy_long(
+      size_t iterations)
+{
+   kstr * str = kstr_new(text_long);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      kstr * str_copy = kstr_copy(str);
+      sink += kstr_size(str_copy);
+      kstr_free(&str_copy);
+   }
+
+   kstr_free(&str);
+}
+
+static
+void
+bench_copy_short(
+      size_t iterations)
+{
+   kstr * str = kstr_new("status");
+   for (size_t i = 0; i < iterations; i++)
+   {
+      kstr * str_copy = kstr_copy(str);
+      sink += kstr_size(str_copy);
+      kstr_free(&str_copy);
+   }
+
+   kstr_free(&str);
+}
+
+static
+void
+bench_find_long(
+      size_t iterations)
+{
+   kstr * str = kstr_new(text_long);
+   kstr_view const needle = kstr_view_text("0123456789abcdeX");
+   for (size_t i = 0; i < iterations; i++)
+      sink += kstr_find(str, needle, i % 16);
+
+   kstr_free(&str);
+}
+
+static
+void
+bench_hash_long(
+      size_t iterations)
+{
+   kstr * str = kstr_new(text_long);
+   for (size_t i = 0; i < iterations; i++)
+      sink += (size_t) kstr_view_hash(kstr_get_view(str, i % 16, kstr_npos));
+
+   kstr_free(&str);
+}
+
+static
+void
+bench_intern_labels(
+      size_t iterations)
+{
+   static char const * const labels[] =
+   {
+      "host", "region", "service", "status", "method", "path", "code",
+      "instance"
+   };
+
+   kstr_intern * table = kstr_intern_new(NULL);
+   char text[32];
+   for (size_t i = 0; i < iterations; i++)
+   {
+      int const count = snprintf(
+            text, sizeof(text), "%s-%zu", labels[i % 8], i % 4096);
+      kstr * str = kstr_intern_get(table, (kstr_view) { text, (size_t) count });
+      sink += kstr_size(str);
+   }
+
+   kstr_intern_free(&table);
+}
+
+static
+void
+bench_new_free_cached(
+      size_t iterations)
+{
+   size_t const old_limit = kstr_cache_limit(1 << 20);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      kstr * str = kstr_new(text_long);
+      sink += kstr_size(str);
+      kstr_free(&str);
+   }
+
+   kstr_cache_limit(old_limit);
+   kstr_cache_purge();
+}
+
+static
+void
+bench_new_free_long(
+      size_t iterations)
+{
+   for (size_t i = 0; i < iterations; i++)
+   {
+      kstr * str = kstr_new(text_long);
+      sink += kstr_size(str);
+      kstr_free(&str);
+   }
+}
+
+static
+void
+bench_new_free_short(
+      size_t iterations)
+{
+   for (size_t i = 0; i < iterations; i++)
+   {
+      kstr * str = kstr_new("status");
+      sink += kstr_size(str);
+      kstr_free(&str);
+   }
+}
+
+static
+double
+bench_now(void)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (double) now.tv_sec * 1e9 + (double) now.tv_nsec;
+}
+
+static
+void
+bench_replace_all(
+      size_t iterations)
+{
+   kstr * str = kstr_new(NULL);
+   kstr_view const needle = kstr_view_text("f");
+   kstr_view const replacement = kstr_view_text("ff");
+   for (size_t i = 0; i < iterations; i++)
+   {
+      kstr_set_text(str, text_long);
+      kstr_replace_all(str, needle, replacement);
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void
+bench_size_width(
+      size_t iterations)
+{
+   kstr * str = kstr_new("status: ok");
+   for (size_t i = 0; i < iterations; i++)
+      sink += kstr_size(str) + kstr_width(str);
+
+   kstr_free(&str);
+}
+
+static
+void
+bench_size_width_inline(
+      size_t iterations)
+{
+   kstr * str = kstr_new("status: ok");
+   for (size_t i = 0; i < iterations; i++)
+      sink += kstr_size_inline(str) + kstr_width_inline(str);
+
+   kstr_free(&str);
+}
+
+static
+void
+bench_split_fields(
+      size_t iterations)
+{
+   kstr * line = kstr_new(
+         "2024-01-01T00:00:00,host-01,GET,/index.html,200,5120,0.003,"
+         "Mozilla/5.0,-,cache-hit,eu-west-1,tls1.3");
+   kstr_view const delimiters = kstr_view_text(",");
+   kstr_view fields[16];
+   for (size_t i = 0; i < iterations; i++)
+   {
+      size_t const count = kstr_split(line, delimiters, fields, 16);
+      sink += count + fields[count - 1].len;
+   }
+
+   kstr_free(&line);
+}
+
+static
+void
+bench_split_strtok(
+      size_t iterations)
+{
+   kstr * line = kstr_new(
+         "2024-01-01T00:00:00,host-01,GET,/index.html,200,5120,0.003,"
+         "Mozilla/5.0,-,cache-hit,eu-west-1,tls1.3");
+   for (size_t i = 0; i < iterations; i++)
+   {
+      char * const copy = kstr_get_copy(line);
+      size_t count = 0;
+      size_t last = 0;
+      for (char * field = strtok(copy, ","); field != NULL;
+            field = strtok(NULL, ","))
+      {
+         count++;
+         last = strlen(field);
+      }
+
+      sink += count + last;
+      free(copy);
+   }
+
+   kstr_free(&line);
+}
+
+static
+void
+bench_style_combined(
+      size_t iterations)
+{
+   kstr_style styles[2] =
+   {
+      {
+         .set_bold = true,
+         .bold = true,
+         .fg = kstr_style_basic(kstr_color_red),
+         .bg = kstr_style_basic(kstr_color_blue)
+      },
+      {
+         .set_bold = true,
+         .bold = false,
+         .fg = kstr_style_basic(kstr_color_green),
+         .bg = kstr_style_basic(kstr_color_default)
+      }
+   };
+
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 64 == 0)
+         kstr_set_text(str, NULL);
+
+      kstr_add_style(str, &styles[i % 2]);
+      kstr_add_text(str, "word ");
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void
+bench_style_separate(
+      size_t iterations)
+{
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < iterations; i++)
+   {
+      if (i % 64 == 0)
+         kstr_set_text(str, NULL);
+
+      bool const even = (i % 2 == 0);
+      kstr_add_bold(str, even);
+      kstr_add_fg(str, even ? kstr_color_red : kstr_color_green);
+      kstr_add_bg(str, even ? kstr_color_blue : kstr_color_default);
+      kstr_add_text(str, "word ");
+   }
+
+   sink += kstr_size(str);
+   kstr_free(&str);
+}
+
+static
+void
+bench_write_lines(
+      size_t iterations)
+{
+   int const fd = open("/dev/null", O_WRONLY);
+   kstr * line = kstr_new(NULL);
+   kstr_add_fg(line, kstr_color_green);
+   kstr_add_text(line, "status: ok");
+   kstr_add_reset(line);
+   kstr_add_text(line, "\n");
+
+   for (size_t i = 0; i < iterations; i++)
+   {
+      char const * const value = kstr_get(line);
+      sink += (size_t) write(fd, value, kstr_size(line) - 1);
+   }
+
+   kstr_free(&line);
+   close(fd);
+}
+
+static
+void
+bench_write_plain_lines(
+      size_t iterations)
+{
+   int const fd = open("/dev/null", O_WRONLY);
+   kstr * line = kstr_new(NULL);
+   kstr_add_fg(line, kstr_color_green);
+   kstr_add_text(line, "status: ok");
+   kstr_add_reset(line);
+   kstr_add_text(line, "\n");
+
+   for (size_t i = 0; i < iterations; i++)
+      sink += kstr_write_plain(line, fd);
+
+   kstr_free(&line);
+   close(fd);
+}
+
+static
+void
+bench_writev_lines(
+      size_t iterations)
+{
+   int const fd = open("/dev/null", O_WRONLY);
+   kstr * lines[64];
+   for (size_t i = 0; i < 64; i++)
+   {
+      lines[i] = kstr_new(NULL);
+      kstr_add_fg(lines[i], kstr_color_green);
+      kstr_add_text(lines[i], "status: ok");
+      kstr_add_reset(lines[i]);
+      kstr_add_text(lines[i], "\n");
+   }
+
+   for (size_t i = 0; i < iterations; i += 64)
+   {
+      size_t const n = (iterations - i < 64) ? iterations - i : 64;
+      sink += kstr_writev(lines, n, fd);
+   }
+
+   for (size_t i = 0; i < 64; i++)
+      kstr_free(&lines[i]);
+   close(fd);
+}
+
+int
+main(
+      int argc,
+      char ** argv)
+{
+   // the first argument scales the number of iterations
+   double scale = 1;
+   if (argc > 1 && (scale = strtod(argv[1], NULL)) <= 0)
+   {
+      fprintf(stderr, "invalid iteration multiplier [%s]\n", argv[1]);
+      return EXIT_FAILURE;
+   }
+
+   // fill the long text value with repeating hex digits
+   for (size_t i = 0; i < sizeof(text_long) - 1; i++)
+      text_long[i] = "0123456789abcdef"[i % 16];
+
+   puts("benchmark,iterations,ns_per_op,allocs_per_op");
+   for (size_t i = 0; i < sizeof(benches) / sizeof(*benches); i++)
+   {
+      // the remaining arguments select benchmarks by name
+      bool selected = argc <= 2;
+      for (int arg = 2; arg < argc && !selected; arg++)
+         selected = strcmp(argv[arg], benches[i].name) == 0;
+      if (!selected)
+         continue;
+
+      size_t iterations = (size_t) ((double) benches[i].iterations * scale);
+      if (iterations == 0)
+         iterations = 1;
+
+      // warm up caches and the allocator before measuring
+      benches[i].fn(iterations / 10 + 1);
+
+      size_t const start_allocs = allocs;
+      double const start = bench_now();
+      benches[i].fn(iterations);
+      double const elapsed = bench_now() - start;
+
+      printf(
+            "%s,%zu,%.2f,%.3f\n",
+            benches[i].name,
+            iterations,
+            elapsed / (double) iterations,
+            (double) (allocs - start_allocs) / (double) iterations);
+   }
+
+   return EXIT_SUCCESS;
+}
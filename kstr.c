@@ -16,24 +16,225 @@
 //!
 //! kstr string library implementation
 
-#include <libgen.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <wchar.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "kstr.h"
+#include "kstr_inline.h"
+
+struct kstr_builder_job;
+struct kstr_chunk;
+struct kstr_code;
+struct kstr_control;
+struct kstr_diy;
+struct kstr_fmt_item;
+struct kstr_intern_slot;
+struct kstr_scanner;
+struct kstr_segment;
+struct kstr_writer;
+struct kstr_range;
 
-//! abort and destroy a string
+//! handle an allocation failure
 //!
-//! calls `abort()` and destroys the string with kstr_free() in case `SIGABRT`
-//! is caught and handled.
+//! identical to kstr_fail() with `ENOMEM`.
 //!
-//! \param ptr string pointer
+//! \param ptr string pointer (or `NULL`)
 //!
 //! \return `NULL`
 static kstr * kstr_abort(kstr ** ptr);
 
+//! handle a failure according to the error mode
+//!
+//! with ::kstr_error_abort, calls `abort()` and destroys the string with
+//! kstr_free() in case `SIGABRT` is caught and handled. with
+//! ::kstr_error_return, sets `errno` to \a error and leaves the string as it
+//! is, so the caller must fail without having changed it.
+//!
+//! \param ptr string pointer (or `NULL`)
+//! \param error error number
+//!
+//! \return `NULL`
+static kstr * kstr_fail(kstr ** ptr, int error);
+
+//! allocate memory from a string arena
+//!
+//! memory is handed out from the arena's current block, and a new block is
+//! allocated from the heap when the current one does not have enough space.
+//!
+//! \param arena arena
+//! \param size number of bytes to allocate
+//!
+//! \return a pointer to the allocated memory, or `NULL` on failure
+static void * kstr_arena_alloc(kstr_arena * arena, size_t size);
+
+//! resize memory allocated from a string arena
+//!
+//! if \a ptr is the most recent allocation from the arena and there is enough
+//! space left in its block, it is extended in place; otherwise, new memory is
+//! allocated and the first \a old_size bytes are copied to it.
+//!
+//! \param arena arena
+//! \param ptr memory to resize
+//! \param old_size current size of \a ptr in bytes
+//! \param new_size new size in bytes
+//!
+//! \return a pointer to the resized memory, or `NULL` on failure
+static void * kstr_arena_realloc(
+      kstr_arena * arena, void * ptr, size_t old_size, size_t new_size);
+
+//! append a decimal integer to a string
+//!
+//! \param this string
+//! \param negative prefix the digits with a minus sign if true
+//! \param value magnitude of the integer
+//!
+//! \return \a this
+static kstr * kstr_add_decimal(kstr * this, bool negative, uintmax_t value);
+
+//! append one conversion of a compiled format to a string
+//!
+//! \param this string
+//! \param item conversion
+//! \param spec conversion specification (nul-terminated)
+//! \param args format string arguments
+//!
+//! \return \a this
+static kstr * kstr_add_conversion(
+      kstr * this,
+      struct kstr_fmt_item const * item,
+      char const * spec,
+      va_list * args);
+
+//! append a fixed-point number to a string
+//!
+//! appends \a value divided by 10 to the power of \a precision, with
+//! \a precision digits after the decimal point.
+//!
+//! \param this string
+//! \param negative prefix the digits with a minus sign if true
+//! \param value magnitude of the number, scaled to an integer
+//! \param precision digits after the decimal point (at most 9)
+//!
+//! \return \a this
+static kstr * kstr_add_fixed(
+      kstr * this,
+      bool negative,
+      uint64_t value,
+      int precision);
+
+//! multiply two extended-precision floating-point numbers
+//!
+//! only the upper 64 bits of the product's significand are kept, rounded.
+//!
+//! \param x first factor
+//! \param y second factor
+//!
+//! \return the product
+static struct kstr_diy kstr_diy_times(struct kstr_diy x, struct kstr_diy y);
+
+//! find the shortest decimal digits that read back as a number
+//!
+//! uses the grisu3 algorithm, which produces the shortest digits closest to
+//! \a value but gives up on the rare values (about 0.5%) where it can't prove
+//! that they are, leaving them to the caller.
+//!
+//! \param value finite positive number
+//! \param digits buffer for at least 17 digits (not nul-terminated)
+//! \param count set to the number of digits
+//! \param exponent set to the power of 10 the digits are multiplied by
+//!
+//! \return true on success, false if the digits couldn't be found
+static bool kstr_shortest(
+      double value,
+      char * digits,
+      int * count,
+      int * exponent);
+
+//! round the last digit found by kstr_shortest() towards its value
+//!
+//! \param digits digits found so far
+//! \param count number of digits in \a digits
+//! \param distance distance from the upper boundary to the value
+//! \param unsafe width of the interval around the value, in which the digits
+//!        may or may not read back as the value
+//! \param rest distance from the digits to the upper boundary
+//! \param ten_kappa value of one unit of the last digit
+//! \param unit error of the scaled boundaries
+//!
+//! \return true if the digits are the closest ones and read back as the
+//!         value, false if that can't be proven
+static bool kstr_shortest_round(
+      char * digits,
+      int count,
+      uint64_t distance,
+      uint64_t unsafe,
+      uint64_t rest,
+      uint64_t ten_kappa,
+      uint64_t unit);
+
+//! get the segment of a concurrent string that follows a full one
+//!
+//! links a new segment with space for at least \a count bytes after
+//! \a segment if another thread hasn't already, and makes the segment after
+//! \a segment the concurrent string's last segment.
+//!
+//! \param this concurrent string
+//! \param segment full segment
+//! \param count number of bytes to reserve
+//!
+//! \return the segment after \a segment
+static struct kstr_segment * kstr_concurrent_next(
+      kstr_concurrent * this,
+      struct kstr_segment * segment,
+      size_t count);
+
+//! wait for the appends before an offset in a segment to finish
+//!
+//! \param segment segment
+//! \param offset offset of the next append in \a segment
+static void kstr_concurrent_wait(
+      struct kstr_segment * segment,
+      size_t offset);
+
+//! copy a range of a builder's output into place
+//!
+//! runs in a thread of its own, except for the range kstr_builder_finish()
+//! copies itself.
+//!
+//! \param job pointer to a ::kstr_builder_job
+//!
+//! \return `NULL`
+static void * kstr_builder_copy(void * job);
+
+//! update a string's width after appending characters
+//!
+//! \param this string
+//! \param chars appended characters
+//! \param count number of bytes in \a chars
+//! \param visible true for visible text, false for a control code
+static void kstr_added(
+      kstr * this,
+      char const * chars,
+      size_t count,
+      bool visible);
+
 //! return the number of available bytes in a string's character buffer
 //!
 //! returns the size of the buffer minus the number of used bytes.
@@ -43,8 +244,22 @@ static kstr * kstr_abort(kstr ** ptr);
 //! \return the available buffer size in bytes
 static size_t kstr_available(kstr * this);
 
+//! count the leading printable ascii characters in a byte array
+//!
+//! this is the fast path of kstr_measure(), which checks 16 bytes at a time
+//! with sse2 if available, or 8 bytes at a time otherwise.
+//!
+//! \param bytes bytes to scan
+//! \param count number of bytes in \a bytes
+//!
+//! \return the number of leading bytes in the range 0x20 to 0x7e
+static size_t kstr_ascii_run(unsigned char const * bytes, size_t count);
+
 //! append characters to a string's value
 //!
+//! \a chars may point into the string's own buffer. if \a visible is true,
+//! the string's width is increased by the display width of the characters.
+//!
 //! \param this string
 //! \param chars characters to append
 //! \param count number of characters from \a chars to append
@@ -54,15 +269,381 @@ static size_t kstr_available(kstr * this);
 static kstr * kstr_add_chars(
       kstr * this, char const * chars, size_t count, bool visible);
 
+//! start a new buffer for a chunked string
+//!
+//! links the string's buffer to the end of its chunks, without copying or
+//! moving its bytes, and replaces it with an empty buffer of at least
+//! ::kstr_chunk_size bytes that fits \a count more bytes.
+//!
+//! \param this string using ::kstr_growth_chunked
+//! \param count number of bytes to make available
+//!
+//! \return \a this
+static kstr * kstr_add_chunk(kstr * this, size_t count);
+
+//! mark a string's value as changed
+//!
+//! invalidates anything cached about the value, such as the basename, by
+//! advancing the string's generation. cached storage is kept for reuse.
+//!
+//! \param this string
+static void kstr_changed(kstr * this);
+
+//! allocate a character buffer for a string
+//!
+//! like kstr_alloc(), but reuses a buffer from the calling thread's cache if
+//! there is one of the next size class up, in which case \a size is increased
+//! to the size of that buffer.
+//!
+//! \param arena arena, or `NULL` for the heap
+//! \param size number of bytes to allocate, set to the number allocated
+//!
+//! \return a pointer to the allocated memory, or `NULL` on failure
+static char * kstr_alloc_data(kstr_arena * arena, size_t * size);
+
+//! allocate a string object
+//!
+//! like kstr_alloc(), but reuses an object from the calling thread's cache if
+//! there is one. the object's members are not initialized.
+//!
+//! \param arena arena, or `NULL` for the heap
+//!
+//! \return a pointer to the allocated object, or `NULL` on failure
+static kstr * kstr_alloc_object(kstr_arena * arena);
+
+//! allocate memory for a string
+//!
+//! the memory comes from \a arena if it is not a null pointer, or from the
+//! heap otherwise.
+//!
+//! \param arena arena, or `NULL` for the heap
+//! \param size number of bytes to allocate
+//!
+//! \return a pointer to the allocated memory, or `NULL` on failure
+static void * kstr_alloc(kstr_arena * arena, size_t size);
+
+//! find the smallest buffer size class of the string cache that fits a size
+//!
+//! \param size number of bytes
+//!
+//! \return the size class, or ::kstr_cache_classes if \a size is too large
+static size_t kstr_cache_fit(size_t size);
+
+//! take memory of a size class from the calling thread's string cache
+//!
+//! \param cls size class (::kstr_cache_object for string objects)
+//!
+//! \return a pointer to the memory, or `NULL` if the cache has none
+static void * kstr_cache_get(size_t cls);
+
+//! give memory of a size class to the calling thread's string cache
+//!
+//! the memory is freed instead if it would take the cache over its limit,
+//! or if \a cls is past the last size class.
+//!
+//! \param ptr memory allocated from the heap
+//! \param cls size class (::kstr_cache_object for string objects)
+static void kstr_cache_put(void * ptr, size_t cls);
+
+//! return the size of the memory in a size class of the string cache
+//!
+//! \param cls size class (::kstr_cache_object for string objects)
+//!
+//! \return the size in bytes
+static size_t kstr_cache_size(size_t cls);
+
+//! free the string cache of a thread that is exiting
+//!
+//! \param cache the thread's cache
+static void kstr_cache_exit(void * cache);
+
+//! create the thread-specific key that frees string caches on thread exit
+static void kstr_cache_key_create(void);
+
+//! double the number of slots of an intern table
+//!
+//! \param table intern table
+//!
+//! \return \a table, or `NULL` on failure
+static kstr_intern * kstr_intern_grow(kstr_intern * table);
+
+//! find the first of a set of bytes in a view
+//!
+//! \param view view to search
+//! \param delimiters bytes to look for
+//! \param pos offset to start searching at (at most `view.len`)
+//!
+//! \return the offset of the first byte in \a delimiters, or ::kstr_npos if
+//!         there is none
+static size_t kstr_find_any(kstr_view view, kstr_view delimiters, size_t pos);
+
+//! join the chunks of a string's value into a single buffer
+//!
+//! does nothing if the value isn't split into chunks.
+//!
+//! \param this string
+//!
+//! \return \a this
+static kstr * kstr_flatten(kstr * this);
+
+//! forget the attributes known to be active at the end of a string's value
+//!
+//! used when bytes that may set other attributes are added or the value is
+//! edited, so that the attributes set before the value can't be known either.
+//!
+//! \param this string
+static void kstr_forget_style(kstr * this);
+
+//! save the end of a string's value
+//!
+//! \param this string
+//!
+//! \return the mark to pass to kstr_undo()
+static struct kstr_mark kstr_mark_end(kstr * this);
+
+//! undo the appends made since the end of a string's value was saved
+//!
+//! removes the bytes appended after \a mark, along with their width and
+//! control codes, so that a method that fails after appending part of its
+//! output leaves the string as it was. the bytes before \a mark stay where
+//! they are, even if a new buffer was started after them.
+//!
+//! \param this string
+//! \param mark end of the value returned by kstr_mark_end()
+static void kstr_undo(kstr * this, struct kstr_mark const * mark);
+
+//! copy a view out of a string's buffer
+//!
+//! if \a view refers to bytes in the string's buffer, they are copied to
+//! allocated memory and \a view is changed to refer to the copy, so that they
+//! can be inserted into the string while its buffer changes.
+//!
+//! \param this string
+//! \param view view to check
+//! \param copy set to the allocated copy, or `NULL` if none was needed
+//!
+//! \return \a this
+static kstr * kstr_detach(kstr * this, kstr_view * view, char ** copy);
+
+//! check whether a code point is in a table of ranges
+//!
+//! \param point unicode code point
+//! \param ranges sorted, non-overlapping ranges
+//! \param count number of ranges
+//!
+//! \return true if \a point is in one of the ranges, false otherwise
+static bool kstr_in_ranges(
+      uint32_t point, struct kstr_range const * ranges, size_t count);
+
+//! advance an escape sequence scanner
+//!
+//! feeds one byte of an escape sequence to the scanner, which returns to
+//! ::kstr_escape_none once the sequence ends.
+//!
+//! \param escape scanner state
+//! \param byte next byte of the escape sequence
+static void kstr_escape_step(enum kstr_escape * escape, unsigned char byte);
+
+//! parse a format string
+//!
+//! counts the items and characters of the compiled form of \a fmt, and, if
+//! \a compiled is not a null pointer, also fills in its items and characters.
+//!
+//! \param fmt format string
+//! \param compiled compiled format with enough space (or `NULL`)
+//! \param num_items set to the number of items
+//! \param num_chars set to the number of characters
+//!
+//! \return true on success, false if \a fmt can't be compiled
+static bool kstr_fmt_parse(
+      char const * fmt,
+      kstr_fmt * compiled,
+      size_t * num_items,
+      size_t * num_chars);
+
+//! count the decimal digits of an integer
+//!
+//! \param value integer
+//!
+//! \return the number of digits (at least 1)
+static size_t kstr_decimal_digits(uintmax_t value);
+
+//! write the decimal digits of an integer
+//!
+//! writes exactly \a digits digits, padded with leading zeros if needed.
+//!
+//! \param chars destination
+//! \param digits number of digits to write (at least 1)
+//! \param value integer
+static void kstr_put_decimal(char * chars, size_t digits, uintmax_t value);
+
+//! get the characters of a string piece
+//!
+//! \param piece string piece
+//! \param code set to the piece's characters and their length
+//!
+//! \return true on success, false if the piece's kind or color is invalid
+static bool kstr_piece_code(
+      struct kstr_piece const * piece,
+      struct kstr_code * code);
+
 //! increase the size of a string's character buffer
 //!
-//! reallocates the buffer with more space. any pointers to the buffer are
-//! invalidated.
+//! if fewer than \a count bytes are available, the buffer is reallocated once
+//! with a size chosen by the string's growth policy. if the buffer is shared
+//! with clones of the string, the string is given a buffer of its own, so
+//! this must be called before any modification of the buffer. any pointers to
+//! the buffer are invalidated.
+//!
+//! \param this string
+//! \param count minimum number of available bytes needed
+//!
+//! \return \a this
+static kstr * kstr_grow(kstr * this, size_t count);
+
+//! increase the size of a string's character buffer in place
+//!
+//! identical to kstr_grow(), except that a chunked string's buffer is resized
+//! instead of starting a new chunk, so that the value's last bytes stay in
+//! the same buffer.
+//!
+//! \param this string
+//! \param count minimum number of available bytes needed
+//!
+//! \return \a this
+static kstr * kstr_grow_flat(kstr * this, size_t count);
+
+//! check whether a string uses its embedded character buffer
+//!
+//! \param this string
+//!
+//! \return true if the value is stored inline, false if it is on the heap
+static bool kstr_is_inline(kstr * this);
+
+//! release a string's character buffer
+//!
+//! frees the buffer if it was allocated from the heap for this string alone,
+//! or drops the string's reference to it if it is shared with clones. the
+//! string's buffer fields are left unchanged.
+//!
+//! \param this string
+static void kstr_release(kstr * this);
+
+//! calculate the display width of characters appended to a string
+//!
+//! decodes \a chars as utf-8 and adds up the display width of each code point
+//! (see kstr_point_width()), with each invalid byte taking one column. a
+//! sequence that is split across appends is completed by the next append, so
+//! the string keeps the decoder state.
+//!
+//! \param this string
+//! \param chars characters to measure
+//! \param count number of characters in \a chars
+//!
+//! \return the display width in columns
+static size_t kstr_measure(kstr * this, char const * chars, size_t count);
+
+//! check whether growing a string moved its value to another buffer
+//!
+//! a chunked string that starts a new buffer keeps the old one as a chunk,
+//! so characters in it stay where they are.
+//!
+//! \param this string
+//! \param old_data the string's buffer before growing
+//!
+//! \return true if the value's bytes in \a old_data have moved
+static bool kstr_moved(kstr * this, char const * old_data);
+
+//! calculate the display width of text from a scanner state
+//!
+//! measures \a chars the way kstr_measure() measures appended text, starting
+//! from the state in \a scanner and leaving it in the state after the text.
+//! the width of an incomplete utf-8 sequence at the end isn't counted yet.
+//!
+//! \param chars characters
+//! \param count number of bytes in \a chars
+//! \param escapes recognize escape sequences
+//! \param scanner scanner state
+//!
+//! \return the width in columns
+static size_t kstr_scan_width(
+      char const * chars,
+      size_t count,
+      bool escapes,
+      struct kstr_scanner * scanner);
+
+//! calculate the display width of part of a flat value
+//!
+//! measures the bytes like kstr_scan_width(), except that the recorded
+//! control codes among them take no columns and end an incomplete sequence,
+//! as when they were appended. edits measure the value from the edit point
+//! before and after changing it with this, which is as precise as measuring
+//! the whole value again.
+//!
+//! \param this string
+//! \param pos offset of the first byte
+//! \param count number of bytes
+//! \param scanner scanner state
+//!
+//! \return the width in columns
+static size_t kstr_span_width(
+      kstr * this, size_t pos, size_t count, struct kstr_scanner * scanner);
+
+//! advance a utf-8 decoder
+//!
+//! feeds one byte of text that isn't part of an escape sequence to the
+//! decoder, adding the width of each code point it completes (see
+//! kstr_point_width()) to \a width. an invalid byte takes one column. a byte
+//! that cuts an incomplete sequence short is not consumed: the sequence takes
+//! one column, and the decoder is ready to start over with the byte.
+//!
+//! \param point code point decoded so far
+//! \param pending number of continuation bytes still expected
+//! \param byte next byte of text
+//! \param width display width to add to
+//!
+//! \return true if \a byte was consumed, false if it must be fed again
+static bool kstr_utf8_step(
+      uint32_t * point, unsigned char * pending, unsigned char byte,
+      size_t * width);
+
+//! get the display width of a unicode code point
+//!
+//! control characters, combining marks, and other zero-width code points take
+//! no columns, east asian wide and fullwidth code points take two columns, and
+//! everything else takes one column.
+//!
+//! \param point unicode code point
+//!
+//! \return the display width in columns
+static size_t kstr_point_width(uint32_t point);
+
+//! resize memory allocated for a string with kstr_alloc()
+//!
+//! \param arena arena, or `NULL` for the heap
+//! \param ptr memory to resize
+//! \param old_size current size of \a ptr in bytes
+//! \param new_size new size in bytes
+//!
+//! \return a pointer to the resized memory, or `NULL` on failure
+static void * kstr_realloc(
+      kstr_arena * arena, void * ptr, size_t old_size, size_t new_size);
+
+//! free the chunks of a string's value
+//!
+//! \param this string
+static void kstr_release_chunks(kstr * this);
+
+//! change the size of a string's character buffer
+//!
+//! moves the value between the embedded buffer and allocated memory as
+//! needed. any pointers to the buffer are invalidated.
 //!
 //! \param this string
+//! \param size new buffer size, which must be at least the used size
 //!
 //! \return \a this
-static kstr * kstr_grow(kstr * this);
+static kstr * kstr_resize(kstr * this, size_t size);
 
 //! reset a string's value to empty
 //!
@@ -73,392 +654,5564 @@ static kstr * kstr_grow(kstr * this);
 //! \return \a this
 static kstr * kstr_reset(kstr * this);
 
-//! string object structure
-struct kstr
+//! remove bytes from the end of a string's value
+//!
+//! keeps the first \a size bytes of the value, which must be flat and at
+//! least that long, and updates its width. the scanner is left in its state
+//! after the kept bytes, so that appends continue from it.
+//!
+//! \param this string
+//! \param size number of bytes to keep
+//!
+//! \return \a this
+static kstr * kstr_cut(kstr * this, size_t size);
+
+//! record bytes of a string's value as a control code
+//!
+//! merges the bytes with the last recorded control code if they follow it.
+//! does nothing if the string's control codes aren't tracked.
+//!
+//! \param this string
+//! \param pos offset of the bytes in the value
+//! \param count number of bytes
+static void kstr_control_add(kstr * this, size_t pos, size_t count);
+
+//! copy the recorded control codes of a string to a copy of it
+//!
+//! \param this_copy copy, whose value is the same as \a this
+//! \param this original string
+static void kstr_control_copy(kstr * this_copy, kstr const * this);
+
+//! add the bytes of part of a value that aren't control codes to a writer
+//!
+//! \param writer writer
+//! \param this string, whose control codes are tracked
+//! \param chars bytes of the part of the value
+//! \param count number of bytes in \a chars
+//! \param base offset of \a chars in the value
+//! \param next index of the first control code that may overlap \a chars,
+//!        advanced past those that end within it
+//!
+//! \return true on success, false if writing failed
+static bool kstr_writer_add_plain(
+      struct kstr_writer * writer,
+      kstr const * this,
+      char const * chars,
+      size_t count,
+      size_t base,
+      size_t * next);
+
+//! check whether two style colors are the same
+//!
+//! \param a first color
+//! \param b second color
+//!
+//! \return true if \a a and \a b are of the same kind and value
+static bool kstr_color_equal(
+      kstr_style_color const * a, kstr_style_color const * b);
+
+//! write the parameters of a color to a control code being built
+//!
+//! writes e.g. `31`, `38;5;208` or `48;2;255;128;0`, without a separator.
+//!
+//! \param out where to write the parameters
+//! \param color color, which must not be of kind ::kstr_color_kind_none
+//! \param bg write background parameters instead of foreground ones
+//!
+//! \return the end of the parameters written, or `NULL` if \a color is
+//!         invalid
+static char * kstr_sgr_color(
+      char * out, kstr_style_color const * color, bool bg);
+
+//! write a number of at most three digits to a control code being built
+//!
+//! \param out where to write the digits
+//! \param value number
+//!
+//! \return the end of the digits written
+static char * kstr_sgr_number(char * out, unsigned int value);
+
+//! record the attribute set by a control code piece as active
+//!
+//! \param this string the piece was appended to
+//! \param piece piece, which may be of any kind
+static void kstr_track(kstr * this, struct kstr_piece const * piece);
+
+//! add bytes to the output of a writer
+//!
+//! writes out the bytes added so far first if the writer is full.
+//!
+//! \param writer writer
+//! \param chars bytes to write
+//! \param count number of bytes in \a chars
+//!
+//! \return true on success, false if writing failed
+static bool kstr_writer_add(
+      struct kstr_writer * writer, char const * chars, size_t count);
+
+//! write out the bytes added to a writer
+//!
+//! writes all of the bytes with as few calls to `writev()` as possible,
+//! continuing after partial writes and interrupted calls.
+//!
+//! \param writer writer
+//!
+//! \return true on success, false if writing failed (with `errno` set)
+static bool kstr_writer_flush(struct kstr_writer * writer);
+
+//! ansi control code and its length
+struct kstr_code
 {
-   size_t data_size; //!< allocated buffer size
-   size_t used; //!< number of buffer bytes used (including nul)
-   size_t width; //!< string width (visible characters)
+   char const * chars; //!< control code characters
+   size_t count; //!< number of bytes in \a chars (excluding nul)
+};
 
-   char * basename; //!< storage for the cached basename
-   char * data; //!< character buffer
+//! normalized power of ten, with its significand's top bit set
+struct kstr_power
+{
+   uint64_t f; //!< significand
+   int16_t e; //!< binary exponent
+   int16_t k; //!< decimal exponent
 };
 
-static
-kstr *
-kstr_abort(
-      kstr ** ptr)
+//! powers of 10 for fixed-point conversion, all exact as doubles
+static uint64_t const kstr_powers[] =
 {
-   abort();
-   return kstr_free(ptr);
+   UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000),
+   UINT64_C(10000), UINT64_C(100000), UINT64_C(1000000),
+   UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000)
+};
+
+//! normalized powers of ten for kstr_shortest(), from 10^-348 to 10^340 in
+//! steps of 10^8
+static struct kstr_power const kstr_cached_powers[] =
+{
+   { UINT64_C(0xfa8fd5a0081c0288), -1220, -348 },
+   { UINT64_C(0xbaaee17fa23ebf76), -1193, -340 },
+   { UINT64_C(0x8b16fb203055ac76), -1166, -332 },
+   { UINT64_C(0xcf42894a5dce35ea), -1140, -324 },
+   { UINT64_C(0x9a6bb0aa55653b2d), -1113, -316 },
+   { UINT64_C(0xe61acf033d1a45df), -1087, -308 },
+   { UINT64_C(0xab70fe17c79ac6ca), -1060, -300 },
+   { UINT64_C(0xff77b1fcbebcdc4f), -1034, -292 },
+   { UINT64_C(0xbe5691ef416bd60c), -1007, -284 },
+   { UINT64_C(0x8dd01fad907ffc3c), -980, -276 },
+   { UINT64_C(0xd3515c2831559a83), -954, -268 },
+   { UINT64_C(0x9d71ac8fada6c9b5), -927, -260 },
+   { UINT64_C(0xea9c227723ee8bcb), -901, -252 },
+   { UINT64_C(0xaecc49914078536d), -874, -244 },
+   { UINT64_C(0x823c12795db6ce57), -847, -236 },
+   { UINT64_C(0xc21094364dfb5637), -821, -228 },
+   { UINT64_C(0x9096ea6f3848984f), -794, -220 },
+   { UINT64_C(0xd77485cb25823ac7), -768, -212 },
+   { UINT64_C(0xa086cfcd97bf97f4), -741, -204 },
+   { UINT64_C(0xef340a98172aace5), -715, -196 },
+   { UINT64_C(0xb23867fb2a35b28e), -688, -188 },
+   { UINT64_C(0x84c8d4dfd2c63f3b), -661, -180 },
+   { UINT64_C(0xc5dd44271ad3cdba), -635, -172 },
+   { UINT64_C(0x936b9fcebb25c996), -608, -164 },
+   { UINT64_C(0xdbac6c247d62a584), -582, -156 },
+   { UINT64_C(0xa3ab66580d5fdaf6), -555, -148 },
+   { UINT64_C(0xf3e2f893dec3f126), -529, -140 },
+   { UINT64_C(0xb5b5ada8aaff80b8), -502, -132 },
+   { UINT64_C(0x87625f056c7c4a8b), -475, -124 },
+   { UINT64_C(0xc9bcff6034c13053), -449, -116 },
+   { UINT64_C(0x964e858c91ba2655), -422, -108 },
+   { UINT64_C(0xdff9772470297ebd), -396, -100 },
+   { UINT64_C(0xa6dfbd9fb8e5b88f), -369, -92 },
+   { UINT64_C(0xf8a95fcf88747d94), -343, -84 },
+   { UINT64_C(0xb94470938fa89bcf), -316, -76 },
+   { UINT64_C(0x8a08f0f8bf0f156b), -289, -68 },
+   { UINT64_C(0xcdb02555653131b6), -263, -60 },
+   { UINT64_C(0x993fe2c6d07b7fac), -236, -52 },
+   { UINT64_C(0xe45c10c42a2b3b06), -210, -44 },
+   { UINT64_C(0xaa242499697392d3), -183, -36 },
+   { UINT64_C(0xfd87b5f28300ca0e), -157, -28 },
+   { UINT64_C(0xbce5086492111aeb), -130, -20 },
+   { UINT64_C(0x8cbccc096f5088cc), -103, -12 },
+   { UINT64_C(0xd1b71758e219652c), -77, -4 },
+   { UINT64_C(0x9c40000000000000), -50, 4 },
+   { UINT64_C(0xe8d4a51000000000), -24, 12 },
+   { UINT64_C(0xad78ebc5ac620000), 3, 20 },
+   { UINT64_C(0x813f3978f8940984), 30, 28 },
+   { UINT64_C(0xc097ce7bc90715b3), 56, 36 },
+   { UINT64_C(0x8f7e32ce7bea5c70), 83, 44 },
+   { UINT64_C(0xd5d238a4abe98068), 109, 52 },
+   { UINT64_C(0x9f4f2726179a2245), 136, 60 },
+   { UINT64_C(0xed63a231d4c4fb27), 162, 68 },
+   { UINT64_C(0xb0de65388cc8ada8), 189, 76 },
+   { UINT64_C(0x83c7088e1aab65db), 216, 84 },
+   { UINT64_C(0xc45d1df942711d9a), 242, 92 },
+   { UINT64_C(0x924d692ca61be758), 269, 100 },
+   { UINT64_C(0xda01ee641a708dea), 295, 108 },
+   { UINT64_C(0xa26da3999aef774a), 322, 116 },
+   { UINT64_C(0xf209787bb47d6b85), 348, 124 },
+   { UINT64_C(0xb454e4a179dd1877), 375, 132 },
+   { UINT64_C(0x865b86925b9bc5c2), 402, 140 },
+   { UINT64_C(0xc83553c5c8965d3d), 428, 148 },
+   { UINT64_C(0x952ab45cfa97a0b3), 455, 156 },
+   { UINT64_C(0xde469fbd99a05fe3), 481, 164 },
+   { UINT64_C(0xa59bc234db398c25), 508, 172 },
+   { UINT64_C(0xf6c69a72a3989f5c), 534, 180 },
+   { UINT64_C(0xb7dcbf5354e9bece), 561, 188 },
+   { UINT64_C(0x88fcf317f22241e2), 588, 196 },
+   { UINT64_C(0xcc20ce9bd35c78a5), 614, 204 },
+   { UINT64_C(0x98165af37b2153df), 641, 212 },
+   { UINT64_C(0xe2a0b5dc971f303a), 667, 220 },
+   { UINT64_C(0xa8d9d1535ce3b396), 694, 228 },
+   { UINT64_C(0xfb9b7cd9a4a7443c), 720, 236 },
+   { UINT64_C(0xbb764c4ca7a44410), 747, 244 },
+   { UINT64_C(0x8bab8eefb6409c1a), 774, 252 },
+   { UINT64_C(0xd01fef10a657842c), 800, 260 },
+   { UINT64_C(0x9b10a4e5e9913129), 827, 268 },
+   { UINT64_C(0xe7109bfba19c0c9d), 853, 276 },
+   { UINT64_C(0xac2820d9623bf429), 880, 284 },
+   { UINT64_C(0x80444b5e7aa7cf85), 907, 292 },
+   { UINT64_C(0xbf21e44003acdd2d), 933, 300 },
+   { UINT64_C(0x8e679c2f5e44ff8f), 960, 308 },
+   { UINT64_C(0xd433179d9c8cb841), 986, 316 },
+   { UINT64_C(0x9e19db92b4e31ba9), 1013, 324 },
+   { UINT64_C(0xeb96bf6ebadf77d9), 1039, 332 },
+   { UINT64_C(0xaf87023b9bf0ee6b), 1066, 340 }
+};
+
+//! power of ten of the first of ::kstr_cached_powers, negated
+enum { kstr_cached_powers_offset = 348 };
+
+//! ratio of consecutive ::kstr_cached_powers as a power of ten
+enum { kstr_cached_powers_step = 8 };
+
+//! number of pieces whose characters kstr_add_iov() keeps on the stack
+enum { kstr_iov_codes = 32 };
+
+//! number of times an append to a concurrent string checks whether earlier
+//! appends are done before yielding the processor between checks
+enum { kstr_concurrent_spins = 1000 };
+
+//! minimum size of the buffers of a string using ::kstr_growth_chunked
+enum { kstr_chunk_size = 1 << 20 };
+
+//! minimum number of bytes kstr_builder_finish() copies per thread
+enum { kstr_builder_parallel = 1 << 20 };
+
+//! maximum number of threads kstr_builder_finish() copies with
+enum { kstr_builder_threads = 64 };
+
+//! string cache size classes
+//!
+//! class 0 holds string objects, and the others hold character buffers of
+//! twice the embedded buffer's size and up, doubling from class to class (128
+//! bytes to 64 KiB).
+enum { kstr_cache_object = 0, kstr_cache_classes = 11 };
+
+//! multiplier of the hash function, from murmurhash64a
+static uint64_t const kstr_hash_mul = UINT64_C(0xc6a4a7935bd1e995);
+
+//! maximum number of delimiters kstr_find_any() compares with vector
+//! instructions, beyond which it looks each byte up in a table
+enum { kstr_split_vector = 4 };
+
+//! number of bytes to make room for when reading into a full buffer
+enum { kstr_read_size = 4096 };
+
+//! maximum size of a control code built by kstr_add_style()
+//!
+//! `ESC [ 22 ; 38;2;255;255;255 ; 48;2;255;255;255 m` is the longest.
+enum { kstr_sgr_size = 48 };
+
+//! number of pieces a writer gathers for a single `writev()` call
+enum { kstr_writer_iovs = 64 };
+
+//! initialize a ::kstr_code from a string literal
+#define kstr_code_init(literal) { literal, sizeof(literal) - 1 }
+
+//! background color control codes, indexed by ::kstr_color
+static struct kstr_code const kstr_bg_codes[kstr_num_colors] =
+{
+   kstr_code_init("\x1b[49m"), // default
+   kstr_code_init("\x1b[40m"), // black
+   kstr_code_init("\x1b[44m"), // blue
+   kstr_code_init("\x1b[46m"), // cyan
+   kstr_code_init("\x1b[42m"), // green
+   kstr_code_init("\x1b[45m"), // magenta
+   kstr_code_init("\x1b[41m"), // red
+   kstr_code_init("\x1b[47m"), // white
+   kstr_code_init("\x1b[43m") // yellow
+};
+
+//! bold control codes (normal and bold)
+static struct kstr_code const kstr_bold_codes[2] =
+{
+   kstr_code_init("\x1b[22m"), // normal
+   kstr_code_init("\x1b[1m") // bold
+};
+
+//! foreground color control codes, indexed by ::kstr_color
+static struct kstr_code const kstr_fg_codes[kstr_num_colors] =
+{
+   kstr_code_init("\x1b[39m"), // default
+   kstr_code_init("\x1b[30m"), // black
+   kstr_code_init("\x1b[34m"), // blue
+   kstr_code_init("\x1b[36m"), // cyan
+   kstr_code_init("\x1b[32m"), // green
+   kstr_code_init("\x1b[35m"), // magenta
+   kstr_code_init("\x1b[31m"), // red
+   kstr_code_init("\x1b[37m"), // white
+   kstr_code_init("\x1b[33m") // yellow
+};
+
+//! reset control code
+static struct kstr_code const kstr_reset_code =
+   kstr_code_init("\x1b[0m");
+
+//! argument types of format conversions
+enum kstr_arg
+{
+   kstr_arg_none, //!< no argument (literal text)
+   kstr_arg_int, //!< `int`
+   kstr_arg_long, //!< `long`
+   kstr_arg_llong, //!< `long long`
+   kstr_arg_intmax, //!< `intmax_t`
+   kstr_arg_ssize, //!< `ssize_t`
+   kstr_arg_ptrdiff, //!< `ptrdiff_t`
+   kstr_arg_uptrdiff, //!< `ptrdiff_t`, converted as an unsigned integer
+   kstr_arg_uint, //!< `unsigned int`
+   kstr_arg_ulong, //!< `unsigned long`
+   kstr_arg_ullong, //!< `unsigned long long`
+   kstr_arg_uintmax, //!< `uintmax_t`
+   kstr_arg_size, //!< `size_t`
+   kstr_arg_double, //!< `double`
+   kstr_arg_ldouble, //!< `long double`
+   kstr_arg_wint, //!< `wint_t`
+   kstr_arg_string, //!< `char *`
+   kstr_arg_wstring, //!< `wchar_t *`
+   kstr_arg_pointer //!< `void *`
+};
+
+//! literal text or conversion of a compiled format
+struct kstr_fmt_item
+{
+   size_t offset; //!< offset of the text or specification in the characters
+   size_t count; //!< number of bytes of text (or of the specification)
+   enum kstr_arg arg; //!< argument type (::kstr_arg_none for literal text)
+   char conversion; //!< conversion specifier
+   bool fast; //!< convert without *printf()*
+   unsigned char stars; //!< number of `*` widths and precisions
+   int precision; //!< precision of a fast `%%f` conversion
+};
+
+//! compiled format structure
+struct kstr_fmt
+{
+   size_t num_items; //!< number of items
+   char * chars; //!< literal text and nul-terminated specifications
+   struct kstr_fmt_item items[]; //!< items in order
+};
+
+//! extended-precision floating-point number (f * 2^e)
+struct kstr_diy
+{
+   uint64_t f; //!< significand
+   int e; //!< binary exponent
+};
+
+//! range of unicode code points
+struct kstr_range
+{
+   uint32_t first; //!< first code point in the range
+   uint32_t last; //!< last code point in the range
+};
+
+//! string arena memory block
+struct kstr_arena_block
+{
+   struct kstr_arena_block * next; //!< next block in the arena
+   size_t size; //!< size of \a data in bytes
+   size_t used; //!< number of bytes of \a data handed out
+   size_t last; //!< offset of the most recent allocation in \a data
+
+   max_align_t data[]; //!< block memory
+};
+
+//! string arena structure
+struct kstr_arena
+{
+   size_t block_size; //!< size of each regular block
+   struct kstr_arena_block * blocks; //!< blocks, most recent first
+};
+
+//! segment of a concurrent string
+//!
+//! appends reserve space by adding to \a reserved, which may overshoot
+//! \a size. the one append whose reservation crosses \a size closes the
+//! segment, and appends that don't fit move on to \a next. appends publish
+//! their bytes by advancing \a committed in offset order.
+struct kstr_segment
+{
+   _Atomic(struct kstr_segment *) next; //!< next segment (or `NULL`)
+   atomic_size_t reserved; //!< number of bytes of \a data reserved
+   atomic_size_t committed; //!< number of bytes of \a data published
+   atomic_bool closed; //!< \a committed is final
+   size_t size; //!< size of \a data in bytes
+
+   char data[]; //!< segment bytes
+};
+
+//! concurrent string structure
+struct kstr_concurrent
+{
+   size_t segment_size; //!< size of each regular segment
+   struct kstr_segment * head; //!< first segment
+   _Atomic(struct kstr_segment *) tail; //!< segment appends go to
+};
+
+//! full buffer holding part of a chunked string's value
+struct kstr_chunk
+{
+   struct kstr_chunk * next; //!< next chunk (or `NULL`)
+   char * data; //!< character buffer
+   size_t count; //!< number of bytes in \a data (excluding nul)
+};
+
+//! end of a string's value, saved to undo appends that fail partway
+struct kstr_mark
+{
+   size_t used; //!< \a used of the string
+   size_t chunked; //!< \a chunked of the string
+   struct kstr_chunk * last_chunk; //!< \a last_chunk of the string
+   size_t width; //!< \a width of the string
+   uint32_t utf8_point; //!< \a utf8_point of the string
+   unsigned char utf8_pending; //!< \a utf8_pending of the string
+   enum kstr_escape escape; //!< \a escape of the string
+   kstr_style style; //!< \a style of the string
+   bool style_forgotten; //!< \a style_forgotten of the string
+   size_t control_count; //!< \a control_count of the string
+   size_t control_last; //!< byte count of the last control code (or 0)
+   bool controls_tracked; //!< \a controls_tracked of the string
+};
+
+//! character buffer shared by clones of a string
+struct kstr_shared
+{
+   atomic_size_t refs; //!< number of strings using the buffer
+   char data[]; //!< character buffer
+};
+
+//! gathers pieces of output to hand to `writev()` at once
+struct kstr_writer
+{
+   int fd; //!< file descriptor to write to
+   size_t count; //!< number of pieces in \a iov
+   struct iovec iov[kstr_writer_iovs]; //!< pieces to write
+};
+
+//! slot of an intern table
+struct kstr_intern_slot
+{
+   uint64_t hash; //!< hash of \a str's value
+   kstr * str; //!< interned string (or `NULL` for an empty slot)
+};
+
+//! intern table structure
+struct kstr_intern
+{
+   kstr_arena * arena; //!< arena interned strings belong to (or `NULL`)
+   size_t count; //!< number of interned strings
+   size_t capacity; //!< number of slots (a power of two)
+   struct kstr_intern_slot * slots; //!< open-addressed hash table
+};
+
+//! bulk builder structure
+struct kstr_builder
+{
+   kstr * target; //!< string the slices are appended to
+   size_t count; //!< number of slices
+   size_t * offsets; //!< offset of each slice in the output, and the total
+   kstr * slices[]; //!< strings the pieces of the output are built in
+};
+
+//! range of a builder's output copied by one thread
+struct kstr_builder_job
+{
+   kstr * const * slices; //!< flattened slices
+   size_t const * offsets; //!< offset of each slice in the output
+   size_t count; //!< number of slices
+   char * dest; //!< where the output starts
+   size_t start; //!< offset of the first byte to copy
+   size_t end; //!< offset after the last byte to copy
+};
+
+//! control code in a string's value
+struct kstr_control
+{
+   size_t pos; //!< offset of the first byte in the value
+   size_t count; //!< number of bytes
+};
+
+//! state of the scanner that measures text
+struct kstr_scanner
+{
+   uint32_t utf8_point; //!< code point decoded so far
+   unsigned char utf8_pending; //!< continuation bytes still expected
+   enum kstr_escape escape; //!< escape sequence scanner state
+};
+
+//! per-thread cache of freed string memory
+//!
+//! each list links free memory of one size class through its first bytes.
+struct kstr_cache
+{
+   size_t limit; //!< maximum number of bytes to keep
+   size_t size; //!< number of bytes kept
+   bool registered; //!< the cache is freed when the thread exits
+   void * lists[kstr_cache_classes]; //!< free memory by size class
+};
+
+//! the calling thread's string cache
+static _Thread_local struct kstr_cache kstr_cache;
+
+//! thread-specific key whose destructor frees a thread's string cache
+static pthread_key_t kstr_cache_key;
+
+//! ::kstr_cache_key was created
+static bool kstr_cache_keyed;
+
+//! creates ::kstr_cache_key once
+static pthread_once_t kstr_cache_once = PTHREAD_ONCE_INIT;
+
+//! the calling thread's counters
+static _Thread_local kstr_stats kstr_thread_stats;
+
+//! how all threads handle failures, set with kstr_set_error_mode()
+static _Atomic kstr_error_mode kstr_errors = kstr_error_abort;
+
+//! add to one of the calling thread's counters
+//!
+//! without instrumentation, \a n is not evaluated.
+#ifdef kstr_instrument
+#define kstr_count(counter, n) ((void) (kstr_thread_stats.counter += (n)))
+#else
+#define kstr_count(counter, n) ((void) sizeof(n))
+#endif
+
+static
+kstr *
+kstr_abort(
+      kstr ** ptr)
+{
+   return kstr_fail(ptr, ENOMEM);
+}
+
+kstr *
+kstr_add_bg(
+      kstr * this,
+      kstr_color color)
+{
+   if ((uintmax_t) color >= (uintmax_t) kstr_num_colors)
+      return kstr_fail(&this, EINVAL);
+
+   // append the color control code
+   struct kstr_code const * const code = &kstr_bg_codes[color];
+   if ((this = kstr_add_chars(this, code->chars, code->count, false)) != NULL)
+      this->style.bg = kstr_style_basic(color);
+
+   return this;
+}
+
+kstr *
+kstr_add_bold(
+      kstr * this,
+      bool bold)
+{
+   // append the bold control code
+   struct kstr_code const * const code = &kstr_bold_codes[bold];
+   if ((this = kstr_add_chars(this, code->chars, code->count, false)) != NULL)
+   {
+      this->style.set_bold = true;
+      this->style.bold = bold;
+   }
+
+   return this;
+}
+
+kstr *
+kstr_add_bytes(
+      kstr * this,
+      char const * bytes,
+      size_t count)
+{
+   return kstr_add_chars(this, bytes, count, true);
+}
+
+kstr *
+kstr_add_cached(
+      kstr * this,
+      kstr_fmt ** cache,
+      char const * fmt,
+      ...)
+{
+   // the cache is only ever set once, from null to a compiled format
+   _Atomic(kstr_fmt *) * const slot = (_Atomic(kstr_fmt *) *) cache;
+   kstr_fmt * compiled = atomic_load_explicit(slot, memory_order_acquire);
+   if (compiled == NULL && (compiled = kstr_fmt_compile(fmt)) != NULL)
+   {
+      kstr_fmt * expected = NULL;
+      if (
+            !atomic_compare_exchange_strong_explicit(
+               slot,
+               &expected,
+               compiled,
+               memory_order_acq_rel,
+               memory_order_acquire))
+      {
+         // another thread got there first
+         kstr_fmt_free(&compiled);
+         compiled = expected;
+      }
+   }
+
+   va_list args;
+   va_start(args, fmt);
+   if (compiled != NULL)
+      this = kstr_add_vcompiled(this, compiled, args);
+   else
+      this = kstr_add_vfmt(this, fmt, args);
+   va_end(args);
+
+   return this;
+}
+
+static
+kstr *
+kstr_add_chars(
+      kstr * this,
+      char const * chars,
+      size_t count,
+      bool visible)
+{
+   if (chars == NULL || count == 0)
+      return this;
+
+   // remember where characters from the string's own buffer are, since
+   // growing may move them
+   char const * const old_data = this->data;
+   uintptr_t const offset = (uintptr_t) chars - (uintptr_t) old_data;
+   bool const own = offset < this->data_size;
+
+   // grow the buffer if not enough bytes are available
+   if (kstr_grow(this, count) == NULL)
+      return NULL;
+
+   if (own && kstr_moved(this, old_data))
+      chars = this->data + offset;
+
+   // append the character data
+   char * const end = this->data + this->used - 1;
+   memcpy(end, chars, count);
+   this->used += count;
+   this->data[this->used - 1] = '\0';
+
+   kstr_added(this, end, count, visible);
+   kstr_changed(this);
+
+   return this;
+}
+
+static
+kstr *
+kstr_add_chunk(
+      kstr * this,
+      size_t count)
+{
+   // the new buffer fits at least a chunk, or all of a larger append
+   if (count == (size_t) -1)
+      return kstr_abort(&this);
+
+   size_t const size = (count < kstr_chunk_size) ? kstr_chunk_size : count + 1;
+
+   struct kstr_chunk * chunk;
+   if ((chunk = kstr_alloc(this->arena, sizeof(*chunk))) == NULL)
+      return kstr_abort(&this);
+
+   char * data;
+   if ((data = kstr_alloc(this->arena, size)) == NULL)
+   {
+      if (this->arena == NULL)
+         free(chunk);
+      return kstr_abort(&this);
+   }
+
+   // link the full buffer to the end of the chunks
+   chunk->next = NULL;
+   chunk->data = this->data;
+   chunk->count = this->used - 1;
+   if (this->last_chunk == NULL)
+      this->chunks = chunk;
+   else
+      this->last_chunk->next = chunk;
+   this->last_chunk = chunk;
+   this->chunked += chunk->count;
+
+   data[0] = '\0';
+   this->data = data;
+   this->data_size = size;
+   this->used = 1;
+   return this;
+}
+
+kstr *
+kstr_add_compiled(
+      kstr * this,
+      kstr_fmt const * fmt,
+      ...)
+{
+   va_list args;
+   va_start(args, fmt);
+   this = kstr_add_vcompiled(this, fmt, args);
+   va_end(args);
+
+   return this;
+}
+
+kstr *
+kstr_add_concurrent(
+      kstr * this,
+      kstr_concurrent * source)
+{
+   struct kstr_mark const mark = kstr_mark_end(this);
+   for (
+         struct kstr_segment * segment = source->head;
+         segment != NULL;
+         segment = atomic_load_explicit(&segment->next, memory_order_acquire))
+   {
+      // a closed segment's committed size doesn't change anymore, while an
+      // open one is the last segment with complete appends
+      bool const closed =
+         atomic_load_explicit(&segment->closed, memory_order_acquire);
+      size_t const committed =
+         atomic_load_explicit(&segment->committed, memory_order_acquire);
+      if (kstr_add_chars(this, segment->data, committed, true) == NULL)
+      {
+         // remove the segments copied before the one that failed
+         kstr_undo(this, &mark);
+         return NULL;
+      }
+
+      // the appended bytes may set attributes that aren't tracked
+      if (committed > 0)
+         kstr_forget_style(this);
+
+      if (!closed)
+         break;
+   }
+
+   return this;
+}
+
+static
+kstr *
+kstr_add_conversion(
+      kstr * this,
+      struct kstr_fmt_item const * item,
+      char const * spec,
+      va_list * args)
+{
+   // `*` widths and precisions come before the converted argument
+   int stars[2] = { 0, 0 };
+   for (unsigned int i = 0; i < item->stars; i++)
+      stars[i] = va_arg(*args, int);
+
+// fetch the argument, then either convert it with the given expression or
+// format it with its own specification
+#define kstr_convert(type, expr) \
+   do \
+   { \
+      type const value = va_arg(*args, type); \
+      if (item->fast) \
+         return (expr); \
+      if (item->stars == 0) \
+         return kstr_add_fmt(this, spec, value); \
+      if (item->stars == 1) \
+         return kstr_add_fmt(this, spec, stars[0], value); \
+      return kstr_add_fmt(this, spec, stars[0], stars[1], value); \
+   } \
+   while (0)
+
+   switch (item->arg)
+   {
+      case kstr_arg_int:
+         kstr_convert(
+               int,
+               item->conversion == 'c' ?
+                  kstr_add_bytes(this, &(char) { (char) value }, 1) :
+                  kstr_add_int(this, value));
+
+      case kstr_arg_long:
+         kstr_convert(long, kstr_add_int(this, value));
+
+      case kstr_arg_llong:
+         kstr_convert(long long, kstr_add_int(this, value));
+
+      case kstr_arg_intmax:
+         kstr_convert(intmax_t, kstr_add_int(this, value));
+
+      case kstr_arg_ssize:
+         kstr_convert(ssize_t, kstr_add_int(this, value));
+
+      case kstr_arg_ptrdiff:
+         kstr_convert(ptrdiff_t, kstr_add_int(this, value));
+
+      case kstr_arg_uptrdiff:
+         // the argument has the signed type, converted like its unsigned
+         // counterpart, which has the same size as size_t
+         kstr_convert(
+               ptrdiff_t,
+               item->conversion == 'x' ?
+                  kstr_add_hex(this, (size_t) value) :
+                  kstr_add_uint(this, (size_t) value));
+
+      case kstr_arg_uint:
+         kstr_convert(
+               unsigned int,
+               item->conversion == 'x' ?
+                  kstr_add_hex(this, value) : kstr_add_uint(this, value));
+
+      case kstr_arg_ulong:
+         kstr_convert(
+               unsigned long,
+               item->conversion == 'x' ?
+                  kstr_add_hex(this, value) : kstr_add_uint(this, value));
+
+      case kstr_arg_ullong:
+         kstr_convert(
+               unsigned long long,
+               item->conversion == 'x' ?
+                  kstr_add_hex(this, value) : kstr_add_uint(this, value));
+
+      case kstr_arg_uintmax:
+         kstr_convert(
+               uintmax_t,
+               item->conversion == 'x' ?
+                  kstr_add_hex(this, value) : kstr_add_uint(this, value));
+
+      case kstr_arg_size:
+         kstr_convert(
+               size_t,
+               item->conversion == 'x' ?
+                  kstr_add_hex(this, value) : kstr_add_uint(this, value));
+
+      case kstr_arg_double:
+         kstr_convert(double, kstr_add_double(this, value, item->precision));
+
+      case kstr_arg_ldouble:
+         kstr_convert(long double, this);
+
+      case kstr_arg_wint:
+         kstr_convert(wint_t, this);
+
+      case kstr_arg_string:
+         kstr_convert(
+               char const *,
+               value != NULL ?
+                  kstr_add_text(this, value) : kstr_add_fmt(this, spec, value));
+
+      case kstr_arg_wstring:
+         kstr_convert(wchar_t const *, this);
+
+      case kstr_arg_pointer:
+         kstr_convert(void const *, this);
+
+      default:
+         return this;
+   }
+
+#undef kstr_convert
+}
+
+static
+kstr *
+kstr_add_decimal(
+      kstr * this,
+      bool negative,
+      uintmax_t value)
+{
+   // count the digits first so the buffer is checked only once
+   size_t const digits = kstr_decimal_digits(value);
+   size_t const count = negative + digits;
+   if (kstr_grow(this, count) == NULL)
+      return NULL;
+
+   char * const end = this->data + this->used - 1;
+   if (negative)
+      end[0] = '-';
+   kstr_put_decimal(end + negative, digits, value);
+
+   this->used += count;
+   this->data[this->used - 1] = '\0';
+   kstr_added(this, end, count, true);
+   kstr_changed(this);
+
+   return this;
+}
+
+kstr *
+kstr_add_double(
+      kstr * this,
+      double value,
+      int precision)
+{
+   bool const negative = signbit(value);
+   double const magnitude = negative ? -value : value;
+
+   if (precision < 0)
+   {
+      // integers are printed in full by "%.15g" below 10^15
+      if (magnitude < 1e15 && magnitude == (double) (uint64_t) magnitude)
+         return kstr_add_fixed(this, negative, (uint64_t) magnitude, 0);
+
+      // format the shortest digits as "%.*g" does with at least 15 of them
+      char digits[17];
+      int count;
+      int exponent;
+      if (
+            isfinite(value) &&
+            kstr_shortest(magnitude, digits, &count, &exponent))
+      {
+         int const point = count + exponent;
+         int const precision = (count > 15) ? count : 15;
+         char buffer[32];
+         char * out = buffer;
+         if (negative)
+            *out++ = '-';
+
+         if (point - 1 < -4 || point - 1 >= precision)
+         {
+            // d.ddde+xx, with at least two exponent digits
+            int const power = point - 1;
+            unsigned int const magnitude_power =
+               (unsigned int) (power < 0 ? -power : power);
+            *out++ = digits[0];
+            if (count > 1)
+            {
+               *out++ = '.';
+               memcpy(out, digits + 1, (size_t) count - 1);
+               out += count - 1;
+            }
+            *out++ = 'e';
+            *out++ = (power < 0) ? '-' : '+';
+            if (magnitude_power >= 100)
+               *out++ = (char) ('0' + magnitude_power / 100);
+            *out++ = (char) ('0' + magnitude_power / 10 % 10);
+            *out++ = (char) ('0' + magnitude_power % 10);
+         }
+         else if (point <= 0)
+         {
+            // 0.000ddd
+            *out++ = '0';
+            *out++ = '.';
+            memset(out, '0', (size_t) -point);
+            out += -point;
+            memcpy(out, digits, (size_t) count);
+            out += count;
+         }
+         else if (count <= point)
+         {
+            // ddd000
+            memcpy(out, digits, (size_t) count);
+            memset(out + count, '0', (size_t) (point - count));
+            out += point;
+         }
+         else
+         {
+            // ddd.ddd
+            memcpy(out, digits, (size_t) point);
+            out += point;
+            *out++ = '.';
+            memcpy(out, digits + point, (size_t) (count - point));
+            out += count - point;
+         }
+
+         return kstr_add_bytes(this, buffer, (size_t) (out - buffer));
+      }
+
+      // otherwise use the fewest significant digits that read back as the
+      // same value; any value with up to 15 significant digits survives a
+      // round trip, except subnormal values, which are less precise
+      char buffer[32];
+      int length = 0;
+      for (int digits = magnitude < DBL_MIN ? 1 : 15; digits <= 17; digits++)
+      {
+         length = snprintf(buffer, sizeof(buffer), "%.*g", digits, value);
+         if (!isfinite(value) || strtod(buffer, NULL) == value)
+            break;
+      }
+
+      return kstr_add_bytes(this, buffer, length < 0 ? 0 : (size_t) length);
+   }
+
+   size_t const num_powers = sizeof(kstr_powers) / sizeof(*kstr_powers);
+   if ((size_t) precision < num_powers && magnitude < 0x1p40)
+   {
+      // the scaled value is off by at most half an ulp (2^-13 below 2^40), so
+      // it can be rounded directly unless it's too close to a tie
+      double const scaled = magnitude * (double) kstr_powers[precision];
+      if (scaled < 0x1p40)
+      {
+         uint64_t const whole = (uint64_t) scaled;
+         double const fraction = scaled - (double) whole;
+         if (fraction < 0.5 - 0x1p-10 || fraction > 0.5 + 0x1p-10)
+            return kstr_add_fixed(
+                  this, negative, whole + (fraction > 0.5), precision);
+      }
+   }
+
+   return kstr_add_fmt(this, "%.*f", precision, value);
+}
+
+kstr *
+kstr_add_fg(
+      kstr * this,
+      kstr_color color)
+{
+   if ((uintmax_t) color >= (uintmax_t) kstr_num_colors)
+      return kstr_fail(&this, EINVAL);
+
+   // append the color control code
+   struct kstr_code const * const code = &kstr_fg_codes[color];
+   if ((this = kstr_add_chars(this, code->chars, code->count, false)) != NULL)
+      this->style.fg = kstr_style_basic(color);
+
+   return this;
+}
+
+static
+kstr *
+kstr_add_fixed(
+      kstr * this,
+      bool negative,
+      uint64_t value,
+      int precision)
+{
+   uint64_t const scale = kstr_powers[precision];
+   uint64_t const whole = value / scale;
+
+   // count the characters first so the buffer is checked only once
+   size_t const digits = kstr_decimal_digits(whole);
+   size_t const count =
+      negative + digits + (precision > 0 ? 1 + (size_t) precision : 0);
+   if (kstr_grow(this, count) == NULL)
+      return NULL;
+
+   char * const end = this->data + this->used - 1;
+   if (negative)
+      end[0] = '-';
+   kstr_put_decimal(end + negative, digits, whole);
+   if (precision > 0)
+   {
+      end[negative + digits] = '.';
+      kstr_put_decimal(
+            end + negative + digits + 1, (size_t) precision, value % scale);
+   }
+
+   this->used += count;
+   this->data[this->used - 1] = '\0';
+   kstr_added(this, end, count, true);
+   kstr_changed(this);
+
+   return this;
+}
+
+kstr *
+kstr_add_fmt(
+      kstr * this,
+      char const * fmt,
+      ...)
+{
+   va_list args;
+   va_start(args, fmt);
+   this = kstr_add_vfmt(this, fmt, args);
+   va_end(args);
+
+   return this;
+}
+
+kstr *
+kstr_add_hex(
+      kstr * this,
+      uintmax_t value)
+{
+   static char const hex_digits[16] = "0123456789abcdef";
+
+   // count the digits first so the buffer is checked only once
+   size_t count = 1;
+   for (uintmax_t rest = value >> 4; rest != 0; rest >>= 4)
+      count++;
+
+   if (kstr_grow(this, count) == NULL)
+      return NULL;
+
+   char * const end = this->data + this->used - 1;
+   for (size_t i = count; i > 0; i--, value >>= 4)
+      end[i - 1] = hex_digits[value & 0xf];
+
+   this->used += count;
+   this->data[this->used - 1] = '\0';
+   kstr_added(this, end, count, true);
+   kstr_changed(this);
+
+   return this;
+}
+
+kstr *
+kstr_add_int(
+      kstr * this,
+      intmax_t value)
+{
+   // negate in unsigned arithmetic, which also works for the minimum value
+   uintmax_t const magnitude =
+      value < 0 ? -(uintmax_t) value : (uintmax_t) value;
+   return kstr_add_decimal(this, value < 0, magnitude);
+}
+
+kstr *
+kstr_add_iov(
+      kstr * this,
+      struct kstr_piece const * pieces,
+      size_t n)
+{
+   if (pieces == NULL || n == 0)
+      return this;
+
+   // keep the characters of every piece, since pieces taken from the
+   // string's own value can't be measured again once it has changed
+   struct kstr_code stack_codes[kstr_iov_codes];
+   struct kstr_code * codes = stack_codes;
+   if (
+         n > kstr_iov_codes &&
+         (
+            n > (size_t) -1 / sizeof(*codes) ||
+            (codes = malloc(n * sizeof(*codes))) == NULL))
+      return kstr_abort(&this);
+
+   // add up the sizes of all pieces
+   size_t total = 0;
+   for (size_t i = 0; i < n; i++)
+   {
+      if (!kstr_piece_code(&pieces[i], &codes[i]))
+      {
+         if (codes != stack_codes)
+            free(codes);
+         return kstr_fail(&this, EINVAL);
+      }
+
+      if (codes[i].count > (size_t) -1 - total)
+      {
+         if (codes != stack_codes)
+            free(codes);
+         return kstr_abort(&this);
+      }
+
+      total += codes[i].count;
+   }
+
+   // remember where the string's own buffer is, since growing may move
+   // characters of pieces taken from it
+   uintptr_t const old_data = (uintptr_t) this->data;
+   size_t const old_data_size = this->data_size;
+
+   // grow the buffer once for all pieces
+   if (kstr_grow(this, total) == NULL)
+   {
+      if (codes != stack_codes)
+         free(codes);
+      return NULL;
+   }
+
+   bool const moved = kstr_moved(this, (char const *) old_data);
+
+   // append the character data of each piece, measuring each run of
+   // consecutive visible pieces at once
+   char * end = this->data + this->used - 1;
+   char * run = end;
+   for (size_t i = 0; i < n; i++)
+   {
+      struct kstr_code code = codes[i];
+      if (code.count == 0)
+         continue;
+
+      kstr_piece_kind const kind = pieces[i].kind;
+      if (kind != kstr_piece_text && kind != kstr_piece_bytes)
+      {
+         if (end != run)
+            kstr_added(this, run, (size_t) (end - run), true);
+         kstr_added(this, end, code.count, false);
+         kstr_track(this, &pieces[i]);
+         run = end + code.count;
+      }
+      else
+      {
+         uintptr_t const offset = (uintptr_t) code.chars - old_data;
+         if (moved && offset < old_data_size)
+            code.chars = this->data + offset;
+      }
+
+      memcpy(end, code.chars, code.count);
+      end += code.count;
+   }
+
+   if (end != run)
+      kstr_added(this, run, (size_t) (end - run), true);
+   if (codes != stack_codes)
+      free(codes);
+
+   this->used += total;
+   this->data[this->used - 1] = '\0';
+
+   kstr_changed(this);
+
+   return this;
+}
+
+kstr *
+kstr_add_reset(
+      kstr * this)
+{
+   // append the reset control code
+   struct kstr_code const * const code = &kstr_reset_code;
+   if ((this = kstr_add_chars(this, code->chars, code->count, false)) != NULL)
+      kstr_track(this, &(struct kstr_piece) { .kind = kstr_piece_reset });
+
+   return this;
+}
+
+kstr *
+kstr_add_style(
+      kstr * this,
+      kstr_style const * style)
+{
+   if (style == NULL)
+      return this;
+
+   // skip the attributes that are already active
+   bool const bold = style->set_bold
+      && (!this->style.set_bold || this->style.bold != style->bold);
+   bool const fg = style->fg.kind != kstr_color_kind_none
+      && !kstr_color_equal(&style->fg, &this->style.fg);
+   bool const bg = style->bg.kind != kstr_color_kind_none
+      && !kstr_color_equal(&style->bg, &this->style.bg);
+
+   // build a single control code with the parameters of every attribute
+   char code[kstr_sgr_size];
+   char * end = code;
+   *end++ = '\x1b';
+   *end++ = '[';
+   if (bold)
+   {
+      struct kstr_code const * const bold_code =
+         &kstr_bold_codes[style->bold];
+      memcpy(end, bold_code->chars + 2, bold_code->count - 3);
+      end += bold_code->count - 3;
+   }
+
+   if (fg)
+   {
+      if (end - code > 2)
+         *end++ = ';';
+      if ((end = kstr_sgr_color(end, &style->fg, false)) == NULL)
+         return kstr_fail(&this, EINVAL);
+   }
+
+   if (bg)
+   {
+      if (end - code > 2)
+         *end++ = ';';
+      if ((end = kstr_sgr_color(end, &style->bg, true)) == NULL)
+         return kstr_fail(&this, EINVAL);
+   }
+
+   if (end - code == 2)
+      return this;
+
+   *end++ = 'm';
+   if ((this = kstr_add_chars(this, code, (size_t) (end - code), false))
+         == NULL)
+      return NULL;
+
+   if (bold)
+   {
+      this->style.set_bold = true;
+      this->style.bold = style->bold;
+   }
+
+   if (fg)
+      this->style.fg = style->fg;
+   if (bg)
+      this->style.bg = style->bg;
+
+   return this;
+}
+
+kstr *
+kstr_add_text(
+      kstr * this,
+      char const * text)
+{
+   return kstr_add_chars(this, text, text == NULL ? 0 : strlen(text), true);
+}
+
+kstr *
+kstr_add_uint(
+      kstr * this,
+      uintmax_t value)
+{
+   return kstr_add_decimal(this, false, value);
+}
+
+kstr *
+kstr_add_vcompiled(
+      kstr * this,
+      kstr_fmt const * fmt,
+      va_list args)
+{
+   if (fmt == NULL)
+      return this;
+
+   // copy the arg list so it can be passed around by pointer
+   va_list args_copy;
+   va_copy(args_copy, args);
+   struct kstr_mark const mark = kstr_mark_end(this);
+   kstr * result = this;
+   for (size_t i = 0; i < fmt->num_items && result != NULL; i++)
+   {
+      struct kstr_fmt_item const * const item = &fmt->items[i];
+      char const * const chars = fmt->chars + item->offset;
+      if (item->arg == kstr_arg_none)
+         result = kstr_add_chars(this, chars, item->count, true);
+      else
+         result = kstr_add_conversion(this, item, chars, &args_copy);
+   }
+   va_end(args_copy);
+
+   // remove the output of the items before the one that failed
+   if (result == NULL)
+      kstr_undo(this, &mark);
+
+   return result;
+}
+
+kstr *
+kstr_add_view(
+      kstr * this,
+      kstr_view view)
+{
+   // the viewed bytes may hold control codes of another string, whose
+   // attributes aren't tracked
+   if ((this = kstr_add_chars(this, view.ptr, view.len, true)) != NULL
+         && view.len > 0)
+      kstr_forget_style(this);
+
+   return this;
+}
+
+kstr *
+kstr_add_vfmt(
+      kstr * this,
+      char const * fmt,
+      va_list args)
+{
+   if (fmt == NULL)
+      return this;
+
+   // make sure the buffer isn't shared with any clones
+   if (kstr_grow(this, 0) == NULL)
+      return NULL;
+
+   // try formatting directly into the available space, which is usually
+   // enough once the buffer has grown to fit typical values
+   va_list args_copy;
+   va_copy(args_copy, args);
+   kstr_count(fmt_passes, 1);
+   int length = vsnprintf(
+         this->data + this->used - 1, kstr_available(this) + 1, fmt, args_copy);
+   va_end(args_copy);
+
+   if (length < 0)
+   {
+      this->data[this->used - 1] = '\0';
+      return this;
+   }
+
+   size_t const count = (size_t) length;
+   if (kstr_available(this) < count)
+   {
+      // the output was truncated, so grow the buffer and format it again
+      if (kstr_grow(this, count) == NULL)
+      {
+         this->data[this->used - 1] = '\0';
+         return NULL;
+      }
+
+      va_copy(args_copy, args);
+      kstr_count(fmt_passes, 1);
+      vsnprintf(this->data + this->used - 1, count + 1, fmt, args_copy);
+      va_end(args_copy);
+   }
+
+   this->width += kstr_measure(this, this->data + this->used - 1, count);
+   this->used += count;
+
+   kstr_changed(this);
+
+   return this;
+}
+
+static
+void
+kstr_added(
+      kstr * this,
+      char const * chars,
+      size_t count,
+      bool visible)
+{
+   if (visible)
+      this->width += kstr_measure(this, chars, count);
+   else
+   {
+      // a control code ends an incomplete utf-8 or escape sequence
+      if (this->utf8_pending > 0)
+         this->width++;
+      this->utf8_pending = 0;
+      this->escape = kstr_escape_none;
+
+      kstr_control_add(
+            this, this->chunked + (size_t) (chars - this->data), count);
+   }
+}
+
+static
+void *
+kstr_alloc(
+      kstr_arena * arena,
+      size_t size)
+{
+   kstr_count(allocs, 1);
+   return arena == NULL ? malloc(size) : kstr_arena_alloc(arena, size);
+}
+
+static
+char *
+kstr_alloc_data(
+      kstr_arena * arena,
+      size_t * size)
+{
+   // reuse a cached buffer that is at least as large as requested
+   if (arena == NULL)
+   {
+      size_t const cls = kstr_cache_fit(*size);
+      char * data;
+      if ((data = kstr_cache_get(cls)) != NULL)
+      {
+         *size = kstr_cache_size(cls);
+         return data;
+      }
+   }
+
+   return kstr_alloc(arena, *size);
+}
+
+static
+kstr *
+kstr_alloc_object(
+      kstr_arena * arena)
+{
+   kstr * this;
+   if (arena == NULL && (this = kstr_cache_get(kstr_cache_object)) != NULL)
+      return this;
+
+   return kstr_alloc(arena, sizeof(*this));
+}
+
+static
+void *
+kstr_arena_alloc(
+      kstr_arena * arena,
+      size_t size)
+{
+   static size_t const align = _Alignof(max_align_t);
+
+   // round the size up so the next allocation stays aligned
+   if (size > (size_t) -1 - (align - 1))
+      return NULL;
+   size = (size + align - 1) / align * align;
+
+   struct kstr_arena_block * block = arena->blocks;
+   if (block == NULL || block->size - block->used < size)
+   {
+      // allocate a new block, giving oversized requests a block of their own
+      size_t const block_size =
+         (size > arena->block_size) ? size : arena->block_size;
+      if (block_size > (size_t) -1 - sizeof(*block))
+         return NULL;
+
+      struct kstr_arena_block * new_block;
+      if ((new_block = malloc(sizeof(*new_block) + block_size)) == NULL)
+         return NULL;
+
+      new_block->size = block_size;
+      new_block->used = 0;
+      new_block->last = 0;
+
+      // keep using the current block for small requests if it has space left
+      if (block != NULL && block_size > arena->block_size)
+      {
+         new_block->next = block->next;
+         block->next = new_block;
+      }
+      else
+      {
+         new_block->next = block;
+         arena->blocks = new_block;
+      }
+
+      block = new_block;
+   }
+
+   // hand out the next piece of the block
+   block->last = block->used;
+   block->used += size;
+   return (char *) block->data + block->last;
+}
+
+kstr_arena *
+kstr_arena_free(
+      kstr_arena ** ptr)
+{
+   if (ptr == NULL)
+      return NULL;
+
+   // set the pointer's target to null
+   kstr_arena * arena = *ptr;
+   *ptr = NULL;
+   if (arena == NULL)
+      return NULL;
+
+   // free all blocks and the arena itself
+   while (arena->blocks != NULL)
+   {
+      struct kstr_arena_block * const next = arena->blocks->next;
+      free(arena->blocks);
+      arena->blocks = next;
+   }
+
+   free(arena);
+   return NULL;
+}
+
+kstr_arena *
+kstr_arena_new(
+      size_t block_size)
+{
+   static size_t const default_block_size = 64 * 1024;
+
+   kstr_arena * arena;
+   if ((arena = malloc(sizeof(*arena))) == NULL)
+   {
+      kstr_abort(NULL);
+      return NULL;
+   }
+
+   arena->block_size = (block_size == 0) ? default_block_size : block_size;
+   arena->blocks = NULL;
+   return arena;
+}
+
+static
+void *
+kstr_arena_realloc(
+      kstr_arena * arena,
+      void * ptr,
+      size_t old_size,
+      size_t new_size)
+{
+   static size_t const align = _Alignof(max_align_t);
+
+   // shrinking never needs to move anything
+   if (new_size <= old_size)
+      return ptr;
+
+   // extend the most recent allocation in place if its block has room
+   struct kstr_arena_block * const block = arena->blocks;
+   if (block != NULL && ptr == (char *) block->data + block->last)
+   {
+      size_t const space = block->size - block->last;
+      if (new_size <= space - space % align)
+      {
+         block->used = block->last + (new_size + align - 1) / align * align;
+         return ptr;
+      }
+   }
+
+   // otherwise allocate new memory and copy the old contents
+   void * new_ptr;
+   if ((new_ptr = kstr_arena_alloc(arena, new_size)) == NULL)
+      return NULL;
+
+   if (ptr != NULL)
+      memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+   return new_ptr;
+}
+
+kstr_arena *
+kstr_arena_reset(
+      kstr_arena * arena)
+{
+   // keep one regular block and free the rest
+   struct kstr_arena_block * keep = NULL;
+   while (arena->blocks != NULL)
+   {
+      struct kstr_arena_block * const next = arena->blocks->next;
+      if (keep == NULL && arena->blocks->size == arena->block_size)
+         keep = arena->blocks;
+      else
+         free(arena->blocks);
+      arena->blocks = next;
+   }
+
+   if (keep != NULL)
+   {
+      keep->next = NULL;
+      keep->used = 0;
+      keep->last = 0;
+   }
+
+   arena->blocks = keep;
+   return arena;
+}
+
+static
+size_t
+kstr_ascii_run(
+      unsigned char const * bytes,
+      size_t count)
+{
+   size_t i = 0;
+
+#ifdef __SSE2__
+   // a byte is printable if, as a signed value, it is above 0x1f and below
+   // 0x7f, which excludes all bytes with the high bit set
+   __m128i const low = _mm_set1_epi8(0x1f);
+   __m128i const high = _mm_set1_epi8(0x7f);
+   for (; count - i >= 16; i += 16)
+   {
+      __m128i const chunk = _mm_loadu_si128((__m128i const *) (bytes + i));
+      __m128i const printable = _mm_and_si128(
+            _mm_cmpgt_epi8(chunk, low), _mm_cmplt_epi8(chunk, high));
+
+      unsigned int const mask = (unsigned int) _mm_movemask_epi8(printable);
+      if (mask != 0xffff)
+         return i + (size_t) __builtin_ctz(~mask);
+   }
+#else
+   static uint64_t const ones = UINT64_C(0x0101010101010101);
+   static uint64_t const highs = UINT64_C(0x8080808080808080);
+   for (; count - i >= 8; i += 8)
+   {
+      uint64_t word;
+      memcpy(&word, bytes + i, sizeof(word));
+
+      // stop at a word with a high bit set, a byte below 0x20, or a 0x7f byte
+      uint64_t const del = word ^ (ones * 0x7f);
+      if (
+            (word & highs) != 0 ||
+            ((word - ones * 0x20) & ~word & highs) != 0 ||
+            ((del - ones) & ~del & highs) != 0)
+         break;
+   }
+#endif
+
+   while (i < count && bytes[i] >= 0x20 && bytes[i] < 0x7f)
+      i++;
+
+   return i;
+}
+
+static
+size_t
+kstr_available(
+      kstr * this)
+{
+   return this->data_size - this->used;
+}
+
+char const *
+kstr_basename(
+      kstr * this)
+{
+   // the basename is already nul-terminated unless trailing slashes follow
+   kstr_view const view = kstr_basename_view(this);
+   if (view.ptr == NULL || view.ptr[view.len] == '\0')
+      return view.ptr;
+
+   // use the cached copy if the value hasn't changed since it was made
+   if (this->basename_generation == this->generation)
+   {
+      kstr_count(basename_hits, 1);
+      return this->basename;
+   }
+
+   kstr_count(basename_misses, 1);
+
+   // make room for the copy, reusing the cache's storage if possible
+   if (this->basename_size < view.len + 1)
+   {
+      char * new_basename;
+      if (
+            (new_basename = kstr_realloc(
+               this->arena,
+               this->basename,
+               this->basename_size,
+               view.len + 1)) == NULL)
+      {
+         kstr_abort(&this);
+         return NULL;
+      }
+
+      this->basename = new_basename;
+      this->basename_size = view.len + 1;
+   }
+
+   // cache a nul-terminated copy of the basename
+   this->basename_generation = this->generation;
+   memcpy(this->basename, view.ptr, view.len);
+   this->basename[view.len] = '\0';
+   return this->basename;
+}
+
+kstr_view
+kstr_basename_view(
+      kstr * this)
+{
+   if (kstr_flatten(this) == NULL)
+      return (kstr_view) { NULL, 0 };
+
+   char const * const data = this->data;
+   size_t end = this->used - 1;
+   if (end == 0)
+      return (kstr_view) { ".", 1 };
+
+   // skip trailing slashes
+   while (end > 0 && data[end - 1] == '/')
+      end--;
+   if (end == 0)
+      return (kstr_view) { "/", 1 };
+
+   // the basename follows the last remaining slash
+   size_t start = end;
+   while (start > 0 && data[start - 1] != '/')
+      start--;
+
+   return (kstr_view) { data + start, end - start };
+}
+
+static
+void *
+kstr_builder_copy(
+      void * job)
+{
+   struct kstr_builder_job const * const range = job;
+
+   // find the slice holding the first byte of the range
+   size_t low = 0;
+   size_t high = range->count;
+   while (high - low > 1)
+   {
+      size_t const mid = low + (high - low) / 2;
+      if (range->offsets[mid] <= range->start)
+         low = mid;
+      else
+         high = mid;
+   }
+
+   // copy the slices' bytes that fall in the range
+   for (size_t i = low, pos = range->start; pos < range->end; i++)
+   {
+      size_t const slice_end = range->offsets[i + 1];
+      if (slice_end <= pos)
+         continue;
+
+      size_t const end = (slice_end < range->end) ? slice_end : range->end;
+      memcpy(
+            range->dest + pos,
+            range->slices[i]->data + (pos - range->offsets[i]),
+            end - pos);
+      pos = end;
+   }
+
+   return NULL;
+}
+
+kstr *
+kstr_builder_finish(
+      kstr_builder * this,
+      size_t threads)
+{
+   kstr * target = this->target;
+
+   // join the chunks of each slice and lay the slices out end to end
+   this->offsets[0] = 0;
+   for (size_t i = 0; i < this->count; i++)
+   {
+      kstr * const slice = this->slices[i];
+      if (kstr_flatten(slice) == NULL)
+         return NULL;
+
+      if (slice->used - 1 > (size_t) -1 - this->offsets[i])
+         return kstr_abort(&target);
+      this->offsets[i + 1] = this->offsets[i] + slice->used - 1;
+   }
+
+   size_t const total = this->offsets[this->count];
+   if (kstr_grow(target, total) == NULL)
+      return NULL;
+
+   // copy evenly sized ranges of the output, each in a thread of its own
+   // except the first, which is copied while the others run
+   size_t jobs = total / kstr_builder_parallel;
+   if (jobs > threads)
+      jobs = threads;
+   if (jobs > kstr_builder_threads)
+      jobs = kstr_builder_threads;
+   if (jobs == 0)
+      jobs = 1;
+
+   struct kstr_builder_job job[kstr_builder_threads];
+   pthread_t thread[kstr_builder_threads];
+   bool started[kstr_builder_threads];
+   for (size_t i = 0; i < jobs; i++)
+   {
+      job[i] = (struct kstr_builder_job) {
+         .slices = this->slices,
+         .offsets = this->offsets,
+         .count = this->count,
+         .dest = target->data + target->used - 1,
+         .start = total / jobs * i,
+         .end = (i == jobs - 1) ? total : total / jobs * (i + 1)
+      };
+      started[i] =
+         i > 0 && pthread_create(&thread[i], NULL, kstr_builder_copy, &job[i])
+         == 0;
+   }
+
+   // copy the ranges that didn't get a thread here as well
+   for (size_t i = 0; i < jobs; i++)
+      if (!started[i])
+         kstr_builder_copy(&job[i]);
+   for (size_t i = 0; i < jobs; i++)
+      if (started[i])
+         pthread_join(thread[i], NULL);
+
+   // each boundary between non-empty values ends an incomplete utf-8 or
+   // escape sequence like a control code does
+   size_t const base = target->chunked + target->used - 1;
+   for (size_t i = 0; i < this->count; i++)
+   {
+      kstr * const slice = this->slices[i];
+      if (slice->used == 1)
+         continue;
+
+      if (target->utf8_pending > 0)
+         target->width++;
+      target->width += slice->width;
+      target->utf8_point = slice->utf8_point;
+      target->utf8_pending = slice->utf8_pending;
+      target->escape = slice->escape;
+
+      // move the slice's control codes to where its bytes are now
+      if (!slice->controls_tracked)
+      {
+         target->control_count = 0;
+         target->controls_tracked = false;
+      }
+
+      for (size_t j = 0; j < slice->control_count; j++)
+         kstr_control_add(
+               target,
+               base + this->offsets[i] + slice->controls[j].pos,
+               slice->controls[j].count);
+
+      // the attributes a slice sets replace those known before it, unless
+      // it holds codes that may have set attributes that aren't tracked
+      if (slice->style_forgotten)
+         target->style = (kstr_style) { 0 };
+      if (slice->style.set_bold)
+      {
+         target->style.set_bold = true;
+         target->style.bold = slice->style.bold;
+      }
+      if (slice->style.fg.kind != kstr_color_kind_none)
+         target->style.fg = slice->style.fg;
+      if (slice->style.bg.kind != kstr_color_kind_none)
+         target->style.bg = slice->style.bg;
+   }
+
+   target->used += total;
+   target->data[target->used - 1] = '\0';
+   kstr_changed(target);
+
+   // empty the slices, keeping their buffers for the next batch
+   for (size_t i = 0; i < this->count; i++)
+      kstr_reset(this->slices[i]);
+
+   return target;
+}
+
+kstr_builder *
+kstr_builder_free(
+      kstr_builder ** ptr)
+{
+   if (ptr == NULL)
+      return NULL;
+
+   // set the pointer's target to null
+   kstr_builder * builder = *ptr;
+   *ptr = NULL;
+   if (builder == NULL)
+      return NULL;
+
+   for (size_t i = 0; i < builder->count; i++)
+      kstr_free(&builder->slices[i]);
+
+   free(builder->offsets);
+   free(builder);
+   return NULL;
+}
+
+kstr_builder *
+kstr_builder_new(
+      kstr * this,
+      size_t count)
+{
+   kstr_builder * builder;
+   if (
+         count >= ((size_t) -1 - sizeof(*builder)) / sizeof(kstr *) ||
+         (builder = malloc(sizeof(*builder) + count * sizeof(kstr *))) == NULL)
+   {
+      kstr_abort(NULL);
+      return NULL;
+   }
+
+   builder->target = this;
+   builder->count = 0;
+   if ((builder->offsets = malloc((count + 1) * sizeof(size_t))) == NULL)
+   {
+      kstr_abort(NULL);
+      return kstr_builder_free(&builder);
+   }
+
+   // the slices recognize escape sequences if the string does
+   for (; builder->count < count; builder->count++)
+   {
+      kstr * slice;
+      if ((slice = kstr_new(NULL)) == NULL)
+         return kstr_builder_free(&builder);
+
+      builder->slices[builder->count] = kstr_set_escapes(slice, this->escapes);
+   }
+
+   return builder;
+}
+
+kstr *
+kstr_builder_slice(
+      kstr_builder * this,
+      size_t index)
+{
+   if (index >= this->count)
+      return kstr_fail(NULL, EINVAL);
+
+   return this->slices[index];
+}
+
+static
+void
+kstr_cache_exit(
+      void * cache)
+{
+   (void) cache;
+
+   // strings destroyed by later destructors register the cache again
+   kstr_cache_purge();
+   kstr_cache.registered = false;
+}
+
+static
+size_t
+kstr_cache_fit(
+      size_t size)
+{
+   size_t cls = kstr_cache_object + 1;
+   while (cls < kstr_cache_classes && kstr_cache_size(cls) < size)
+      cls++;
+
+   return cls;
+}
+
+static
+void *
+kstr_cache_get(
+      size_t cls)
+{
+   if (cls >= kstr_cache_classes || kstr_cache.lists[cls] == NULL)
+      return NULL;
+
+   void * ptr = kstr_cache.lists[cls];
+   kstr_cache.lists[cls] = *(void **) ptr;
+   kstr_cache.size -= kstr_cache_size(cls);
+   return ptr;
+}
+
+static
+void
+kstr_cache_key_create(void)
+{
+   kstr_cache_keyed = pthread_key_create(&kstr_cache_key, kstr_cache_exit) == 0;
+}
+
+size_t
+kstr_cache_limit(
+      size_t limit)
+{
+   size_t const old_limit = kstr_cache.limit;
+   kstr_cache.limit = limit;
+   if (kstr_cache.size > limit)
+      kstr_cache_purge();
+
+   return old_limit;
+}
+
+size_t
+kstr_cache_purge(void)
+{
+   size_t const size = kstr_cache.size;
+   for (size_t cls = 0; cls < kstr_cache_classes; cls++)
+   {
+      while (kstr_cache.lists[cls] != NULL)
+      {
+         void * ptr = kstr_cache.lists[cls];
+         kstr_cache.lists[cls] = *(void **) ptr;
+         free(ptr);
+      }
+   }
+
+   kstr_cache.size = 0;
+   return size;
+}
+
+static
+void
+kstr_cache_put(
+      void * ptr,
+      size_t cls)
+{
+   if (
+         cls >= kstr_cache_classes ||
+         kstr_cache_size(cls) > kstr_cache.limit - kstr_cache.size)
+   {
+      free(ptr);
+      return;
+   }
+
+   // make sure the cache is freed when the thread exits before keeping
+   // anything in it
+   if (!kstr_cache.registered)
+   {
+      pthread_once(&kstr_cache_once, kstr_cache_key_create);
+      if (
+            !kstr_cache_keyed ||
+            pthread_setspecific(kstr_cache_key, &kstr_cache) != 0)
+      {
+         free(ptr);
+         return;
+      }
+
+      kstr_cache.registered = true;
+   }
+
+   *(void **) ptr = kstr_cache.lists[cls];
+   kstr_cache.lists[cls] = ptr;
+   kstr_cache.size += kstr_cache_size(cls);
+}
+
+static
+size_t
+kstr_cache_size(
+      size_t cls)
+{
+   if (cls == kstr_cache_object)
+      return sizeof(kstr);
+
+   return (size_t) kstr_inline_size << cls;
+}
+
+size_t
+kstr_capacity(
+      kstr * this)
+{
+   return this->chunked + this->data_size;
+}
+
+static
+void
+kstr_changed(
+      kstr * this)
+{
+   this->generation++;
+}
+
+kstr *
+kstr_clone(
+      kstr * this)
+{
+   // clones share a single buffer
+   if (kstr_flatten(this) == NULL)
+      return NULL;
+
+   // short values and arena strings are cheap enough to copy
+   if (kstr_is_inline(this) || this->arena != NULL)
+      return kstr_copy(this);
+
+   // move the value into a shared buffer the first time it is cloned
+   if (this->shared == NULL)
+   {
+      struct kstr_shared * shared;
+      if (this->data_size > (size_t) -1 - sizeof(*shared))
+         return kstr_abort(&this);
+      if ((shared = kstr_alloc(NULL, sizeof(*shared) + this->data_size))
+            == NULL)
+         return kstr_abort(&this);
+
+      atomic_init(&shared->refs, 1);
+      memcpy(shared->data, this->data, this->used);
+      kstr_count(bytes_copied, this->used);
+      free(this->data);
+
+      this->data = shared->data;
+      this->shared = shared;
+   }
+
+   // allocate and initialize the clone, which refers to the same buffer
+   kstr * clone;
+   if ((clone = kstr_alloc_object(NULL)) == NULL)
+      return kstr_abort(&this);
+
+   clone->arena = NULL;
+   clone->basename = NULL;
+   clone->basename_generation = 0;
+   clone->basename_size = 0;
+   clone->chunked = 0;
+   clone->chunks = NULL;
+   clone->control_capacity = 0;
+   clone->control_count = 0;
+   clone->controls = NULL;
+   clone->generation = 1;
+   clone->hash = this->hash;
+   clone->hash_generation = (this->hash_generation == this->generation);
+   clone->style = this->style;
+   clone->style_forgotten = this->style_forgotten;
+   clone->interned = false;
+   clone->data = this->data;
+   clone->data_size = this->data_size;
+   clone->growth = this->growth;
+   clone->last_chunk = NULL;
+   clone->plain = NULL;
+   clone->plain_generation = 0;
+   clone->plain_size = 0;
+   clone->shared = this->shared;
+   clone->used = this->used;
+   clone->escape = this->escape;
+   clone->escapes = this->escapes;
+   clone->utf8_pending = this->utf8_pending;
+   clone->utf8_point = this->utf8_point;
+   clone->width = this->width;
+   kstr_control_copy(clone, this);
+
+   atomic_fetch_add(&this->shared->refs, 1);
+   return clone;
+}
+
+static
+bool
+kstr_color_equal(
+      kstr_style_color const * a,
+      kstr_style_color const * b)
+{
+   if (a->kind != b->kind)
+      return false;
+
+   switch (a->kind)
+   {
+      case kstr_color_kind_basic:
+         return a->basic == b->basic;
+
+      case kstr_color_kind_256:
+         return a->index == b->index;
+
+      case kstr_color_kind_rgb:
+         return a->red == b->red && a->green == b->green
+            && a->blue == b->blue;
+
+      default:
+         return false;
+   }
+}
+
+int
+kstr_compare(
+      kstr * this,
+      kstr * other)
+{
+   return kstr_view_compare(
+         kstr_get_view(this, 0, kstr_npos),
+         kstr_get_view(other, 0, kstr_npos));
+}
+
+kstr_concurrent *
+kstr_concurrent_add_bytes(
+      kstr_concurrent * this,
+      char const * bytes,
+      size_t count)
+{
+   if (bytes == NULL || count == 0)
+      return this;
+
+   struct kstr_segment * segment =
+      atomic_load_explicit(&this->tail, memory_order_acquire);
+   for (;;)
+   {
+      // reserve space, which only fails if the segment is full
+      size_t const offset = atomic_fetch_add_explicit(
+            &segment->reserved, count, memory_order_relaxed);
+      if (offset <= segment->size && count <= segment->size - offset)
+      {
+         // copy the bytes, then publish them after any earlier appends
+         memcpy(segment->data + offset, bytes, count);
+         kstr_concurrent_wait(segment, offset);
+         atomic_store_explicit(
+               &segment->committed, offset + count, memory_order_release);
+         return this;
+      }
+
+      if (offset <= segment->size)
+      {
+         // this reservation crossed the end, so it marks the segment's
+         // committed size as final once the earlier appends are published
+         kstr_concurrent_wait(segment, offset);
+         atomic_store_explicit(&segment->closed, true, memory_order_release);
+      }
+
+      if ((segment = kstr_concurrent_next(this, segment, count)) == NULL)
+         return NULL;
+   }
+}
+
+kstr_concurrent *
+kstr_concurrent_add_text(
+      kstr_concurrent * this,
+      char const * text)
+{
+   return kstr_concurrent_add_bytes(
+         this, text, text == NULL ? 0 : strlen(text));
+}
+
+kstr_concurrent *
+kstr_concurrent_add_view(
+      kstr_concurrent * this,
+      kstr_view view)
+{
+   return kstr_concurrent_add_bytes(this, view.ptr, view.len);
+}
+
+kstr_concurrent *
+kstr_concurrent_free(
+      kstr_concurrent ** ptr)
+{
+   if (ptr == NULL)
+      return NULL;
+
+   // set the pointer's target to null
+   kstr_concurrent * const this = *ptr;
+   *ptr = NULL;
+   if (this == NULL)
+      return NULL;
+
+   // free all segments and the concurrent string itself
+   struct kstr_segment * segment = this->head;
+   while (segment != NULL)
+   {
+      struct kstr_segment * const next =
+         atomic_load_explicit(&segment->next, memory_order_relaxed);
+      free(segment);
+      segment = next;
+   }
+
+   free(this);
+   return NULL;
+}
+
+kstr_concurrent *
+kstr_concurrent_new(
+      size_t segment_size)
+{
+   static size_t const default_segment_size = 64 * 1024;
+
+   kstr_concurrent * this;
+   if ((this = malloc(sizeof(*this))) == NULL)
+   {
+      kstr_abort(NULL);
+      return NULL;
+   }
+
+   this->segment_size =
+      (segment_size == 0) ? default_segment_size : segment_size;
+   this->head = NULL;
+   if ((this->head = kstr_concurrent_next(this, NULL, 0)) == NULL)
+   {
+      free(this);
+      return NULL;
+   }
+
+   return this;
+}
+
+static
+struct kstr_segment *
+kstr_concurrent_next(
+      kstr_concurrent * this,
+      struct kstr_segment * segment,
+      size_t count)
+{
+   struct kstr_segment * next = (segment == NULL) ?
+      NULL : atomic_load_explicit(&segment->next, memory_order_acquire);
+   if (next == NULL)
+   {
+      // allocate a segment that fits the append
+      size_t const size = (count > this->segment_size) ?
+         count : this->segment_size;
+      if (
+            size > (size_t) -1 - sizeof(*next) ||
+            (next = malloc(sizeof(*next) + size)) == NULL)
+      {
+         kstr_abort(NULL);
+         return NULL;
+      }
+
+      atomic_init(&next->next, NULL);
+      atomic_init(&next->reserved, 0);
+      atomic_init(&next->committed, 0);
+      atomic_init(&next->closed, false);
+      next->size = size;
+
+      if (segment == NULL)
+      {
+         atomic_init(&this->tail, next);
+         return next;
+      }
+
+      // link the new segment unless another thread linked one first
+      struct kstr_segment * expected = NULL;
+      if (
+            !atomic_compare_exchange_strong_explicit(
+               &segment->next,
+               &expected,
+               next,
+               memory_order_acq_rel,
+               memory_order_acquire))
+      {
+         free(next);
+         next = expected;
+      }
+   }
+
+   // move the tail along, unless another thread already did
+   struct kstr_segment * expected = segment;
+   atomic_compare_exchange_strong_explicit(
+         &this->tail,
+         &expected,
+         next,
+         memory_order_acq_rel,
+         memory_order_acquire);
+   return next;
+}
+
+size_t
+kstr_concurrent_size(
+      kstr_concurrent * this)
+{
+   size_t size = 0;
+   for (
+         struct kstr_segment * segment = this->head;
+         segment != NULL;
+         segment = atomic_load_explicit(&segment->next, memory_order_acquire))
+   {
+      bool const closed =
+         atomic_load_explicit(&segment->closed, memory_order_acquire);
+      size += atomic_load_explicit(&segment->committed, memory_order_acquire);
+      if (!closed)
+         break;
+   }
+
+   return size;
+}
+
+static
+void
+kstr_concurrent_wait(
+      struct kstr_segment * segment,
+      size_t offset)
+{
+   // earlier appends are usually only copying bytes, so spin for a while,
+   // then give up the processor in case one of them was preempted
+   for (
+         unsigned int spins = 0;
+         atomic_load_explicit(&segment->committed, memory_order_acquire) !=
+         offset;
+         spins++)
+   {
+      if (spins >= kstr_concurrent_spins)
+      {
+         sched_yield();
+         continue;
+      }
+
+#ifdef __SSE2__
+      _mm_pause();
+#endif
+   }
+}
+
+static
+void
+kstr_control_add(
+      kstr * this,
+      size_t pos,
+      size_t count)
+{
+   if (!this->controls_tracked || count == 0)
+      return;
+
+   // extend the last control code if the bytes follow it
+   if (this->control_count > 0)
+   {
+      struct kstr_control * const last =
+         &this->controls[this->control_count - 1];
+      if (last->pos + last->count == pos)
+      {
+         last->count += count;
+         return;
+      }
+   }
+
+   if (this->control_count == this->control_capacity)
+   {
+      size_t const capacity =
+         (this->control_capacity == 0) ? 8 : this->control_capacity * 2;
+      struct kstr_control * controls;
+      if (capacity > (size_t) -1 / sizeof(*controls)
+            || (controls = kstr_realloc(
+               this->arena,
+               this->controls,
+               this->control_capacity * sizeof(*controls),
+               capacity * sizeof(*controls))) == NULL)
+      {
+         // stop tracking the control codes if errors don't abort
+         kstr_abort(&this);
+         this->control_count = 0;
+         this->controls_tracked = false;
+         return;
+      }
+
+      this->controls = controls;
+      this->control_capacity = capacity;
+   }
+
+   this->controls[this->control_count++] = (struct kstr_control) { pos, count };
+}
+
+static
+void
+kstr_control_copy(
+      kstr * this_copy,
+      kstr const * this)
+{
+   this_copy->controls_tracked = this->controls_tracked;
+   if (this->control_count == 0)
+      return;
+
+   size_t const size = this->control_count * sizeof(*this->controls);
+   if ((this_copy->controls = kstr_realloc(
+         this_copy->arena, NULL, 0, size)) == NULL)
+   {
+      // the copy doesn't track its control codes if errors don't abort
+      kstr_abort(&this_copy);
+      this_copy->controls_tracked = false;
+      return;
+   }
+
+   memcpy(this_copy->controls, this->controls, size);
+   this_copy->control_capacity = this->control_count;
+   this_copy->control_count = this->control_count;
+}
+
+kstr *
+kstr_copy(
+      kstr * this)
+{
+   return kstr_copy_in(NULL, this);
+}
+
+kstr *
+kstr_copy_in(
+      kstr_arena * arena,
+      kstr * this)
+{
+   // copy the value from a single buffer
+   if (kstr_flatten(this) == NULL)
+      return NULL;
+
+   // allocate and initialize the string object
+   kstr * this_copy;
+   if ((this_copy = kstr_alloc_object(arena)) == NULL)
+      return kstr_abort(&this);
+
+   this_copy->arena = arena;
+   this_copy->basename = NULL;
+   this_copy->basename_generation = 0;
+   this_copy->basename_size = 0;
+   this_copy->chunked = 0;
+   this_copy->chunks = NULL;
+   this_copy->control_capacity = 0;
+   this_copy->control_count = 0;
+   this_copy->controls = NULL;
+   this_copy->generation = 1;
+   this_copy->hash = this->hash;
+   this_copy->hash_generation = (this->hash_generation == this->generation);
+   this_copy->style = this->style;
+   this_copy->style_forgotten = this->style_forgotten;
+   this_copy->interned = false;
+   this_copy->growth = this->growth;
+   this_copy->last_chunk = NULL;
+   this_copy->plain = NULL;
+   this_copy->plain_generation = 0;
+   this_copy->plain_size = 0;
+   this_copy->shared = NULL;
+   this_copy->used = this->used;
+   this_copy->escape = this->escape;
+   this_copy->escapes = this->escapes;
+   this_copy->utf8_pending = this->utf8_pending;
+   this_copy->utf8_point = this->utf8_point;
+   this_copy->width = this->width;
+
+   // allocate only as much buffer as the value needs, which may fit in the
+   // embedded buffer even if the original's doesn't
+   this_copy->data = this_copy->inline_data;
+   this_copy->data_size = sizeof(this_copy->inline_data);
+   if (this->used > this_copy->data_size)
+   {
+      size_t size = this->used;
+      if ((this_copy->data = kstr_alloc_data(arena, &size)) == NULL)
+      {
+         this_copy->data = this_copy->inline_data;
+         kstr_free(&this_copy);
+         return kstr_abort(&this);
+      }
+
+      this_copy->data_size = size;
+   }
+
+   memcpy(this_copy->data, this->data, this->used);
+   kstr_count(bytes_copied, this->used);
+   kstr_control_copy(this_copy, this);
+   return this_copy;
+}
+
+static
+kstr *
+kstr_cut(
+      kstr * this,
+      size_t size)
+{
+   size_t const count = this->used - 1 - size;
+   if (count == 0)
+      return this;
+
+   // the cut-off bytes count from the scanner state where they start
+   struct kstr_scanner scanner = { 0, 0, kstr_escape_none };
+   kstr_span_width(this, 0, size, &scanner);
+   struct kstr_scanner const kept = scanner;
+   size_t const width = kstr_span_width(this, size, count, &scanner);
+   this->width = (width < this->width) ? this->width - width : 0;
+   this->used = size + 1;
+   this->data[size] = '\0';
+   this->escape = kept.escape;
+   this->utf8_pending = kept.utf8_pending;
+   this->utf8_point = kept.utf8_point;
+   kstr_forget_style(this);
+
+   // forget the control codes that were cut off
+   while (this->control_count > 0
+         && this->controls[this->control_count - 1].pos >= size)
+      this->control_count--;
+   if (this->control_count > 0)
+   {
+      struct kstr_control * const last =
+         &this->controls[this->control_count - 1];
+      if (last->count > size - last->pos)
+         last->count = size - last->pos;
+   }
+
+   kstr_changed(this);
+   return this;
+}
+
+static
+size_t
+kstr_decimal_digits(
+      uintmax_t value)
+{
+   size_t digits = 1;
+   for (; value >= 100; value /= 100)
+      digits += 2;
+
+   return digits + (value >= 10);
+}
+
+static
+kstr *
+kstr_detach(
+      kstr * this,
+      kstr_view * view,
+      char ** copy)
+{
+   *copy = NULL;
+   uintptr_t const offset = (uintptr_t) view->ptr - (uintptr_t) this->data;
+   if (view->len == 0 || offset >= this->data_size)
+      return this;
+
+   if ((*copy = malloc(view->len)) == NULL)
+      return kstr_abort(&this);
+
+   memcpy(*copy, view->ptr, view->len);
+   view->ptr = *copy;
+   return this;
+}
+
+kstr_view
+kstr_dirname(
+      kstr * this)
+{
+   if (kstr_flatten(this) == NULL)
+      return (kstr_view) { NULL, 0 };
+
+   char const * const data = this->data;
+   size_t end = this->used - 1;
+   if (end == 0)
+      return (kstr_view) { ".", 1 };
+
+   // skip trailing slashes
+   while (end > 0 && data[end - 1] == '/')
+      end--;
+   if (end == 0)
+      return (kstr_view) { "/", 1 };
+
+   // skip the basename
+   while (end > 0 && data[end - 1] != '/')
+      end--;
+   if (end == 0)
+      return (kstr_view) { ".", 1 };
+
+   // skip the slashes separating the directory name from the basename
+   while (end > 0 && data[end - 1] == '/')
+      end--;
+   if (end == 0)
+      return (kstr_view) { "/", 1 };
+
+   return (kstr_view) { data, end };
+}
+
+static
+struct kstr_diy
+kstr_diy_times(
+      struct kstr_diy x,
+      struct kstr_diy y)
+{
+   // multiply the 32-bit halves of the significands, rounding the lower half
+   uint64_t const mask = UINT64_C(0xffffffff);
+   uint64_t const a = x.f >> 32;
+   uint64_t const b = x.f & mask;
+   uint64_t const c = y.f >> 32;
+   uint64_t const d = y.f & mask;
+   uint64_t const ad = a * d;
+   uint64_t const bc = b * c;
+   uint64_t const middle =
+      ((b * d) >> 32) + (ad & mask) + (bc & mask) + (UINT64_C(1) << 31);
+
+   return (struct kstr_diy) {
+      a * c + (ad >> 32) + (bc >> 32) + (middle >> 32),
+      x.e + y.e + 64
+   };
+}
+
+bool
+kstr_equal(
+      kstr * this,
+      kstr * other)
+{
+   // values of different sizes differ without looking at them
+   if (kstr_size(this) != kstr_size(other))
+      return false;
+
+   return kstr_view_equal(
+         kstr_get_view(this, 0, kstr_npos),
+         kstr_get_view(other, 0, kstr_npos));
+}
+
+kstr *
+kstr_erase(
+      kstr * this,
+      size_t pos,
+      size_t count)
+{
+   return kstr_replace_range(this, pos, count, (kstr_view) { "", 0 });
+}
+
+static
+void
+kstr_escape_step(
+      enum kstr_escape * escape,
+      unsigned char byte)
+{
+   switch (*escape)
+   {
+      case kstr_escape_start:
+         if (byte == '[')
+            *escape = kstr_escape_csi;
+         else if (
+               byte == ']' || byte == 'P' || byte == 'X' || byte == '^' ||
+               byte == '_')
+            *escape = kstr_escape_string;
+         else if (byte >= 0x20 && byte <= 0x2f)
+            *escape = kstr_escape_nf;
+         else if (byte != 0x1b)
+            *escape = kstr_escape_none;
+         break;
+
+      case kstr_escape_nf:
+         // intermediate bytes continue until a final byte
+         if (byte < 0x20 || byte > 0x2f)
+            *escape = kstr_escape_none;
+         break;
+
+      case kstr_escape_csi:
+         // parameter and intermediate bytes continue until a final byte
+         if (byte >= 0x40 && byte <= 0x7e)
+            *escape = kstr_escape_none;
+         break;
+
+      case kstr_escape_string:
+         // control strings end with a bell or a string terminator (`ESC \`)
+         if (byte == 0x07)
+            *escape = kstr_escape_none;
+         else if (byte == 0x1b)
+            *escape = kstr_escape_string_esc;
+         break;
+
+      case kstr_escape_string_esc:
+         if (byte == '\\')
+            *escape = kstr_escape_none;
+         else if (byte != 0x1b)
+            *escape = kstr_escape_string;
+         break;
+
+      default:
+         *escape = kstr_escape_none;
+         break;
+   }
+}
+
+kstr_view
+kstr_extension(
+      kstr * this)
+{
+   kstr_view const base = kstr_basename_view(this);
+   if (base.ptr == NULL)
+      return base;
+
+   kstr_view const none = { base.ptr + base.len, 0 };
+
+   // "." and ".." are not names with extensions
+   if (kstr_view_equal(base, kstr_view_text(".")))
+      return none;
+   if (kstr_view_equal(base, kstr_view_text("..")))
+      return none;
+
+   // the extension starts at the last dot, unless it begins the name
+   size_t pos = base.len;
+   while (pos > 0 && base.ptr[pos - 1] != '.')
+      pos--;
+   if (pos <= 1)
+      return none;
+
+   return kstr_view_sub(base, pos - 1, kstr_npos);
+}
+
+static
+kstr *
+kstr_fail(
+      kstr ** ptr,
+      int error)
+{
+   if (atomic_load_explicit(&kstr_errors, memory_order_relaxed)
+         == kstr_error_return)
+   {
+      errno = error;
+      return NULL;
+   }
+
+   abort();
+   return kstr_free(ptr);
+}
+
+size_t
+kstr_find(
+      kstr * this,
+      kstr_view needle,
+      size_t pos)
+{
+   return kstr_view_find(kstr_get_view(this, 0, kstr_npos), needle, pos);
+}
+
+static
+size_t
+kstr_find_any(
+      kstr_view view,
+      kstr_view delimiters,
+      size_t pos)
+{
+   if (delimiters.len == 0)
+      return kstr_npos;
+   if (delimiters.len == 1)
+      return kstr_view_find_char(view, delimiters.ptr[0], pos);
+
+   unsigned char const * const bytes = (unsigned char const *) view.ptr;
+   size_t i = pos;
+
+#ifdef __SSE2__
+   // compare 16 bytes at a time with each of a few delimiters
+   if (delimiters.len <= kstr_split_vector)
+   {
+      __m128i sets[kstr_split_vector];
+      for (size_t k = 0; k < delimiters.len; k++)
+         sets[k] = _mm_set1_epi8(delimiters.ptr[k]);
+
+      for (; view.len - i >= 16; i += 16)
+      {
+         __m128i const chunk = _mm_loadu_si128((__m128i const *) (bytes + i));
+         __m128i hits = _mm_cmpeq_epi8(chunk, sets[0]);
+         for (size_t k = 1; k < delimiters.len; k++)
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, sets[k]));
+
+         unsigned int const mask = (unsigned int) _mm_movemask_epi8(hits);
+         if (mask != 0)
+            return i + (size_t) __builtin_ctz(mask);
+      }
+   }
+#endif
+
+   // look the remaining bytes up in a bitmap of the delimiters
+   uint64_t table[4] = { 0, 0, 0, 0 };
+   for (size_t k = 0; k < delimiters.len; k++)
+   {
+      unsigned char const byte = (unsigned char) delimiters.ptr[k];
+      table[byte >> 6] |= UINT64_C(1) << (byte & 63);
+   }
+
+   for (; i < view.len; i++)
+      if ((table[bytes[i] >> 6] >> (bytes[i] & 63)) & 1)
+         return i;
+
+   return kstr_npos;
+}
+
+size_t
+kstr_find_char(
+      kstr * this,
+      char c,
+      size_t pos)
+{
+   return kstr_view_find_char(kstr_get_view(this, 0, kstr_npos), c, pos);
+}
+
+static
+kstr *
+kstr_flatten(
+      kstr * this)
+{
+   if (this->chunks == NULL)
+      return this;
+
+   // copy the chunks and the rest of the value into a buffer of its own
+   size_t const size = this->chunked + this->used;
+   char * data;
+   if ((data = kstr_alloc(this->arena, size)) == NULL)
+      return kstr_abort(&this);
+
+   char * end = data;
+   for (struct kstr_chunk * chunk = this->chunks; chunk; chunk = chunk->next)
+   {
+      memcpy(end, chunk->data, chunk->count);
+      end += chunk->count;
+   }
+
+   memcpy(end, this->data, this->used);
+   kstr_count(bytes_copied, size);
+   kstr_release(this);
+   kstr_release_chunks(this);
+
+   this->data = data;
+   this->data_size = size;
+   this->used = size;
+   return this;
+}
+
+kstr_fmt *
+kstr_fmt_compile(
+      char const * fmt)
+{
+   if (fmt == NULL)
+      return NULL;
+
+   // count the items and characters before allocating
+   size_t num_items;
+   size_t num_chars;
+   if (!kstr_fmt_parse(fmt, NULL, &num_items, &num_chars))
+      return NULL;
+
+   size_t const items_size = num_items * sizeof(struct kstr_fmt_item);
+   kstr_fmt * compiled;
+   if ((compiled = malloc(sizeof(*compiled) + items_size + num_chars)) == NULL)
+   {
+      kstr_abort(NULL);
+      return NULL;
+   }
+
+   // the characters are stored after the items
+   compiled->num_items = num_items;
+   compiled->chars = (char *) compiled->items + items_size;
+   kstr_fmt_parse(fmt, compiled, &num_items, &num_chars);
+   return compiled;
+}
+
+kstr_fmt *
+kstr_fmt_free(
+      kstr_fmt ** ptr)
+{
+   if (ptr == NULL)
+      return NULL;
+
+   // set the pointer's target to null
+   kstr_fmt * const compiled = *ptr;
+   *ptr = NULL;
+   free(compiled);
+   return NULL;
+}
+
+static
+bool
+kstr_fmt_parse(
+      char const * fmt,
+      kstr_fmt * compiled,
+      size_t * num_items,
+      size_t * num_chars)
+{
+   size_t items = 0;
+   size_t chars = 0;
+   bool literal = false;
+
+   char const * next = fmt;
+   while (*next != '\0')
+   {
+      // add a literal character, treating `%%` as a literal percent sign
+      if (next[0] != '%' || next[1] == '%')
+      {
+         if (!literal && compiled != NULL)
+            compiled->items[items] = (struct kstr_fmt_item)
+               { .offset = chars, .arg = kstr_arg_none };
+         if (!literal)
+            items++;
+         literal = true;
+
+         if (compiled != NULL)
+         {
+            compiled->chars[chars] = next[0];
+            compiled->items[items - 1].count++;
+         }
+
+         chars++;
+         next += (next[0] == '%') ? 2 : 1;
+         continue;
+      }
+
+      // parse the flags, width, and precision of a conversion
+      char const * const spec = next++;
+      struct kstr_fmt_item item = { .offset = chars, .precision = 6 };
+      bool plain = true;
+      while (*next != '\0' && strchr("-+ #0'", *next) != NULL)
+      {
+         plain = false;
+         next++;
+      }
+
+      if (*next == '*')
+      {
+         item.stars++;
+         next++;
+      }
+      else
+         while (*next >= '0' && *next <= '9')
+         {
+            plain = false;
+            next++;
+         }
+
+      // positional arguments aren't supported
+      if (*next == '$')
+         return false;
+
+      bool precise = false;
+      if (*next == '.')
+      {
+         precise = true;
+         if (*++next == '*')
+         {
+            item.stars++;
+            next++;
+         }
+         else
+         {
+            item.precision = 0;
+            while (*next >= '0' && *next <= '9')
+            {
+               if (item.precision < 1000)
+                  item.precision = item.precision * 10 + (*next - '0');
+               next++;
+            }
+         }
+      }
+
+      plain = plain && item.stars == 0;
+
+      // parse the length modifier, trying longer modifiers first
+      static char const lengths[][3] =
+         { "", "h", "hh", "l", "ll", "j", "z", "t", "L" };
+      size_t length = 0;
+      for (size_t i = sizeof(lengths) / sizeof(*lengths) - 1; i > 0; i--)
+      {
+         size_t const count = strlen(lengths[i]);
+         if (strncmp(next, lengths[i], count) == 0)
+         {
+            length = i;
+            next += count;
+            break;
+         }
+      }
+
+      // find the argument type of the conversion
+      static enum kstr_arg const signed_args[] =
+      {
+         kstr_arg_int, kstr_arg_int, kstr_arg_int, kstr_arg_long,
+         kstr_arg_llong, kstr_arg_intmax, kstr_arg_ssize, kstr_arg_ptrdiff,
+         kstr_arg_none
+      };
+      static enum kstr_arg const unsigned_args[] =
+      {
+         kstr_arg_uint, kstr_arg_uint, kstr_arg_uint, kstr_arg_ulong,
+         kstr_arg_ullong, kstr_arg_uintmax, kstr_arg_size, kstr_arg_uptrdiff,
+         kstr_arg_none
+      };
+      if (*next == '\0')
+         return false;
+
+      bool const whole = length != 1 && length != 2 && length != 8;
+      item.conversion = *next;
+      switch (*next++)
+      {
+         case 'd':
+         case 'i':
+            item.arg = signed_args[length];
+            item.fast = plain && !precise && whole;
+            break;
+
+         case 'o':
+         case 'u':
+         case 'x':
+         case 'X':
+            item.arg = unsigned_args[length];
+            item.fast =
+               plain && !precise && whole && item.conversion != 'o' &&
+               item.conversion != 'X';
+            break;
+
+         case 'a':
+         case 'A':
+         case 'e':
+         case 'E':
+         case 'f':
+         case 'F':
+         case 'g':
+         case 'G':
+            if (length == 8)
+               item.arg = kstr_arg_ldouble;
+            else if (length == 0 || length == 3)
+               item.arg = kstr_arg_double;
+            item.fast =
+               plain && item.conversion == 'f' && item.arg == kstr_arg_double;
+            break;
+
+         case 'c':
+            item.arg = (length == 0) ? kstr_arg_int :
+               (length == 3) ? kstr_arg_wint : kstr_arg_none;
+            item.fast = plain && !precise && length == 0;
+            break;
+
+         case 's':
+            item.arg = (length == 0) ? kstr_arg_string :
+               (length == 3) ? kstr_arg_wstring : kstr_arg_none;
+            item.fast = plain && !precise && length == 0;
+            break;
+
+         case 'p':
+            item.arg = (length == 0) ? kstr_arg_pointer : kstr_arg_none;
+            break;
+
+         default:
+            break;
+      }
+
+      // reject unknown conversions, invalid length modifiers, and `%%n`
+      if (item.arg == kstr_arg_none)
+         return false;
+
+      // store the specification with a terminating nul
+      item.count = (size_t) (next - spec);
+      if (compiled != NULL)
+      {
+         memcpy(compiled->chars + chars, spec, item.count);
+         compiled->chars[chars + item.count] = '\0';
+         compiled->items[items] = item;
+      }
+
+      items++;
+      chars += item.count + 1;
+      literal = false;
+   }
+
+   *num_items = items;
+   *num_chars = chars;
+   return true;
+}
+
+static
+void
+kstr_forget_style(
+      kstr * this)
+{
+   this->style = (kstr_style) { 0 };
+   this->style_forgotten = true;
+}
+
+kstr *
+kstr_free(
+      kstr ** ptr)
+{
+   if (ptr == NULL)
+      return NULL;
+
+   // set the pointer's target to null
+   kstr * this = *ptr;
+   *ptr = NULL;
+   if (this == NULL || this->interned)
+      return NULL;
+
+#ifdef kstr_instrument
+   // count how many bytes of the buffer the string never used
+   size_t waste = kstr_capacity(this) - kstr_size(this);
+   size_t bucket = 0;
+   for (waste /= 16; waste > 0 && bucket < kstr_waste_buckets - 1; waste /= 4)
+      bucket++;
+   kstr_thread_stats.waste[bucket]++;
+#endif
+
+   // free allocated memory (arena memory is released with the arena)
+   kstr_release(this);
+   kstr_release_chunks(this);
+   if (this->arena == NULL)
+   {
+      free(this->basename);
+      free(this->controls);
+      free(this->plain);
+      kstr_cache_put(this, kstr_cache_object);
+   }
+
+   return NULL;
+}
+
+char const *
+kstr_get(
+      kstr * this)
+{
+   if (kstr_flatten(this) == NULL)
+      return NULL;
+   return this->data;
+}
+
+size_t
+kstr_get_chunks(
+      kstr * this,
+      kstr_view * chunks,
+      size_t max)
+{
+   size_t count = 0;
+   for (struct kstr_chunk * chunk = this->chunks; chunk; chunk = chunk->next)
+   {
+      if (count < max)
+         chunks[count] = (kstr_view) { chunk->data, chunk->count };
+      count++;
+   }
+
+   // the rest of the value follows the chunks
+   if (this->used > 1)
+   {
+      if (count < max)
+         chunks[count] = (kstr_view) { this->data, this->used - 1 };
+      count++;
+   }
+
+   return count;
+}
+
+char *
+kstr_get_copy(
+      kstr * this)
+{
+   if (kstr_flatten(this) == NULL)
+      return NULL;
+
+   char * data_copy;
+   if ((data_copy = malloc(this->used)) == NULL)
+   {
+      kstr_abort(&this);
+      return NULL;
+   }
+
+   memcpy(data_copy, this->data, this->used);
+   return data_copy;
+}
+
+kstr_view
+kstr_get_plain(
+      kstr * this)
+{
+   if (kstr_flatten(this) == NULL)
+      return (kstr_view) { "", 0 };
+
+   // without control codes, the value is already plain
+   if (this->controls_tracked && this->control_count == 0)
+      return (kstr_view) { this->data, this->used - 1 };
+
+   // use the cached copy if the value hasn't changed since it was made
+   if (this->plain_generation == this->generation)
+      return (kstr_view) { this->plain, this->plain_count };
+
+   // make room for the copy, reusing the cache's storage if possible
+   if (this->plain_size < this->used)
+   {
+      char * new_plain;
+      if (
+            (new_plain = kstr_realloc(
+               this->arena,
+               this->plain,
+               this->plain_size,
+               this->used)) == NULL)
+      {
+         kstr_abort(&this);
+         return (kstr_view) { "", 0 };
+      }
+
+      this->plain = new_plain;
+      this->plain_size = this->used;
+   }
+
+   size_t const size = this->used - 1;
+   size_t count = 0;
+   if (this->controls_tracked)
+   {
+      // copy the bytes between the recorded control codes
+      size_t read = 0;
+      for (size_t i = 0; i < this->control_count; i++)
+      {
+         struct kstr_control const * const control = &this->controls[i];
+         memcpy(this->plain + count, this->data + read, control->pos - read);
+         count += control->pos - read;
+         read = control->pos + control->count;
+      }
+
+      memcpy(this->plain + count, this->data + read, size - read);
+      count += size - read;
+   }
+   else
+   {
+      // after an edit, find the control codes by scanning for escape
+      // sequences instead
+      enum kstr_escape escape = kstr_escape_none;
+      for (size_t i = 0; i < size; i++)
+      {
+         unsigned char const byte = (unsigned char) this->data[i];
+         if (escape != kstr_escape_none)
+            kstr_escape_step(&escape, byte);
+         else if (byte == 0x1b)
+            escape = kstr_escape_start;
+         else
+            this->plain[count++] = (char) byte;
+      }
+   }
+
+   // cache a nul-terminated copy of the plain value
+   this->plain[count] = '\0';
+   this->plain_count = count;
+   this->plain_generation = this->generation;
+   return (kstr_view) { this->plain, count };
+}
+
+kstr_view
+kstr_get_view(
+      kstr * this,
+      size_t pos,
+      size_t count)
+{
+   if (kstr_flatten(this) == NULL)
+      return (kstr_view) { "", 0 };
+
+   return kstr_view_sub(
+         (kstr_view) { this->data, this->used - 1 }, pos, count);
+}
+
+bool
+kstr_getline(
+      kstr * this,
+      FILE * file)
+{
+   // make sure the buffer isn't shared with any clones
+   if (kstr_grow(this, 0) == NULL)
+      return false;
+
+   // read characters straight into the available space, growing the buffer
+   // whenever it fills up before the end of the line
+   bool line = false;
+   int c = 0;
+   flockfile(file);
+   while (c != '\n')
+   {
+      if (kstr_available(this) == 0 && kstr_grow(this, 1) == NULL)
+      {
+         funlockfile(file);
+         return false;
+      }
+
+      char * const end = this->data + this->used - 1;
+      size_t count = 0;
+      size_t const available = kstr_available(this);
+      while (count < available && (c = getc_unlocked(file)) != EOF)
+      {
+         end[count++] = (char) c;
+         if (c == '\n')
+            break;
+      }
+
+      if (count > 0)
+      {
+         this->used += count;
+         this->data[this->used - 1] = '\0';
+         kstr_added(this, end, count, true);
+         kstr_changed(this);
+         line = true;
+      }
+
+      if (c == EOF)
+         break;
+   }
+
+   funlockfile(file);
+   return line;
+}
+
+static
+kstr *
+kstr_grow(
+      kstr * this,
+      size_t count)
+{
+   // a chunked string starts a new buffer instead of resizing a full one,
+   // unless the buffer is shared, since \a data then points into a shared
+   // allocation (even once the clones are gone) that can't become a chunk
+   if (
+         this->growth == kstr_growth_chunked &&
+         kstr_available(this) < count &&
+         !kstr_is_inline(this) &&
+         this->shared == NULL &&
+         this->used > 1)
+      return kstr_add_chunk(this, count);
+
+   return kstr_grow_flat(this, count);
+}
+
+static
+kstr *
+kstr_grow_flat(
+      kstr * this,
+      size_t count)
+{
+   bool const shared =
+      this->shared != NULL && atomic_load(&this->shared->refs) > 1;
+   if (kstr_available(this) >= count && !shared)
+      return this;
+
+   // safely calculate the minimum size of the new buffer
+   if (count > (size_t) -1 - this->used)
+      return kstr_abort(&this);
+
+   size_t const min_size = this->used + count;
+   size_t new_data_size = this->data_size;
+   if (new_data_size >= min_size)
+      return kstr_resize(this, new_data_size);
+
+   // calculate the size of the new buffer using the growth policy
+   switch (this->growth)
+   {
+      case kstr_growth_chunked:
+         if (new_data_size < kstr_chunk_size)
+            new_data_size = kstr_chunk_size;
+         if (new_data_size < min_size)
+            new_data_size = min_size;
+         break;
+
+      case kstr_growth_page:
+      {
+         long const page_size = sysconf(_SC_PAGESIZE);
+         size_t const page = (page_size > 0) ? (size_t) page_size : 4096;
+         if (min_size > (size_t) -1 - (page - 1))
+            new_data_size = min_size;
+         else
+            new_data_size = (min_size + page - 1) / page * page;
+         break;
+      }
+
+      case kstr_growth_half:
+         while (new_data_size < min_size)
+            if (new_data_size > (size_t) -1 - new_data_size / 2)
+               new_data_size = min_size;
+            else
+               new_data_size += new_data_size / 2;
+         break;
+
+      default:
+         while (new_data_size < min_size)
+            if (new_data_size > (size_t) -1 / 2)
+               new_data_size = min_size;
+            else
+               new_data_size *= 2;
+         break;
+   }
+
+   return kstr_resize(this, new_data_size);
+}
+
+uint64_t
+kstr_hash(
+      kstr * this)
+{
+   // the hash is calculated again only after the value changes
+   if (this->hash_generation != this->generation)
+   {
+      this->hash = kstr_view_hash(kstr_get_view(this, 0, kstr_npos));
+      this->hash_generation = this->generation;
+   }
+
+   return this->hash;
+}
+
+static
+bool
+kstr_in_ranges(
+      uint32_t point,
+      struct kstr_range const * ranges,
+      size_t count)
+{
+   if (count == 0 || point < ranges[0].first || point > ranges[count - 1].last)
+      return false;
+
+   // binary search for the range that could contain the code point
+   size_t low = 0;
+   size_t high = count;
+   while (low < high)
+   {
+      size_t const mid = low + (high - low) / 2;
+      if (point > ranges[mid].last)
+         low = mid + 1;
+      else if (point < ranges[mid].first)
+         high = mid;
+      else
+         return true;
+   }
+
+   return false;
+}
+
+kstr *
+kstr_insert(
+      kstr * this,
+      size_t pos,
+      kstr_view text)
+{
+   return kstr_replace_range(this, pos, 0, text);
+}
+
+kstr_intern *
+kstr_intern_free(
+      kstr_intern ** ptr)
+{
+   if (ptr == NULL)
+      return NULL;
+
+   // set the pointer's target to null
+   kstr_intern * table = *ptr;
+   *ptr = NULL;
+   if (table == NULL)
+      return NULL;
+
+   // destroy the interned strings along with the table
+   for (size_t i = 0; i < table->capacity; i++)
+   {
+      kstr * str = table->slots[i].str;
+      if (str == NULL)
+         continue;
+
+      str->interned = false;
+      kstr_free(&str);
+   }
+
+   free(table->slots);
+   free(table);
+   return NULL;
+}
+
+kstr *
+kstr_intern_get(
+      kstr_intern * table,
+      kstr_view view)
+{
+   uint64_t const hash = kstr_view_hash(view);
+
+   // look for an equal value. the table is kept at most three quarters full,
+   // so there is always an empty slot to stop at
+   size_t mask = table->capacity - 1;
+   size_t i = (size_t) hash & mask;
+   for (; table->slots[i].str != NULL; i = (i + 1) & mask)
+   {
+      struct kstr_intern_slot const * const slot = &table->slots[i];
+      if (
+            slot->hash == hash &&
+            kstr_view_equal(kstr_get_view(slot->str, 0, kstr_npos), view))
+         return slot->str;
+   }
+
+   // grow only to insert, and find the empty slot in the larger table
+   if (table->count + 1 > table->capacity / 4 * 3)
+   {
+      if (kstr_intern_grow(table) == NULL)
+         return NULL;
+
+      mask = table->capacity - 1;
+      i = (size_t) hash & mask;
+      while (table->slots[i].str != NULL)
+         i = (i + 1) & mask;
+   }
+
+   // intern a new string in the empty slot
+   kstr * str;
+   if ((str = kstr_new_in(table->arena, NULL)) == NULL)
+      return NULL;
+   if (kstr_add_bytes(str, view.ptr, view.len) == NULL)
+      return kstr_free(&str);
+
+   str->hash = hash;
+   str->hash_generation = str->generation;
+   str->interned = true;
+
+   table->slots[i] = (struct kstr_intern_slot) { hash, str };
+   table->count++;
+   return str;
+}
+
+static
+kstr_intern *
+kstr_intern_grow(
+      kstr_intern * table)
+{
+   size_t const capacity = table->capacity * 2;
+   struct kstr_intern_slot * slots;
+   if (
+         capacity > (size_t) -1 / sizeof(*slots) ||
+         (slots = calloc(capacity, sizeof(*slots))) == NULL)
+   {
+      kstr_abort(NULL);
+      return NULL;
+   }
+
+   // move each string to its slot in the larger table
+   size_t const mask = capacity - 1;
+   for (size_t i = 0; i < table->capacity; i++)
+   {
+      struct kstr_intern_slot const slot = table->slots[i];
+      if (slot.str == NULL)
+         continue;
+
+      size_t j = (size_t) slot.hash & mask;
+      while (slots[j].str != NULL)
+         j = (j + 1) & mask;
+      slots[j] = slot;
+   }
+
+   free(table->slots);
+   table->capacity = capacity;
+   table->slots = slots;
+   return table;
+}
+
+kstr_intern *
+kstr_intern_new(
+      kstr_arena * arena)
+{
+   static size_t const initial_capacity = 64;
+
+   kstr_intern * table;
+   if ((table = malloc(sizeof(*table))) == NULL)
+   {
+      kstr_abort(NULL);
+      return NULL;
+   }
+
+   if ((table->slots = calloc(initial_capacity, sizeof(*table->slots))) == NULL)
+   {
+      free(table);
+      kstr_abort(NULL);
+      return NULL;
+   }
+
+   table->arena = arena;
+   table->capacity = initial_capacity;
+   table->count = 0;
+   return table;
+}
+
+size_t
+kstr_intern_size(
+      kstr_intern * table)
+{
+   return table->count;
+}
+
+static
+bool
+kstr_is_inline(
+      kstr * this)
+{
+   return this->data == this->inline_data;
+}
+
+kstr *
+kstr_join(
+      kstr * this,
+      kstr_view const * pieces,
+      size_t n,
+      kstr_view separator)
+{
+   if (n == 0)
+      return this;
+
+   // add up the size of the joined pieces to grow the buffer once
+   size_t total = 0;
+   for (size_t i = 0; i < n; i++)
+   {
+      size_t const count = pieces[i].len + ((i > 0) ? separator.len : 0);
+      if (count > (size_t) -1 - total)
+         return kstr_abort(&this);
+      total += count;
+   }
+
+   // remember where the string's own buffer is, since growing may move
+   // characters of pieces taken from it
+   uintptr_t const old_data = (uintptr_t) this->data;
+   size_t const old_data_size = this->data_size;
+   if (kstr_grow(this, total) == NULL)
+      return NULL;
+
+   bool const moved = kstr_moved(this, (char const *) old_data);
+   if (moved && (uintptr_t) separator.ptr - old_data < old_data_size)
+      separator.ptr = this->data + ((uintptr_t) separator.ptr - old_data);
+
+   char * const start = this->data + this->used - 1;
+   char * end = start;
+   for (size_t i = 0; i < n; i++)
+   {
+      if (i > 0 && separator.len > 0)
+      {
+         memcpy(end, separator.ptr, separator.len);
+         end += separator.len;
+      }
+
+      char const * chars = pieces[i].ptr;
+      uintptr_t const offset = (uintptr_t) chars - old_data;
+      if (moved && offset < old_data_size)
+         chars = this->data + offset;
+
+      if (pieces[i].len > 0)
+         memcpy(end, chars, pieces[i].len);
+      end += pieces[i].len;
+   }
+
+   this->used += total;
+   this->data[this->used - 1] = '\0';
+   kstr_added(this, start, total, true);
+   kstr_changed(this);
+
+   // the joined bytes may set attributes that aren't tracked
+   if (total > 0)
+      kstr_forget_style(this);
+
+   return this;
+}
+
+static
+struct kstr_mark
+kstr_mark_end(
+      kstr * this)
+{
+   return (struct kstr_mark)
+   {
+      .used = this->used,
+      .chunked = this->chunked,
+      .last_chunk = this->last_chunk,
+      .width = this->width,
+      .utf8_point = this->utf8_point,
+      .utf8_pending = this->utf8_pending,
+      .escape = this->escape,
+      .style = this->style,
+      .style_forgotten = this->style_forgotten,
+      .control_count = this->control_count,
+      .control_last = (this->control_count > 0)
+         ? this->controls[this->control_count - 1].count : 0,
+      .controls_tracked = this->controls_tracked
+   };
+}
+
+static
+size_t
+kstr_measure(
+      kstr * this,
+      char const * chars,
+      size_t count)
+{
+   unsigned char const * const bytes = (unsigned char const *) chars;
+   size_t width = 0;
+
+   size_t i = 0;
+   while (i < count)
+   {
+      if (this->utf8_pending == 0 && this->escape == kstr_escape_none)
+      {
+         // skip over printable ascii text in bulk
+         size_t const run = kstr_ascii_run(bytes + i, count - i);
+         width += run;
+         if ((i += run) == count)
+            break;
+      }
+
+      unsigned char const byte = bytes[i];
+
+      // the attributes an untracked control code sets aren't known
+      if (byte == 0x1b)
+         kstr_forget_style(this);
+
+      if (this->escape != kstr_escape_none
+            || (byte == 0x1b && this->escapes && this->utf8_pending == 0))
+      {
+         // escape sequences in text are control codes too
+         if (this->controls_tracked)
+            kstr_control_add(
+                  this, this->chunked + (size_t) (chars - this->data) + i, 1);
+      }
+
+      if (this->escape != kstr_escape_none)
+         kstr_escape_step(&this->escape, byte);
+      else if (byte == 0x1b && this->escapes && this->utf8_pending == 0)
+         this->escape = kstr_escape_start;
+      else if (!kstr_utf8_step(
+               &this->utf8_point, &this->utf8_pending, byte, &width))
+         continue;
+
+      i++;
+   }
+
+   return width;
+}
+
+static
+bool
+kstr_moved(
+      kstr * this,
+      char const * old_data)
+{
+   if (this->data == old_data)
+      return false;
+
+   return this->last_chunk == NULL || this->last_chunk->data != old_data;
+}
+
+kstr *
+kstr_new(
+      char const * text)
+{
+   return kstr_new_in(NULL, text);
+}
+
+kstr *
+kstr_new_bytes(
+      char const * bytes,
+      size_t count)
+{
+   kstr * this;
+   if ((this = kstr_new_in(NULL, NULL)) == NULL)
+      return NULL;
+
+   if (kstr_add_bytes(this, bytes, count) == NULL)
+      return kstr_free(&this);
+
+   return this;
+}
+
+kstr *
+kstr_new_in(
+      kstr_arena * arena,
+      char const * text)
+{
+   // allocate and initialize the string object
+   kstr * this;
+   if ((this = kstr_alloc_object(arena)) == NULL)
+      return kstr_abort(&this);
+
+   this->arena = arena;
+   this->basename = NULL;
+   this->basename_generation = 0;
+   this->basename_size = 0;
+   this->chunked = 0;
+   this->chunks = NULL;
+   this->control_capacity = 0;
+   this->controls = NULL;
+   this->escapes = false;
+   this->generation = 1;
+   this->hash = 0;
+   this->hash_generation = 0;
+   this->interned = false;
+   this->growth = kstr_growth_double;
+   this->last_chunk = NULL;
+   this->plain = NULL;
+   this->plain_generation = 0;
+   this->plain_size = 0;
+   this->shared = NULL;
+   this->data_size = sizeof(this->inline_data);
+   this->used = 1;
+   this->escape = kstr_escape_none;
+   this->utf8_pending = 0;
+   this->utf8_point = 0;
+   this->width = 0;
+   this->style = (kstr_style) { 0 };
+   this->style_forgotten = false;
+   this->control_count = 0;
+   this->controls_tracked = true;
+
+   // start out with the embedded character buffer
+   this->data = this->inline_data;
+   this->data[0] = '\0';
+
+   if (kstr_add_text(this, text) == NULL)
+      return kstr_free(&this);
+
+   return this;
+}
+
+kstr *
+kstr_new_with_capacity(
+      size_t capacity)
+{
+   kstr * this;
+   if ((this = kstr_new_in(NULL, NULL)) == NULL)
+      return NULL;
+
+   if (kstr_reserve(this, capacity) == NULL)
+      return kstr_free(&this);
+
+   return this;
+}
+
+static
+bool
+kstr_piece_code(
+      struct kstr_piece const * piece,
+      struct kstr_code * code)
+{
+   switch (piece->kind)
+   {
+      case kstr_piece_text:
+         code->chars = piece->chars;
+         code->count = piece->chars == NULL ? 0 : strlen(piece->chars);
+         return true;
+
+      case kstr_piece_bytes:
+         code->chars = piece->chars;
+         code->count = piece->chars == NULL ? 0 : piece->count;
+         return true;
+
+      case kstr_piece_bold:
+         *code = kstr_bold_codes[piece->bold];
+         return true;
+
+      case kstr_piece_fg:
+         if ((uintmax_t) piece->color >= (uintmax_t) kstr_num_colors)
+            return false;
+         *code = kstr_fg_codes[piece->color];
+         return true;
+
+      case kstr_piece_bg:
+         if ((uintmax_t) piece->color >= (uintmax_t) kstr_num_colors)
+            return false;
+         *code = kstr_bg_codes[piece->color];
+         return true;
+
+      case kstr_piece_reset:
+         *code = kstr_reset_code;
+         return true;
+
+      default:
+         return false;
+   }
+}
+
+static
+size_t
+kstr_point_width(
+      uint32_t point)
+{
+   // the tables are generated from the unicode 14.0.0 character database.
+   // code points that take no columns: control characters (Cc), nonspacing
+   // and enclosing marks (Mn, Me), format characters (Cf) other than the soft
+   // hyphen and the prepended concatenation marks, and the hangul jungseong
+   // and jongseong jamo that join onto a leading consonant
+   static struct kstr_range const zero[] =
+   {
+      { 0x0000, 0x001f }, { 0x007f, 0x009f }, { 0x0300, 0x036f },
+      { 0x0483, 0x0489 }, { 0x0591, 0x05bd }, { 0x05bf, 0x05bf },
+      { 0x05c1, 0x05c2 }, { 0x05c4, 0x05c5 }, { 0x05c7, 0x05c7 },
+      { 0x0610, 0x061a }, { 0x061c, 0x061c }, { 0x064b, 0x065f },
+      { 0x0670, 0x0670 }, { 0x06d6, 0x06dc }, { 0x06df, 0x06e4 },
+      { 0x06e7, 0x06e8 }, { 0x06ea, 0x06ed }, { 0x0711, 0x0711 },
+      { 0x0730, 0x074a }, { 0x07a6, 0x07b0 }, { 0x07eb, 0x07f3 },
+      { 0x07fd, 0x07fd }, { 0x0816, 0x0819 }, { 0x081b, 0x0823 },
+      { 0x0825, 0x0827 }, { 0x0829, 0x082d }, { 0x0859, 0x085b },
+      { 0x0898, 0x089f }, { 0x08ca, 0x08e1 }, { 0x08e3, 0x0902 },
+      { 0x093a, 0x093a }, { 0x093c, 0x093c }, { 0x0941, 0x0948 },
+      { 0x094d, 0x094d }, { 0x0951, 0x0957 }, { 0x0962, 0x0963 },
+      { 0x0981, 0x0981 }, { 0x09bc, 0x09bc }, { 0x09c1, 0x09c4 },
+      { 0x09cd, 0x09cd }, { 0x09e2, 0x09e3 }, { 0x09fe, 0x0a02 },
+      { 0x0a3c, 0x0a3c }, { 0x0a41, 0x0a51 }, { 0x0a70, 0x0a71 },
+      { 0x0a75, 0x0a75 }, { 0x0a81, 0x0a82 }, { 0x0abc, 0x0abc },
+      { 0x0ac1, 0x0ac8 }, { 0x0acd, 0x0acd }, { 0x0ae2, 0x0ae3 },
+      { 0x0afa, 0x0b01 }, { 0x0b3c, 0x0b3c }, { 0x0b3f, 0x0b3f },
+      { 0x0b41, 0x0b44 }, { 0x0b4d, 0x0b56 }, { 0x0b62, 0x0b63 },
+      { 0x0b82, 0x0b82 }, { 0x0bc0, 0x0bc0 }, { 0x0bcd, 0x0bcd },
+      { 0x0c00, 0x0c00 }, { 0x0c04, 0x0c04 }, { 0x0c3c, 0x0c3c },
+      { 0x0c3e, 0x0c40 }, { 0x0c46, 0x0c56 }, { 0x0c62, 0x0c63 },
+      { 0x0c81, 0x0c81 }, { 0x0cbc, 0x0cbc }, { 0x0cbf, 0x0cbf },
+      { 0x0cc6, 0x0cc6 }, { 0x0ccc, 0x0ccd }, { 0x0ce2, 0x0ce3 },
+      { 0x0d00, 0x0d01 }, { 0x0d3b, 0x0d3c }, { 0x0d41, 0x0d44 },
+      { 0x0d4d, 0x0d4d }, { 0x0d62, 0x0d63 }, { 0x0d81, 0x0d81 },
+      { 0x0dca, 0x0dca }, { 0x0dd2, 0x0dd6 }, { 0x0e31, 0x0e31 },
+      { 0x0e34, 0x0e3a }, { 0x0e47, 0x0e4e }, { 0x0eb1, 0x0eb1 },
+      { 0x0eb4, 0x0ebc }, { 0x0ec8, 0x0ecd }, { 0x0f18, 0x0f19 },
+      { 0x0f35, 0x0f35 }, { 0x0f37, 0x0f37 }, { 0x0f39, 0x0f39 },
+      { 0x0f71, 0x0f7e }, { 0x0f80, 0x0f84 }, { 0x0f86, 0x0f87 },
+      { 0x0f8d, 0x0fbc }, { 0x0fc6, 0x0fc6 }, { 0x102d, 0x1030 },
+      { 0x1032, 0x1037 }, { 0x1039, 0x103a }, { 0x103d, 0x103e },
+      { 0x1058, 0x1059 }, { 0x105e, 0x1060 }, { 0x1071, 0x1074 },
+      { 0x1082, 0x1082 }, { 0x1085, 0x1086 }, { 0x108d, 0x108d },
+      { 0x109d, 0x109d }, { 0x1160, 0x11ff }, { 0x135d, 0x135f },
+      { 0x1712, 0x1714 }, { 0x1732, 0x1733 }, { 0x1752, 0x1753 },
+      { 0x1772, 0x1773 }, { 0x17b4, 0x17b5 }, { 0x17b7, 0x17bd },
+      { 0x17c6, 0x17c6 }, { 0x17c9, 0x17d3 }, { 0x17dd, 0x17dd },
+      { 0x180b, 0x180f }, { 0x1885, 0x1886 }, { 0x18a9, 0x18a9 },
+      { 0x1920, 0x1922 }, { 0x1927, 0x1928 }, { 0x1932, 0x1932 },
+      { 0x1939, 0x193b }, { 0x1a17, 0x1a18 }, { 0x1a1b, 0x1a1b },
+      { 0x1a56, 0x1a56 }, { 0x1a58, 0x1a60 }, { 0x1a62, 0x1a62 },
+      { 0x1a65, 0x1a6c }, { 0x1a73, 0x1a7f }, { 0x1ab0, 0x1b03 },
+      { 0x1b34, 0x1b34 }, { 0x1b36, 0x1b3a }, { 0x1b3c, 0x1b3c },
+      { 0x1b42, 0x1b42 }, { 0x1b6b, 0x1b73 }, { 0x1b80, 0x1b81 },
+      { 0x1ba2, 0x1ba5 }, { 0x1ba8, 0x1ba9 }, { 0x1bab, 0x1bad },
+      { 0x1be6, 0x1be6 }, { 0x1be8, 0x1be9 }, { 0x1bed, 0x1bed },
+      { 0x1bef, 0x1bf1 }, { 0x1c2c, 0x1c33 }, { 0x1c36, 0x1c37 },
+      { 0x1cd0, 0x1cd2 }, { 0x1cd4, 0x1ce0 }, { 0x1ce2, 0x1ce8 },
+      { 0x1ced, 0x1ced }, { 0x1cf4, 0x1cf4 }, { 0x1cf8, 0x1cf9 },
+      { 0x1dc0, 0x1dff }, { 0x200b, 0x200f }, { 0x202a, 0x202e },
+      { 0x2060, 0x206f }, { 0x20d0, 0x20f0 }, { 0x2cef, 0x2cf1 },
+      { 0x2d7f, 0x2d7f }, { 0x2de0, 0x2dff }, { 0x302a, 0x302d },
+      { 0x3099, 0x309a }, { 0xa66f, 0xa672 }, { 0xa674, 0xa67d },
+      { 0xa69e, 0xa69f }, { 0xa6f0, 0xa6f1 }, { 0xa802, 0xa802 },
+      { 0xa806, 0xa806 }, { 0xa80b, 0xa80b }, { 0xa825, 0xa826 },
+      { 0xa82c, 0xa82c }, { 0xa8c4, 0xa8c5 }, { 0xa8e0, 0xa8f1 },
+      { 0xa8ff, 0xa8ff }, { 0xa926, 0xa92d }, { 0xa947, 0xa951 },
+      { 0xa980, 0xa982 }, { 0xa9b3, 0xa9b3 }, { 0xa9b6, 0xa9b9 },
+      { 0xa9bc, 0xa9bd }, { 0xa9e5, 0xa9e5 }, { 0xaa29, 0xaa2e },
+      { 0xaa31, 0xaa32 }, { 0xaa35, 0xaa36 }, { 0xaa43, 0xaa43 },
+      { 0xaa4c, 0xaa4c }, { 0xaa7c, 0xaa7c }, { 0xaab0, 0xaab0 },
+      { 0xaab2, 0xaab4 }, { 0xaab7, 0xaab8 }, { 0xaabe, 0xaabf },
+      { 0xaac1, 0xaac1 }, { 0xaaec, 0xaaed }, { 0xaaf6, 0xaaf6 },
+      { 0xabe5, 0xabe5 }, { 0xabe8, 0xabe8 }, { 0xabed, 0xabed },
+      { 0xd7b0, 0xd7ff }, { 0xfb1e, 0xfb1e }, { 0xfe00, 0xfe0f },
+      { 0xfe20, 0xfe2f }, { 0xfeff, 0xfeff }, { 0xfff9, 0xfffb },
+      { 0x101fd, 0x101fd }, { 0x102e0, 0x102e0 }, { 0x10376, 0x1037a },
+      { 0x10a01, 0x10a0f }, { 0x10a38, 0x10a3f }, { 0x10ae5, 0x10ae6 },
+      { 0x10d24, 0x10d27 }, { 0x10eab, 0x10eac }, { 0x10f46, 0x10f50 },
+      { 0x10f82, 0x10f85 }, { 0x11001, 0x11001 }, { 0x11038, 0x11046 },
+      { 0x11070, 0x11070 }, { 0x11073, 0x11074 }, { 0x1107f, 0x11081 },
+      { 0x110b3, 0x110b6 }, { 0x110b9, 0x110ba }, { 0x110c2, 0x110c2 },
+      { 0x11100, 0x11102 }, { 0x11127, 0x1112b }, { 0x1112d, 0x11134 },
+      { 0x11173, 0x11173 }, { 0x11180, 0x11181 }, { 0x111b6, 0x111be },
+      { 0x111c9, 0x111cc }, { 0x111cf, 0x111cf }, { 0x1122f, 0x11231 },
+      { 0x11234, 0x11234 }, { 0x11236, 0x11237 }, { 0x1123e, 0x1123e },
+      { 0x112df, 0x112df }, { 0x112e3, 0x112ea }, { 0x11300, 0x11301 },
+      { 0x1133b, 0x1133c }, { 0x11340, 0x11340 }, { 0x11366, 0x11374 },
+      { 0x11438, 0x1143f }, { 0x11442, 0x11444 }, { 0x11446, 0x11446 },
+      { 0x1145e, 0x1145e }, { 0x114b3, 0x114b8 }, { 0x114ba, 0x114ba },
+      { 0x114bf, 0x114c0 }, { 0x114c2, 0x114c3 }, { 0x115b2, 0x115b5 },
+      { 0x115bc, 0x115bd }, { 0x115bf, 0x115c0 }, { 0x115dc, 0x115dd },
+      { 0x11633, 0x1163a }, { 0x1163d, 0x1163d }, { 0x1163f, 0x11640 },
+      { 0x116ab, 0x116ab }, { 0x116ad, 0x116ad }, { 0x116b0, 0x116b5 },
+      { 0x116b7, 0x116b7 }, { 0x1171d, 0x1171f }, { 0x11722, 0x11725 },
+      { 0x11727, 0x1172b }, { 0x1182f, 0x11837 }, { 0x11839, 0x1183a },
+      { 0x1193b, 0x1193c }, { 0x1193e, 0x1193e }, { 0x11943, 0x11943 },
+      { 0x119d4, 0x119db }, { 0x119e0, 0x119e0 }, { 0x11a01, 0x11a0a },
+      { 0x11a33, 0x11a38 }, { 0x11a3b, 0x11a3e }, { 0x11a47, 0x11a47 },
+      { 0x11a51, 0x11a56 }, { 0x11a59, 0x11a5b }, { 0x11a8a, 0x11a96 },
+      { 0x11a98, 0x11a99 }, { 0x11c30, 0x11c3d }, { 0x11c3f, 0x11c3f },
+      { 0x11c92, 0x11ca7 }, { 0x11caa, 0x11cb0 }, { 0x11cb2, 0x11cb3 },
+      { 0x11cb5, 0x11cb6 }, { 0x11d31, 0x11d45 }, { 0x11d47, 0x11d47 },
+      { 0x11d90, 0x11d91 }, { 0x11d95, 0x11d95 }, { 0x11d97, 0x11d97 },
+      { 0x11ef3, 0x11ef4 }, { 0x13430, 0x13438 }, { 0x16af0, 0x16af4 },
+      { 0x16b30, 0x16b36 }, { 0x16f4f, 0x16f4f }, { 0x16f8f, 0x16f92 },
+      { 0x16fe4, 0x16fe4 }, { 0x1bc9d, 0x1bc9e }, { 0x1bca0, 0x1cf46 },
+      { 0x1d167, 0x1d169 }, { 0x1d173, 0x1d182 }, { 0x1d185, 0x1d18b },
+      { 0x1d1aa, 0x1d1ad }, { 0x1d242, 0x1d244 }, { 0x1da00, 0x1da36 },
+      { 0x1da3b, 0x1da6c }, { 0x1da75, 0x1da75 }, { 0x1da84, 0x1da84 },
+      { 0x1da9b, 0x1daaf }, { 0x1e000, 0x1e02a }, { 0x1e130, 0x1e136 },
+      { 0x1e2ae, 0x1e2ae }, { 0x1e2ec, 0x1e2ef }, { 0x1e8d0, 0x1e8d6 },
+      { 0x1e944, 0x1e94a }, { 0xe0001, 0xe01ef }
+   };
+
+   // east asian wide and fullwidth (W, F) code points, which take two
+   // columns, including the unassigned ones in the ideograph blocks and the
+   // yijing hexagram symbols (wide from unicode 16.0). ranges join across
+   // unassigned code points
+   static struct kstr_range const wide[] =
+   {
+      { 0x1100, 0x115f }, { 0x231a, 0x231b }, { 0x2329, 0x232a },
+      { 0x23e9, 0x23ec }, { 0x23f0, 0x23f0 }, { 0x23f3, 0x23f3 },
+      { 0x25fd, 0x25fe }, { 0x2614, 0x2615 }, { 0x2648, 0x2653 },
+      { 0x267f, 0x267f }, { 0x2693, 0x2693 }, { 0x26a1, 0x26a1 },
+      { 0x26aa, 0x26ab }, { 0x26bd, 0x26be }, { 0x26c4, 0x26c5 },
+      { 0x26ce, 0x26ce }, { 0x26d4, 0x26d4 }, { 0x26ea, 0x26ea },
+      { 0x26f2, 0x26f3 }, { 0x26f5, 0x26f5 }, { 0x26fa, 0x26fa },
+      { 0x26fd, 0x26fd }, { 0x2705, 0x2705 }, { 0x270a, 0x270b },
+      { 0x2728, 0x2728 }, { 0x274c, 0x274c }, { 0x274e, 0x274e },
+      { 0x2753, 0x2755 }, { 0x2757, 0x2757 }, { 0x2795, 0x2797 },
+      { 0x27b0, 0x27b0 }, { 0x27bf, 0x27bf }, { 0x2b1b, 0x2b1c },
+      { 0x2b50, 0x2b50 }, { 0x2b55, 0x2b55 }, { 0x2e80, 0x303e },
+      { 0x3041, 0x3247 }, { 0x3250, 0xa4c6 }, { 0xa960, 0xa97c },
+      { 0xac00, 0xd7a3 }, { 0xf900, 0xfaff }, { 0xfe10, 0xfe19 },
+      { 0xfe30, 0xfe6b }, { 0xff01, 0xff60 }, { 0xffe0, 0xffe6 },
+      { 0x16fe0, 0x1b2fb }, { 0x1f004, 0x1f004 }, { 0x1f0cf, 0x1f0cf },
+      { 0x1f18e, 0x1f18e }, { 0x1f191, 0x1f19a }, { 0x1f200, 0x1f320 },
+      { 0x1f32d, 0x1f335 }, { 0x1f337, 0x1f37c }, { 0x1f37e, 0x1f393 },
+      { 0x1f3a0, 0x1f3ca }, { 0x1f3cf, 0x1f3d3 }, { 0x1f3e0, 0x1f3f0 },
+      { 0x1f3f4, 0x1f3f4 }, { 0x1f3f8, 0x1f43e }, { 0x1f440, 0x1f440 },
+      { 0x1f442, 0x1f4fc }, { 0x1f4ff, 0x1f53d }, { 0x1f54b, 0x1f54e },
+      { 0x1f550, 0x1f567 }, { 0x1f57a, 0x1f57a }, { 0x1f595, 0x1f596 },
+      { 0x1f5a4, 0x1f5a4 }, { 0x1f5fb, 0x1f64f }, { 0x1f680, 0x1f6c5 },
+      { 0x1f6cc, 0x1f6cc }, { 0x1f6d0, 0x1f6d2 }, { 0x1f6d5, 0x1f6df },
+      { 0x1f6eb, 0x1f6ec }, { 0x1f6f4, 0x1f6fc }, { 0x1f7e0, 0x1f7f0 },
+      { 0x1f90c, 0x1f93a }, { 0x1f93c, 0x1f945 }, { 0x1f947, 0x1f9ff },
+      { 0x1fa70, 0x1faf6 }, { 0x20000, 0x3fffd }
+   };
+
+   if (point >= 0x20 && point < 0x7f)
+      return 1;
+   if (kstr_in_ranges(point, zero, sizeof(zero) / sizeof(*zero)))
+      return 0;
+   if (kstr_in_ranges(point, wide, sizeof(wide) / sizeof(*wide)))
+      return 2;
+
+   return 1;
+}
+
+static
+void
+kstr_put_decimal(
+      char * chars,
+      size_t digits,
+      uintmax_t value)
+{
+   static char const pairs[201] =
+      "00010203040506070809101112131415161718192021222324252627282930313233"
+      "34353637383940414243444546474849505152535455565758596061626364656667"
+      "6869707172737475767778798081828384858687888990919293949596979899";
+
+   // write two digits at a time from the end
+   char * next = chars + digits;
+   while (value >= 100)
+   {
+      unsigned int const pair = (unsigned int) (value % 100) * 2;
+      value /= 100;
+      *--next = pairs[pair + 1];
+      *--next = pairs[pair];
+   }
+
+   if (value >= 10)
+   {
+      unsigned int const pair = (unsigned int) value * 2;
+      *--next = pairs[pair + 1];
+      *--next = pairs[pair];
+   }
+   else
+      *--next = (char) ('0' + value);
+
+   // pad with leading zeros
+   while (next > chars)
+      *--next = '0';
+}
+
+bool
+kstr_read_fd(
+      kstr * this,
+      int fd,
+      size_t max)
+{
+   // make sure the buffer isn't shared with any clones
+   if (kstr_grow(this, 0) == NULL)
+      return false;
+
+   size_t total = 0;
+   while (total < max)
+   {
+      // grow a full buffer by what is left to read, up to a limit
+      size_t const left = max - total;
+      if (
+            kstr_available(this) == 0 &&
+            kstr_grow(this, (left < kstr_read_size) ? left : kstr_read_size)
+               == NULL)
+         return false;
+
+      char * const end = this->data + this->used - 1;
+      size_t const available = kstr_available(this);
+      ssize_t const count =
+         read(fd, end, (left < available) ? left : available);
+      if (count < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return false;
+      }
+
+      if (count == 0)
+         break;
+
+      this->used += (size_t) count;
+      this->data[this->used - 1] = '\0';
+      kstr_added(this, end, (size_t) count, true);
+      kstr_changed(this);
+      total += (size_t) count;
+   }
+
+   return true;
+}
+
+static
+void
+kstr_release(
+      kstr * this)
+{
+   if (this->shared != NULL)
+   {
+      // free the shared buffer along with its last reference
+      if (atomic_fetch_sub(&this->shared->refs, 1) == 1)
+         free(this->shared);
+      this->shared = NULL;
+   }
+   else if (!kstr_is_inline(this) && this->arena == NULL)
+   {
+      // only buffers of exactly a size class's size can be cached
+      size_t const cls = kstr_cache_fit(this->data_size);
+      kstr_cache_put(
+         this->data,
+         kstr_cache_size(cls) == this->data_size ? cls : kstr_cache_classes);
+   }
+}
+
+static
+void *
+kstr_realloc(
+      kstr_arena * arena,
+      void * ptr,
+      size_t old_size,
+      size_t new_size)
+{
+   if (arena == NULL)
+      return realloc(ptr, new_size);
+
+   return kstr_arena_realloc(arena, ptr, old_size, new_size);
+}
+
+static
+void
+kstr_release_chunks(
+      kstr * this)
+{
+   struct kstr_chunk * chunk = this->chunks;
+   while (chunk != NULL)
+   {
+      struct kstr_chunk * const next = chunk->next;
+      if (this->arena == NULL)
+      {
+         free(chunk->data);
+         free(chunk);
+      }
+      chunk = next;
+   }
+
+   this->chunked = 0;
+   this->chunks = NULL;
+   this->last_chunk = NULL;
+}
+
+kstr *
+kstr_replace_all(
+      kstr * this,
+      kstr_view needle,
+      kstr_view replacement)
+{
+   if (needle.len == 0)
+      return this;
+   if (kstr_flatten(this) == NULL)
+      return NULL;
+
+   // count the occurrences to size the buffer once
+   size_t const size = this->used - 1;
+   size_t const first =
+      kstr_view_find((kstr_view) { this->data, size }, needle, 0);
+   size_t matches = 0;
+   for (
+         size_t pos = first;
+         pos != kstr_npos;
+         pos = kstr_view_find(
+            (kstr_view) { this->data, size }, needle, pos + needle.len))
+      matches++;
+   if (matches == 0)
+      return this;
+
+   char * needle_copy;
+   if (kstr_detach(this, &needle, &needle_copy) == NULL)
+      return NULL;
+
+   char * replacement_copy;
+   if (kstr_detach(this, &replacement, &replacement_copy) == NULL)
+   {
+      free(needle_copy);
+      return NULL;
+   }
+
+   // make room for a longer value, then move the value to the end of the
+   // buffer so that each replacement is written over bytes already read
+   size_t const extra =
+      (replacement.len > needle.len) ? replacement.len - needle.len : 0;
+   bool const overflow = extra > ((size_t) -1 - this->used) / matches;
+   if (overflow || kstr_grow_flat(this, extra * matches) == NULL)
+   {
+      free(needle_copy);
+      free(replacement_copy);
+      return overflow ? kstr_abort(&this) : NULL;
+   }
+
+   // measure the value from the first match on before changing it
+   struct kstr_scanner scanner = { 0, 0, kstr_escape_none };
+   kstr_span_width(this, 0, first, &scanner);
+   struct kstr_scanner const start = scanner;
+   size_t const removed =
+      kstr_span_width(this, first, size - first, &scanner);
+
+   size_t const shift = extra * matches;
+   if (shift > 0)
+      memmove(this->data + shift, this->data, this->used);
+
+   kstr_view const source = { this->data + shift, size };
+   size_t read = 0;
+   size_t written = 0;
+   size_t next = 0;
+   size_t kept = 0;
+   for (size_t i = 0; i < matches; i++)
+   {
+      size_t const pos = kstr_view_find(source, needle, read);
+      memmove(this->data + written, source.ptr + read, pos - read);
+      written += pos - read;
+      memcpy(this->data + written, replacement.ptr, replacement.len);
+      written += replacement.len;
+      read = pos + needle.len;
+
+      // move the control codes before the match, and forget the ones the
+      // match cuts into
+      for (; next < this->control_count && this->controls[next].pos < read;
+            next++)
+      {
+         struct kstr_control control = this->controls[next];
+         if (control.pos + control.count > pos)
+            continue;
+
+         control.pos = control.pos - i * needle.len + i * replacement.len;
+         this->controls[kept++] = control;
+      }
+   }
+
+   for (; next < this->control_count; next++)
+   {
+      struct kstr_control control = this->controls[next];
+      control.pos =
+         control.pos - matches * needle.len + matches * replacement.len;
+      this->controls[kept++] = control;
+   }
+
+   this->control_count = kept;
+   memmove(this->data + written, source.ptr + read, size + 1 - read);
+   this->used = written + size + 1 - read;
+
+   // measure the changed value from the same point
+   scanner = start;
+   size_t const added =
+      kstr_span_width(this, first, this->used - 1 - first, &scanner);
+   this->width += added;
+   this->width = (removed < this->width) ? this->width - removed : 0;
+   this->escape = scanner.escape;
+   this->utf8_pending = scanner.utf8_pending;
+   this->utf8_point = scanner.utf8_point;
+
+   kstr_forget_style(this);
+   this->control_count = 0;
+   this->controls_tracked = false;
+
+   free(needle_copy);
+   free(replacement_copy);
+
+   kstr_changed(this);
+   return this;
+}
+
+kstr *
+kstr_replace_range(
+      kstr * this,
+      size_t pos,
+      size_t count,
+      kstr_view text)
+{
+   if (kstr_flatten(this) == NULL)
+      return NULL;
+
+   // clip the range to the value
+   size_t const size = this->used - 1;
+   if (pos > size)
+      pos = size;
+   if (count > size - pos)
+      count = size - pos;
+   if (count == 0 && text.len == 0)
+      return this;
+
+   char * copy;
+   if (kstr_detach(this, &text, &copy) == NULL)
+      return NULL;
+
+   // make room for the new text before changing anything
+   size_t const extra = (text.len > count) ? text.len - count : 0;
+   if (kstr_grow_flat(this, extra) == NULL)
+   {
+      free(copy);
+      return NULL;
+   }
+
+   // replacing the end of the value is the same as cutting it and appending,
+   // which can't fail now that the buffer has room for the text
+   if (pos + count == size)
+   {
+      kstr_cut(this, pos);
+      kstr_add_chars(this, text.ptr, text.len, true);
+
+      free(copy);
+      return this;
+   }
+
+   // measure the value from the edit point before changing it
+   struct kstr_scanner scanner = { 0, 0, kstr_escape_none };
+   kstr_span_width(this, 0, pos, &scanner);
+   struct kstr_scanner const start = scanner;
+   size_t const removed = kstr_span_width(this, pos, size - pos, &scanner);
+
+   // move the rest of the value, including its nul terminator, to make room
+   memmove(
+         this->data + pos + text.len,
+         this->data + pos + count,
+         this->used - pos - count);
+   memcpy(this->data + pos, text.ptr, text.len);
+   this->used = this->used - count + text.len;
+
+   // move the control codes after the range, and forget the ones it cuts
+   // into, before measuring the changed value from the same point
+   size_t kept = 0;
+   for (size_t i = 0; i < this->control_count; i++)
+   {
+      struct kstr_control control = this->controls[i];
+      if (control.pos + control.count > pos && control.pos < pos + count)
+         continue;
+      if (count == 0 && control.pos < pos && control.pos + control.count > pos)
+         continue;
+
+      if (control.pos >= pos + count)
+         control.pos = control.pos - count + text.len;
+      this->controls[kept++] = control;
+   }
+
+   this->control_count = kept;
+   scanner = start;
+   size_t const added =
+      kstr_span_width(this, pos, this->used - 1 - pos, &scanner);
+   this->width += added;
+   this->width = (removed < this->width) ? this->width - removed : 0;
+   this->escape = scanner.escape;
+   this->utf8_pending = scanner.utf8_pending;
+   this->utf8_point = scanner.utf8_point;
+
+   kstr_forget_style(this);
+   this->control_count = 0;
+   this->controls_tracked = false;
+
+   free(copy);
+
+   kstr_changed(this);
+   return this;
+}
+
+kstr *
+kstr_reserve(
+      kstr * this,
+      size_t count)
+{
+   if (kstr_available(this) >= count)
+      return this;
+
+   if (count > (size_t) -1 - this->used)
+      return kstr_abort(&this);
+
+   return kstr_resize(this, this->used + count);
+}
+
+static
+kstr *
+kstr_reset(
+      kstr * this)
+{
+   kstr_release_chunks(this);
+
+   // stop using a buffer that is shared with clones
+   if (this->shared != NULL && atomic_load(&this->shared->refs) > 1)
+   {
+      kstr_release(this);
+      this->data = this->inline_data;
+      this->data_size = sizeof(this->inline_data);
+   }
+
+   // clear the string's value
+   this->data[0] = '\0';
+   this->used = 1;
+   this->escape = kstr_escape_none;
+   this->utf8_pending = 0;
+   this->utf8_point = 0;
+   this->width = 0;
+   this->style = (kstr_style) { 0 };
+   this->style_forgotten = false;
+   this->control_count = 0;
+   this->controls_tracked = true;
+
+   kstr_changed(this);
+
+   return this;
+}
+
+static
+kstr *
+kstr_resize(
+      kstr * this,
+      size_t size)
+{
+   uintptr_t const old_data = (uintptr_t) this->data;
+   char * new_data;
+   if (size <= sizeof(this->inline_data))
+   {
+      // move the value back into the embedded buffer
+      if (kstr_is_inline(this))
+         return this;
+
+      memcpy(this->inline_data, this->data, this->used);
+      kstr_release(this);
+
+      new_data = this->inline_data;
+      size = sizeof(this->inline_data);
+   }
+   else if (this->shared != NULL && atomic_load(&this->shared->refs) == 1)
+   {
+      // no clones use the shared buffer anymore, so resize it in place
+      struct kstr_shared * new_shared;
+      if (size > (size_t) -1 - sizeof(*new_shared))
+         return kstr_abort(&this);
+      if (
+            (new_shared = kstr_realloc(
+               NULL, this->shared, 0, sizeof(*new_shared) + size)) == NULL)
+         return kstr_abort(&this);
+
+      this->shared = new_shared;
+      new_data = new_shared->data;
+   }
+   else if (kstr_is_inline(this) || this->shared != NULL)
+   {
+      // move the value into a buffer of its own
+      if ((new_data = kstr_alloc_data(this->arena, &size)) == NULL)
+         return kstr_abort(&this);
+      memcpy(new_data, this->data, this->used);
+      kstr_release(this);
+   }
+   else if (
+         (new_data = kstr_realloc(
+            this->arena, this->data, this->data_size, size)) == NULL)
+      return kstr_abort(&this);
+
+   // the value was copied if it is in a different buffer now
+   kstr_count(resizes, 1);
+   kstr_count(
+         bytes_copied, ((uintptr_t) new_data != old_data) ? this->used : 0);
+
+   this->data_size = size;
+   this->data = new_data;
+   return this;
+}
+
+static
+size_t
+kstr_scan_width(
+      char const * chars,
+      size_t count,
+      bool escapes,
+      struct kstr_scanner * scanner)
+{
+   unsigned char const * const bytes = (unsigned char const *) chars;
+   size_t width = 0;
+
+   size_t i = 0;
+   while (i < count)
+   {
+      if (scanner->utf8_pending == 0 && scanner->escape == kstr_escape_none)
+      {
+         // skip over printable ascii text in bulk
+         size_t const run = kstr_ascii_run(bytes + i, count - i);
+         width += run;
+         if ((i += run) == count)
+            break;
+      }
+
+      unsigned char const byte = bytes[i];
+      if (scanner->escape != kstr_escape_none)
+         kstr_escape_step(&scanner->escape, byte);
+      else if (byte == 0x1b && escapes && scanner->utf8_pending == 0)
+         scanner->escape = kstr_escape_start;
+      else if (!kstr_utf8_step(
+               &scanner->utf8_point, &scanner->utf8_pending, byte, &width))
+         continue;
+
+      i++;
+   }
+
+   return width;
+}
+
+kstr *
+kstr_set_bytes(
+      kstr * this,
+      char const * bytes,
+      size_t count)
+{
+   kstr_reset(this);
+   return kstr_add_bytes(this, bytes, count);
+}
+
+kstr_error_mode
+kstr_set_error_mode(
+      kstr_error_mode mode)
+{
+   if ((uintmax_t) mode >= (uintmax_t) kstr_num_error_modes)
+   {
+      kstr_fail(NULL, EINVAL);
+      return atomic_load_explicit(&kstr_errors, memory_order_relaxed);
+   }
+
+   return atomic_exchange_explicit(&kstr_errors, mode, memory_order_relaxed);
+}
+
+kstr *
+kstr_set_escapes(
+      kstr * this,
+      bool escapes)
+{
+   this->escapes = escapes;
+   return this;
+}
+
+kstr *
+kstr_set_fmt(
+      kstr * this,
+      char const * fmt,
+      ...)
+{
+   va_list args;
+   va_start(args, fmt);
+   this = kstr_set_vfmt(this, fmt, args);
+   va_end(args);
+
+   return this;
+}
+
+kstr *
+kstr_set_growth(
+      kstr * this,
+      kstr_growth growth)
+{
+   if ((uintmax_t) growth >= (uintmax_t) kstr_num_growths)
+      return kstr_fail(&this, EINVAL);
+
+   this->growth = growth;
+   return this;
+}
+
+kstr *
+kstr_set_text(
+      kstr * this,
+      char const * text)
+{
+   kstr_reset(this);
+   return kstr_add_text(this, text);
+}
+
+kstr *
+kstr_set_vfmt(
+      kstr * this,
+      char const * fmt,
+      va_list args)
+{
+   kstr_reset(this);
+   return kstr_add_vfmt(this, fmt, args);
+}
+
+static
+char *
+kstr_sgr_color(
+      char * out,
+      kstr_style_color const * color,
+      bool bg)
+{
+   switch (color->kind)
+   {
+      case kstr_color_kind_basic:
+      {
+         // reuse the parameter of the precomputed control codes
+         if ((uintmax_t) color->basic >= (uintmax_t) kstr_num_colors)
+            return NULL;
+
+         struct kstr_code const * const code =
+            bg ? &kstr_bg_codes[color->basic] : &kstr_fg_codes[color->basic];
+         memcpy(out, code->chars + 2, code->count - 3);
+         return out + code->count - 3;
+      }
+
+      case kstr_color_kind_256:
+         memcpy(out, bg ? "48;5;" : "38;5;", 5);
+         return kstr_sgr_number(out + 5, color->index);
+
+      case kstr_color_kind_rgb:
+         memcpy(out, bg ? "48;2;" : "38;2;", 5);
+         out = kstr_sgr_number(out + 5, color->red);
+         *out++ = ';';
+         out = kstr_sgr_number(out, color->green);
+         *out++ = ';';
+         return kstr_sgr_number(out, color->blue);
+
+      default:
+         return NULL;
+   }
+}
+
+static
+char *
+kstr_sgr_number(
+      char * out,
+      unsigned int value)
+{
+   if (value >= 100)
+      *out++ = (char) ('0' + value / 100);
+   if (value >= 10)
+      *out++ = (char) ('0' + value / 10 % 10);
+   *out++ = (char) ('0' + value % 10);
+   return out;
+}
+
+static
+bool
+kstr_shortest(
+      double value,
+      char * digits,
+      int * count,
+      int * exponent)
+{
+   uint64_t bits;
+   memcpy(&bits, &value, sizeof(bits));
+   uint64_t const fraction = bits & ((UINT64_C(1) << 52) - 1);
+   int const biased = (int) (bits >> 52) & 0x7ff;
+
+   // the value and the boundaries halfway to its neighbors, which are closer
+   // below powers of two
+   struct kstr_diy v = (biased == 0) ?
+      (struct kstr_diy) { fraction, -1074 } :
+      (struct kstr_diy) { fraction | (UINT64_C(1) << 52), biased - 1075 };
+   struct kstr_diy high = { (v.f << 1) + 1, v.e - 1 };
+   struct kstr_diy low = (fraction == 0 && biased > 1) ?
+      (struct kstr_diy) { (v.f << 2) - 1, v.e - 2 } :
+      (struct kstr_diy) { (v.f << 1) - 1, v.e - 1 };
+   while ((high.f & (UINT64_C(1) << 63)) == 0)
+   {
+      high.f <<= 1;
+      high.e--;
+   }
+   low.f <<= low.e - high.e;
+   low.e = high.e;
+   while ((v.f & (UINT64_C(1) << 63)) == 0)
+   {
+      v.f <<= 1;
+      v.e--;
+   }
+
+   // scale by a cached power of ten so the binary exponent is between -60
+   // and -32, which leaves the integral part of the scaled value in 32 bits;
+   // the power is found from log10(2) * (min_e + 63), rounded up, which is
+   // calculated in 32.32 fixed point
+   int const min_e = -60 - (v.e + 64);
+   int64_t const scaled = (int64_t) (min_e + 63) * 1292913987;
+   int const k = (scaled >= 0) ?
+      (int) ((scaled + 0xffffffff) >> 32) : -(int) ((-scaled) >> 32);
+   struct kstr_power const power = kstr_cached_powers[
+      (kstr_cached_powers_offset + k - 1) / kstr_cached_powers_step + 1];
+   struct kstr_diy const ten_mk = { power.f, power.e };
+   struct kstr_diy const w = kstr_diy_times(v, ten_mk);
+   low = kstr_diy_times(low, ten_mk);
+   high = kstr_diy_times(high, ten_mk);
+
+   // the scaled boundaries are off by at most one unit, so only digits
+   // inside the narrower interval are known to read back as the value
+   uint64_t unit = 1;
+   uint64_t const too_low = low.f - unit;
+   uint64_t const too_high = high.f + unit;
+   uint64_t unsafe = too_high - too_low;
+   int const shift = -w.e;
+   uint64_t const one = UINT64_C(1) << shift;
+   uint32_t integrals = (uint32_t) (too_high >> shift);
+   uint64_t fractionals = too_high & (one - 1);
+
+   // generate the digits of the integral part
+   uint32_t divisor = 1;
+   int kappa = (integrals > 0);
+   while (kappa < 10 && (uint64_t) divisor * 10 <= integrals)
+   {
+      divisor *= 10;
+      kappa++;
+   }
+
+   *count = 0;
+   while (kappa > 0)
+   {
+      digits[(*count)++] = (char) ('0' + integrals / divisor);
+      integrals %= divisor;
+      kappa--;
+
+      uint64_t const rest = ((uint64_t) integrals << shift) + fractionals;
+      if (rest < unsafe)
+      {
+         *exponent = -power.k + kappa;
+         return kstr_shortest_round(
+               digits,
+               *count,
+               too_high - w.f,
+               unsafe,
+               rest,
+               (uint64_t) divisor << shift,
+               unit);
+      }
+
+      divisor /= 10;
+   }
+
+   // then the digits of the fractional part, until they're close enough
+   for (;;)
+   {
+      fractionals *= 10;
+      unit *= 10;
+      unsafe *= 10;
+      digits[(*count)++] = (char) ('0' + (fractionals >> shift));
+      fractionals &= one - 1;
+      kappa--;
+
+      if (fractionals < unsafe)
+      {
+         *exponent = -power.k + kappa;
+         return kstr_shortest_round(
+               digits,
+               *count,
+               (too_high - w.f) * unit,
+               unsafe,
+               fractionals,
+               one,
+               unit);
+      }
+   }
+}
+
+static
+bool
+kstr_shortest_round(
+      char * digits,
+      int count,
+      uint64_t distance,
+      uint64_t unsafe,
+      uint64_t rest,
+      uint64_t ten_kappa,
+      uint64_t unit)
+{
+   // lower the last digit while that brings the digits closer to the value
+   uint64_t const small_distance = distance - unit;
+   uint64_t const big_distance = distance + unit;
+   while (
+         rest < small_distance &&
+         unsafe - rest >= ten_kappa &&
+         (
+            rest + ten_kappa < small_distance ||
+            small_distance - rest >= rest + ten_kappa - small_distance))
+   {
+      digits[count - 1]--;
+      rest += ten_kappa;
+   }
+
+   // give up if a lower digit might be closer still
+   if (
+         rest < big_distance &&
+         unsafe - rest >= ten_kappa &&
+         (
+            rest + ten_kappa < big_distance ||
+            big_distance - rest > rest + ten_kappa - big_distance))
+      return false;
+
+   // the digits must be safely inside the interval
+   return 2 * unit <= rest && rest <= unsafe - 4 * unit;
+}
+
+kstr *
+kstr_shrink_to_fit(
+      kstr * this)
+{
+   // a buffer shared with clones is left alone, since copying it would not
+   // release any memory
+   if (this->shared != NULL && atomic_load(&this->shared->refs) > 1)
+      return this;
+
+   return kstr_resize(this, this->used);
+}
+
+size_t
+kstr_size(
+      kstr * this)
+{
+   return this->chunked + this->used;
+}
+
+bool
+kstr_slurp_file(
+      kstr * this,
+      char const * path)
+{
+   int const fd = open(path, O_RDONLY | O_CLOEXEC);
+   if (fd < 0)
+      return false;
+
+   // size the buffer once for the whole file, with a byte to spare to see
+   // the end of the file without growing again
+   struct stat st;
+   if (
+         fstat(fd, &st) == 0 &&
+         S_ISREG(st.st_mode) &&
+         st.st_size > 0 &&
+         (uintmax_t) st.st_size < (uintmax_t) SIZE_MAX &&
+         kstr_reserve(this, (size_t) st.st_size + 1) == NULL)
+   {
+      close(fd);
+      return false;
+   }
+
+   bool const done = kstr_read_fd(this, fd, kstr_npos);
+   int const error = errno;
+   close(fd);
+   errno = error;
+   return done;
+}
+
+static
+size_t
+kstr_span_width(
+      kstr * this,
+      size_t pos,
+      size_t count,
+      struct kstr_scanner * scanner)
+{
+   size_t const end = pos + count;
+   size_t width = 0;
+
+   // skip the control codes before the bytes
+   size_t next = 0;
+   while (next < this->control_count
+         && this->controls[next].pos + this->controls[next].count <= pos)
+      next++;
+
+   while (pos < end)
+   {
+      struct kstr_control const * const control =
+         (next < this->control_count) ? &this->controls[next] : NULL;
+      if (control != NULL && control->pos <= pos)
+      {
+         // a control code ends an incomplete utf-8 or escape sequence
+         if (scanner->utf8_pending > 0)
+            width++;
+         scanner->utf8_pending = 0;
+         scanner->escape = kstr_escape_none;
+
+         size_t const control_end = control->pos + control->count;
+         pos = (control_end < end) ? control_end : end;
+         next++;
+         continue;
+      }
+
+      // measure the text up to the next control code
+      size_t const text_end =
+         (control != NULL && control->pos < end) ? control->pos : end;
+      width += kstr_scan_width(
+            this->data + pos, text_end - pos, this->escapes, scanner);
+      pos = text_end;
+   }
+
+   return width;
+}
+
+size_t
+kstr_split(
+      kstr * this,
+      kstr_view delimiters,
+      kstr_view * pieces,
+      size_t max)
+{
+   return kstr_view_split(
+         kstr_get_view(this, 0, kstr_npos), delimiters, pieces, max);
+}
+
+void
+kstr_stats_get(
+      kstr_stats * stats)
+{
+   *stats = kstr_thread_stats;
+}
+
+void
+kstr_stats_reset(void)
+{
+   kstr_thread_stats = (kstr_stats) { 0 };
+}
+
+kstr_style_color
+kstr_style_256(
+      uint8_t index)
+{
+   return (kstr_style_color) { .kind = kstr_color_kind_256, .index = index };
 }
 
-kstr *
-kstr_add_bg(
-      kstr * this,
+kstr_style_color
+kstr_style_basic(
       kstr_color color)
 {
-   static char const * const codes[kstr_num_colors] =
-   {
-      "\x1b[49m", // default
-      "\x1b[40m", // black
-      "\x1b[44m", // blue
-      "\x1b[46m", // cyan
-      "\x1b[42m", // green
-      "\x1b[45m", // magenta
-      "\x1b[41m", // red
-      "\x1b[47m", // white
-      "\x1b[43m" // yellow
-   };
-
-   if ((uintmax_t) color >= (uintmax_t) kstr_num_colors)
-      return kstr_abort(&this);
-
-   // append the color control code
-   char const * const chars = codes[color];
-   return kstr_add_chars(this, chars, strlen(chars), false);
+   return (kstr_style_color) { .kind = kstr_color_kind_basic, .basic = color };
 }
 
-kstr *
-kstr_add_bold(
-      kstr * this,
-      bool bold)
+kstr_style_color
+kstr_style_rgb(
+      uint8_t red,
+      uint8_t green,
+      uint8_t blue)
 {
-   // append the bold control code
-   char const * const chars = bold ? "\x1b[1m" : "\x1b[22m";
-   return kstr_add_chars(this, chars, strlen(chars), false);
+   return (kstr_style_color)
+   {
+      .kind = kstr_color_kind_rgb, .red = red, .green = green, .blue = blue
+   };
 }
 
 static
-kstr *
-kstr_add_chars(
+void
+kstr_track(
       kstr * this,
-      char const * chars,
-      size_t count,
-      bool visible)
+      struct kstr_piece const * piece)
 {
-   if (chars == NULL || count == 0)
-      return this;
+   switch (piece->kind)
+   {
+      case kstr_piece_bold:
+         this->style.set_bold = true;
+         this->style.bold = piece->bold;
+         break;
 
-   // grow the buffer until enough bytes are available
-   while (kstr_available(this) < count)
-      if (kstr_grow(this) == NULL)
-         return NULL;
+      case kstr_piece_fg:
+         this->style.fg = kstr_style_basic(piece->color);
+         break;
 
-   // append the character data
-   memcpy(this->data + this->used - 1, chars, count);
-   this->used += count;
-   this->data[this->used - 1] = '\0';
-   if (visible)
-      this->width += count;
+      case kstr_piece_bg:
+         this->style.bg = kstr_style_basic(piece->color);
+         break;
 
-   // invalidate the cached basename
-   free(this->basename);
-   this->basename = NULL;
+      case kstr_piece_reset:
+         this->style.set_bold = true;
+         this->style.bold = false;
+         this->style.fg = kstr_style_basic(kstr_color_default);
+         this->style.bg = kstr_style_basic(kstr_color_default);
+         break;
 
-   return this;
+      default:
+         break;
+   }
 }
 
 kstr *
-kstr_add_fg(
+kstr_truncate(
       kstr * this,
-      kstr_color color)
+      size_t size)
 {
-   static char const * const codes[kstr_num_colors] =
-   {
-      "\x1b[39m", // default
-      "\x1b[30m", // black
-      "\x1b[34m", // blue
-      "\x1b[36m", // cyan
-      "\x1b[32m", // green
-      "\x1b[35m", // magenta
-      "\x1b[31m", // red
-      "\x1b[37m", // white
-      "\x1b[33m" // yellow
-   };
+   return kstr_erase(this, size, kstr_npos);
+}
 
-   if ((uintmax_t) color >= (uintmax_t) kstr_num_colors)
-      return kstr_abort(&this);
+static
+void
+kstr_undo(
+      kstr * this,
+      struct kstr_mark const * mark)
+{
+   if (this->chunked == mark->chunked)
+      this->used = mark->used;
+   else
+   {
+      // the marked buffer became the first new chunk, so it keeps the bytes
+      // before the mark while the chunks after it and the current buffer are
+      // emptied
+      struct kstr_chunk * const chunk =
+         (mark->last_chunk == NULL) ? this->chunks : mark->last_chunk->next;
+      for (struct kstr_chunk * next = chunk->next; next != NULL; )
+      {
+         struct kstr_chunk * const after = next->next;
+         if (this->arena == NULL)
+         {
+            free(next->data);
+            free(next);
+         }
+         next = after;
+      }
 
-   // append the color control code
-   char const * const chars = codes[color];
-   return kstr_add_chars(this, chars, strlen(chars), false);
+      chunk->next = NULL;
+      chunk->count = mark->used - 1;
+      this->last_chunk = chunk;
+      this->chunked = mark->chunked + chunk->count;
+      this->used = 1;
+   }
+
+   this->data[this->used - 1] = '\0';
+   this->width = mark->width;
+   this->utf8_point = mark->utf8_point;
+   this->utf8_pending = mark->utf8_pending;
+   this->escape = mark->escape;
+   this->style = mark->style;
+   this->style_forgotten = mark->style_forgotten;
+
+   // appended control codes may have extended the last one
+   this->control_count = mark->control_count;
+   this->controls_tracked = mark->controls_tracked;
+   if (this->control_count > 0)
+      this->controls[this->control_count - 1].count = mark->control_last;
+
+   kstr_changed(this);
 }
 
-kstr *
-kstr_add_fmt(
-      kstr * this,
-      char const * fmt,
-      ...)
+static
+bool
+kstr_utf8_step(
+      uint32_t * point,
+      unsigned char * pending,
+      unsigned char byte,
+      size_t * width)
 {
-   va_list args;
-   va_start(args, fmt);
-   this = kstr_add_vfmt(this, fmt, args);
-   va_end(args);
+   if (*pending > 0)
+   {
+      if ((byte & 0xc0) != 0x80)
+      {
+         // an incomplete sequence is shown as one replacement character, and
+         // the byte starts over
+         *pending = 0;
+         (*width)++;
+         return false;
+      }
 
-   return this;
+      // add the continuation byte to the code point
+      *point = (*point << 6) | (byte & 0x3f);
+      if (--*pending == 0)
+         *width += kstr_point_width(*point);
+   }
+   else if (byte < 0x80)
+      *width += kstr_point_width(byte);
+   else if (byte >= 0xc2 && byte <= 0xdf)
+   {
+      *point = byte & 0x1f;
+      *pending = 1;
+   }
+   else if (byte >= 0xe0 && byte <= 0xef)
+   {
+      *point = byte & 0x0f;
+      *pending = 2;
+   }
+   else if (byte >= 0xf0 && byte <= 0xf4)
+   {
+      *point = byte & 0x07;
+      *pending = 3;
+   }
+   else
+      (*width)++;
+
+   return true;
 }
 
-kstr *
-kstr_add_reset(
-      kstr * this)
+int
+kstr_view_compare(
+      kstr_view view1,
+      kstr_view view2)
 {
-   static char const * const chars = "\x1b[0m";
+   size_t const len = (view1.len < view2.len) ? view1.len : view2.len;
+   int const result = (len == 0) ? 0 : memcmp(view1.ptr, view2.ptr, len);
+   if (result != 0 || view1.len == view2.len)
+      return result;
 
-   // append the reset control code
-   return kstr_add_chars(this, chars, strlen(chars), false);
+   return (view1.len < view2.len) ? -1 : 1;
 }
 
-kstr *
-kstr_add_text(
-      kstr * this,
-      char const * text)
+bool
+kstr_view_equal(
+      kstr_view view1,
+      kstr_view view2)
 {
-   return kstr_add_chars(this, text, text == NULL ? 0 : strlen(text), true);
+   return
+      view1.len == view2.len &&
+      (
+         view1.len == 0 ||
+         view1.ptr == view2.ptr ||
+         memcmp(view1.ptr, view2.ptr, view1.len) == 0);
 }
 
-kstr *
-kstr_add_vfmt(
-      kstr * this,
-      char const * fmt,
-      va_list args)
+size_t
+kstr_view_find(
+      kstr_view view,
+      kstr_view needle,
+      size_t pos)
 {
-   // calculate the formatted string's size
-   va_list args_copy;
-   va_copy(args_copy, args);
-   int length = vsnprintf(NULL, 0, fmt, args_copy);
-   va_end(args_copy);
+   if (pos > view.len || needle.len > view.len - pos)
+      return kstr_npos;
+   if (needle.len == 0)
+      return pos;
 
-   size_t count = (length < 0) ? 0 : (size_t) length;
+   size_t const last = view.len - needle.len;
 
-   // grow the buffer until enough bytes are available
-   while (kstr_available(this) < count)
-      if (kstr_grow(this) == NULL)
-         return NULL;
+#ifdef __SSE2__
+   // look for the first and last bytes of the needle 16 positions at a time,
+   // which skips most false starts before comparing the rest of the needle
+   if (needle.len > 1)
+   {
+      __m128i const first = _mm_set1_epi8(needle.ptr[0]);
+      __m128i const final = _mm_set1_epi8(needle.ptr[needle.len - 1]);
+      for (; last - pos >= 16; pos += 16)
+      {
+         char const * const block = view.ptr + pos;
+         __m128i const heads = _mm_cmpeq_epi8(
+               first, _mm_loadu_si128((__m128i const *) block));
+         __m128i const tails = _mm_cmpeq_epi8(
+               final,
+               _mm_loadu_si128((__m128i const *) (block + needle.len - 1)));
 
-   // append the formatted string
-   va_copy(args_copy, args);
-   vsnprintf(this->data + this->used - 1, count + 1, fmt, args_copy);
-   va_end(args_copy);
+         unsigned int mask =
+            (unsigned int) _mm_movemask_epi8(_mm_and_si128(heads, tails));
+         while (mask != 0)
+         {
+            size_t const i = (size_t) __builtin_ctz(mask);
+            if (memcmp(block + i + 1, needle.ptr + 1, needle.len - 2) == 0)
+               return pos + i;
+            mask &= mask - 1;
+         }
+      }
+   }
+#endif
 
-   this->used += count;
-   this->width += count;
+   // look for the first byte of the needle, then check the rest
+   while (pos <= last)
+   {
+      char const * const match =
+         memchr(view.ptr + pos, needle.ptr[0], last - pos + 1);
+      if (match == NULL)
+         break;
 
-   // invalidate the cached basename
-   free(this->basename);
-   this->basename = NULL;
+      pos = (size_t) (match - view.ptr);
+      if (memcmp(match + 1, needle.ptr + 1, needle.len - 1) == 0)
+         return pos;
+      pos++;
+   }
 
-   return this;
+   return kstr_npos;
 }
 
-static
 size_t
-kstr_available(
-      kstr * this)
+kstr_view_find_char(
+      kstr_view view,
+      char c,
+      size_t pos)
 {
-   return this->data_size - this->used;
+   if (pos >= view.len)
+      return kstr_npos;
+
+   char const * const match = memchr(view.ptr + pos, c, view.len - pos);
+   return (match == NULL) ? kstr_npos : (size_t) (match - view.ptr);
 }
 
-char const *
-kstr_basename(
-      kstr * this)
+uint64_t
+kstr_view_hash(
+      kstr_view view)
 {
-   // use the cached basename if available
-   if (this->basename != NULL)
-      return this->basename;
-
-   // get a modifiable copy of the buffer
-   char * data_copy;
-   if ((data_copy = kstr_get_copy(this)) == NULL)
-      return NULL;
+   uint64_t const m = kstr_hash_mul;
+   unsigned char const * const bytes = (unsigned char const *) view.ptr;
+   uint64_t hash = view.len * m;
 
-   // calculate and cache the basename
-   this->basename = strdup(basename(data_copy));
-   free(data_copy);
+   // mix in eight bytes at a time
+   size_t i = 0;
+   for (; view.len - i >= 8; i += 8)
+   {
+      uint64_t word;
+      memcpy(&word, bytes + i, sizeof(word));
+      word *= m;
+      word ^= word >> 47;
+      word *= m;
+      hash ^= word;
+      hash *= m;
+   }
 
-   if (this->basename == NULL)
-      kstr_abort(&this);
+   // mix in the remaining bytes, then mix the bits of the hash
+   if (i < view.len)
+   {
+      uint64_t word = 0;
+      for (size_t j = 0; i + j < view.len; j++)
+         word |= (uint64_t) bytes[i + j] << (8 * j);
+      hash ^= word;
+      hash *= m;
+   }
 
-   return this->basename;
+   hash ^= hash >> 47;
+   hash *= m;
+   hash ^= hash >> 47;
+   return hash;
 }
 
-kstr *
-kstr_copy(
-      kstr * this)
+size_t
+kstr_view_split(
+      kstr_view view,
+      kstr_view delimiters,
+      kstr_view * pieces,
+      size_t max)
 {
-   // allocate and initialize the string object
-   kstr * this_copy;
-   if ((this_copy = malloc(sizeof(*this_copy))) == NULL)
-      return kstr_abort(&this);
-
-   this_copy->basename = NULL;
-   this_copy->data_size = this->data_size;
-   this_copy->used = this->used;
-   this_copy->width = this->width;
-
-   // allocate and initialize the character buffer
-   if ((this_copy->data = malloc(this_copy->data_size)) == NULL)
+   size_t count = 0;
+   kstr_view rest = view;
+   kstr_view piece;
+   while (kstr_view_token(&rest, delimiters, &piece))
    {
-      kstr_free(&this_copy);
-      return kstr_abort(&this);
+      if (count < max)
+         pieces[count] = piece;
+      count++;
    }
 
-   memcpy(this_copy->data, this->data, this_copy->data_size);
-   return this_copy;
+   return count;
 }
 
-kstr *
-kstr_free(
-      kstr ** ptr)
+kstr_view
+kstr_view_sub(
+      kstr_view view,
+      size_t pos,
+      size_t count)
 {
-   if (ptr == NULL)
-      return NULL;
+   if (pos > view.len)
+      pos = view.len;
+   if (count > view.len - pos)
+      count = view.len - pos;
 
-   // set the pointer's target to null
-   kstr * this = *ptr;
-   *ptr = NULL;
-   if (this == NULL)
-      return NULL;
+   return (kstr_view) { view.ptr + pos, count };
+}
 
-   // free allocated memory
-   free(this->data);
-   free(this->basename);
-   free(this);
-   return NULL;
+kstr_view
+kstr_view_text(
+      char const * text)
+{
+   return (kstr_view) { text, (text == NULL) ? 0 : strlen(text) };
 }
 
-char const *
-kstr_get(
-      kstr * this)
+bool
+kstr_view_token(
+      kstr_view * rest,
+      kstr_view delimiters,
+      kstr_view * token)
 {
-   return this->data;
+   // a length no view can have marks the end, so that an empty view with a
+   // null pointer still has its one empty piece
+   if (rest->len == kstr_npos)
+      return false;
+
+   // the last token ends at the end of the view
+   size_t const end = kstr_find_any(*rest, delimiters, 0);
+   if (end == kstr_npos)
+   {
+      *token = *rest;
+      rest->len = kstr_npos;
+      return true;
+   }
+
+   *token = (kstr_view) { rest->ptr, end };
+   *rest = (kstr_view) { rest->ptr + end + 1, rest->len - end - 1 };
+   return true;
 }
 
-char *
-kstr_get_copy(
+size_t
+kstr_width(
       kstr * this)
 {
-   char * data_copy;
-   if ((data_copy = strdup(this->data)) == NULL)
-      kstr_abort(&this);
+   return this->width;
+}
 
-   return data_copy;
+bool
+kstr_write(
+      kstr * this,
+      int fd)
+{
+   return kstr_writev(&this, 1, fd);
 }
 
-static
-kstr *
-kstr_grow(
-      kstr * this)
+bool
+kstr_write_plain(
+      kstr * this,
+      int fd)
 {
-   static size_t const grow_factor = 2;
+   struct kstr_writer writer;
+   writer.fd = fd;
+   writer.count = 0;
 
-   // safely calculate the size of the new buffer
-   if (this->data_size == (size_t) -1)
-      return kstr_abort(&this);
+   // without tracked control codes, write the cached plain copy
+   if (!this->controls_tracked)
+   {
+      kstr_view const plain = kstr_get_plain(this);
+      return kstr_writer_add(&writer, plain.ptr, plain.len)
+         && kstr_writer_flush(&writer);
+   }
 
-   size_t new_data_size;
-   if (this->data_size > (size_t) -1 / grow_factor)
-      new_data_size = (size_t) -1;
-   else
-      new_data_size = this->data_size * grow_factor;
+   // write the bytes between the control codes of each chunk as they are
+   size_t base = 0;
+   size_t next = 0;
+   for (struct kstr_chunk * chunk = this->chunks; chunk; chunk = chunk->next)
+   {
+      if (!kstr_writer_add_plain(
+            &writer, this, chunk->data, chunk->count, base, &next))
+         return false;
+      base += chunk->count;
+   }
 
-   // grow the buffer
-   char * new_data;
-   if ((new_data = realloc(this->data, new_data_size)) == NULL)
-      return kstr_abort(&this);
+   if (!kstr_writer_add_plain(
+         &writer, this, this->data, this->used - 1, base, &next))
+      return false;
 
-   this->data_size = new_data_size;
-   this->data = new_data;
-   return this;
+   return kstr_writer_flush(&writer);
 }
 
-kstr *
-kstr_new(
-      char const * text)
+static
+bool
+kstr_writer_add(
+      struct kstr_writer * writer,
+      char const * chars,
+      size_t count)
 {
-   static size_t const init_size = 64;
+   if (count == 0)
+      return true;
 
-   // allocate and initialize the string object
-   kstr * this;
-   if ((this = malloc(sizeof(*this))) == NULL)
-      return kstr_abort(&this);
+   if (writer->count == kstr_writer_iovs && !kstr_writer_flush(writer))
+      return false;
 
-   this->basename = NULL;
-   this->data_size = init_size;
-   this->used = 1;
-   this->width = 0;
+   writer->iov[writer->count++] = (struct iovec) { (void *) chars, count };
+   return true;
+}
 
-   // allocate and initialize the character buffer
-   if ((this->data = malloc(this->data_size)) == NULL)
-      return kstr_abort(&this);
-   this->data[0] = '\0';
+static
+bool
+kstr_writer_add_plain(
+      struct kstr_writer * writer,
+      kstr const * this,
+      char const * chars,
+      size_t count,
+      size_t base,
+      size_t * next)
+{
+   size_t pos = 0;
+   while (pos < count)
+   {
+      // skip the control codes that end before the current byte
+      size_t i = *next;
+      while (i < this->control_count
+            && this->controls[i].pos + this->controls[i].count <= base + pos)
+         i++;
+      *next = i;
 
-   if (kstr_add_text(this, text) == NULL)
-      return kstr_abort(&this);
+      // skip the bytes of a control code, or write those before the next one
+      size_t end = count;
+      if (i < this->control_count)
+      {
+         struct kstr_control const * const control = &this->controls[i];
+         if (control->pos <= base + pos)
+         {
+            size_t const control_end = control->pos + control->count - base;
+            pos = (control_end < count) ? control_end : count;
+            continue;
+         }
 
-   return this;
+         if (control->pos - base < end)
+            end = control->pos - base;
+      }
+
+      if (!kstr_writer_add(writer, chars + pos, end - pos))
+         return false;
+      pos = end;
+   }
+
+   return true;
 }
 
 static
-kstr *
-kstr_reset(
-      kstr * this)
+bool
+kstr_writer_flush(
+      struct kstr_writer * writer)
 {
-   // clear the string's value
-   this->data[0] = '\0';
-   this->used = 1;
-   this->width = 0;
+   struct iovec * iov = writer->iov;
+   size_t count = writer->count;
+   writer->count = 0;
 
-   // invalidate the cached basename
-   free(this->basename);
-   this->basename = NULL;
+   while (count > 0)
+   {
+      ssize_t written = writev(writer->fd, iov, (int) count);
+      if (written < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return false;
+      }
 
-   return this;
-}
+      // skip the pieces that were written, and the written part of the
+      // first piece that wasn't
+      while (count > 0 && (size_t) written >= iov->iov_len)
+      {
+         written -= (ssize_t) iov->iov_len;
+         iov++;
+         count--;
+      }
 
-kstr *
-kstr_set_fmt(
-      kstr * this,
-      char const * fmt,
-      ...)
-{
-   va_list args;
-   va_start(args, fmt);
-   this = kstr_set_vfmt(this, fmt, args);
-   va_end(args);
+      if (count > 0)
+      {
+         iov->iov_base = (char *) iov->iov_base + written;
+         iov->iov_len -= (size_t) written;
+      }
+   }
 
-   return this;
+   return true;
 }
 
-kstr *
-kstr_set_text(
-      kstr * this,
-      char const * text)
+bool
+kstr_writev(
+      kstr * const * strings,
+      size_t n,
+      int fd)
 {
-   kstr_reset(this);
-   return kstr_add_text(this, text);
-}
+   struct kstr_writer writer;
+   writer.fd = fd;
+   writer.count = 0;
 
-kstr *
-kstr_set_vfmt(
-      kstr * this,
-      char const * fmt,
-      va_list args)
-{
-   kstr_reset(this);
-   return kstr_add_vfmt(this, fmt, args);
-}
+   // write each chunk of each string's value as it is
+   for (size_t i = 0; i < n; i++)
+   {
+      kstr * const this = strings[i];
+      for (struct kstr_chunk * chunk = this->chunks; chunk; chunk = chunk->next)
+         if (!kstr_writer_add(&writer, chunk->data, chunk->count))
+            return false;
 
-size_t
-kstr_size(
-      kstr * this)
-{
-   return this->used;
-}
+      if (!kstr_writer_add(&writer, this->data, this->used - 1))
+         return false;
+   }
 
-size_t
-kstr_width(
-      kstr * this)
-{
-   return this->width;
+   return kstr_writer_flush(&writer);
 }
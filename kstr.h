@@ -19,15 +19,22 @@
 //! kstr implements a string object and associated methods. a string manages
 //! its own memory, grows dynamically as text is added to it, supports embedded
 //! ansi terminal control codes for colorization and styling, and tracks its
-//! width (visible character count) and size (number of bytes used)
-//! independently.
+//! width (terminal columns taken by visible text) and size (number of bytes
+//! used) independently.
 //!
 //! the api deals with opaque pointers to ::kstr objects, which must be created
 //! with kstr_new() and destroyed with kstr_free().
 //!
-//! any method that modifies a string will raise `SIGABRT` if memory allocation
-//! fails. if the signal is caught and handled, the method will destroy the
-//! string with kstr_free() and return a null pointer.
+//! strings can optionally be allocated from a ::kstr_arena with kstr_new_in()
+//! or kstr_copy_in(). all memory used by such strings comes from the arena and
+//! is released at once by kstr_arena_free() or kstr_arena_reset().
+//!
+//! by default, any method that modifies a string will raise `SIGABRT` if memory
+//! allocation fails or an argument is invalid. if the signal is caught and
+//! handled, the method will destroy the string with kstr_free() and return a
+//! null pointer. after kstr_set_error_mode() selects ::kstr_error_return,
+//! methods instead fail without changing the string, returning a null pointer
+//! (or `false`) with `errno` set, so that a program can recover.
 
 #ifndef kstr_h
 #define kstr_h
@@ -35,10 +42,42 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 //! string object type
 typedef struct kstr kstr;
 
+//! string arena type
+typedef struct kstr_arena kstr_arena;
+
+//! compiled format string type
+typedef struct kstr_fmt kstr_fmt;
+
+//! string intern table type
+typedef struct kstr_intern kstr_intern;
+
+//! concurrent string type
+typedef struct kstr_concurrent kstr_concurrent;
+
+//! bulk builder type
+typedef struct kstr_builder kstr_builder;
+
+//! position returned by search functions when nothing is found
+#define kstr_npos ((size_t) -1)
+
+//! read-only view of a range of bytes
+//!
+//! a view refers to memory owned by something else, usually a string, and is
+//! passed around by value without being allocated or destroyed. a view
+//! obtained from a string becomes invalid if the string is modified or
+//! destroyed. the viewed bytes are not necessarily nul-terminated.
+typedef struct kstr_view
+{
+   char const * ptr; //!< first byte
+   size_t len; //!< number of bytes
+} kstr_view;
+
 //! string colors
 typedef enum kstr_color
 {
@@ -54,6 +93,121 @@ typedef enum kstr_color
    kstr_num_colors //!< symbolic number of enumerators
 } kstr_color;
 
+//! kinds of colors a style can set
+typedef enum kstr_color_kind
+{
+   kstr_color_kind_none, //!< leave the color as it is
+   kstr_color_kind_basic, //!< one of the colors of ::kstr_color
+   kstr_color_kind_256, //!< entry of the 256-color palette
+   kstr_color_kind_rgb, //!< 24-bit color
+   kstr_num_color_kinds //!< symbolic number of enumerators
+} kstr_color_kind;
+
+//! color set by a style
+//!
+//! only the members used by a color's kind need to be set. colors are most
+//! easily made with kstr_style_basic(), kstr_style_256(), and
+//! kstr_style_rgb().
+typedef struct kstr_style_color
+{
+   kstr_color_kind kind; //!< kind of color
+   kstr_color basic; //!< color (::kstr_color_kind_basic)
+   uint8_t index; //!< palette index (::kstr_color_kind_256)
+   uint8_t red; //!< red component (::kstr_color_kind_rgb)
+   uint8_t green; //!< green component (::kstr_color_kind_rgb)
+   uint8_t blue; //!< blue component (::kstr_color_kind_rgb)
+} kstr_style_color;
+
+//! text attributes to set with a single control code
+//!
+//! a zero-initialized style leaves every attribute as it is, so only the
+//! attributes to change need to be set, e.g.
+//! `{ .fg = { .kind = kstr_color_kind_256, .index = 208 } }`.
+typedef struct kstr_style
+{
+   bool set_bold; //!< set the bold attribute to \a bold
+   bool bold; //!< enable or disable bold (if \a set_bold)
+   kstr_style_color fg; //!< foreground color
+   kstr_style_color bg; //!< background color
+} kstr_style;
+
+//! string buffer growth policies
+//!
+//! a growth policy determines how much a string's buffer grows when more
+//! space is needed to append to its value. regardless of the policy, the
+//! buffer is resized at most once per append.
+//!
+//! with ::kstr_growth_chunked, a full buffer is kept as a chunk of the value
+//! instead of being resized, so appending to a very large string never copies
+//! what it already holds. the chunks are joined into a single buffer the next
+//! time the whole value is needed, e.g. by kstr_get(), kstr_get_view() or
+//! kstr_copy(), while kstr_get_chunks() reads them without joining them.
+typedef enum kstr_growth
+{
+   kstr_growth_double, //!< double the size until it fits (default)
+   kstr_growth_half, //!< grow the size by half until it fits
+   kstr_growth_page, //!< round the needed size up to a multiple of the page size
+   kstr_growth_chunked, //!< link a new buffer of at least 1 MiB to the value
+   kstr_num_growths //!< symbolic number of enumerators
+} kstr_growth;
+
+//! ways of handling failures
+typedef enum kstr_error_mode
+{
+   kstr_error_abort, //!< raise `SIGABRT` with `abort()` (default)
+   kstr_error_return, //!< return a null pointer and set `errno`
+   kstr_num_error_modes //!< symbolic number of enumerators
+} kstr_error_mode;
+
+//! number of buckets of the wasted capacity histogram of ::kstr_stats
+#define kstr_waste_buckets 8
+
+//! counters of what strings cost a thread
+//!
+//! the counters are only updated if the library is built with the
+//! `kstr_instrument` macro defined, e.g. with `make instrument=1`; otherwise,
+//! they stay zero.
+typedef struct kstr_stats
+{
+   uint64_t allocs; //!< blocks of memory allocated for objects and buffers
+   uint64_t resizes; //!< buffers resized to grow, shrink, or stop sharing
+   uint64_t bytes_copied; //!< bytes copied to move values to other buffers
+   uint64_t fmt_passes; //!< calls of `vsnprintf()` by kstr_add_vfmt()
+   uint64_t basename_hits; //!< kstr_basename() calls using the cached copy
+   uint64_t basename_misses; //!< kstr_basename() calls making a new copy
+
+   //! strings destroyed by kstr_free(), by how many bytes of their buffers
+   //! were unused: fewer than 16, 64, 256, 1 KiB, 4 KiB, 16 KiB, 64 KiB, or
+   //! more
+   uint64_t waste[kstr_waste_buckets];
+} kstr_stats;
+
+//! string piece kinds
+typedef enum kstr_piece_kind
+{
+   kstr_piece_text, //!< nul-terminated text in \a chars
+   kstr_piece_bytes, //!< \a count bytes in \a chars
+   kstr_piece_bold, //!< bold control code (see kstr_add_bold())
+   kstr_piece_fg, //!< foreground color control code (see kstr_add_fg())
+   kstr_piece_bg, //!< background color control code (see kstr_add_bg())
+   kstr_piece_reset, //!< reset control code (see kstr_add_reset())
+   kstr_num_piece_kinds //!< symbolic number of enumerators
+} kstr_piece_kind;
+
+//! piece of text or control code to append
+//!
+//! an array of pieces can be appended to a string with kstr_add_iov(). only
+//! the members used by a piece's kind need to be set, e.g.
+//! `{ .kind = kstr_piece_fg, .color = kstr_color_red }`.
+typedef struct kstr_piece
+{
+   kstr_piece_kind kind; //!< kind of piece
+   char const * chars; //!< text or bytes (text and bytes pieces)
+   size_t count; //!< number of bytes in \a chars (bytes pieces)
+   kstr_color color; //!< color (::kstr_piece_fg, ::kstr_piece_bg)
+   bool bold; //!< enable or disable bold (::kstr_piece_bold)
+} kstr_piece;
+
 //! create a new string
 //!
 //! allocates memory for the string object. if \a text is not a null pointer,
@@ -66,11 +220,50 @@ typedef enum kstr_color
 //! \return a new string
 kstr * kstr_new(char const * text);
 
+//! create a new string with a preallocated buffer
+//!
+//! identical to kstr_new() with an empty initial value, except that the
+//! string's buffer is allocated with enough space to append \a capacity bytes
+//! without growing.
+//!
+//! \param capacity number of bytes to preallocate
+//!
+//! \return a new string
+kstr * kstr_new_with_capacity(size_t capacity);
+
+//! create a new string from a byte array
+//!
+//! identical to kstr_new(), except that the initial value is the first
+//! \a count bytes of \a bytes, which may include nul characters. if \a bytes
+//! is a null pointer, the string is initialized with an empty value.
+//!
+//! \param bytes initial value
+//! \param count number of bytes in \a bytes
+//!
+//! \return a new string
+kstr * kstr_new_bytes(char const * bytes, size_t count);
+
+//! create a new string in an arena
+//!
+//! identical to kstr_new(), except that the string object and its character
+//! buffer are allocated from \a arena. if \a arena is a null pointer, the
+//! string is allocated on the heap just like kstr_new().
+//!
+//! a string allocated from an arena may still be passed to kstr_free(), but
+//! its memory is only released when the arena is reset or destroyed.
+//!
+//! \param arena arena to allocate from
+//! \param text initial value
+//!
+//! \return a new string
+kstr * kstr_new_in(kstr_arena * arena, char const * text);
+
 //! destroy a string
 //!
 //! if \a ptr is not null, the string it points to is destroyed and is set to
 //! `NULL`. all memory used by the string is freed, and any pointers to it are
-//! no longer valid.
+//! no longer valid. strings returned by kstr_intern_get() are left alone, as
+//! they are destroyed with their intern table.
 //!
 //! \param ptr string pointer
 //!
@@ -79,15 +272,337 @@ kstr * kstr_free(kstr ** ptr);
 
 //! create a copy of a string
 //!
-//! allocates memory for a new string object that is identical to \a this. the
-//! returned string must be destroyed with kstr_free() when it is no longer
-//! needed.
+//! allocates memory for a new string object that is identical to \a this.
+//! only the bytes used by the value are copied, so the copy's buffer may be
+//! smaller than the original's. the returned string must be destroyed with
+//! kstr_free() when it is no longer needed.
 //!
 //! \param this string
 //!
 //! \return a copy of the string
 kstr * kstr_copy(kstr * this);
 
+//! create a copy-on-write clone of a string
+//!
+//! allocates memory for a new string object that is identical to \a this but
+//! shares its character buffer instead of copying it. the buffer is copied
+//! only when either string is modified, so fanning out one value to many
+//! clones is cheap. clones may be used and destroyed independently, even from
+//! different threads. short values and strings allocated from an arena are
+//! copied with kstr_copy() instead. the returned string must be destroyed with
+//! kstr_free() when it is no longer needed.
+//!
+//! \param this string
+//!
+//! \return a clone of the string
+kstr * kstr_clone(kstr * this);
+
+//! create a copy of a string in an arena
+//!
+//! identical to kstr_copy(), except that the new string is allocated from
+//! \a arena (see kstr_new_in()). \a this does not need to belong to the same
+//! arena, or to any arena at all.
+//!
+//! \param arena arena to allocate from
+//! \param this string
+//!
+//! \return a copy of the string
+kstr * kstr_copy_in(kstr_arena * arena, kstr * this);
+
+//! create a new arena
+//!
+//! allocates an arena that hands out memory for strings in blocks of
+//! \a block_size bytes. if \a block_size is zero, a default size is used.
+//! the returned arena must be destroyed with kstr_arena_free() when it is no
+//! longer needed.
+//!
+//! \param block_size size of each block of arena memory
+//!
+//! \return a new arena
+kstr_arena * kstr_arena_new(size_t block_size);
+
+//! destroy an arena
+//!
+//! if \a ptr is not null, the arena it points to is destroyed and is set to
+//! `NULL`. all strings allocated from the arena are destroyed along with it,
+//! and any pointers to them are no longer valid.
+//!
+//! \param ptr arena pointer
+//!
+//! \return `NULL`
+kstr_arena * kstr_arena_free(kstr_arena ** ptr);
+
+//! release all strings allocated from an arena
+//!
+//! all strings allocated from the arena are destroyed, and any pointers to
+//! them are no longer valid. the arena keeps its first block of memory so it
+//! can be reused without allocating again.
+//!
+//! \param arena arena
+//!
+//! \return \a arena
+kstr_arena * kstr_arena_reset(kstr_arena * arena);
+
+//! create a new intern table
+//!
+//! an intern table holds a single string for each distinct value interned in
+//! it, so that equal values interned in the same table can be compared by
+//! pointer. the interned strings are allocated from \a arena if it is not a
+//! null pointer, in which case the arena must not be reset or destroyed
+//! before the table. the returned table must be destroyed with
+//! kstr_intern_free() when it is no longer needed. a table must not be used by
+//! several threads at once.
+//!
+//! \param arena arena to allocate interned strings from (or `NULL`)
+//!
+//! \return a new intern table
+kstr_intern * kstr_intern_new(kstr_arena * arena);
+
+//! destroy an intern table
+//!
+//! if \a ptr is not null, the table it points to and all strings interned in
+//! it are destroyed, and it is set to `NULL`.
+//!
+//! \param ptr intern table pointer
+//!
+//! \return `NULL`
+kstr_intern * kstr_intern_free(kstr_intern ** ptr);
+
+//! intern a value
+//!
+//! returns the table's string with the bytes of \a view as its value, which
+//! is created the first time the value is interned. the returned string
+//! belongs to the table and must not be modified; kstr_free() leaves it
+//! alone. its hash is already cached (see kstr_hash()).
+//!
+//! \param table intern table
+//! \param view value to intern
+//!
+//! \return the interned string
+kstr * kstr_intern_get(kstr_intern * table, kstr_view view);
+
+//! get the number of strings in an intern table
+//!
+//! \param table intern table
+//!
+//! \return the number of distinct values interned in the table
+size_t kstr_intern_size(kstr_intern * table);
+
+//! set the calling thread's string cache limit
+//!
+//! each thread can keep the memory of strings it destroys with kstr_free() in
+//! a cache, so that strings it creates later with kstr_new() or kstr_copy()
+//! can reuse it instead of allocating it again. string objects and
+//! character buffers of up to 64 KiB are cached, as long as the cache holds
+//! at most \a limit bytes; anything else is freed as usual. the cache is
+//! disabled (its limit is zero) by default. memory is only reused by the
+//! thread that cached it, and a thread's cache is freed when it exits.
+//!
+//! if the cache holds more than \a limit bytes, it is purged.
+//!
+//! \param limit maximum number of bytes to cache (zero to disable)
+//!
+//! \return the previous limit
+size_t kstr_cache_limit(size_t limit);
+
+//! free the memory in the calling thread's string cache
+//!
+//! the cache limit is left unchanged, so the cache fills up again as strings
+//! are destroyed; set the limit to zero first to disable the cache.
+//!
+//! \return the number of bytes freed
+size_t kstr_cache_purge(void);
+
+//! set how failures are handled
+//!
+//! the mode applies to all threads and should be set before strings are used,
+//! typically once at startup. with ::kstr_error_return, a method that can't
+//! allocate memory returns a null pointer (or `false`) with `errno` set to
+//! `ENOMEM`, and one given an invalid argument, such as an invalid color, sets
+//! `errno` to `EINVAL`. the string is left as it was before the call, so it
+//! must not be replaced with the returned null pointer: e.g.
+//! `if (kstr_add_text(str, text) == NULL)` rather than
+//! `str = kstr_add_text(str, text)`. only kstr_set_text() and the other
+//! methods that replace the whole value leave it empty. kstr_new(), kstr_copy()
+//! and the other functions that create objects return a null pointer without
+//! leaking anything.
+//!
+//! an invalid \a mode is handled as an invalid argument according to the
+//! current mode, which is left unchanged.
+//!
+//! \param mode new error mode
+//!
+//! \return the previous error mode
+kstr_error_mode kstr_set_error_mode(kstr_error_mode mode);
+
+//! get the calling thread's counters
+//!
+//! \param stats where to store the counters
+void kstr_stats_get(kstr_stats * stats);
+
+//! reset the calling thread's counters to zero
+void kstr_stats_reset(void);
+
+//! create a new concurrent string
+//!
+//! a concurrent string collects bytes appended by many threads at once
+//! without a mutex. each append reserves space with an atomic fetch-add and
+//! copies its bytes in parallel with other appends, and the bytes of one
+//! append are never interleaved with those of another. appends are published
+//! in order, so they aren't lock-free: once an append has copied its bytes,
+//! it waits for the earlier appends into the same segment to finish, spinning
+//! briefly and then yielding the processor. appends always complete as long
+//! as every appending thread keeps being scheduled, but a thread that stops
+//! in the middle of an append (e.g. in a signal handler) holds up the appends
+//! after it in the segment. space is allocated in segments of
+//! \a segment_size bytes (or a default size if it's zero), and a new segment
+//! is linked in when one fills up, so the bytes already appended never move
+//! and are only freed by kstr_concurrent_free(). the value can be read with
+//! kstr_add_concurrent() at any time, and doesn't track a width.
+//! the returned string must be destroyed with kstr_concurrent_free() when it
+//! is no longer needed.
+//!
+//! \param segment_size size of each segment of the concurrent string
+//!
+//! \return a new concurrent string
+kstr_concurrent * kstr_concurrent_new(size_t segment_size);
+
+//! destroy a concurrent string
+//!
+//! if \a ptr is not null, the concurrent string it points to is destroyed and
+//! is set to `NULL`. no other thread may be using the string.
+//!
+//! \param ptr concurrent string pointer
+//!
+//! \return `NULL`
+kstr_concurrent * kstr_concurrent_free(kstr_concurrent ** ptr);
+
+//! add bytes to a concurrent string
+//!
+//! appends the first \a count bytes of \a bytes to the concurrent string's
+//! value. this is safe to call from any number of threads at once. once the
+//! bytes are copied, the append waits for any earlier appends into the same
+//! segment to finish copying, so readers only see complete appends.
+//!
+//! \param this concurrent string
+//! \param bytes additional value
+//! \param count number of bytes in \a bytes
+//!
+//! \return \a this
+kstr_concurrent * kstr_concurrent_add_bytes(
+      kstr_concurrent * this,
+      char const * bytes,
+      size_t count);
+
+//! add text to a concurrent string
+//!
+//! identical to kstr_concurrent_add_bytes() with the bytes of \a text, not
+//! including the nul terminator. if \a text is a null pointer, nothing is
+//! appended.
+//!
+//! \param this concurrent string
+//! \param text additional value
+//!
+//! \return \a this
+kstr_concurrent * kstr_concurrent_add_text(
+      kstr_concurrent * this,
+      char const * text);
+
+//! add the bytes of a view to a concurrent string
+//!
+//! identical to kstr_concurrent_add_bytes() with the bytes of \a view, e.g.
+//! a line built in a thread's own string and viewed with kstr_get_view().
+//!
+//! \param this concurrent string
+//! \param view additional value
+//!
+//! \return \a this
+kstr_concurrent * kstr_concurrent_add_view(
+      kstr_concurrent * this,
+      kstr_view view);
+
+//! get the size of a concurrent string's value
+//!
+//! returns the number of bytes of complete appends so far, not including a
+//! nul terminator.
+//!
+//! \param this concurrent string
+//!
+//! \return the size in bytes
+size_t kstr_concurrent_size(kstr_concurrent * this);
+
+//! add the value of a concurrent string to a string
+//!
+//! appends the bytes of all complete appends to \a source so far, in
+//! segment order, to the string's value. appends to \a source may continue
+//! while this is called.
+//!
+//! \param this string
+//! \param source concurrent string
+//!
+//! \return \a this
+kstr * kstr_add_concurrent(kstr * this, kstr_concurrent * source);
+
+//! create a new bulk builder
+//!
+//! a bulk builder assembles a large value from \a count pieces that are built
+//! in parallel, e.g. one per worker thread, and appends them to a string in
+//! order. each piece is built in a slice of its own, obtained with
+//! kstr_builder_slice(), and kstr_builder_finish() then copies every slice
+//! into place at once. the string must not be modified or destroyed until the
+//! builder is destroyed with kstr_builder_free(), except by
+//! kstr_builder_finish().
+//!
+//! \param this string to append to
+//! \param count number of slices
+//!
+//! \return a new bulk builder
+kstr_builder * kstr_builder_new(kstr * this, size_t count);
+
+//! destroy a bulk builder
+//!
+//! if \a ptr is not null, the builder it points to is destroyed along with its
+//! slices and is set to `NULL`. the string it appends to is left as it is.
+//!
+//! \param ptr bulk builder pointer
+//!
+//! \return `NULL`
+kstr_builder * kstr_builder_free(kstr_builder ** ptr);
+
+//! get a slice of a bulk builder
+//!
+//! returns the string the piece at \a index is built in, which starts out
+//! empty and recognizes escape sequences if the builder's string does. a slice
+//! may be appended to like any other string, and different slices may be used
+//! by different threads at once, but each slice must only be used by one
+//! thread at a time. slices must not be destroyed. if \a index is out of
+//! range, the call fails with `EINVAL`.
+//!
+//! \param this bulk builder
+//! \param index slice index
+//!
+//! \return the slice
+kstr * kstr_builder_slice(kstr_builder * this, size_t index);
+
+//! append the slices of a bulk builder to its string
+//!
+//! appends the values of every slice to the builder's string in index order,
+//! growing it only once and copying the slices' bytes with up to \a threads
+//! threads (including the calling one) when the output is large. the bytes,
+//! width, and control codes are the same as if the slices' values had been
+//! appended one after another, except that the end of a slice ends an
+//! incomplete utf-8 or escape sequence like a control code does, and a slice
+//! doesn't know the style set by those before it, so kstr_add_style() may
+//! repeat attributes that are already active. the slices are emptied when
+//! done, so the builder can be used for another batch. no other thread may
+//! be using the slices while this is called.
+//!
+//! \param this bulk builder
+//! \param threads maximum number of threads to copy with
+//!
+//! \return the builder's string
+kstr * kstr_builder_finish(kstr_builder * this, size_t threads);
+
 //! set a string's value
 //!
 //! if \a text is not a null pointer, the string is changed to use the given
@@ -99,6 +614,19 @@ kstr * kstr_copy(kstr * this);
 //! \return \a this
 kstr * kstr_set_text(kstr * this, char const * text);
 
+//! set a string's value from a byte array
+//!
+//! the string is changed to use the first \a count bytes of \a bytes as its
+//! value, which may include nul characters. if \a bytes is a null pointer,
+//! it is changed to use an empty value.
+//!
+//! \param this string
+//! \param bytes new value
+//! \param count number of bytes in \a bytes
+//!
+//! \return \a this
+kstr * kstr_set_bytes(kstr * this, char const * bytes, size_t count);
+
 //! format a string's value
 //!
 //! the string is changed to use a value calculated from the given
@@ -142,6 +670,30 @@ kstr * kstr_set_vfmt(kstr * this, char const * fmt, va_list args)
 //! \return \a this
 kstr * kstr_add_text(kstr * this, char const * text);
 
+//! add bytes to a string
+//!
+//! if \a bytes is not a null pointer, its first \a count bytes are appended
+//! to the string's value. unlike kstr_add_text(), the length is not calculated
+//! with `strlen()`, so the bytes may include nul characters.
+//!
+//! \param this string
+//! \param bytes additional value
+//! \param count number of bytes in \a bytes
+//!
+//! \return \a this
+kstr * kstr_add_bytes(kstr * this, char const * bytes, size_t count);
+
+//! add the bytes of a view to a string
+//!
+//! the bytes referred to by \a view are appended to the string's value, as
+//! with kstr_add_bytes(). the view may refer to the string's own value.
+//!
+//! \param this string
+//! \param view additional value
+//!
+//! \return \a this
+kstr * kstr_add_view(kstr * this, kstr_view view);
+
 //! add formatted text to a string
 //!
 //! the given *printf()* -style format string and its arguments are used to
@@ -161,7 +713,9 @@ kstr * kstr_add_fmt(kstr * this, char const * fmt, ...)
 //! append text to a string's value using a format string and arg list
 //!
 //! the given *printf()* -style format string and its arguments are used to
-//! append text to the string's value.
+//! append text to the string's value. the text is formatted directly into the
+//! buffer's free space, and is only formatted a second time if the buffer
+//! first has to grow. if \a fmt is a null pointer, nothing is appended.
 //!
 //! \param this string
 //! \param fmt format string
@@ -174,6 +728,153 @@ kstr * kstr_add_vfmt(kstr * this, char const * fmt, va_list args)
 #endif
 ;
 
+//! add a signed integer to a string
+//!
+//! appends the decimal representation of \a value to the string's value, as
+//! with the `"%jd"` format. the digits are counted first, so the buffer grows
+//! at most once, and no format string is parsed.
+//!
+//! \param this string
+//! \param value integer to append
+//!
+//! \return \a this
+kstr * kstr_add_int(kstr * this, intmax_t value);
+
+//! add an unsigned integer to a string
+//!
+//! appends the decimal representation of \a value to the string's value, as
+//! with the `"%ju"` format. like kstr_add_int(), this grows the buffer at most
+//! once and parses no format string.
+//!
+//! \param this string
+//! \param value integer to append
+//!
+//! \return \a this
+kstr * kstr_add_uint(kstr * this, uintmax_t value);
+
+//! add an unsigned integer in hexadecimal to a string
+//!
+//! appends the lowercase hexadecimal representation of \a value, without a
+//! prefix, to the string's value, as with the `"%jx"` format.
+//!
+//! \param this string
+//! \param value integer to append
+//!
+//! \return \a this
+kstr * kstr_add_hex(kstr * this, uintmax_t value);
+
+//! add a floating-point number to a string
+//!
+//! if \a precision is zero or more, appends \a value with that many digits
+//! after the decimal point, as with the `"%.*f"` format. values of moderate
+//! magnitude with a precision of up to 9 are converted directly, and others
+//! (including rounding ties, infinities, and nans) are formatted with
+//! kstr_add_fmt(), so the result is the same either way in the "C" locale.
+//!
+//! if \a precision is negative, appends the shortest representation that
+//! reads back as exactly \a value, in the style of the `"%g"` format with as
+//! many digits as needed but at least 15. the digits are found directly with
+//! the grisu3 algorithm, except for the rare values it can't decide and for
+//! infinities and nans, which are formatted with `snprintf()`.
+//!
+//! \param this string
+//! \param value number to append
+//! \param precision digits after the decimal point, or negative for the
+//!        shortest exact representation
+//!
+//! \return \a this
+kstr * kstr_add_double(kstr * this, double value, int precision);
+
+//! compile a format string
+//!
+//! parses the given *printf()* -style format string once, so text can be
+//! appended with it by kstr_add_compiled() without parsing it again. literal
+//! text is copied directly, and plain `%%d`, `%%i`, `%%u`, `%%x`, `%%c`,
+//! `%%s`, and `%%f` conversions (with an optional precision for `%%f`) are
+//! converted without *printf()*. other conversions are formatted one at a
+//! time with kstr_add_fmt(). the returned format must be destroyed with
+//! kstr_fmt_free() when it is no longer needed.
+//!
+//! \param fmt format string
+//!
+//! \return a new compiled format, or a null pointer if \a fmt is a null
+//!         pointer or uses positional arguments, `%%n`, or an invalid
+//!         conversion
+kstr_fmt * kstr_fmt_compile(char const * fmt);
+
+//! destroy a compiled format
+//!
+//! if \a ptr is not null, the compiled format it points to is destroyed and
+//! is set to `NULL`.
+//!
+//! \param ptr compiled format pointer
+//!
+//! \return `NULL`
+kstr_fmt * kstr_fmt_free(kstr_fmt ** ptr);
+
+//! add text to a string using a compiled format
+//!
+//! identical to kstr_add_fmt() with the format string that \a fmt was
+//! compiled from. if \a fmt is a null pointer, nothing is appended.
+//!
+//! \param this string
+//! \param fmt compiled format
+//! \param ... format string arguments
+//!
+//! \return \a this
+kstr * kstr_add_compiled(kstr * this, kstr_fmt const * fmt, ...);
+
+//! add text to a string using a compiled format and arg list
+//!
+//! identical to kstr_add_compiled(), except that the arguments are given as
+//! an arg list.
+//!
+//! \param this string
+//! \param fmt compiled format
+//! \param args format string arguments
+//!
+//! \return \a this
+kstr * kstr_add_vcompiled(kstr * this, kstr_fmt const * fmt, va_list args);
+
+//! add formatted text to a string using a cached compiled format
+//!
+//! identical to kstr_add_fmt(), except that \a fmt is compiled the first time
+//! and the compiled format is kept in \a cache, which must initially be
+//! `NULL`. if several threads share \a cache, one of them stores its compiled
+//! format there and the others discard theirs. a format that can't be
+//! compiled is passed to kstr_add_vfmt() each time. the compiled format is
+//! never destroyed, so \a cache is normally a static variable.
+//!
+//! \param this string
+//! \param cache compiled format cache
+//! \param fmt format string
+//! \param ... format string arguments
+//!
+//! \return \a this
+kstr * kstr_add_cached(kstr * this, kstr_fmt ** cache, char const * fmt, ...)
+#ifndef kstr_stdc
+   __attribute__((format(printf, 3, 4)))
+#endif
+;
+
+//! \def kstr_add_fmt_cached(this, fmt, ...)
+//!
+//! add formatted text to a string, compiling the format once per call site
+//!
+//! calls kstr_add_cached() with a static cache for the call site, so \a fmt
+//! should be a string literal. the arguments are checked against the format
+//! at compile time, as with kstr_add_fmt(). when the compiler doesn't
+//! support statement expressions (`kstr_stdc`), this is kstr_add_fmt().
+#ifndef kstr_stdc
+#define kstr_add_fmt_cached(this, ...) \
+   __extension__ ({ \
+      static kstr_fmt * kstr_fmt_cache_; \
+      kstr_add_cached((this), &kstr_fmt_cache_, __VA_ARGS__); \
+   })
+#else
+#define kstr_add_fmt_cached(this, ...) kstr_add_fmt((this), __VA_ARGS__)
+#endif
+
 //! add a control code to set or clear the bold text attribute
 //!
 //! if \a bold is true, the ansi control code for enabling bold text is
@@ -222,15 +923,269 @@ kstr * kstr_add_bg(kstr * this, kstr_color color);
 //! \return \a this
 kstr * kstr_add_reset(kstr * this);
 
+//! add a single control code to set several text attributes
+//!
+//! appends one ansi control code, e.g. `ESC[1;31;44m`, that sets all of the
+//! attributes in \a style, instead of one code per attribute. attributes that
+//! are already active at the end of the string's value are skipped, and if
+//! none are left, nothing is appended. this does not increase the string's
+//! width, as control codes are not considered visible text.
+//!
+//! the active attributes are those set by kstr_add_style(), kstr_add_bold(),
+//! kstr_add_fg(), kstr_add_bg(), kstr_add_reset() and kstr_add_iov() since
+//! the string was created or last cleared, cut or edited. control codes
+//! appended as text aren't tracked, so an escape character in appended text,
+//! or bytes added by kstr_add_view(), kstr_join() or kstr_add_concurrent(),
+//! make none of the attributes known to be active. a style with an invalid
+//! color is an invalid argument, which aborts the program or fails with
+//! `EINVAL` according to kstr_set_error_mode().
+//!
+//! \param this string
+//! \param style attributes to set
+//!
+//! \return \a this
+kstr * kstr_add_style(kstr * this, kstr_style const * style);
+
+//! make a style color of one of the basic colors
+//!
+//! \param color color
+//!
+//! \return a style color of kind ::kstr_color_kind_basic
+kstr_style_color kstr_style_basic(kstr_color color);
+
+//! make a style color of an entry of the 256-color palette
+//!
+//! \param index palette index
+//!
+//! \return a style color of kind ::kstr_color_kind_256
+kstr_style_color kstr_style_256(uint8_t index);
+
+//! make a 24-bit style color
+//!
+//! \param red red component
+//! \param green green component
+//! \param blue blue component
+//!
+//! \return a style color of kind ::kstr_color_kind_rgb
+kstr_style_color kstr_style_rgb(uint8_t red, uint8_t green, uint8_t blue);
+
+//! append several pieces of text and control codes to a string's value
+//!
+//! appends the \a n pieces in \a pieces in order, with the same result as
+//! calling kstr_add_text(), kstr_add_bytes(), kstr_add_bold(), kstr_add_fg(),
+//! kstr_add_bg(), or kstr_add_reset() for each piece. the total size is
+//! computed first, so the buffer grows at most once, and the pieces are copied
+//! in a single pass. a piece with an invalid kind or color is an invalid
+//! argument, which aborts the program or fails with `EINVAL` according to
+//! kstr_set_error_mode().
+//!
+//! \param this string
+//! \param pieces pieces to append
+//! \param n number of pieces in \a pieces
+//!
+//! \return \a this
+kstr * kstr_add_iov(kstr * this, kstr_piece const * pieces, size_t n);
+
+//! append views joined by a separator to a string's value
+//!
+//! appends the \a n views in \a pieces in order, with \a separator between
+//! each pair of consecutive views. the total size is computed first, so the
+//! buffer grows at most once. the views may point into the string's own
+//! value.
+//!
+//! \param this string
+//! \param pieces views to append
+//! \param n number of views in \a pieces
+//! \param separator bytes to append between views
+//!
+//! \return \a this
+kstr * kstr_join(
+      kstr * this, kstr_view const * pieces, size_t n, kstr_view separator);
+
+//! append bytes read from a file descriptor to a string
+//!
+//! reads with `read()` straight into the available space of the string's
+//! buffer until the end of the file or until \a max bytes have been read,
+//! growing the buffer as needed. calls interrupted by signals are retried.
+//! on error, the bytes read before it are kept.
+//!
+//! \param this string
+//! \param fd file descriptor
+//! \param max maximum number of bytes to read (::kstr_npos for no limit)
+//!
+//! \return true on success, false on error (with `errno` set by `read()`)
+bool kstr_read_fd(kstr * this, int fd, size_t max);
+
+//! append a line read from a file to a string
+//!
+//! reads characters straight into the string's buffer up to and including
+//! the next newline, or up to the end of the file if there is none.
+//!
+//! \param this string
+//! \param file file
+//!
+//! \return true if any characters were read, false at the end of the file or
+//!         on error (see `ferror()`)
+bool kstr_getline(kstr * this, FILE * file);
+
+//! append the contents of a file to a string
+//!
+//! opens the file and reads it with kstr_read_fd(). the size of a regular
+//! file is looked up first, so that the buffer grows only once.
+//!
+//! \param this string
+//! \param path path of the file
+//!
+//! \return true on success, false on error (with `errno` set)
+bool kstr_slurp_file(kstr * this, char const * path);
+
+//! replace a range of a string's value
+//!
+//! replaces up to \a count bytes of the value, starting at byte offset
+//! \a pos, with the bytes of \a text, moving the rest of the value within the
+//! string's buffer. the range is clipped to the end of the value, so passing
+//! ::kstr_npos for \a count replaces the rest of the value. the buffer grows
+//! at most once. \a text may be part of the string's own value.
+//!
+//! the string's width is updated by measuring the value from \a pos on,
+//! before and after the change, the way appended text is measured. escape
+//! sequences in \a text take no columns only if kstr_set_escapes() is
+//! enabled, and the rest of a control code that is partly replaced takes
+//! columns like text.
+//!
+//! \param this string
+//! \param pos offset of the first byte to replace
+//! \param count maximum number of bytes to replace
+//! \param text bytes to insert instead
+//!
+//! \return \a this
+kstr * kstr_replace_range(
+      kstr * this, size_t pos, size_t count, kstr_view text);
+
+//! insert bytes into a string's value
+//!
+//! identical to kstr_replace_range() with a \a count of zero.
+//!
+//! \param this string
+//! \param pos offset to insert at (clipped to the end of the value)
+//! \param text bytes to insert
+//!
+//! \return \a this
+kstr * kstr_insert(kstr * this, size_t pos, kstr_view text);
+
+//! remove bytes from a string's value
+//!
+//! identical to kstr_replace_range() with empty text.
+//!
+//! \param this string
+//! \param pos offset of the first byte to remove
+//! \param count maximum number of bytes to remove
+//!
+//! \return \a this
+kstr * kstr_erase(kstr * this, size_t pos, size_t count);
+
+//! shorten a string's value
+//!
+//! removes all but the first \a size bytes of the value. longer values are
+//! left unchanged.
+//!
+//! \param this string
+//! \param size maximum number of bytes to keep
+//!
+//! \return \a this
+kstr * kstr_truncate(kstr * this, size_t size);
+
+//! replace every occurrence of a sequence of bytes in a string's value
+//!
+//! replaces the non-overlapping occurrences of \a needle, from the start of
+//! the value, with \a replacement. the occurrences are counted first, so the
+//! buffer grows at most once and each byte of the value is moved at most
+//! once. nothing is replaced if \a needle is empty. the width is adjusted as
+//! with kstr_replace_range().
+//!
+//! \param this string
+//! \param needle bytes to replace
+//! \param replacement bytes to insert instead
+//!
+//! \return \a this
+kstr * kstr_replace_all(kstr * this, kstr_view needle, kstr_view replacement);
+
+//! reserve space in a string's buffer
+//!
+//! if fewer than \a count bytes can be appended to the string's value without
+//! growing its buffer, the buffer is grown to exactly the needed size. this
+//! does not change the string's value.
+//!
+//! \param this string
+//! \param count number of bytes to reserve for appending
+//!
+//! \return \a this
+kstr * kstr_reserve(kstr * this, size_t count);
+
+//! release unused space in a string's buffer
+//!
+//! the string's buffer is shrunk to the number of bytes used by its value.
+//! this does not change the string's value.
+//!
+//! \param this string
+//!
+//! \return \a this
+kstr * kstr_shrink_to_fit(kstr * this);
+
+//! set a string's buffer growth policy
+//!
+//! changes how the string's buffer grows when more space is needed (see
+//! ::kstr_growth). new strings use ::kstr_growth_double, and copies use the
+//! same policy as the original.
+//!
+//! \param this string
+//! \param growth growth policy
+//!
+//! \return \a this
+kstr * kstr_set_growth(kstr * this, kstr_growth growth);
+
+//! set whether escape sequences in appended text are recognized
+//!
+//! by default, only control codes added with kstr_add_bold(), kstr_add_fg(),
+//! kstr_add_bg(), and kstr_add_reset() are excluded from a string's width. if
+//! \a escapes is true, ansi escape sequences found in text appended
+//! afterward, e.g. pre-colored text passed to kstr_add_text() or
+//! kstr_add_fmt(), are excluded from the width too. this recognizes control
+//! sequences (`ESC [` ... final byte), control strings such as `ESC ]` ...
+//! `BEL` or `ESC \`, and other `ESC` sequences, including ones split across
+//! appends. new strings don't recognize escape sequences, and copies use the
+//! same setting as the original.
+//!
+//! \param this string
+//! \param escapes recognize escape sequences if true, don't if false
+//!
+//! \return \a this
+kstr * kstr_set_escapes(kstr * this, bool escapes);
+
+//! get the capacity of a string's buffer
+//!
+//! returns the allocated size of the string's buffer, which is always at least
+//! kstr_size(). the buffer's size includes the chunks of a value that is split
+//! into chunks (see ::kstr_growth_chunked).
+//!
+//! \param this string
+//!
+//! \return the capacity in bytes
+size_t kstr_capacity(kstr * this);
+
 //! get the width of a string's value
 //!
-//! returns the width of the string's value in bytes. the width does not
-//! include the nul terminator or any control codes added with kstr_add_bold(),
-//! kstr_add_fg(), or kstr_add_bg().
+//! returns the number of terminal columns taken by the string's value. the
+//! width is kept up to date as text is added, so getting it does not scan the
+//! value. text is decoded as utf-8: east asian wide and fullwidth characters
+//! take two columns; control characters, combining marks, and any control
+//! codes added with kstr_add_bold(), kstr_add_fg(), or kstr_add_bg() take
+//! none; and each invalid byte takes one. a utf-8 sequence that is split
+//! across appends is counted once it is complete.
 //!
 //! \param this string
 //!
-//! \return the width in bytes
+//! \return the width in columns
 size_t kstr_width(kstr * this);
 
 //! get the size of a string's value
@@ -246,7 +1201,8 @@ size_t kstr_size(kstr * this);
 
 //! get a string's value
 //!
-//! returns the string's value, which is guaranteed to be nul-terminated. the
+//! returns the string's value, which is guaranteed to be nul-terminated. if
+//! the value contains nul characters, use kstr_size() to find its end. the
 //! returned pointer becomes invalid if the string is modified or destroyed.
 //!
 //! \param this string
@@ -254,26 +1210,344 @@ size_t kstr_size(kstr * this);
 //! \return the string's value
 char const * kstr_get(kstr * this);
 
+//! get views of the chunks of a string's value
+//!
+//! a string using ::kstr_growth_chunked may hold its value in several chunks,
+//! which are joined into one piece by kstr_get() and most other functions that
+//! read the value. this function instead stores views of the chunks, in order,
+//! in \a chunks without joining them, e.g. to write them out with `writev()`.
+//! the concatenation of the views is the string's value, and an empty value
+//! has no chunks. the views become invalid if the string is modified or
+//! destroyed.
+//!
+//! \param this string
+//! \param chunks array to store views of up to \a max chunks in
+//! \param max number of views that fit in \a chunks
+//!
+//! \return the number of chunks, which may be larger than \a max
+size_t kstr_get_chunks(kstr * this, kstr_view * chunks, size_t max);
+
+//! write a string's value to a file descriptor
+//!
+//! identical to kstr_writev() with a single string.
+//!
+//! \param this string
+//! \param fd file descriptor
+//!
+//! \return true on success, false on error (with `errno` set)
+bool kstr_write(kstr * this, int fd);
+
+//! write the values of several strings to a file descriptor
+//!
+//! hands the strings' buffers to the kernel with `writev()` without copying
+//! them, so that one system call usually writes them all, with each chunk of a
+//! chunked value (see ::kstr_growth_chunked) as a separate piece. partial
+//! writes and calls interrupted by signals are continued until everything has
+//! been written. on error, some of the values may have been written.
+//!
+//! \param strings strings to write, in order
+//! \param n number of strings in \a strings
+//! \param fd file descriptor
+//!
+//! \return true on success, false on error (with `errno` set by `writev()`)
+bool kstr_writev(kstr * const * strings, size_t n, int fd);
+
+//! write a string's value without control codes to a file descriptor
+//!
+//! writes the same bytes as kstr_get_plain(), for sinks such as log files
+//! that aren't terminals. unless the string was edited, the bytes between
+//! control codes are handed to the kernel with `writev()` straight from the
+//! string's buffer, without scanning or copying the value.
+//!
+//! \param this string
+//! \param fd file descriptor
+//!
+//! \return true on success, false on error (with `errno` set)
+bool kstr_write_plain(kstr * this, int fd);
+
 //! create a copy of a string's value
 //!
 //! allocates and returns a copy of the string's value, which is guaranteed to
-//! be nul-terminated. the returned pointer must be destroyed with `free()`
-//! when it is no longer needed.
+//! be nul-terminated. all kstr_size() bytes are copied, including any nul
+//! characters in the value. the returned pointer must be destroyed with
+//! `free()` when it is no longer needed.
 //!
 //! \param this string
 //!
 //! \return a copy of the string's value
 char * kstr_get_copy(kstr * this);
 
+//! get a view of part of a string's value
+//!
+//! returns a view of up to \a count bytes of the string's value, starting at
+//! byte offset \a pos. the range is clipped to the end of the value, so
+//! passing ::kstr_npos for \a count gets the rest of the value. the view
+//! becomes invalid if the string is modified or destroyed.
+//!
+//! \param this string
+//! \param pos offset of the first byte
+//! \param count maximum number of bytes
+//!
+//! \return a view of the range
+kstr_view kstr_get_view(kstr * this, size_t pos, size_t count);
+
+//! get a string's value without control codes
+//!
+//! the control codes are the bytes that don't count towards the string's
+//! width: those appended with kstr_add_style(), kstr_add_bold(),
+//! kstr_add_fg(), kstr_add_bg(), kstr_add_reset() and kstr_add_iov(), and
+//! escape sequences in text if kstr_set_escapes() is enabled. the string
+//! records where they are as it appends them, so they are removed without
+//! scanning the value. after kstr_insert(), kstr_erase(), kstr_replace_range()
+//! or kstr_replace_all() change anything but the end of the value, this is
+//! no longer known until the value is cleared, and every escape sequence is
+//! removed instead.
+//!
+//! if the value has no control codes, the view refers to the string's buffer.
+//! otherwise, the plain value is copied to storage owned by the string, which
+//! is reused until the value changes. either way, the viewed bytes are
+//! followed by a nul terminator and are valid until the string is modified
+//! or destroyed.
+//!
+//! \param this string
+//!
+//! \return a view of the plain value
+kstr_view kstr_get_plain(kstr * this);
+
+//! find a sequence of bytes in a string's value
+//!
+//! identical to kstr_view_find() with a view of the string's value, whose
+//! size is known without scanning for a nul terminator.
+//!
+//! \param this string to search
+//! \param needle bytes to find
+//! \param pos offset to start searching at
+//!
+//! \return the offset of the first occurrence, or ::kstr_npos if not found
+size_t kstr_find(kstr * this, kstr_view needle, size_t pos);
+
+//! find a byte in a string's value
+//!
+//! identical to kstr_view_find_char() with a view of the string's value.
+//!
+//! \param this string to search
+//! \param c byte to find
+//! \param pos offset to start searching at
+//!
+//! \return the offset of the first occurrence, or ::kstr_npos if not found
+size_t kstr_find_char(kstr * this, char c, size_t pos);
+
+//! split a string's value into views at delimiters
+//!
+//! identical to kstr_view_split() with a view of the string's value. the
+//! views point into the string's buffer and are valid until it is changed.
+//!
+//! \param this string to split
+//! \param delimiters bytes any of which separates two pieces
+//! \param pieces array to store at most \a max views in
+//! \param max number of views \a pieces can hold
+//!
+//! \return the number of pieces, which may be greater than \a max
+size_t kstr_split(
+      kstr * this, kstr_view delimiters, kstr_view * pieces, size_t max);
+
+//! compare the values of two strings
+//!
+//! identical to kstr_view_compare() with views of the strings' values.
+//!
+//! \param this first string
+//! \param other second string
+//!
+//! \return a negative value, zero, or a positive value if \a this is less
+//!         than, equal to, or greater than \a other
+int kstr_compare(kstr * this, kstr * other);
+
+//! check whether two strings have the same value
+//!
+//! strings of different sizes are told apart without comparing their bytes.
+//!
+//! \param this first string
+//! \param other second string
+//!
+//! \return true if the values are equal, false otherwise
+bool kstr_equal(kstr * this, kstr * other);
+
+//! calculate the hash of a string's value
+//!
+//! identical to kstr_view_hash() with a view of the string's value. the hash
+//! is cached in the string, and only calculated again after the value
+//! changes.
+//!
+//! \param this string
+//!
+//! \return the hash of the value
+uint64_t kstr_hash(kstr * this);
+
 //! get the basename of a string's value
 //!
 //! calculates and returns the basename of the string's value (see the standard
-//! `basename()` function). the returned pointer becomes invalid if the string
-//! is modified or destroyed.
+//! `basename()` function). the returned pointer usually points into the
+//! string's value, so no memory is allocated; only a value with trailing
+//! slashes needs a separate nul-terminated copy. the returned pointer becomes
+//! invalid if the string is modified or destroyed.
 //!
 //! \param this string
 //!
-//! \return the basename of the string's value
+//! \return the basename of the string's value, or a null pointer if joining
+//!         a chunked value or making the copy fails and errors don't abort
 char const * kstr_basename(kstr * this);
 
+//! get a view of the basename of a string's value
+//!
+//! identical to kstr_basename(), except that the basename is returned as a
+//! view, which is never allocated. the view becomes invalid if the string is
+//! modified or destroyed.
+//!
+//! \param this string
+//!
+//! \return a view of the basename of the string's value, or a view with a
+//!         null pointer if joining a chunked value fails and errors don't
+//!         abort
+kstr_view kstr_basename_view(kstr * this);
+
+//! get a view of the directory name of a string's value
+//!
+//! calculates the directory name of the string's value (see the standard
+//! `dirname()` function) without allocating memory. a value consisting only
+//! of slashes has the directory name "/". the view becomes invalid if the
+//! string is modified or destroyed.
+//!
+//! \param this string
+//!
+//! \return a view of the directory name of the string's value, or a view
+//!         with a null pointer if joining a chunked value fails and errors
+//!         don't abort
+kstr_view kstr_dirname(kstr * this);
+
+//! get a view of the extension of a string's value
+//!
+//! returns the extension of the basename of the string's value, starting at
+//! its last `.` character (e.g. ".gz" for "/tmp/file.tar.gz"). a basename
+//! that starts with its only `.`, such as ".profile", or that is "." or "..",
+//! has no extension, and an empty view is returned. the view becomes invalid
+//! if the string is modified or destroyed.
+//!
+//! \param this string
+//!
+//! \return a view of the extension of the string's value, or a view with a
+//!         null pointer if joining a chunked value fails and errors don't
+//!         abort
+kstr_view kstr_extension(kstr * this);
+
+//! get a view of nul-terminated text
+//!
+//! returns a view of \a text, not including its nul terminator. if \a text is
+//! a null pointer, an empty view is returned.
+//!
+//! \param text text
+//!
+//! \return a view of the text
+kstr_view kstr_view_text(char const * text);
+
+//! get a view of part of another view
+//!
+//! returns a view of up to \a count bytes of \a view, starting at byte
+//! offset \a pos. the range is clipped to the end of \a view.
+//!
+//! \param view view
+//! \param pos offset of the first byte
+//! \param count maximum number of bytes
+//!
+//! \return a view of the range
+kstr_view kstr_view_sub(kstr_view view, size_t pos, size_t count);
+
+//! compare two views
+//!
+//! compares the bytes of the views as unsigned characters. if one view is a
+//! prefix of the other, the shorter view compares less.
+//!
+//! \param view1 first view
+//! \param view2 second view
+//!
+//! \return a negative value, zero, or a positive value if \a view1 is less
+//!         than, equal to, or greater than \a view2
+int kstr_view_compare(kstr_view view1, kstr_view view2);
+
+//! check whether two views have the same bytes
+//!
+//! \param view1 first view
+//! \param view2 second view
+//!
+//! \return true if the views are equal, false otherwise
+bool kstr_view_equal(kstr_view view1, kstr_view view2);
+
+//! find a sequence of bytes in a view
+//!
+//! searches \a view for the first occurrence of \a needle at or after byte
+//! offset \a pos. an empty needle is found at \a pos if it is within the
+//! view.
+//!
+//! \param view view to search
+//! \param needle bytes to find
+//! \param pos offset to start searching at
+//!
+//! \return the offset of the first occurrence, or ::kstr_npos if not found
+size_t kstr_view_find(kstr_view view, kstr_view needle, size_t pos);
+
+//! find a byte in a view
+//!
+//! searches \a view for the first occurrence of \a c at or after byte offset
+//! \a pos.
+//!
+//! \param view view to search
+//! \param c byte to find
+//! \param pos offset to start searching at
+//!
+//! \return the offset of the first occurrence, or ::kstr_npos if not found
+size_t kstr_view_find_char(kstr_view view, char c, size_t pos);
+
+//! calculate the hash of a view's bytes
+//!
+//! uses a variant of murmurhash64a that reads eight bytes at a time. equal
+//! views have equal hashes, and the hash of a given sequence of bytes is the
+//! same on every run of a program, but not necessarily on platforms of
+//! different byte orders. the hash isn't suitable for cryptographic use.
+//!
+//! \param view view
+//!
+//! \return the hash of the view's bytes
+uint64_t kstr_view_hash(kstr_view view);
+
+//! split a view into views at delimiters
+//!
+//! every byte of \a view that is one of the bytes in \a delimiters ends a
+//! piece, so a view with \e n delimiters has \e n + 1 pieces, some of which
+//! may be empty. nothing is copied: the pieces point into \a view. if there
+//! are more than \a max pieces, only the first \a max are stored, and the
+//! return value tells how large \a pieces must be to hold all of them.
+//!
+//! \param view view to split
+//! \param delimiters bytes any of which separates two pieces
+//! \param pieces array to store at most \a max views in
+//! \param max number of views \a pieces can hold
+//!
+//! \return the number of pieces, which may be greater than \a max
+size_t kstr_view_split(
+      kstr_view view, kstr_view delimiters, kstr_view * pieces, size_t max);
+
+//! take the next piece from a view being split at delimiters
+//!
+//! yields the same pieces as kstr_view_split(), one per call, without an
+//! array to store them in. \a rest starts out as the view to split and is
+//! advanced past each piece and its delimiter. once the last piece is taken,
+//! the length of \a rest is set to ::kstr_npos, and further calls return
+//! `false`.
+//!
+//! \param rest remaining part of the view being split
+//! \param delimiters bytes any of which separates two pieces
+//! \param token where to store the next piece
+//!
+//! \return `true` if a piece was stored in \a token, `false` if none is left
+bool kstr_view_token(kstr_view * rest, kstr_view delimiters, kstr_view * token);
+
 #endif
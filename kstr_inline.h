@@ -0,0 +1,220 @@
+// Copyright (c) 2013, kt.d <kt@kt.d>
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+// WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+// WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+// OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+// CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+//! \file
+//!
+//! kstr inline interface
+//!
+//! exposes the layout of ::kstr objects and inline versions of the most
+//! frequently called methods, so that programs can read a string's value,
+//! size, and width and append short text to it without calling into the
+//! library. only when an append needs more than the inline version handles,
+//! e.g. growing the buffer, is the library called.
+//!
+//! the layout is private to the library and changes between versions, so a
+//! program including this header must be rebuilt whenever the library is.
+//! kstr.h is enough for everything else.
+
+#ifndef kstr_inline_h
+#define kstr_inline_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "kstr.h"
+
+struct kstr_chunk;
+struct kstr_control;
+struct kstr_shared;
+
+//! size of the character buffer embedded in a string object
+//!
+//! values that fit in this many bytes (including the nul terminator) are
+//! stored inside the string object itself, so creating a short string only
+//! requires a single allocation.
+enum { kstr_inline_size = 64 };
+
+//! escape sequence scanner states
+enum kstr_escape
+{
+   kstr_escape_none, //!< not in an escape sequence
+   kstr_escape_start, //!< after the escape character
+   kstr_escape_nf, //!< in the intermediate bytes of an `ESC` sequence
+   kstr_escape_csi, //!< in a control sequence (`ESC [`)
+   kstr_escape_string, //!< in a control string (`ESC ]`, `ESC P`, etc.)
+   kstr_escape_string_esc //!< after an escape character in a control string
+};
+
+//! string object structure
+struct kstr
+{
+   size_t data_size; //!< allocated buffer size
+   size_t used; //!< number of buffer bytes used (including nul)
+   size_t width; //!< string width (display columns)
+   uint32_t utf8_point; //!< code point of an incomplete utf-8 sequence
+   unsigned char utf8_pending; //!< bytes missing from \a utf8_point
+   bool escapes; //!< recognize escape sequences in visible text
+   enum kstr_escape escape; //!< escape sequence scanner state
+
+   kstr_arena * arena; //!< arena the string belongs to (or `NULL`)
+   kstr_growth growth; //!< buffer growth policy
+   size_t generation; //!< incremented whenever the value changes
+   uint64_t hash; //!< cached hash of the value
+   size_t hash_generation; //!< \a generation of the cached hash
+   bool interned; //!< owned by an intern table, which destroys it
+
+   char * basename; //!< storage for the cached basename
+   size_t basename_size; //!< allocated size of \a basename
+   size_t basename_generation; //!< \a generation of the cached basename
+   char * data; //!< character buffer (\a inline_data or allocated memory)
+   struct kstr_shared * shared; //!< shared buffer containing \a data (or `NULL`)
+   struct kstr_chunk * chunks; //!< first chunk of the value (or `NULL`)
+   struct kstr_chunk * last_chunk; //!< last chunk of the value (or `NULL`)
+   size_t chunked; //!< number of bytes in \a chunks (the rest are in \a data)
+   kstr_style style; //!< attributes known to be active at the end of the value
+   bool style_forgotten; //!< \a style was forgotten since the value was empty
+   struct kstr_control * controls; //!< control codes in the value, in order
+   size_t control_count; //!< number of control codes in \a controls
+   size_t control_capacity; //!< allocated number of control codes
+   bool controls_tracked; //!< \a controls holds every control code
+   char * plain; //!< storage for the cached plain value
+   size_t plain_size; //!< allocated size of \a plain
+   size_t plain_count; //!< number of bytes in the cached plain value
+   size_t plain_generation; //!< \a generation of the cached plain value
+
+   char inline_data[kstr_inline_size]; //!< embedded character buffer
+};
+
+//! append bytes to a string's value inline
+//!
+//! identical to kstr_add_bytes(), but appends printable ascii text that fits
+//! in the string's buffer without calling into the library.
+//!
+//! \param this string
+//! \param bytes bytes to append
+//! \param count number of bytes in \a bytes
+//!
+//! \return \a this
+static inline kstr * kstr_add_bytes_inline(
+      kstr * this, char const * bytes, size_t count);
+
+//! append text to a string's value inline
+//!
+//! identical to kstr_add_text(), but appends printable ascii text that fits
+//! in the string's buffer without calling into the library.
+//!
+//! \param this string
+//! \param text text to append
+//!
+//! \return \a this
+static inline kstr * kstr_add_text_inline(kstr * this, char const * text);
+
+//! get a string's value inline
+//!
+//! identical to kstr_get(), but only calls into the library to join the
+//! chunks of a chunked value.
+//!
+//! \param this string
+//!
+//! \return the string's value
+static inline char const * kstr_get_inline(kstr * this);
+
+//! get a string's size inline
+//!
+//! identical to kstr_size().
+//!
+//! \param this string
+//!
+//! \return the string's size in bytes (including the nul terminator)
+static inline size_t kstr_size_inline(kstr * this);
+
+//! get a string's width inline
+//!
+//! identical to kstr_width().
+//!
+//! \param this string
+//!
+//! \return the string's width in columns
+static inline size_t kstr_width_inline(kstr * this);
+
+static inline
+kstr *
+kstr_add_bytes_inline(
+      kstr * this,
+      char const * bytes,
+      size_t count)
+{
+   if (bytes == NULL || count == 0)
+      return this;
+
+   // leave shared buffers, full buffers, and incomplete sequences to the
+   // library
+   if (
+         this->shared != NULL ||
+         this->utf8_pending != 0 ||
+         this->escape != kstr_escape_none ||
+         count > this->data_size - this->used)
+      return kstr_add_bytes(this, bytes, count);
+
+   // each printable ascii character takes one column
+   for (size_t i = 0; i < count; i++)
+      if ((unsigned char) bytes[i] - 0x20u > 0x7eu - 0x20u)
+         return kstr_add_bytes(this, bytes, count);
+
+   memcpy(this->data + this->used - 1, bytes, count);
+   this->used += count;
+   this->data[this->used - 1] = '\0';
+   this->width += count;
+   this->generation++;
+
+   return this;
+}
+
+static inline
+kstr *
+kstr_add_text_inline(
+      kstr * this,
+      char const * text)
+{
+   return kstr_add_bytes_inline(
+         this, text, (text == NULL) ? 0 : strlen(text));
+}
+
+static inline
+char const *
+kstr_get_inline(
+      kstr * this)
+{
+   return (this->chunks == NULL) ? this->data : kstr_get(this);
+}
+
+static inline
+size_t
+kstr_size_inline(
+      kstr * this)
+{
+   return this->chunked + this->used;
+}
+
+static inline
+size_t
+kstr_width_inline(
+      kstr * this)
+{
+   return this->width;
+}
+
+#endif
@@ -16,12 +16,21 @@
 //!
 //! kstr test program implementation
 
+#include <errno.h>
+#include <float.h>
+#include <limits.h>
 #include <locale.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <wchar.h>
+#include <unistd.h>
 
 #include <kstr.h>
+#include <kstr_inline.h>
 
 //! write an error message to stderr and exit
 //!
@@ -29,12 +38,183 @@
 //! \param ... format string arguments
 static _Noreturn void err(char const * fmt, ...);
 
+//! append numbered records to a concurrent string
+//!
+//! \param arg concurrent string
+//!
+//! \return `NULL`
+static void * append_records(void * arg);
+
+//! append colored, numbered rows of text
+//!
+//! \param str string
+//! \param thread number of the thread the rows are for
+static void add_rows(kstr * str, size_t thread);
+
+//! append the rows of a thread to its bulk builder slice
+//!
+//! \param arg slice and thread number
+//!
+//! \return `NULL`
+static void * build_rows(void * arg);
+
+//! create and free strings in a thread, leaving memory in its cache
+//!
+//! \param arg unused
+//!
+//! \return `NULL`
+static void * cache_strings(void * arg);
+
+//! check that a value consists of complete records
+//!
+//! \param value value to check
+//! \param counts incremented for each record of each thread (or `NULL`)
+static void check_records(char const * value, size_t * counts);
+
+//! read a concurrent string until all records are appended
+//!
+//! \param arg concurrent string
+//!
+//! \return `NULL`
+static void * read_records(void * arg);
+
+//! check that a compiled format appends the same text as kstr_add_fmt()
+//!
+//! \param fmt format string
+//! \param ... format string arguments
+static void check_compiled(char const * fmt, ...);
+
+//! check that a file holds a string's value
+//!
+//! \param file file written from its start
+//! \param expected string holding the expected contents
+static void check_output(FILE * file, kstr * expected);
+
+//! append a view's bytes as text
+//!
+//! \param str string
+//! \param view bytes to append
+//!
+//! \return the result of kstr_add_bytes()
+static kstr * add_view_bytes(kstr * str, kstr_view view);
+
+//! append a view's bytes through a concurrent string
+//!
+//! \param str string
+//! \param view bytes to append
+//!
+//! \return the result of kstr_add_concurrent()
+static kstr * add_view_concurrent(kstr * str, kstr_view view);
+
+//! append a view's bytes as the only piece of a join
+//!
+//! \param str string
+//! \param view bytes to append
+//!
+//! \return the result of kstr_join()
+static kstr * add_view_joined(kstr * str, kstr_view view);
+
+//! create a string with one of the constructors of test_error_constructors()
+//!
+//! \param kind index of the constructor
+//! \param source string to copy or clone, holding ::text_long
+//!
+//! \return the new string, or `NULL` if \a kind is out of range
+static kstr * construct(size_t kind, kstr * source);
+
+//! create a string for the edits of test_error_edits()
+//!
+//! \param chunked use ::kstr_growth_chunked and a value of several chunks
+//!
+//! \return a new string
+static kstr * edit_value(bool chunked);
+
+//! append the segments of ::edit_segments to a string
+//!
+//! \param str string
+//!
+//! \return the result of kstr_add_concurrent()
+static kstr * edit_add_concurrent(kstr * str);
+
+//! append formatted text with a cached compiled format
+//!
+//! \param str string
+//!
+//! \return the result of kstr_add_fmt_cached()
+static kstr * edit_add_formatted(kstr * str);
+
+//! replace bytes of a string with bytes of its own value everywhere
+//!
+//! \param str string
+//!
+//! \return the result of kstr_replace_all()
+static kstr * edit_replace_all(kstr * str);
+
+//! replace a range in the middle of a string with part of its own value
+//!
+//! \param str string
+//!
+//! \return the result of kstr_replace_range()
+static kstr * edit_replace_middle(kstr * str);
+
+//! replace the end of a string with part of its own value
+//!
+//! \param str string
+//!
+//! \return the result of kstr_replace_range()
+static kstr * edit_replace_end(kstr * str);
+
+//! insert part of a string's own value into it
+//!
+//! \param str string
+//!
+//! \return the result of kstr_insert()
+static kstr * edit_insert(kstr * str);
+
+//! make an allocation fail if one is due to
+//!
+//! \return true if the allocation should fail
+static bool fail_allocation(void);
+
+//! allocate memory with the real `calloc()`
+void * __real_calloc(size_t count, size_t size);
+
+//! allocate memory with the real `malloc()`
+void * __real_malloc(size_t size);
+
+//! resize memory with the real `realloc()`
+void * __real_realloc(void * ptr, size_t size);
+
+//! allocate memory with `calloc()` unless the allocation should fail
+void * __wrap_calloc(size_t count, size_t size);
+
+//! allocate memory with `malloc()` unless the allocation should fail
+void * __wrap_malloc(size_t size);
+
+//! resize memory with `realloc()` unless the allocation should fail
+void * __wrap_realloc(void * ptr, size_t size);
+
+//! test appending bytes including nul characters
+static void test_add_bytes_nul(void);
+
+//! test appending many pieces that include a string's own value
+static void test_add_iov_self_many(void);
+
+//! test appending a view of a string's own value
+static void test_add_view_self(void);
+
+//! test appending a view of text
+static void test_add_view_text(void);
+
 //! test appending a formatted string with all 8-bit characters
 static void test_add_fmt_bytes(void);
 
 //! test appending a formatted string with an empty format string
 static void test_add_fmt_empty(void);
 
+//! test appending formatted strings that just fit or overflow the buffer
+static void test_add_fmt_fit(void);
+
 //! test appending a formatted string with a long value
 static void test_add_fmt_long(void);
 
@@ -50,6 +230,84 @@ static void test_add_fmt_simple(void);
 //! test appending a formatted string with a utf-8 value
 static void test_add_fmt_utf8(void);
 
+//! test appending floating-point numbers with a fixed precision
+static void test_add_double_fixed(void);
+
+//! test appending floating-point numbers in their shortest exact form
+static void test_add_double_shortest(void);
+
+//! test appending unsigned integers in hexadecimal
+static void test_add_hex(void);
+
+//! test appending signed and unsigned integers
+static void test_add_int(void);
+
+//! test appending text with cached compiled formats
+static void test_add_cached(void);
+
+//! test appending text with compiled formats
+static void test_add_compiled(void);
+
+//! test assembling a string from slices with a bulk builder
+static void test_builder(void);
+
+//! test building the slices of a bulk builder in several threads
+static void test_builder_threads(void);
+
+//! test freeing a thread's string cache when it exits
+static void test_cache_thread(void);
+
+//! test appending to a chunked string whose clone was destroyed
+static void test_chunked_clone(void);
+
+//! test comparing the values of strings
+static void test_compare(void);
+
+//! test appending to a concurrent string from one thread
+static void test_concurrent_basic(void);
+
+//! test appending to a concurrent string from several threads
+static void test_concurrent_threads(void);
+
+//! test editing a string with control codes
+static void test_edit_codes(void);
+
+//! test editing strings with shared or chunked buffers
+static void test_edit_shared(void);
+
+//! test the width of strings after edits
+static void test_edit_width(void);
+
+//! test getting path components when joining chunks fails
+static void test_error_basename(void);
+
+//! test constructors that fail to allocate memory
+static void test_error_constructors(void);
+
+//! test edits and appends that fail to allocate memory
+static void test_error_edits(void);
+
+//! test interning values when the table fails to grow
+static void test_error_intern(void);
+
+//! test returning errors instead of aborting
+static void test_error_mode(void);
+
+//! test finding bytes in a string
+static void test_find(void);
+
+//! test finding bytes in a long string
+static void test_find_long(void);
+
+//! test compiling format strings that can't be compiled
+static void test_fmt_compile_invalid(void);
+
+//! test appending pieces of text and control codes
+static void test_add_iov_mixed(void);
+
+//! test appending pieces from a string's own value
+static void test_add_iov_self(void);
+
 //! test appending a string value including all 8-bit characters
 static void test_add_text_bytes(void);
 
@@ -68,6 +326,18 @@ static void test_add_text_simple(void);
 //! test appending a utf-8 string value
 static void test_add_text_utf8(void);
 
+//! test copying strings into an arena
+static void test_arena_copy(void);
+
+//! test growing strings allocated from an arena
+static void test_arena_grow(void);
+
+//! test creating strings in an arena
+static void test_arena_new(void);
+
+//! test reusing an arena after resetting it
+static void test_arena_reset(void);
+
 //! test getting the basename of an absolute path
 static void test_basename_absolute(void);
 
@@ -89,15 +359,81 @@ static void test_basename_null(void);
 //! test getting the basename of a relative path
 static void test_basename_relative(void);
 
+//! test reusing the cached basename after changing a string
+static void test_basename_reuse(void);
+
 //! test getting the basename of the root directory
 static void test_basename_root(void);
 
+//! test getting the basename of a path with trailing slashes
+static void test_basename_trailing(void);
+
+//! test getting a view of the basename of a path
+static void test_basename_view(void);
+
+//! test reusing the memory of destroyed strings
+static void test_cache_reuse(void);
+
+//! test limiting the memory kept in the string cache
+static void test_cache_limit(void);
+
+//! test growing strings with each growth policy
+static void test_capacity_growth(void);
+
+//! test creating a string with a preallocated buffer
+static void test_capacity_new(void);
+
+//! test reserving space in a string's buffer
+static void test_capacity_reserve(void);
+
+//! test releasing unused space in a string's buffer
+static void test_capacity_shrink(void);
+
+//! test appending to a chunked string and reading its chunks
+static void test_chunked_add(void);
+
+//! test appending a chunked string's own value to it
+static void test_chunked_self(void);
+
+//! test cloning a string and modifying the original
+static void test_clone(void);
+
+//! test cloning a string many times and destroying the clones
+static void test_clone_fan_out(void);
+
+//! test cloning a string and modifying the clone
+static void test_clone_modified(void);
+
 //! test appending control codes to a string
 static void test_control_codes(void);
 
 //! test copying a string
 static void test_copy(void);
 
+//! test copying a string with a long value
+static void test_copy_long(void);
+
+//! test copying a string with unused buffer space
+static void test_copy_used(void);
+
+//! test getting the directory name of a path
+static void test_dirname(void);
+
+//! test that escape sequences count toward width unless recognized
+static void test_escapes_disabled(void);
+
+//! test appending text with escape sequences with kstr_add_fmt()
+static void test_escapes_fmt(void);
+
+//! test appending text with escape sequences one byte at a time
+static void test_escapes_split(void);
+
+//! test appending text with various kinds of escape sequences
+static void test_escapes_text(void);
+
+//! test getting the extension of a path
+static void test_extension(void);
+
 //! test freeing a string
 static void test_free_new(void);
 
@@ -110,9 +446,42 @@ static void test_free_null_ptr(void);
 //! test copying a string's value
 static void test_get_copy(void);
 
+//! test copying a string's value including nul characters
+static void test_get_copy_nul(void);
+
+//! test reading lines from a file
+static void test_getline(void);
+
+//! test hashing the values of strings
+static void test_hash(void);
+
+//! test caching the hash of a string
+static void test_hash_cached(void);
+
+//! test appending with the inline methods
+static void test_inline_add(void);
+
+//! test reading strings with the inline methods
+static void test_inline_get(void);
+
+//! test inserting, erasing and truncating
+static void test_insert_erase(void);
+
+//! test interning values
+static void test_intern(void);
+
+//! test interning values in an arena
+static void test_intern_arena(void);
+
+//! test joining views into a string
+static void test_join(void);
+
 //! test creating a string with all 8-bit characters
 static void test_new_bytes(void);
 
+//! test creating a string from bytes including nul characters
+static void test_new_bytes_nul(void);
+
 //! test creating a string with an empty initial value
 static void test_new_empty(void);
 
@@ -128,6 +497,24 @@ static void test_new_simple(void);
 //! test creating a string with a utf-8 initial value
 static void test_new_utf8(void);
 
+//! test getting a value without control codes
+static void test_plain(void);
+
+//! test getting a value without control codes after edits
+static void test_plain_edit(void);
+
+//! test reading from a file descriptor
+static void test_read_fd(void);
+
+//! test replacing every occurrence of bytes
+static void test_replace_all(void);
+
+//! test replacing a range of a string
+static void test_replace_range(void);
+
+//! test setting a string value from bytes including nul characters
+static void test_set_bytes_nul(void);
+
 //! test formatting a string with all 8-bit characters
 static void test_set_fmt_bytes(void);
 
@@ -182,6 +569,27 @@ static void test_size_null(void);
 //! test getting the size of a string of text
 static void test_size_text(void);
 
+//! test reading a whole file
+static void test_slurp_file(void);
+
+//! test splitting a string into views at delimiters
+static void test_split(void);
+
+//! test splitting long views on each path of the delimiter scan
+static void test_split_long(void);
+
+//! test the per-thread counters
+static void test_stats(void);
+
+//! test styles with basic, 256-palette and 24-bit colors
+static void test_style_colors(void);
+
+//! test setting several attributes with a single control code
+static void test_style_combined(void);
+
+//! test skipping attributes that are already active
+static void test_style_tracking(void);
+
 //! test getting the width of a string of control codes
 static void test_width_control(void);
 
@@ -197,6 +605,42 @@ static void test_width_null(void);
 //! test getting the width of a string of text
 static void test_width_text(void);
 
+//! test comparing views
+static void test_view_compare(void);
+
+//! test finding bytes in a view
+static void test_view_find(void);
+
+//! test getting a view of part of a string
+static void test_view_get(void);
+
+//! test getting views of text and of other views
+static void test_view_sub(void);
+
+//! test getting the width of a string with invalid utf-8 bytes
+static void test_width_invalid(void);
+
+//! test getting the width of a long string with control characters
+static void test_width_long(void);
+
+//! test getting the width of marks and symbols from several scripts
+static void test_width_scripts(void);
+
+//! test getting the width of utf-8 text appended one byte at a time
+static void test_width_split(void);
+
+//! test getting the width of a string of utf-8 text
+static void test_width_utf8(void);
+
+//! test writing a string to a file descriptor
+static void test_write(void);
+
+//! test writing a value without control codes
+static void test_write_plain(void);
+
+//! test writing many strings to a file descriptor at once
+static void test_writev(void);
+
 //! run the test program
 //!
 //! \return `EXIT_SUCCESS` on success, `EXIT_FAILURE` on error
@@ -246,327 +690,4004 @@ char const text_long[] =
 //! chinese.
 char const text_utf8[] = "這是UTF-8文本";
 
-static
-void
-err(
-      char const * fmt,
-      ...)
-{
-   va_list args;
-   va_start(args, fmt);
-   vfprintf(stderr, fmt, args);
-   va_end(args);
-
-   fputc('\n', stderr);
-   fflush(stderr);
-   exit(EXIT_FAILURE);
-}
-
-int
-main(void)
-{
-   // try to set the default locale
-   setlocale(LC_ALL, "");
-
-   // test kstr_free()
-   test_free_new();
-   test_free_null();
-   test_free_null_ptr();
-
-   // test kstr_new()
-   test_new_bytes();
-   test_new_empty();
-   test_new_long();
-   test_new_null_ptr();
-   test_new_simple();
-   test_new_utf8();
+//! number of threads appending records in test_concurrent_threads()
+enum { record_threads = 4 };
 
-   // test kstr_copy()
-   test_copy();
+//! number of records appended by each thread
+enum { record_count = 2000 };
 
-   // test kstr_get_copy()
-   test_get_copy();
+//! total size of all records appended by all threads
+static size_t record_total;
 
-   // test kstr_set_text()
-   test_set_text_bytes();
-   test_set_text_empty();
-   test_set_text_long();
-   test_set_text_null();
-   test_set_text_simple();
-   test_set_text_utf8();
+//! concurrent string of several segments appended by test_error_edits()
+static kstr_concurrent * edit_segments;
 
-   // test kstr_set_fmt()
-   test_set_fmt_bytes();
-   test_set_fmt_empty();
-   test_set_fmt_long();
-   test_set_fmt_no_args();
-   test_set_fmt_null();
-   test_set_fmt_simple();
-   test_set_fmt_utf8();
+//! number of allocations until one fails in the calling thread (0 for none)
+static _Thread_local size_t allocs_until_failure;
 
-   // test kstr_add_text()
-   test_add_text_bytes();
-   test_add_text_empty();
-   test_add_text_long();
-   test_add_text_null();
-   test_add_text_simple();
-   test_add_text_utf8();
+//! number of threads building slices in test_builder_threads()
+enum { row_threads = 4 };
 
-   // test kstr_add_fmt()
-   test_add_fmt_bytes();
-   test_add_fmt_empty();
-   test_add_fmt_long();
-   test_add_fmt_no_args();
-   test_add_fmt_null();
-   test_add_fmt_simple();
-   test_add_fmt_utf8();
+//! number of rows built by each thread, enough to copy with several threads
+enum { row_count = 100000 };
 
-   // test kstr_basename()
-   test_basename_absolute();
-   test_basename_changed();
-   test_basename_cwd();
-   test_basename_empty();
-   test_basename_file();
-   test_basename_null();
-   test_basename_relative();
-   test_basename_root();
+//! slice built by one thread in test_builder_threads()
+struct row_slice
+{
+   kstr * slice; //!< slice to build the rows in
+   size_t thread; //!< thread number
+};
 
-   // test kstr_size()
-   test_size_control();
-   test_size_empty();
-   test_size_mixed();
-   test_size_null();
-   test_size_text();
+static
+void *
+append_records(
+      void * arg)
+{
+   kstr_concurrent * const records = arg;
 
-   // test kstr_width()
-   test_width_control();
-   test_width_empty();
-   test_width_mixed();
-   test_width_null();
-   test_width_text();
+   // take a thread number
+   static atomic_size_t next_thread;
+   size_t const thread = atomic_fetch_add(&next_thread, 1) % record_threads;
 
-   // test kstr_add_bg(), kstr_add_fg(), kstr_add_bold(), kstr_add_reset()
-   test_control_codes();
+   // build each record in a string of the thread's own, with one long record
+   // that doesn't fit in a segment
+   kstr * record = kstr_new(NULL);
+   for (size_t i = 0; i < record_count; i++)
+   {
+      kstr_set_fmt(record, "<%zu:%zu:", thread, i);
+      if (i == record_count / 2)
+         kstr_add_text(record, text_long);
+      kstr_add_text(record, ">");
+      kstr_concurrent_add_view(records, kstr_get_view(record, 0, kstr_npos));
+   }
 
-   return EXIT_SUCCESS;
+   kstr_free(&record);
+   return NULL;
 }
 
 static
 void
-test_add_fmt_bytes(void)
+add_rows(
+      kstr * str,
+      size_t thread)
 {
-   fputs(
-         "test: append a formatted string with all 8-bit characters\n",
+   kstr_add_fg(str, (kstr_color) (kstr_color_blue + thread));
+   for (size_t i = 0; i < row_count; i++)
+      kstr_add_fmt(str, "%zu:%zu %s\n", thread, i, text_utf8);
+   kstr_add_reset(str);
+}
+
+static
+void *
+build_rows(
+      void * arg)
+{
+   struct row_slice const * const row = arg;
+   add_rows(row->slice, row->thread);
+   return NULL;
+}
+
+static
+void *
+cache_strings(
+      void * arg)
+{
+   (void) arg;
+
+   // leave memory in the cache without purging it
+   kstr_cache_limit(1 << 20);
+   for (size_t i = 0; i < 8; i++)
+   {
+      kstr * str = kstr_new(text_long);
+      kstr_free(&str);
+   }
+
+   return NULL;
+}
+
+static
+kstr *
+add_view_bytes(
+      kstr * str,
+      kstr_view view)
+{
+   return kstr_add_bytes(str, view.ptr, view.len);
+}
+
+static
+kstr *
+add_view_concurrent(
+      kstr * str,
+      kstr_view view)
+{
+   kstr_concurrent * source = kstr_concurrent_new(0);
+   kstr_concurrent_add_view(source, view);
+   str = kstr_add_concurrent(str, source);
+   kstr_concurrent_free(&source);
+
+   return str;
+}
+
+static
+kstr *
+add_view_joined(
+      kstr * str,
+      kstr_view view)
+{
+   return kstr_join(str, &view, 1, (kstr_view) { 0 });
+}
+
+static
+kstr *
+construct(
+      size_t kind,
+      kstr * source)
+{
+   switch (kind)
+   {
+      case 0: return kstr_new(text_long);
+      case 1: return kstr_new_bytes(text_long, strlen(text_long));
+      case 2: return kstr_new_with_capacity(1000);
+      case 3: return kstr_new_in(NULL, text_long);
+      case 4: return kstr_copy(source);
+      case 5: return kstr_clone(source);
+      default: return NULL;
+   }
+}
+
+static
+kstr *
+edit_add_concurrent(
+      kstr * str)
+{
+   return kstr_add_concurrent(str, edit_segments);
+}
+
+static
+kstr *
+edit_add_formatted(
+      kstr * str)
+{
+   return kstr_add_fmt_cached(str, "abc%sdef%zu", text_long, (size_t) 42);
+}
+
+static
+kstr *
+edit_insert(
+      kstr * str)
+{
+   return kstr_insert(str, 3, kstr_get_view(str, 0, 500));
+}
+
+static
+kstr *
+edit_replace_all(
+      kstr * str)
+{
+   return kstr_replace_all(
+         str, kstr_get_view(str, 0, 2), kstr_get_view(str, 0, 20));
+}
+
+static
+kstr *
+edit_replace_end(
+      kstr * str)
+{
+   return kstr_replace_range(str, 10, kstr_npos, kstr_get_view(str, 0, 1000));
+}
+
+static
+kstr *
+edit_replace_middle(
+      kstr * str)
+{
+   return kstr_replace_range(str, 10, 5, kstr_get_view(str, 0, 100));
+}
+
+static
+kstr *
+edit_value(
+      bool chunked)
+{
+   if (!chunked)
+      return kstr_new(text_long);
+
+   kstr * str = kstr_set_growth(kstr_new(NULL), kstr_growth_chunked);
+   for (size_t i = 0; i < 1100; i++)
+      kstr_add_text(str, text_long);
+
+   return str;
+}
+
+static
+bool
+fail_allocation(void)
+{
+   return allocs_until_failure != 0 && --allocs_until_failure == 0;
+}
+
+static
+void
+check_records(
+      char const * value,
+      size_t * counts)
+{
+   while (*value != '\0')
+   {
+      size_t thread;
+      size_t i;
+      int length = 0;
+      if (
+            sscanf(value, "<%zu:%zu:%n", &thread, &i, &length) != 2 ||
+            length == 0 ||
+            thread >= record_threads ||
+            i >= record_count)
+         err("malformed record at [%.20s]", value);
+
+      value += length;
+      if (i == record_count / 2)
+      {
+         if (strncmp(value, text_long, strlen(text_long)) != 0)
+            err("malformed long record");
+         value += strlen(text_long);
+      }
+
+      if (*value++ != '>')
+         err("incomplete record");
+
+      if (counts != NULL)
+         counts[thread]++;
+   }
+}
+
+static
+void
+check_compiled(
+      char const * fmt,
+      ...)
+{
+   kstr_fmt * compiled = kstr_fmt_compile(fmt);
+   if (compiled == NULL)
+      err("can't compile format [%s]", fmt);
+
+   va_list args;
+   va_start(args, fmt);
+   kstr * expected = kstr_add_vfmt(kstr_new(__func__), fmt, args);
+   va_end(args);
+
+   va_start(args, fmt);
+   kstr * str = kstr_add_vcompiled(kstr_new(__func__), compiled, args);
+   va_end(args);
+
+   if (
+         kstr_size(str) != kstr_size(expected) ||
+         memcmp(kstr_get(str), kstr_get(expected), kstr_size(str)) != 0)
+      err(
+            "format [%s] gives [%s], expecting [%s]",
+            fmt,
+            kstr_get(str),
+            kstr_get(expected));
+
+   if (kstr_width(str) != kstr_width(expected))
+      err(
+            "format [%s] gives width [%zu], expecting [%zu]",
+            fmt,
+            kstr_width(str),
+            kstr_width(expected));
+
+   kstr_free(&str);
+   kstr_free(&expected);
+   kstr_fmt_free(&compiled);
+}
+
+static
+void
+check_output(
+      FILE * file,
+      kstr * expected)
+{
+   int const fd = fileno(file);
+   if (lseek(fd, 0, SEEK_SET) != 0)
+      err("can't rewind output file");
+
+   // read one byte more than expected to catch extra output
+   size_t const size = kstr_size(expected) - 1;
+   char * const data = malloc(size + 1);
+   if (data == NULL)
+      err("out of memory");
+
+   size_t total = 0;
+   ssize_t count;
+   while ((count = read(fd, data + total, size + 1 - total)) > 0)
+      total += (size_t) count;
+
+   if (total != size)
+      err("output has [%zu] bytes, expecting [%zu]", total, size);
+   if (memcmp(data, kstr_get(expected), size) != 0)
+      err("output differs from the expected value");
+
+   free(data);
+}
+
+static
+void
+err(
+      char const * fmt,
+      ...)
+{
+   va_list args;
+   va_start(args, fmt);
+   vfprintf(stderr, fmt, args);
+   va_end(args);
+
+   fputc('\n', stderr);
+   fflush(stderr);
+   exit(EXIT_FAILURE);
+}
+
+static
+void *
+read_records(
+      void * arg)
+{
+   kstr_concurrent * const records = arg;
+
+   // every value that can be read consists of complete records
+   kstr * str = kstr_new(NULL);
+   size_t size = 0;
+   do
+   {
+      kstr_set_text(str, NULL);
+      kstr_add_concurrent(str, records);
+      check_records(kstr_get(str), NULL);
+      if (kstr_size(str) - 1 < size)
+         err("size [%zu] shrank from [%zu]", kstr_size(str) - 1, size);
+      size = kstr_size(str) - 1;
+   }
+   while (kstr_concurrent_size(records) < record_total);
+
+   kstr_free(&str);
+   return NULL;
+}
+
+int
+main(void)
+{
+   // try to set the default locale
+   setlocale(LC_ALL, "");
+
+   // test kstr_free()
+   test_free_new();
+   test_free_null();
+   test_free_null_ptr();
+
+   // test kstr_new()
+   test_new_bytes();
+   test_new_bytes_nul();
+   test_new_empty();
+   test_new_long();
+   test_new_null_ptr();
+   test_new_simple();
+   test_new_utf8();
+
+   // test kstr_copy()
+   test_copy();
+   test_copy_long();
+   test_copy_used();
+
+   // test kstr_clone()
+   test_clone();
+   test_clone_fan_out();
+   test_clone_modified();
+
+   // test kstr_arena_new(), kstr_new_in(), kstr_copy_in(), kstr_arena_reset()
+   test_arena_copy();
+   test_arena_grow();
+   test_arena_new();
+   test_arena_reset();
+
+   // test kstr_get_copy()
+   test_get_copy();
+   test_get_copy_nul();
+
+   // test kstr_set_bytes()
+   test_set_bytes_nul();
+
+   // test kstr_set_text()
+   test_set_text_bytes();
+   test_set_text_empty();
+   test_set_text_long();
+   test_set_text_null();
+   test_set_text_simple();
+   test_set_text_utf8();
+
+   // test kstr_set_fmt()
+   test_set_fmt_bytes();
+   test_set_fmt_empty();
+   test_set_fmt_long();
+   test_set_fmt_no_args();
+   test_set_fmt_null();
+   test_set_fmt_simple();
+   test_set_fmt_utf8();
+
+   // test kstr_add_bytes()
+   test_add_bytes_nul();
+
+   // test kstr_add_view()
+   test_add_view_self();
+   test_add_view_text();
+
+   // test kstr_add_text()
+   test_add_text_bytes();
+   test_add_text_empty();
+   test_add_text_long();
+   test_add_text_null();
+   test_add_text_simple();
+   test_add_text_utf8();
+
+   // test kstr_add_fmt()
+   test_add_fmt_bytes();
+   test_add_fmt_empty();
+   test_add_fmt_fit();
+   test_add_fmt_long();
+   test_add_fmt_no_args();
+   test_add_fmt_null();
+   test_add_fmt_simple();
+   test_add_fmt_utf8();
+
+   // test kstr_add_double(), kstr_add_hex(), kstr_add_int(), kstr_add_uint()
+   test_add_double_fixed();
+   test_add_double_shortest();
+   test_add_hex();
+   test_add_int();
+
+   // test kstr_fmt_compile(), kstr_add_compiled(), kstr_add_cached()
+   test_add_cached();
+   test_add_compiled();
+   test_fmt_compile_invalid();
+
+   // test kstr_concurrent_new(), kstr_concurrent_add_bytes(),
+   // kstr_add_concurrent()
+   test_concurrent_basic();
+   test_concurrent_threads();
+
+   // test kstr_add_iov()
+   test_add_iov_mixed();
+   test_add_iov_self();
+   test_add_iov_self_many();
+
+   // test kstr_basename()
+   test_basename_absolute();
+   test_basename_changed();
+   test_basename_cwd();
+   test_basename_empty();
+   test_basename_file();
+   test_basename_null();
+   test_basename_relative();
+   test_basename_reuse();
+   test_basename_root();
+   test_basename_trailing();
+   test_basename_view();
+
+   // test kstr_dirname()
+   test_dirname();
+
+   // test kstr_extension()
+   test_extension();
+
+   // test kstr_cache_limit(), kstr_cache_purge()
+   test_cache_reuse();
+   test_cache_limit();
+   test_cache_thread();
+
+   // test kstr_capacity(), kstr_new_with_capacity(), kstr_reserve(),
+   // kstr_set_growth(), kstr_shrink_to_fit()
+   test_capacity_growth();
+   test_capacity_new();
+   test_capacity_reserve();
+   test_capacity_shrink();
+
+   // test kstr_get_chunks(), ::kstr_growth_chunked
+   test_chunked_add();
+   test_chunked_clone();
+   test_chunked_self();
+
+   // test kstr_size()
+   test_size_control();
+   test_size_empty();
+   test_size_mixed();
+   test_size_null();
+   test_size_text();
+
+   // test kstr_width()
+   test_width_control();
+   test_width_empty();
+   test_width_mixed();
+   test_width_null();
+   test_width_text();
+   test_width_invalid();
+   test_width_long();
+   test_width_scripts();
+   test_width_split();
+   test_width_utf8();
+
+   // test kstr_set_escapes()
+   test_escapes_disabled();
+   test_escapes_fmt();
+   test_escapes_split();
+   test_escapes_text();
+
+   // test kstr_add_bg(), kstr_add_fg(), kstr_add_bold(), kstr_add_reset()
+   test_control_codes();
+
+   // test kstr_add_style(), kstr_style_256(), kstr_style_basic(),
+   // kstr_style_rgb()
+   test_style_combined();
+   test_style_colors();
+   test_style_tracking();
+
+   // test kstr_get_view(), kstr_view_compare(), kstr_view_equal(),
+   // kstr_view_find(), kstr_view_find_char(), kstr_view_sub(),
+   // kstr_view_text()
+   test_view_compare();
+   test_view_find();
+   test_view_get();
+   test_view_sub();
+
+   // test kstr_getline(), kstr_read_fd(), kstr_slurp_file()
+   test_getline();
+   test_read_fd();
+   test_slurp_file();
+
+   // test kstr_compare(), kstr_equal(), kstr_find(), kstr_find_char(),
+   // kstr_hash(), kstr_view_hash()
+   test_compare();
+   test_find();
+   test_find_long();
+   test_hash();
+   test_hash_cached();
+
+   // test kstr_intern_free(), kstr_intern_get(), kstr_intern_new(),
+   // kstr_intern_size()
+   test_intern();
+   test_intern_arena();
+
+   // test kstr_erase(), kstr_insert(), kstr_replace_all(),
+   // kstr_replace_range(), kstr_truncate()
+   test_replace_range();
+   test_insert_erase();
+   test_replace_all();
+   test_edit_codes();
+   test_edit_shared();
+   test_edit_width();
+
+   // test kstr_write(), kstr_writev()
+   test_write();
+   test_writev();
+
+   // test kstr_get_plain(), kstr_write_plain()
+   test_plain();
+   test_plain_edit();
+   test_write_plain();
+
+   // test kstr_stats_get(), kstr_stats_reset()
+   test_stats();
+
+   // test kstr_set_error_mode()
+   test_error_mode();
+   test_error_basename();
+   test_error_constructors();
+   test_error_edits();
+   test_error_intern();
+
+   // test kstr_add_bytes_inline(), kstr_add_text_inline(), kstr_get_inline(),
+   // kstr_size_inline(), kstr_width_inline()
+   test_inline_get();
+   test_inline_add();
+
+   // test kstr_join(), kstr_split(), kstr_view_split(), kstr_view_token()
+   test_split();
+   test_split_long();
+   test_join();
+
+   // test kstr_builder_new(), kstr_builder_slice(), kstr_builder_finish(),
+   // kstr_builder_free()
+   test_builder();
+   test_builder_threads();
+
+   return EXIT_SUCCESS;
+}
+
+static
+void
+test_add_bytes_nul(void)
+{
+   fputs("test: append bytes including nul characters\n", stderr);
+
+   char const bytes[] = "one\0two";
+   kstr * str = kstr_new(__func__);
+   kstr_add_bytes(str, bytes, sizeof(bytes));
+   kstr_add_bytes(str, NULL, 1);
+
+   size_t const func_length = sizeof(__func__) - 1;
+   size_t const expected = func_length + sizeof(bytes) + 1;
+   size_t const size = kstr_size(str);
+   if (size != expected)
+      err("size [%zu], expecting [%zu]", size, expected);
+
+   char const * const value = kstr_get(str);
+   if (
+         strncmp(value, __func__, func_length) != 0 ||
+         memcmp(value + func_length, bytes, sizeof(bytes)) != 0 ||
+         value[size - 1] != '\0')
+      err("value [%s], expecting [%s%s]", value, __func__, bytes);
+
+   // nul characters take no columns
+   size_t const expected_width = func_length + sizeof(bytes) - 2;
+   size_t const width = kstr_width(str);
+   if (width != expected_width)
+      err("width [%zu], expecting [%zu]", width, expected_width);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_view_self(void)
+{
+   fputs("test: append a view of a string's own value\n", stderr);
+
+   // appending the whole value repeatedly makes the buffer move each time
+   kstr * str = kstr_new(text_long);
+   for (int i = 0; i < 4; i++)
+      kstr_add_view(str, kstr_get_view(str, 0, kstr_npos));
+
+   size_t const length = strlen(text_long);
+   size_t const expected = 16 * length + 1;
+   size_t const size = kstr_size(str);
+   if (size != expected)
+      err("size [%zu], expecting [%zu]", size, expected);
+
+   char const * const value = kstr_get(str);
+   for (size_t i = 0; i < 16; i++)
+      if (strncmp(value + i * length, text_long, length) != 0)
+         err("value [%s], expecting 16 x [%s]", value, text_long);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_view_text(void)
+{
+   fputs("test: append a view of text\n", stderr);
+
+   kstr * str = kstr_new(NULL);
+   kstr_add_view(str, kstr_view_sub(kstr_view_text(__func__), 5, 3));
+   kstr_add_view(str, kstr_view_text(NULL));
+
+   char const * const expected = "add";
+   char const * const value = kstr_get(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_fmt_bytes(void)
+{
+   fputs(
+         "test: append a formatted string with all 8-bit characters\n",
+         stderr);
+
+   char const * const text = text_bytes;
+   kstr * str = kstr_new(__func__);
+   kstr_add_fmt(str, "%s", text);
+
+   size_t const func_length = sizeof(__func__) - 1;
+   char const * const value = kstr_get(str);
+   if (
+         strncmp(value, __func__, func_length) != 0 ||
+         strcmp(value + func_length, text) != 0)
+      err("value [%s], expecting [%s%s]", value, __func__, text);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_fmt_empty(void)
+{
+   fputs(
+         "test: append a formatted string with an empty format string\n",
+         stderr);
+
+   kstr * str = kstr_new(__func__);
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-zero-length"
+   kstr_add_fmt(str, "");
+#pragma GCC diagnostic pop
+
+   char const * const expected = __func__;
+   char const * const value = kstr_get(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_fmt_fit(void)
+{
+   fputs(
+         "test: append formatted strings that just fit or overflow the buffer\n",
+         stderr);
+
+   // try every length around the initial buffer size
+   for (int length = 0; length < 256; length++)
+   {
+      kstr * str = kstr_new(NULL);
+      kstr_add_fmt(str, "%.*s", length, text_long);
+      kstr_add_fmt(str, "%c", '!');
+
+      size_t const expected = (size_t) length + 2;
+      size_t const size = kstr_size(str);
+      if (size != expected)
+         err("size [%zu], expecting [%zu]", size, expected);
+
+      char const * const value = kstr_get(str);
+      if (
+            strncmp(value, text_long, (size_t) length) != 0 ||
+            strcmp(value + length, "!") != 0)
+         err("value [%s], expecting [%.*s!]", value, length, text_long);
+
+      kstr_free(&str);
+   }
+}
+
+static
+void
+test_add_fmt_long(void)
+{
+   fputs("test: append a formatted string with a long value\n", stderr);
+
+   char const * const text = text_long;
+   kstr * str = kstr_new(__func__);
+   kstr_add_fmt(str, "%s", text);
+
+   size_t const func_length = sizeof(__func__) - 1;
+   char const * const value = kstr_get(str);
+   if (
+         strncmp(value, __func__, func_length) != 0 ||
+         strcmp(value + func_length, text) != 0)
+      err("value [%s], expecting [%s%s]", value, __func__, text);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_fmt_no_args(void)
+{
+   fputs("test: append a formatted string with no format arguments\n", stderr);
+
+   kstr * str = kstr_new(__func__);
+   kstr_add_fmt(str, __func__);
+
+   size_t const func_length = sizeof(__func__) - 1;
+   char const * const value = kstr_get(str);
+   if (
+         strncmp(value, __func__, func_length) != 0 ||
+         strcmp(value + func_length, __func__) != 0)
+      err("value [%s], expecting [%s%s]", value, __func__, __func__);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_fmt_null(void)
+{
+   fputs(
+         "test: append a formatted string with a null format string\n",
+         stderr);
+
+   kstr * str = kstr_new(__func__);
+   kstr_add_fmt(str, NULL);
+
+   char const * const expected = __func__;
+   char const * const value = kstr_get(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_fmt_simple(void)
+{
+   fputs("test: append a formatted string with a simple value\n", stderr);
+
+   char const * const text = __func__;
+   kstr * str = kstr_new(__func__);
+   kstr_add_fmt(str, "%s", text);
+
+   size_t const func_length = sizeof(__func__) - 1;
+   char const * const value = kstr_get(str);
+   if (
+         strncmp(value, __func__, func_length) != 0 ||
+         strcmp(value + func_length, text) != 0)
+      err("value [%s], expecting [%s%s]", value, __func__, text);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_fmt_utf8(void)
+{
+   fputs("test: append a formatted string with a utf-8 value\n", stderr);
+
+   char const * const text = text_utf8;
+   kstr * str = kstr_new(__func__);
+   kstr_add_fmt(str, "%s", text);
+
+   size_t const func_length = sizeof(__func__) - 1;
+   char const * const value = kstr_get(str);
+   if (
+         strncmp(value, __func__, func_length) != 0 ||
+         strcmp(value + func_length, text) != 0)
+      err("value [%s], expecting [%s%s]", value, __func__, text);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_cached(void)
+{
+   fputs("test: append text with cached compiled formats\n", stderr);
+
+   kstr * str = kstr_new(NULL);
+   kstr * expected = kstr_new(NULL);
+   for (int i = 0; i < 3; i++)
+   {
+      kstr_add_fmt_cached(str, "%d:%s:%.2f;", i, "label", i / 7.0);
+      kstr_add_fmt(expected, "%d:%s:%.2f;", i, "label", i / 7.0);
+   }
+
+   if (strcmp(kstr_get(str), kstr_get(expected)) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str), kstr_get(expected));
+
+   // the format is compiled into the cache on first use
+   kstr_fmt * cache = NULL;
+   kstr_add_cached(str, &cache, "%u", 1u);
+   kstr_fmt * const compiled = cache;
+   if (compiled == NULL)
+      err("format wasn't cached");
+
+   kstr_add_cached(str, &cache, "%u", 2u);
+   if (cache != compiled)
+      err("cached format changed");
+   kstr_fmt_free(&cache);
+
+   // a format that can't be compiled is still formatted. it isn't a literal,
+   // since iso c has no positional conversions to check it against
+   char const * const positional = "%1$s";
+   kstr_add_cached(str, &cache, positional, "!");
+   if (cache != NULL)
+      err("invalid format was cached");
+
+   kstr_add_text(expected, "12!");
+   if (strcmp(kstr_get(str), kstr_get(expected)) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str), kstr_get(expected));
+
+   kstr_free(&expected);
+   kstr_free(&str);
+}
+
+static
+void
+test_add_compiled(void)
+{
+   fputs("test: append text with compiled formats\n", stderr);
+
+   int const value = 0;
+   check_compiled("");
+   check_compiled("plain text");
+   check_compiled("%% literal %%%d%%", 5);
+   check_compiled("%d %i %d %d", 42, -1, INT_MAX, INT_MIN);
+   check_compiled("%ld %lld %jd", LONG_MIN, LLONG_MAX, INTMAX_MIN);
+   check_compiled(
+         "%zu %zd %td %zx", SIZE_MAX, (ssize_t) -5, (ptrdiff_t) -7, SIZE_MAX);
+   check_compiled(
+         "%tx|%tu|%to|%tX|%5tu",
+         (ptrdiff_t) 255,
+         (ptrdiff_t) -1,
+         (ptrdiff_t) -8,
+         (ptrdiff_t) 255,
+         (ptrdiff_t) 9);
+   check_compiled("%u %x %lx %X %o %#x", 0u, 255u, ULONG_MAX, 255u, 8u, 255u);
+   check_compiled("%hhd %hu %hhx", 300, 70000, 0x1ff);
+   check_compiled("%+d % d %05d %-5d| %.3d", 1, 2, 3, 4, 5);
+   check_compiled("%c%c%c", 'a', 'b', 'c');
+   check_compiled("%s|%5s|%-5s|%.2s", "x", "y", "z", "abcdef");
+   check_compiled("%s", text_utf8);
+   check_compiled("%f %.2f %.0f %lf %.12f", 1.5, -3.14159, 2.5, 0.1, 1 / 3.0);
+   check_compiled("%e %g %a %10.3f %Lf %F", 1e10, 1e-5, 1.0, 2.0, 1.5L, 1.0);
+   check_compiled("%*d|%-*.*f|%.*s", 5, 42, 8, 2, 3.14159, 3, "abcdef");
+   check_compiled("%p", (void const *) &value);
+   check_compiled("%lc %ls", (wint_t) 'x', L"wide");
+   check_compiled("\x1b[1m%s\x1b[0m %d", "bold", 7);
+}
+
+static
+void
+test_add_double_fixed(void)
+{
+   fputs(
+         "test: append floating-point numbers with a fixed precision\n",
+         stderr);
+
+   static struct
+   {
+      double value;
+      int precision;
+      char const * expected;
+   } const cases[] =
+   {
+      { 0.0, 2, "0.00" },
+      { -0.0, 2, "-0.00" },
+      { 3.14159, 2, "3.14" },
+      { -3.14159, 4, "-3.1416" },
+      { 2.5, 0, "2" },
+      { 3.5, 0, "4" },
+      { 0.125, 2, "0.12" },
+      { 0.375, 2, "0.38" },
+      { 1.005, 2, "1.00" },
+      { 0.1, 9, "0.100000000" },
+      { 99.995, 2, "100.00" },
+      { 999999.9999, 3, "1000000.000" },
+      { -0.001, 2, "-0.00" },
+      { 123456789.0, 1, "123456789.0" },
+      { 1e20, 2, "100000000000000000000.00" },
+      { 1.0 / 3.0, 12, "0.333333333333" },
+      { INFINITY, 2, "inf" },
+      { -INFINITY, 0, "-inf" }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr * str = kstr_new(__func__);
+      kstr_add_double(str, cases[i].value, cases[i].precision);
+
+      char const * const text = kstr_get(str) + strlen(__func__);
+      if (strcmp(text, cases[i].expected) != 0)
+         err(
+               "value [%s] of case [%zu], expecting [%s]",
+               text,
+               i,
+               cases[i].expected);
+
+      size_t const width = kstr_width(str);
+      size_t const expected = strlen(__func__) + strlen(cases[i].expected);
+      if (width != expected)
+         err("width [%zu] of case [%zu], expecting [%zu]", width, i, expected);
+
+      kstr_free(&str);
+   }
+}
+
+static
+void
+test_add_double_shortest(void)
+{
+   fputs(
+         "test: append floating-point numbers in their shortest exact form\n",
+         stderr);
+
+   static struct
+   {
+      double value;
+      char const * expected;
+   } const cases[] =
+   {
+      { 0.0, "0" },
+      { -0.0, "-0" },
+      { 42.0, "42" },
+      { -123456789012345.0, "-123456789012345" },
+      { 1e15, "1e+15" },
+      { 0.1, "0.1" },
+      { 0.1 + 0.2, "0.30000000000000004" },
+      { 1.0 / 3.0, "0.3333333333333333" },
+      { 2.5e-8, "2.5e-08" },
+      { 1.7976931348623157e308, "1.7976931348623157e+308" },
+      { 5e-324, "5e-324" },
+      { 2.2250738585072014e-308, "2.2250738585072014e-308" },
+      { INFINITY, "inf" }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr * str = kstr_new(NULL);
+      kstr_add_double(str, cases[i].value, -1);
+      if (strcmp(kstr_get(str), cases[i].expected) != 0)
+         err(
+               "value [%s] of case [%zu], expecting [%s]",
+               kstr_get(str),
+               i,
+               cases[i].expected);
+
+      // the value reads back exactly
+      double const value = strtod(kstr_get(str), NULL);
+      if (isfinite(cases[i].value) && value != cases[i].value)
+         err("value [%s] of case [%zu] doesn't read back", kstr_get(str), i);
+
+      kstr_free(&str);
+   }
+
+   // numbers of every magnitude match the fewest "%.*g" digits that read
+   // back, with at least 15 digits for normal numbers
+   kstr * str = kstr_new(NULL);
+   uint64_t state = UINT64_C(0x9e3779b97f4a7c15);
+   for (size_t i = 0; i < 200000; i++)
+   {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+
+      double value;
+      memcpy(&value, &state, sizeof(value));
+      if (i % 2 == 0)
+         value = (double) (state % 100000000) / (double) (state >> 54 | 1);
+      if (!isfinite(value))
+         continue;
+
+      char expected[32];
+      bool const subnormal = fabs(value) < DBL_MIN;
+      for (int digits = subnormal ? 1 : 15; digits <= 17; digits++)
+      {
+         snprintf(expected, sizeof(expected), "%.*g", digits, value);
+         if (strtod(expected, NULL) == value)
+            break;
+      }
+
+      kstr_add_double(kstr_set_text(str, NULL), value, -1);
+      if (strcmp(kstr_get(str), expected) != 0)
+         err(
+               "value [%s] of [%a], expecting [%s]",
+               kstr_get(str),
+               value,
+               expected);
+   }
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_hex(void)
+{
+   fputs("test: append unsigned integers in hexadecimal\n", stderr);
+
+   static uintmax_t const values[] =
+   {
+      0, 1, 9, 10, 15, 16, 0xff, 0x100, 0xdeadbeef, UINTMAX_MAX / 3,
+      UINTMAX_MAX
+   };
+
+   for (size_t i = 0; i < sizeof(values) / sizeof(*values); i++)
+   {
+      char expected[64];
+      snprintf(expected, sizeof(expected), "%jx", values[i]);
+
+      kstr * str = kstr_add_hex(kstr_new(NULL), values[i]);
+      if (strcmp(kstr_get(str), expected) != 0)
+         err("value [%s], expecting [%s]", kstr_get(str), expected);
+
+      if (kstr_width(str) != strlen(expected))
+         err("width [%zu], expecting [%zu]", kstr_width(str), strlen(expected));
+
+      kstr_free(&str);
+   }
+}
+
+static
+void
+test_add_int(void)
+{
+   fputs("test: append signed and unsigned integers\n", stderr);
+
+   static intmax_t const values[] =
+   {
+      0, 1, -1, 9, 10, -10, 99, 100, -101, 9999, 10000, 123456789,
+      -987654321, INT32_MAX, INT32_MIN, INTMAX_MAX, INTMAX_MIN
+   };
+
+   // append all values to one string, expecting the same as "%jd" and "%ju"
+   kstr * str = kstr_new(NULL);
+   char expected[2048] = "";
+   size_t count = 0;
+   for (size_t i = 0; i < sizeof(values) / sizeof(*values); i++)
+   {
+      kstr_add_int(str, values[i]);
+      kstr_add_text(str, " ");
+      kstr_add_uint(str, (uintmax_t) values[i]);
+      kstr_add_text(str, " ");
+      count += (size_t) snprintf(
+            expected + count,
+            sizeof(expected) - count,
+            "%jd %ju ",
+            values[i],
+            (uintmax_t) values[i]);
+   }
+
+   if (strcmp(kstr_get(str), expected) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str), expected);
+
+   if (kstr_width(str) != count)
+      err("width [%zu], expecting [%zu]", kstr_width(str), count);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_iov_mixed(void)
+{
+   fputs("test: append pieces of text and control codes\n", stderr);
+
+   kstr_piece const pieces[] =
+   {
+      { .kind = kstr_piece_fg, .color = kstr_color_red },
+      { .kind = kstr_piece_bold, .bold = true },
+      { .kind = kstr_piece_text, .chars = text_utf8 },
+      { .kind = kstr_piece_bytes, .chars = text_bytes, .count = 4 },
+      { .kind = kstr_piece_text, .chars = NULL },
+      { .kind = kstr_piece_bg, .color = kstr_color_default },
+      { .kind = kstr_piece_text, .chars = text_long },
+      { .kind = kstr_piece_reset }
+   };
+
+   // appending the pieces is the same as appending them one at a time
+   kstr * expected = kstr_new(__func__);
+   kstr_add_fg(expected, kstr_color_red);
+   kstr_add_bold(expected, true);
+   kstr_add_text(expected, text_utf8);
+   kstr_add_bytes(expected, text_bytes, 4);
+   kstr_add_bg(expected, kstr_color_default);
+   kstr_add_text(expected, text_long);
+   kstr_add_reset(expected);
+
+   kstr * str = kstr_new(__func__);
+   kstr_add_iov(str, pieces, sizeof(pieces) / sizeof(*pieces));
+
+   if (kstr_size(str) != kstr_size(expected)
+         || memcmp(kstr_get(str), kstr_get(expected), kstr_size(str)) != 0)
+      err("value differs from appending pieces one at a time");
+
+   size_t const width = kstr_width(str);
+   if (width != kstr_width(expected))
+      err("width [%zu], expecting [%zu]", width, kstr_width(expected));
+
+   // appending no pieces changes nothing
+   kstr_add_iov(str, NULL, 0);
+   kstr_add_iov(str, pieces, 0);
+   if (kstr_size(str) != kstr_size(expected))
+      err("size [%zu], expecting [%zu]", kstr_size(str), kstr_size(expected));
+
+   kstr_free(&str);
+   kstr_free(&expected);
+}
+
+static
+void
+test_add_iov_self(void)
+{
+   fputs("test: append pieces from a string's own value\n", stderr);
+
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < 4; i++)
+   {
+      size_t const size = kstr_size(str) - 1;
+      kstr_piece const pieces[] =
+      {
+         { .kind = kstr_piece_text, .chars = text_long },
+         { .kind = kstr_piece_bytes, .chars = kstr_get(str), .count = size }
+      };
+
+      // the string's value may be moved while appending its own bytes
+      kstr_add_iov(str, pieces, 2);
+      size_t const expected = size * 2 + strlen(text_long) + 1;
+      if (kstr_size(str) != expected)
+         err("size [%zu], expecting [%zu]", kstr_size(str), expected);
+
+      if (memcmp(kstr_get(str) + size + strlen(text_long),
+               kstr_get(str), size) != 0)
+         err("appended bytes differ from the original value");
+   }
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_iov_self_many(void)
+{
+   fputs(
+         "test: append many pieces that include a string's own value\n",
+         stderr);
+
+   // with and without room for the pieces, so the value does or doesn't move
+   for (size_t reserve = 0; reserve <= 200; reserve += 200)
+   {
+      kstr * str = kstr_reserve(kstr_new("self"), reserve);
+      kstr_piece pieces[40];
+      for (size_t i = 0; i < 39; i++)
+         pieces[i] = (kstr_piece) { .kind = kstr_piece_text, .chars = "x" };
+      pieces[39] =
+         (kstr_piece) { .kind = kstr_piece_text, .chars = kstr_get(str) };
+
+      kstr_add_iov(str, pieces, 40);
+      char expected[64] = "self";
+      memset(expected + 4, 'x', 39);
+      strcpy(expected + 43, "self");
+      if (strcmp(kstr_get(str), expected) != 0)
+         err("value [%s], expecting [%s]", kstr_get(str), expected);
+
+      kstr_free(&str);
+   }
+}
+
+static
+void
+test_add_text_bytes(void)
+{
+   fputs(
+         "test: append a string value including all 8-bit characters\n",
+         stderr);
+
+   char const * const text = text_bytes;
+   kstr * str = kstr_new(__func__);
+   kstr_add_text(str, text);
+
+   size_t const func_length = sizeof(__func__) - 1;
+   char const * const value = kstr_get(str);
+   if (
+         strncmp(value, __func__, func_length) != 0 ||
+         strcmp(value + func_length, text) != 0)
+      err("value [%s], expecting [%s%s]", value, __func__, text);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_text_empty(void)
+{
+   fputs("test: append an empty string value\n", stderr);
+
+   char const * const text = "";
+   kstr * str = kstr_new(__func__);
+   kstr_add_text(str, text);
+
+   size_t const func_length = sizeof(__func__) - 1;
+   char const * const value = kstr_get(str);
+   if (
+         strncmp(value, __func__, func_length) != 0 ||
+         strcmp(value + func_length, text) != 0)
+      err("value [%s], expecting [%s%s]", value, __func__, text);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_text_long(void)
+{
+   fputs("test: append a long string value\n", stderr);
+
+   char const * const text = text_long;
+   kstr * str = kstr_new(__func__);
+   kstr_add_text(str, text);
+
+   size_t const func_length = sizeof(__func__) - 1;
+   char const * const value = kstr_get(str);
+   if (
+         strncmp(value, __func__, func_length) != 0 ||
+         strcmp(value + func_length, text) != 0)
+      err("value [%s], expecting [%s%s]", value, __func__, text);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_text_null(void)
+{
+   fputs("test: append a null string value\n", stderr);
+
+   char const * const text = NULL;
+   kstr * str = kstr_new(__func__);
+   kstr_add_text(str, text);
+
+   char const * const expected = __func__;
+   char const * const value = kstr_get(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_text_simple(void)
+{
+   fputs("test: append a simple string value\n", stderr);
+
+   char const * const text = __func__;
+   kstr * str = kstr_new(__func__);
+   kstr_add_text(str, text);
+
+   size_t const func_length = sizeof(__func__) - 1;
+   char const * const value = kstr_get(str);
+   if (
+         strncmp(value, __func__, func_length) != 0 ||
+         strcmp(value + func_length, text) != 0)
+      err("value [%s], expecting [%s%s]", value, __func__, text);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_add_text_utf8(void)
+{
+   fputs("test: append a utf-8 string value\n", stderr);
+
+   char const * const text = text_utf8;
+   kstr * str = kstr_new(__func__);
+   kstr_add_text(str, text);
+
+   size_t const func_length = sizeof(__func__) - 1;
+   char const * const value = kstr_get(str);
+   if (
+         strncmp(value, __func__, func_length) != 0 ||
+         strcmp(value + func_length, text) != 0)
+      err("value [%s], expecting [%s%s]", value, __func__, text);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_arena_copy(void)
+{
+   fputs("test: copy strings into an arena\n", stderr);
+
+   kstr_arena * arena = kstr_arena_new(0);
+   kstr * str = kstr_new(text_long);
+   kstr * str_copy = kstr_copy_in(arena, str);
+   kstr * str_copy_copy = kstr_copy(str_copy);
+   kstr_free(&str);
+
+   char const * const expected = text_long;
+   char const * value = kstr_get(str_copy);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_arena_free(&arena);
+   if (arena != NULL)
+      err("arena at %p, expecting null", (void *) arena);
+
+   value = kstr_get(str_copy_copy);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str_copy_copy);
+}
+
+static
+void
+test_arena_grow(void)
+{
+   fputs("test: grow strings allocated from an arena\n", stderr);
+
+   // use a small block size so the strings outgrow it
+   kstr_arena * arena = kstr_arena_new(256);
+   kstr * str1 = kstr_new_in(arena, NULL);
+   kstr * str2 = kstr_new_in(arena, NULL);
+
+   for (int i = 0; i < 4; i++)
+   {
+      kstr_add_text(str1, text_long);
+      kstr_add_text(str2, "x");
+   }
+
+   size_t const expected = 4 * strlen(text_long) + 1;
+   size_t const size = kstr_size(str1);
+   if (size != expected)
+      err("size [%zu], expecting [%zu]", size, expected);
+
+   char const * const value = kstr_get(str2);
+   if (strcmp(value, "xxxx") != 0)
+      err("value [%s], expecting [xxxx]", value);
+
+   kstr_free(&str1);
+   if (str1 != NULL)
+      err("str at %p, expecting null", (void *) str1);
+
+   kstr_arena_free(&arena);
+}
+
+static
+void
+test_arena_new(void)
+{
+   fputs("test: create strings in an arena\n", stderr);
+
+   kstr_arena * arena = kstr_arena_new(0);
+   kstr * strs[100];
+   for (size_t i = 0; i < sizeof(strs) / sizeof(*strs); i++)
+      strs[i] = kstr_new_in(arena, __func__);
+
+   for (size_t i = 0; i < sizeof(strs) / sizeof(*strs); i++)
+   {
+      char const * const expected = __func__;
+      char const * const value = kstr_get(strs[i]);
+      if (strcmp(value, expected) != 0)
+         err("value [%s], expecting [%s]", value, expected);
+   }
+
+   kstr_arena_free(&arena);
+   kstr_arena_free(&arena);
+   kstr_arena_free(NULL);
+}
+
+static
+void
+test_arena_reset(void)
+{
+   fputs("test: reuse an arena after resetting it\n", stderr);
+
+   kstr_arena * arena = kstr_arena_new(0);
+   for (int batch = 0; batch < 3; batch++)
+   {
+      kstr * str = kstr_new_in(arena, __func__);
+      kstr_add_text(str, text_long);
+
+      size_t const expected = sizeof(__func__) + strlen(text_long);
+      size_t const size = kstr_size(str);
+      if (size != expected)
+         err("size [%zu], expecting [%zu]", size, expected);
+
+      kstr_arena_reset(arena);
+   }
+
+   kstr_arena_free(&arena);
+}
+
+static
+void
+test_basename_absolute(void)
+{
+   fputs("test: get the basename of an absolute path\n", stderr);
+
+   kstr * str = kstr_new(NULL);
+   kstr_set_fmt(str, "/one/two/%s", __func__);
+
+   char const * const expected = __func__;
+   char const * const value = kstr_basename(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_basename_changed(void)
+{
+   fputs("test: get the basename after changing a string\n", stderr);
+
+   char const * const text1 = "/one/two/three";
+   char const * const text2 = "/four/five/six";
+   kstr * str = kstr_new(text1);
+
+   kstr_basename(str);
+   kstr_set_text(str, text2);
+
+   char const * const expected = "six";
+   char const * const value = kstr_basename(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_basename_cwd(void)
+{
+   fputs("test: get the basename of the current directory\n", stderr);
+
+   char const * const text = ".";
+   kstr * str = kstr_new(text);
+
+   char const * const expected = text;
+   char const * const value = kstr_basename(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_basename_empty(void)
+{
+   fputs("test: get the basename of an empty path\n", stderr);
+
+   kstr * str = kstr_new(NULL);
+
+   char const * const expected = ".";
+   char const * const value = kstr_basename(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_basename_file(void)
+{
+   fputs("test: get the basename of a filename\n", stderr);
+
+   kstr * str = kstr_new(__func__);
+
+   char const * const expected = __func__;
+   char const * const value = kstr_basename(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_basename_null(void)
+{
+   fputs("test: get the basename of a null path\n", stderr);
+
+   kstr * str = kstr_new(NULL);
+
+   char const * const expected = ".";
+   char const * const value = kstr_basename(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_basename_relative(void)
+{
+   fputs("test: get the basename of a relative path\n", stderr);
+
+   kstr * str = kstr_new(NULL);
+   kstr_set_fmt(str, "one/two/%s", __func__);
+
+   char const * const expected = __func__;
+   char const * const value = kstr_basename(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_basename_reuse(void)
+{
+   fputs(
+         "test: reuse the cached basename after changing a string\n",
+         stderr);
+
+   kstr_arena * arena = kstr_arena_new(0);
+   kstr * strs[] = { kstr_new("/one/two/"), kstr_new_in(arena, "/one/two/") };
+
+   for (size_t i = 0; i < sizeof(strs) / sizeof(*strs); i++)
+   {
+      kstr * const str = strs[i];
+      char const * const cached = kstr_basename(str);
+      if (strcmp(cached, "two") != 0)
+         err("value [%s], expecting [two]", cached);
+
+      // the cache is updated in place after the value changes
+      kstr_add_text(str, "six/");
+      char const * value = kstr_basename(str);
+      if (strcmp(value, "six") != 0)
+         err("value [%s], expecting [six]", value);
+      if (value != cached)
+         err(
+               "basename at %p, expecting %p",
+               (void const *) value,
+               (void const *) cached);
+
+      kstr_add_fmt(str, "%s/", __func__);
+      value = kstr_basename(str);
+      if (strcmp(value, __func__) != 0)
+         err("value [%s], expecting [%s]", value, __func__);
+
+      kstr_free(&strs[i]);
+   }
+
+   kstr_arena_free(&arena);
+}
+
+static
+void
+test_basename_root(void)
+{
+   fputs("test: get the basename of the root directory\n", stderr);
+
+   char const * const text = "/";
+   kstr * str = kstr_new(text);
+
+   char const * const expected = text;
+   char const * const value = kstr_basename(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_basename_trailing(void)
+{
+   fputs("test: get the basename of a path with trailing slashes\n", stderr);
+
+   kstr * str = kstr_new(NULL);
+   kstr_set_fmt(str, "/one/two/%s//", __func__);
+
+   char const * const expected = __func__;
+   char const * value = kstr_basename(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   // the path itself is unchanged
+   value = kstr_get(str);
+   if (strncmp(value + strlen(value) - 2, "//", 2) != 0)
+      err("value [%s], expecting trailing slashes", value);
+
+   kstr_set_text(str, "///");
+   value = kstr_basename(str);
+   if (strcmp(value, "/") != 0)
+      err("value [%s], expecting [/]", value);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_basename_view(void)
+{
+   fputs("test: get a view of the basename of a path\n", stderr);
+
+   static struct
+   {
+      char const * path;
+      char const * expected;
+   } const cases[] =
+   {
+      { "", "." },
+      { "/", "/" },
+      { "//", "/" },
+      { "one", "one" },
+      { "one/", "one" },
+      { "/one/two", "two" },
+      { "/one/two//", "two" },
+      { "one//two", "two" },
+      { ".", "." },
+      { "one/..", ".." }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr * str = kstr_new(cases[i].path);
+      kstr_view const view = kstr_basename_view(str);
+      if (!kstr_view_equal(view, kstr_view_text(cases[i].expected)))
+         err(
+               "basename of [%s] is [%.*s], expecting [%s]",
+               cases[i].path,
+               (int) view.len,
+               view.ptr,
+               cases[i].expected);
+
+      kstr_free(&str);
+   }
+
+   // basenames without trailing slashes point into the value
+   kstr * str = kstr_new("/one/two");
+   char const * const value = kstr_basename(str);
+   if (value != kstr_get(str) + 5)
+      err(
+            "basename at %p, expecting %p",
+            (void const *) value,
+            (void const *) (kstr_get(str) + 5));
+
+   kstr_free(&str);
+}
+
+static
+void
+test_builder(void)
+{
+   fputs("test: assemble a string with a bulk builder\n", stderr);
+
+   kstr * str = kstr_set_escapes(kstr_new("head "), true);
+   kstr * expected = kstr_set_escapes(kstr_new("head "), true);
+   kstr_builder * builder = kstr_builder_new(str, 4);
+
+   // build the slices out of order, leaving one of them empty
+   for (size_t i = 4; i-- > 0;)
+   {
+      if (i == 2)
+         continue;
+
+      kstr * const slice = kstr_builder_slice(builder, i);
+      kstr_add_fmt(slice, "<%zu ", i);
+      kstr_add_fg(slice, kstr_color_green);
+      kstr_add_text(slice, (i == 1) ? "\x1b[1m" : text_utf8);
+      kstr_add_reset(slice);
+      kstr_add_text(slice, ">");
+   }
+
+   for (size_t i = 0; i < 4; i++)
+   {
+      if (i == 2)
+         continue;
+
+      kstr_add_fmt(expected, "<%zu ", i);
+      kstr_add_fg(expected, kstr_color_green);
+      kstr_add_text(expected, (i == 1) ? "\x1b[1m" : text_utf8);
+      kstr_add_reset(expected);
+      kstr_add_text(expected, ">");
+   }
+
+   // the result is the same as appending the values one after another
+   if (kstr_builder_finish(builder, 4) != str)
+      err("finish didn't return the builder's string");
+   if (!kstr_equal(str, expected))
+      err(
+            "built value [%s], expecting [%s]",
+            kstr_get(str),
+            kstr_get(expected));
+   if (kstr_width(str) != kstr_width(expected))
+      err(
+            "built width [%zu], expecting [%zu]",
+            kstr_width(str),
+            kstr_width(expected));
+   if (strcmp(kstr_get_plain(str).ptr, kstr_get_plain(expected).ptr) != 0)
+      err(
+            "built plain value [%s], expecting [%s]",
+            kstr_get_plain(str).ptr,
+            kstr_get_plain(expected).ptr);
+
+   // the style set by the slices is known afterwards
+   kstr_style const style = { .fg = kstr_style_basic(kstr_color_green) };
+   kstr_add_style(str, &style);
+   kstr_add_style(expected, &style);
+   if (!kstr_equal(str, expected))
+      err(
+            "style after building [%s], expecting [%s]",
+            kstr_get(str),
+            kstr_get(expected));
+
+   // the slices are emptied for another batch
+   if (kstr_size(kstr_builder_slice(builder, 0)) != 1)
+      err("slice not emptied by finishing");
+
+   // the end of a slice ends an incomplete utf-8 sequence
+   size_t const width = kstr_width(str);
+   kstr_add_text(kstr_builder_slice(builder, 0), "\xe2");
+   kstr_add_text(kstr_builder_slice(builder, 3), "x");
+   kstr_builder_finish(builder, 1);
+   if (kstr_width(str) != width + 2)
+      err("width [%zu], expecting [%zu]", kstr_width(str), width + 2);
+   if (strcmp(kstr_get(str) + kstr_size(str) - 3, "\xe2x") != 0)
+      err("second batch not appended");
+
+   // a slice holding untracked control codes makes the style unknown
+   kstr_style const red = { .fg = kstr_style_basic(kstr_color_red) };
+   kstr_add_fg(str, kstr_color_red);
+   kstr_add_text(kstr_builder_slice(builder, 1), "x\x1b[32mgreen");
+   kstr_builder_finish(builder, 1);
+   size_t const size = kstr_size(str) - 1;
+   kstr_add_style(str, &red);
+   if (strcmp(kstr_get(str) + size, "\x1b[31m") != 0)
+      err("style after untracked codes [%s]", kstr_get(str) + size);
+
+   // slices out of range fail with EINVAL
+   kstr_set_error_mode(kstr_error_return);
+   errno = 0;
+   if (kstr_builder_slice(builder, 4) != NULL || errno != EINVAL)
+      err("slice out of range didn't fail with EINVAL");
+   kstr_set_error_mode(kstr_error_abort);
+
+   kstr_builder_free(&builder);
+   if (builder != NULL)
+      err("pointer not set to null");
+   kstr_builder_free(&builder);
+   kstr_builder_free(NULL);
+
+   kstr_free(&expected);
+   kstr_free(&str);
+}
+
+static
+void
+test_builder_threads(void)
+{
+   fputs(
+         "test: build the slices of a bulk builder in several threads\n",
+         stderr);
+
+   // a chunked string keeps what it already holds as a chunk
+   kstr * str = kstr_set_growth(kstr_new(text_long), kstr_growth_chunked);
+   kstr * expected = kstr_new(text_long);
+   kstr_builder * builder = kstr_builder_new(str, row_threads);
+
+   struct row_slice rows[row_threads];
+   pthread_t threads[row_threads];
+   for (size_t i = 0; i < row_threads; i++)
+   {
+      rows[i] = (struct row_slice) { kstr_builder_slice(builder, i), i };
+      if (pthread_create(&threads[i], NULL, build_rows, &rows[i]) != 0)
+         err("can't create builder thread");
+   }
+
+   for (size_t i = 0; i < row_threads; i++)
+   {
+      pthread_join(threads[i], NULL);
+      add_rows(expected, i);
+   }
+
+   kstr_builder_finish(builder, row_threads);
+   if (!kstr_equal(str, expected))
+      err("value built in threads differs from the sequential one");
+   if (kstr_width(str) != kstr_width(expected))
+      err(
+            "built width [%zu], expecting [%zu]",
+            kstr_width(str),
+            kstr_width(expected));
+
+   kstr_view const plain = kstr_get_plain(str);
+   kstr_view const expected_plain = kstr_get_plain(expected);
+   if (!kstr_view_equal(plain, expected_plain))
+      err("plain value built in threads differs from the sequential one");
+
+   kstr_builder_free(&builder);
+   kstr_free(&expected);
+   kstr_free(&str);
+}
+
+static
+void
+test_cache_limit(void)
+{
+   fputs("test: limit the memory kept in the string cache\n", stderr);
+
+   // a cache too small for a string object keeps nothing
+   kstr_cache_limit(16);
+   kstr * str = kstr_new(text_long);
+   kstr_free(&str);
+
+   size_t size = kstr_cache_purge();
+   if (size != 0)
+      err("purged [%zu] bytes, expecting [0]", size);
+
+   // lowering the limit below the cached size purges the cache
+   kstr_cache_limit(1 << 20);
+   str = kstr_new(text_long);
+   kstr_free(&str);
+   kstr_cache_limit(0);
+
+   size = kstr_cache_purge();
+   if (size != 0)
+      err("purged [%zu] bytes after lowering the limit, expecting [0]", size);
+
+   // a disabled cache stays empty
+   str = kstr_new(text_long);
+   kstr_free(&str);
+   size = kstr_cache_purge();
+   if (size != 0)
+      err("purged [%zu] bytes with the cache disabled, expecting [0]", size);
+}
+
+static
+void
+test_cache_reuse(void)
+{
+   fputs("test: reuse the memory of destroyed strings\n", stderr);
+
+   size_t const old_limit = kstr_cache_limit(1 << 20);
+   if (old_limit != 0)
+      err("limit [%zu], expecting [0]", old_limit);
+
+   // a new string reuses the object and buffer of a destroyed one
+   kstr * str = kstr_new(text_long);
+   uintptr_t const object = (uintptr_t) str;
+   uintptr_t const data = (uintptr_t) kstr_get(str);
+   kstr_free(&str);
+
+   str = kstr_new(text_long);
+   if ((uintptr_t) str != object)
+      err("object at %p, expecting a reused object", (void *) str);
+   if ((uintptr_t) kstr_get(str) != data)
+      err("buffer at %p, expecting a reused buffer", (void *) kstr_get(str));
+   if (strcmp(kstr_get(str), text_long) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str), text_long);
+
+   // a copy reuses a cached buffer at least as large as it needs
+   kstr * str_copy = kstr_copy(str);
+   kstr_free(&str);
+   kstr_add_text(str_copy, "!");
+   str = kstr_copy(str_copy);
+   if (strcmp(kstr_get(str), kstr_get(str_copy)) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str), kstr_get(str_copy));
+   if (kstr_capacity(str) < kstr_size(str))
+      err(
+            "capacity [%zu], expecting at least [%zu]",
+            kstr_capacity(str),
+            kstr_size(str));
+
+   kstr_free(&str);
+   kstr_free(&str_copy);
+
+   size_t const size = kstr_cache_purge();
+   if (size == 0)
+      err("purged [0] bytes, expecting more");
+   if (kstr_cache_purge() != 0)
+      err("purged the cache twice");
+
+   kstr_cache_limit(old_limit);
+}
+
+static
+void
+test_cache_thread(void)
+{
+   fputs("test: free a thread's string cache when it exits\n", stderr);
+
+   // the leak checker of a sanitizer build reports a cache left behind
+   pthread_t thread;
+   if (pthread_create(&thread, NULL, cache_strings, NULL) != 0)
+      err("can't create caching thread");
+   pthread_join(thread, NULL);
+
+   // the calling thread's cache is separate and still empty
+   if (kstr_cache_purge() != 0)
+      err("the calling thread cached another thread's memory");
+}
+
+static
+void
+test_capacity_growth(void)
+{
+   fputs("test: grow strings with each growth policy\n", stderr);
+
+   for (kstr_growth growth = 0; growth < kstr_num_growths; growth++)
+   {
+      kstr * str = kstr_new(NULL);
+      kstr_set_growth(str, growth);
+
+      for (int i = 0; i < 64; i++)
+         kstr_add_text(str, text_long);
+
+      size_t const expected = 64 * strlen(text_long) + 1;
+      size_t const size = kstr_size(str);
+      if (size != expected)
+         err("size [%zu], expecting [%zu]", size, expected);
+
+      size_t const capacity = kstr_capacity(str);
+      if (capacity < size)
+         err("capacity [%zu], expecting [>=%zu]", capacity, size);
+
+      // copies keep the growth policy
+      kstr * str_copy = kstr_copy(str);
+      kstr_add_text(str_copy, text_long);
+      if (kstr_capacity(str_copy) < kstr_size(str_copy))
+         err(
+               "capacity [%zu], expecting [>=%zu]",
+               kstr_capacity(str_copy),
+               kstr_size(str_copy));
+
+      kstr_free(&str_copy);
+      kstr_free(&str);
+   }
+}
+
+static
+void
+test_capacity_new(void)
+{
+   fputs("test: create a string with a preallocated buffer\n", stderr);
+
+   size_t const count = 4 * sizeof(text_long);
+   kstr * str = kstr_new_with_capacity(count);
+
+   size_t const expected = 1;
+   size_t const size = kstr_size(str);
+   if (size != expected)
+      err("size [%zu], expecting [%zu]", size, expected);
+
+   size_t const capacity = kstr_capacity(str);
+   if (capacity < count + 1)
+      err("capacity [%zu], expecting [>=%zu]", capacity, count + 1);
+
+   for (int i = 0; i < 4; i++)
+      kstr_add_bytes(str, text_long, sizeof(text_long));
+
+   if (kstr_capacity(str) != capacity)
+      err("capacity [%zu], expecting [%zu]", kstr_capacity(str), capacity);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_capacity_reserve(void)
+{
+   fputs("test: reserve space in a string's buffer\n", stderr);
+
+   kstr * str = kstr_new(__func__);
+   kstr_reserve(str, sizeof(text_long));
+
+   size_t const capacity = kstr_capacity(str);
+   size_t const expected = sizeof(__func__) + sizeof(text_long);
+   if (capacity != expected)
+      err("capacity [%zu], expecting [%zu]", capacity, expected);
+
+   // reserving less than is available does nothing
+   kstr_reserve(str, 1);
+   if (kstr_capacity(str) != capacity)
+      err("capacity [%zu], expecting [%zu]", kstr_capacity(str), capacity);
+
+   kstr_add_text(str, text_long);
+   if (kstr_capacity(str) != capacity)
+      err("capacity [%zu], expecting [%zu]", kstr_capacity(str), capacity);
+
+   char const * const value = kstr_get(str);
+   size_t const func_length = sizeof(__func__) - 1;
+   if (
+         strncmp(value, __func__, func_length) != 0 ||
+         strcmp(value + func_length, text_long) != 0)
+      err("value [%s], expecting [%s%s]", value, __func__, text_long);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_capacity_shrink(void)
+{
+   fputs("test: release unused space in a string's buffer\n", stderr);
+
+   kstr * str = kstr_new_with_capacity(4 * sizeof(text_long));
+   kstr_add_text(str, text_long);
+   kstr_shrink_to_fit(str);
+
+   size_t const expected = sizeof(text_long);
+   size_t const capacity = kstr_capacity(str);
+   if (capacity != expected)
+      err("capacity [%zu], expecting [%zu]", capacity, expected);
+
+   if (strcmp(kstr_get(str), text_long) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str), text_long);
+
+   // short values move back into the string object
+   kstr_set_text(str, __func__);
+   kstr_shrink_to_fit(str);
+   if (kstr_capacity(str) >= expected)
+      err("capacity [%zu], expecting [<%zu]", kstr_capacity(str), expected);
+
+   if (strcmp(kstr_get(str), __func__) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str), __func__);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_chunked_add(void)
+{
+   fputs("test: append to a chunked string and read its chunks\n", stderr);
+
+   kstr * str = kstr_new(NULL);
+   kstr_set_growth(str, kstr_growth_chunked);
+   if (kstr_get_chunks(str, NULL, 0) != 0)
+      err("empty value has chunks");
+
+   // appending links new chunks without moving the old ones
+   kstr_add_text(str, text_long);
+   kstr_view first;
+   kstr_get_chunks(str, &first, 1);
+   size_t const appends = 3000;
+   for (size_t i = 1; i < appends; i++)
+      kstr_add_text(str, text_long);
+
+   size_t const len = strlen(text_long);
+   size_t const expected = appends * len + 1;
+   if (kstr_size(str) != expected)
+      err("size [%zu], expecting [%zu]", kstr_size(str), expected);
+   if (kstr_capacity(str) < kstr_size(str))
+      err(
+            "capacity [%zu], expecting [>=%zu]",
+            kstr_capacity(str),
+            kstr_size(str));
+
+   size_t const count = kstr_get_chunks(str, NULL, 0);
+   if (count < 2)
+      err("[%zu] chunks, expecting more than one", count);
+
+   kstr_view * chunks = malloc(count * sizeof(*chunks));
+   if (chunks == NULL)
+      err("out of memory");
+   kstr_get_chunks(str, chunks, count);
+   if (chunks[0].ptr != first.ptr)
+      err("first chunk moved from %p", (void *) first.ptr);
+
+   // the chunks hold the value in order
+   size_t pos = 0;
+   for (size_t i = 0; i < count; i++)
+   {
+      for (size_t j = 0; j < chunks[i].len; j++, pos++)
+         if (chunks[i].ptr[j] != text_long[pos % len])
+            err("chunk [%zu] differs at [%zu]", i, j);
+   }
+   if (pos != expected - 1)
+      err("chunks hold [%zu] bytes, expecting [%zu]", pos, expected - 1);
+
+   free(chunks);
+
+   // reading the whole value joins the chunks
+   char const * const value = kstr_get(str);
+   for (pos = 0; pos < expected - 1; pos++)
+      if (value[pos] != text_long[pos % len])
+         err("value differs at [%zu]", pos);
+   if (value[pos] != '\0')
+      err("value isn't nul-terminated");
+   if (kstr_get_chunks(str, NULL, 0) != 1)
+      err("[%zu] chunks, expecting [1]", kstr_get_chunks(str, NULL, 0));
+   if (kstr_width(str) != expected - 1)
+      err("width [%zu], expecting [%zu]", kstr_width(str), expected - 1);
+
+   // resetting the value frees the chunks
+   kstr_set_text(str, "done");
+   if (strcmp(kstr_get(str), "done") != 0)
+      err("value [%s], expecting [done]", kstr_get(str));
+
+   kstr_free(&str);
+}
+
+static
+void
+test_chunked_clone(void)
+{
+   fputs(
+         "test: append to a chunked string whose clone was destroyed\n",
+         stderr);
+
+   // the buffer is still shared with no other strings, and must be copied
+   // rather than kept as a chunk
+   kstr * str = kstr_set_growth(kstr_new(text_long), kstr_growth_chunked);
+   kstr * clone = kstr_clone(str);
+   kstr_free(&clone);
+
+   size_t const appends = 2000;
+   for (size_t i = 0; i < appends; i++)
+      kstr_add_text(str, text_long);
+
+   size_t const expected = (appends + 1) * strlen(text_long) + 1;
+   if (kstr_size(str) != expected)
+      err("size [%zu], expecting [%zu]", kstr_size(str), expected);
+   if (strncmp(kstr_get(str), text_long, strlen(text_long)) != 0)
+      err("value doesn't start with the original text");
+
+   kstr_free(&str);
+}
+
+static
+void
+test_chunked_self(void)
+{
+   fputs("test: append a chunked string's own value to it\n", stderr);
+
+   kstr * str = kstr_new(NULL);
+   kstr_set_growth(str, kstr_growth_chunked);
+   kstr * expected = kstr_new(NULL);
+   for (int i = 0; i < 1200; i++)
+   {
+      kstr_add_text(str, text_long);
+      kstr_add_text(expected, text_long);
+   }
+
+   // the joined value fills its buffer, so appending it starts a new one
+   kstr_add_text(str, kstr_get(str));
+   kstr_add_text(expected, kstr_get(expected));
+
+   // pieces from the value stay where they are as well
+   kstr_view const view = kstr_get_view(str, 0, 16);
+   kstr_piece const pieces[] =
+   {
+      { .kind = kstr_piece_bytes, .chars = view.ptr, .count = view.len },
+      { .kind = kstr_piece_text, .chars = text_long }
+   };
+   kstr_add_iov(str, pieces, sizeof(pieces) / sizeof(*pieces));
+   kstr_add_bytes(expected, kstr_get(expected), 16);
+   kstr_add_text(expected, text_long);
+
+   if (kstr_size(str) != kstr_size(expected))
+      err(
+            "size [%zu], expecting [%zu]",
+            kstr_size(str),
+            kstr_size(expected));
+   if (memcmp(kstr_get(str), kstr_get(expected), kstr_size(str)) != 0)
+      err("value differs from the expected value");
+
+   kstr_free(&expected);
+   kstr_free(&str);
+}
+
+static
+void
+test_clone(void)
+{
+   fputs("test: clone a string and modify the original\n", stderr);
+
+   kstr * str = kstr_new(text_long);
+   kstr * str_clone = kstr_clone(str);
+
+   if (str == str_clone)
+      err("str at %p returned self as clone", (void *) str);
+
+   if (strcmp(kstr_get(str_clone), text_long) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str_clone), text_long);
+
+   // the clone keeps its value when the original changes
+   kstr_add_text(str, __func__);
+   kstr_free(&str);
+   if (strcmp(kstr_get(str_clone), text_long) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str_clone), text_long);
+
+   size_t const expected = sizeof(text_long);
+   size_t const size = kstr_size(str_clone);
+   if (size != expected)
+      err("size [%zu], expecting [%zu]", size, expected);
+
+   // the last user of a shared buffer can keep modifying it
+   kstr_add_text(str_clone, __func__);
+   kstr_shrink_to_fit(str_clone);
+   if (kstr_size(str_clone) != expected + sizeof(__func__) - 1)
+      err(
+            "size [%zu], expecting [%zu]",
+            kstr_size(str_clone),
+            expected + sizeof(__func__) - 1);
+
+   kstr_free(&str_clone);
+
+   // short values are copied
+   str = kstr_new(__func__);
+   str_clone = kstr_clone(str);
+   kstr_set_text(str, NULL);
+   if (strcmp(kstr_get(str_clone), __func__) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str_clone), __func__);
+
+   kstr_free(&str);
+   kstr_free(&str_clone);
+}
+
+static
+void
+test_clone_fan_out(void)
+{
+   fputs("test: clone a string many times and destroy the clones\n", stderr);
+
+   kstr * str = kstr_new(text_long);
+   kstr * clones[16];
+   for (size_t i = 0; i < sizeof(clones) / sizeof(*clones); i++)
+      clones[i] = kstr_clone(i % 2 == 0 ? str : clones[i - 1]);
+
+   // all clones share one buffer
+   for (size_t i = 0; i < sizeof(clones) / sizeof(*clones); i++)
+      if (kstr_get(clones[i]) != kstr_get(str))
+         err(
+               "value at %p, expecting %p",
+               (void const *) kstr_get(clones[i]),
+               (void const *) kstr_get(str));
+
+   kstr_free(&str);
+   for (size_t i = 0; i < sizeof(clones) / sizeof(*clones); i += 2)
+      kstr_free(&clones[i]);
+
+   for (size_t i = 1; i < sizeof(clones) / sizeof(*clones); i += 2)
+   {
+      if (strcmp(kstr_get(clones[i]), text_long) != 0)
+         err("value [%s], expecting [%s]", kstr_get(clones[i]), text_long);
+      kstr_free(&clones[i]);
+   }
+}
+
+static
+void
+test_clone_modified(void)
+{
+   fputs("test: clone a string and modify the clone\n", stderr);
+
+   kstr * str = kstr_new(text_long);
+   kstr * str_clone1 = kstr_clone(str);
+   kstr * str_clone2 = kstr_clone(str);
+
+   kstr_add_fmt(str_clone1, "%s", __func__);
+   kstr_set_text(str_clone2, __func__);
+
+   if (strcmp(kstr_get(str), text_long) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str), text_long);
+
+   size_t const func_length = sizeof(__func__) - 1;
+   char const * const value = kstr_get(str_clone1);
+   if (
+         strncmp(value, text_long, sizeof(text_long) - 1) != 0 ||
+         strcmp(value + sizeof(text_long) - 1, __func__) != 0)
+      err("value [%s], expecting [%s%s]", value, text_long, __func__);
+
+   if (strcmp(kstr_get(str_clone2), __func__) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str_clone2), __func__);
+
+   if (kstr_width(str_clone2) != func_length)
+      err("width [%zu], expecting [%zu]", kstr_width(str_clone2), func_length);
+
+   kstr_free(&str);
+   kstr_free(&str_clone1);
+   kstr_free(&str_clone2);
+}
+
+//! test appending control codes to a string
+static
+void
+test_compare(void)
+{
+   fputs("test: compare the values of strings\n", stderr);
+
+   static struct
+   {
+      char const * text1;
+      char const * text2;
+      int expected;
+   } const cases[] =
+   {
+      { "", "", 0 },
+      { "abc", "abc", 0 },
+      { "abc", "abd", -1 },
+      { "abd", "abc", 1 },
+      { "ab", "abc", -1 },
+      { "abc", "ab", 1 },
+      { "", "a", -1 },
+      { "\xff", "a", 1 }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr * str1 = kstr_new(cases[i].text1);
+      kstr * str2 = kstr_new(cases[i].text2);
+
+      int const result = kstr_compare(str1, str2);
+      if ((result > 0) - (result < 0) != cases[i].expected)
+         err(
+               "compare [%s] and [%s] result [%d], expecting [%d]",
+               cases[i].text1,
+               cases[i].text2,
+               result,
+               cases[i].expected);
+
+      bool const equal = kstr_equal(str1, str2);
+      if (equal != (cases[i].expected == 0))
+         err(
+               "equal [%s] and [%s] result [%d]",
+               cases[i].text1,
+               cases[i].text2,
+               equal);
+
+      kstr_free(&str2);
+      kstr_free(&str1);
+   }
+
+   // values with nul bytes are compared in full, and clones are equal
+   kstr * str = kstr_new_bytes("a\0b", 3);
+   kstr * str_other = kstr_new_bytes("a\0c", 3);
+   kstr * str_clone = kstr_clone(str);
+   if (kstr_equal(str, str_other) || kstr_compare(str, str_other) >= 0)
+      err("values with nul bytes compared as equal");
+   if (!kstr_equal(str, str_clone) || kstr_compare(str, str_clone) != 0)
+      err("clone compared as different");
+
+   kstr_free(&str_clone);
+   kstr_free(&str_other);
+   kstr_free(&str);
+}
+
+static
+void
+test_concurrent_basic(void)
+{
+   fputs("test: append to a concurrent string from one thread\n", stderr);
+
+   kstr_concurrent * records = kstr_concurrent_new(16);
+   kstr_concurrent_add_text(records, "one ");
+   kstr_concurrent_add_bytes(records, "two\0", 4);
+   kstr_concurrent_add_view(records, kstr_view_text(" three"));
+   kstr_concurrent_add_text(records, NULL);
+   kstr_concurrent_add_bytes(records, NULL, 1);
+   kstr_concurrent_add_text(records, text_long);
+
+   static char const expected[] = "one two\0 three";
+   size_t const count = sizeof(expected) - 1 + strlen(text_long);
+   if (kstr_concurrent_size(records) != count)
+      err("size [%zu], expecting [%zu]", kstr_concurrent_size(records), count);
+
+   // the value is appended after the string's own value
+   kstr * str = kstr_add_concurrent(kstr_new(__func__), records);
+   char const * const value = kstr_get(str) + strlen(__func__);
+   if (
+         kstr_size(str) != strlen(__func__) + count + 1 ||
+         memcmp(value, expected, sizeof(expected) - 1) != 0 ||
+         strcmp(value + sizeof(expected) - 1, text_long) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str), expected);
+
+   kstr_free(&str);
+   kstr_concurrent_free(&records);
+   if (records != NULL)
+      err("pointer not set to null");
+   kstr_concurrent_free(&records);
+   kstr_concurrent_free(NULL);
+}
+
+static
+void
+test_concurrent_threads(void)
+{
+   fputs(
+         "test: append to a concurrent string from several threads\n",
          stderr);
 
-   char const * const text = text_bytes;
-   kstr * str = kstr_new(__func__);
-   kstr_add_fmt(str, "%s", text);
+   record_total = 0;
+   for (size_t thread = 0; thread < record_threads; thread++)
+      for (size_t i = 0; i < record_count; i++)
+         record_total += (size_t) snprintf(NULL, 0, "<%zu:%zu:>", thread, i) +
+            (i == record_count / 2 ? strlen(text_long) : 0);
+
+   // small segments make appends move to new segments often
+   kstr_concurrent * records = kstr_concurrent_new(256);
+   pthread_t readers[2];
+   pthread_t writers[record_threads];
+   for (size_t i = 0; i < sizeof(readers) / sizeof(*readers); i++)
+      if (pthread_create(&readers[i], NULL, read_records, records) != 0)
+         err("can't create reader thread");
+   for (size_t i = 0; i < record_threads; i++)
+      if (pthread_create(&writers[i], NULL, append_records, records) != 0)
+         err("can't create writer thread");
+
+   for (size_t i = 0; i < record_threads; i++)
+      pthread_join(writers[i], NULL);
+   for (size_t i = 0; i < sizeof(readers) / sizeof(*readers); i++)
+      pthread_join(readers[i], NULL);
+
+   // every record was appended exactly once
+   kstr * str = kstr_add_concurrent(kstr_new(NULL), records);
+   size_t counts[record_threads] = { 0 };
+   check_records(kstr_get(str), counts);
+   for (size_t i = 0; i < record_threads; i++)
+      if (counts[i] != record_count)
+         err(
+               "[%zu] records of thread [%zu], expecting [%zu]",
+               counts[i],
+               i,
+               (size_t) record_count);
+
+   if (kstr_size(str) - 1 != record_total)
+      err("size [%zu], expecting [%zu]", kstr_size(str) - 1, record_total);
+
+   kstr_free(&str);
+   kstr_concurrent_free(&records);
+}
+
+static
+void
+test_control_codes(void)
+{
+   fputs("test: append control codes to a string\n", stderr);
+
+   char const * const text = "x";
+   kstr * str = kstr_new(NULL);
+
+   // print a line for each foreground color
+   for (kstr_color fg = 0; fg < kstr_num_colors; fg++)
+   {
+      // clear the string for this line of output
+      kstr_set_text(str, NULL);
+
+      // for each background color, add the fg/bg color attributes, normal
+      // text, bold text, and unbolded text
+      for (kstr_color bg = 0; bg < kstr_num_colors; bg++)
+      {
+         kstr_add_fg(str, fg);
+         kstr_add_bg(str, bg);
+         kstr_add_text(str, text);
+         kstr_add_bold(str, true);
+         kstr_add_text(str, text);
+         kstr_add_bold(str, false);
+         kstr_add_text(str, text);
+      }
+
+      // reset the attributes and add the last text before printing the line
+      kstr_add_bold(str, true);
+      kstr_add_reset(str);
+      kstr_add_text(str, text);
+      kstr_add_text(str, "\n");
+      fputs(kstr_get(str), stderr);
+   }
+
+   kstr_free(&str);
+}
+
+static
+void
+test_copy(void)
+{
+   fputs("test: copy a string\n", stderr);
+
+   char const * const text = __func__;
+   kstr * str = kstr_new(text);
+   kstr * str_copy = kstr_copy(str);
+
+   if (str == str_copy)
+      err("str at %p returned self as copy", (void *) str);
+
+   char const * const expected = text;
+   char const * const value = kstr_get(str_copy);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
+   kstr_free(&str_copy);
+}
+
+static
+void
+test_copy_long(void)
+{
+   fputs("test: copy a string with a long value\n", stderr);
+
+   char const * const text = text_long;
+   kstr * str = kstr_new(text);
+   kstr * str_copy = kstr_copy(str);
+   kstr_free(&str);
+
+   char const * const expected = text;
+   char const * const value = kstr_get(str_copy);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_add_text(str_copy, text);
+   size_t const expected_size = 2 * strlen(text) + 1;
+   size_t const size = kstr_size(str_copy);
+   if (size != expected_size)
+      err("size [%zu], expecting [%zu]", size, expected_size);
+
+   kstr_free(&str_copy);
+}
+
+static
+void
+test_copy_used(void)
+{
+   fputs("test: copy a string with unused buffer space\n", stderr);
+
+   kstr * str = kstr_new_with_capacity(64 * sizeof(text_long));
+   kstr_add_text(str, text_long);
+   kstr * str_copy = kstr_copy(str);
+
+   size_t const expected = sizeof(text_long);
+   size_t const capacity = kstr_capacity(str_copy);
+   if (capacity != expected)
+      err("capacity [%zu], expecting [%zu]", capacity, expected);
+
+   if (strcmp(kstr_get(str_copy), text_long) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str_copy), text_long);
+
+   kstr_free(&str);
+   kstr_free(&str_copy);
+}
+
+static
+void
+test_dirname(void)
+{
+   fputs("test: get the directory name of a path\n", stderr);
+
+   static struct
+   {
+      char const * path;
+      char const * expected;
+   } const cases[] =
+   {
+      { "", "." },
+      { "/", "/" },
+      { "///", "/" },
+      { "/one", "/" },
+      { "one", "." },
+      { "one/two", "one" },
+      { "/one/two/", "/one" },
+      { "one//two", "one" },
+      { "/one//", "/" },
+      { "one/..", "one" }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr * str = kstr_new(cases[i].path);
+      kstr_view const view = kstr_dirname(str);
+      if (!kstr_view_equal(view, kstr_view_text(cases[i].expected)))
+         err(
+               "dirname of [%s] is [%.*s], expecting [%s]",
+               cases[i].path,
+               (int) view.len,
+               view.ptr,
+               cases[i].expected);
+
+      kstr_free(&str);
+   }
+}
+
+static
+void
+test_edit_codes(void)
+{
+   fputs("test: edit a string with control codes\n", stderr);
+
+   kstr * str = kstr_new("a");
+   kstr_add_fg(str, kstr_color_red);
+   kstr_add_text(str, "bc");
+   kstr_add_reset(str);
+   kstr_add_text(str, "d");
+
+   // replacement control codes take no columns if escape sequences are
+   // recognized, like appended ones
+   kstr_set_escapes(str, true);
+   kstr * red = kstr_add_fg(kstr_new(NULL), kstr_color_red);
+   kstr * blue = kstr_add_fg(kstr_new(NULL), kstr_color_blue);
+   kstr_replace_all(
+         str,
+         kstr_get_view(red, 0, kstr_npos),
+         kstr_get_view(blue, 0, kstr_npos));
+   if (kstr_find(str, kstr_get_view(blue, 0, kstr_npos), 0) != 1)
+      err("control code not replaced");
+   if (kstr_width(str) != 4)
+      err("width [%zu], expecting [4]", kstr_width(str));
+
+   kstr_free(&blue);
+   kstr_free(&red);
+
+   kstr_set_text(str, "a");
+   kstr_add_fg(str, kstr_color_red);
+   size_t const start = kstr_size(str) - 1;
+   kstr_add_text(str, "bc");
+   kstr_add_reset(str);
+   kstr_add_text(str, "d");
+
+   kstr_erase(str, 1, start - 1);
+   if (kstr_width(str) != 4)
+      err("width [%zu], expecting [4]", kstr_width(str));
+
+   kstr_truncate(str, 3);
+   if (kstr_width(str) != 3)
+      err("width [%zu], expecting [3]", kstr_width(str));
+
+   kstr_free(&str);
+}
+
+static
+void
+test_edit_shared(void)
+{
+   fputs("test: edit strings with shared or chunked buffers\n", stderr);
+
+   // a clone keeps its value when the original is edited
+   kstr * str = kstr_new(text_long);
+   kstr * str_clone = kstr_clone(str);
+   kstr_replace_range(str, 0, 10, kstr_view_text("edited"));
+   if (strcmp(kstr_get(str_clone), text_long) != 0)
+      err("clone value changed");
+   if (strncmp(kstr_get(str), "edited", 6) != 0)
+      err("value [%.10s], expecting [edited]", kstr_get(str));
+
+   kstr_free(&str_clone);
+   kstr_free(&str);
+
+   // a chunked value is joined to be edited
+   str = kstr_new(NULL);
+   kstr_set_growth(str, kstr_growth_chunked);
+   for (int i = 0; i < 1100; i++)
+      kstr_add_text(str, text_long);
+
+   size_t const size = kstr_size(str);
+   kstr_insert(str, 1, kstr_view_text("++"));
+   kstr_replace_all(str, kstr_view_text("++"), kstr_view_text("+"));
+   kstr_erase(str, 1, 1);
+   if (kstr_size(str) != size)
+      err("size [%zu], expecting [%zu]", kstr_size(str), size);
+   if (strncmp(kstr_get(str), text_long, sizeof(text_long) - 1) != 0)
+      err("value differs from the original value");
+
+   kstr_free(&str);
+}
+
+static
+void
+test_edit_width(void)
+{
+   fputs("test: get the width of strings after edits\n", stderr);
+
+   // without recognized escape sequences, their bytes other than escape take
+   // columns wherever the edit is
+   kstr * str = kstr_new("\x1b[31m" "ab");
+   kstr_erase(str, 0, 5);
+   if (kstr_width(str) != 2)
+      err("width [%zu] after erase, expecting [2]", kstr_width(str));
+
+   kstr_set_text(str, "\x1b[31m" "ab");
+   kstr_truncate(str, 0);
+   if (kstr_width(str) != 0)
+      err("width [%zu] after truncate, expecting [0]", kstr_width(str));
+
+   kstr_set_text(str, "ab");
+   kstr_insert(str, 1, kstr_view_text("\x1b[31m"));
+   if (kstr_width(str) != 6)
+      err("width [%zu] after insert, expecting [6]", kstr_width(str));
+
+   kstr_set_text(str, "a");
+   kstr_replace_range(str, 1, 0, kstr_view_text("\x1b[31m"));
+   if (kstr_width(str) != 5)
+      err("width [%zu] after replacing the end, expecting [5]",
+            kstr_width(str));
+
+   // the rest of a control code that is partly erased takes columns
+   kstr_set_text(str, NULL);
+   kstr_add_bold(str, true);
+   kstr_add_text(str, "X");
+   kstr_erase(str, 0, 1);
+   if (kstr_width(str) != 4)
+      err("width [%zu] after erasing escape, expecting [4]", kstr_width(str));
+
+   // erased and inserted bytes of utf-8 sequences are decoded with the
+   // bytes around them
+   static struct
+   {
+      char const * text;
+      size_t pos;
+      size_t count;
+      char const * insert;
+      char const * expected;
+   } const cases[] =
+   {
+      { "\xc3\xa9", 0, 1, "", "\xa9" },
+      { "\xc3\xa9" "b", 1, 1, "", "\xc3" "b" },
+      { "ab", 1, 0, "\xc3", "a\xc3" "b" },
+      { "a\xc3" "b", 2, 0, "\xa9", "a\xc3\xa9" "b" },
+      { "a\xe4\xb8\xad" "b", 2, 2, "", "a\xe4" "b" },
+      { "a\xe4" "b", 1, 0, "\xe4\xb8", "a\xe4\xb8\xe4" "b" },
+      { "a\xc3", 2, 0, "\xa9", "a\xc3\xa9" }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr_set_text(str, cases[i].text);
+      kstr_replace_range(
+            str, cases[i].pos, cases[i].count, kstr_view_text(cases[i].insert));
+      kstr * expected = kstr_new(cases[i].expected);
+      if (strcmp(kstr_get(str), kstr_get(expected)) != 0)
+         err("case [%zu] gives the wrong value", i);
+      if (kstr_width(str) != kstr_width(expected))
+         err(
+               "width [%zu] of case [%zu], expecting [%zu]",
+               kstr_width(str),
+               i,
+               kstr_width(expected));
+
+      // appends continue the sequence at the end
+      kstr_add_text(str, "\xa9");
+      kstr_add_text(expected, "\xa9");
+      if (kstr_width(str) != kstr_width(expected))
+         err(
+               "width [%zu] of case [%zu] after append, expecting [%zu]",
+               kstr_width(str),
+               i,
+               kstr_width(expected));
+
+      kstr_free(&expected);
+   }
+
+   kstr_free(&str);
+}
+
+static
+void
+test_error_basename(void)
+{
+   fputs("test: get path components when joining chunks fails\n", stderr);
+
+   kstr_set_error_mode(kstr_error_return);
+   for (size_t kind = 0; kind < 4; kind++)
+   {
+      // joining the chunks of the value is the only allocation
+      kstr * str = edit_value(true);
+      kstr_add_text(str, "/dir/name.txt");
+
+      errno = 0;
+      allocs_until_failure = 1;
+      bool failed = false;
+      switch (kind)
+      {
+         case 0:
+            failed = kstr_basename(str) == NULL;
+            break;
+         case 1:
+            failed = kstr_basename_view(str).ptr == NULL;
+            break;
+         case 2:
+            failed = kstr_dirname(str).ptr == NULL;
+            break;
+         default:
+            failed = kstr_extension(str).ptr == NULL;
+            break;
+      }
+
+      allocs_until_failure = 0;
+      if (!failed || errno != ENOMEM)
+         err("case [%zu] didn't fail to join the value", kind);
+
+      // the value is still there to try again
+      if (strcmp(kstr_basename(str), "name.txt") != 0)
+         err("basename [%s], expecting [name.txt]", kstr_basename(str));
+
+      kstr_free(&str);
+   }
+
+   kstr_set_error_mode(kstr_error_abort);
+}
+
+static
+void
+test_error_constructors(void)
+{
+   fputs("test: constructors that fail to allocate memory\n", stderr);
+
+   kstr_set_error_mode(kstr_error_return);
+   for (size_t kind = 0; kind < 6; kind++)
+   {
+      kstr * source = kstr_new(text_long);
+      kstr * expected = construct(kind, source);
+
+      // fail each allocation of the constructor in turn, until it needs no
+      // more; the leak checker of a sanitizer build reports what is leaked
+      for (size_t failure = 1; ; failure++)
+      {
+         kstr * copied = kstr_new(text_long);
+
+         errno = 0;
+         allocs_until_failure = failure;
+         kstr * str = construct(kind, copied);
+         bool const failed = allocs_until_failure == 0;
+         allocs_until_failure = 0;
+
+         if (str == NULL && (!failed || errno != ENOMEM))
+            err("constructor [%zu] failed without an allocation failure", kind);
+         if (str != NULL && !kstr_equal(str, expected))
+            err("constructor [%zu] made [%s] with allocation [%zu] failing",
+                  kind, kstr_get(str), failure);
+         if (!kstr_equal(copied, source))
+            err("constructor [%zu] changed its source", kind);
+
+         kstr_free(&str);
+         kstr_free(&copied);
+         if (!failed)
+            break;
+      }
+
+      kstr_free(&expected);
+      kstr_free(&source);
+   }
+
+   kstr_set_error_mode(kstr_error_abort);
+}
+
+static
+void
+test_error_edits(void)
+{
+   fputs("test: edits and appends that fail to allocate memory\n", stderr);
+
+   static struct
+   {
+      kstr * (* edit)(kstr * str);
+      bool chunked;
+   } const cases[] =
+   {
+      { edit_replace_all, false },
+      { edit_replace_all, true },
+      { edit_replace_middle, false },
+      { edit_replace_middle, true },
+      { edit_replace_end, false },
+      { edit_replace_end, true },
+      { edit_insert, false },
+      { edit_insert, true },
+      { edit_add_formatted, false },
+      { edit_add_formatted, true },
+      { edit_add_concurrent, false },
+      { edit_add_concurrent, true }
+   };
+
+   // the segments fill more than one new chunk after a chunked value
+   edit_segments = kstr_concurrent_new(1 << 18);
+   for (size_t i = 0; i < 2100; i++)
+      kstr_concurrent_add_text(edit_segments, text_long);
+
+   kstr_set_error_mode(kstr_error_return);
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr * expected = cases[i].edit(edit_value(cases[i].chunked));
+
+      // fail each allocation of the edit in turn, until it needs no more; the
+      // leak checker of a sanitizer build reports memory a failure leaks
+      for (size_t failure = 1; ; failure++)
+      {
+         kstr * str = edit_value(cases[i].chunked);
+         kstr * before = kstr_copy(str);
+
+         errno = 0;
+         allocs_until_failure = failure;
+         kstr * const result = cases[i].edit(str);
+         bool const failed = allocs_until_failure == 0;
+         allocs_until_failure = 0;
+
+         // failing edits leave the string as it was
+         if (result == NULL)
+         {
+            if (!failed || errno != ENOMEM)
+               err("case [%zu] failed without an allocation failure", i);
+            if (!kstr_equal(str, before)
+                  || kstr_width(str) != kstr_width(before))
+               err("case [%zu] changed the string when allocation [%zu] failed",
+                     i, failure);
+         }
+         else if (!kstr_equal(str, expected))
+            err("case [%zu] result differs with allocation [%zu] failing",
+                  i, failure);
+
+         kstr_free(&before);
+         kstr_free(&str);
+         if (!failed)
+            break;
+      }
+
+      kstr_free(&expected);
+   }
+
+   kstr_set_error_mode(kstr_error_abort);
+   kstr_concurrent_free(&edit_segments);
+}
+
+static
+void
+test_error_intern(void)
+{
+   fputs("test: intern values when the table fails to grow\n", stderr);
+
+   // fill the table up to the point where one more value makes it grow
+   kstr_intern * table = kstr_intern_new(NULL);
+   kstr * str = kstr_new(NULL);
+   kstr * first = NULL;
+   for (size_t i = 0; i < 48; i++)
+   {
+      kstr_set_fmt(str, "label-%zu", i);
+      kstr * const interned =
+         kstr_intern_get(table, kstr_get_view(str, 0, kstr_npos));
+      if (i == 0)
+         first = interned;
+   }
+
+   // values already in the table are found without growing it
+   kstr_set_error_mode(kstr_error_return);
+   errno = 0;
+   allocs_until_failure = 1;
+   kstr * const found = kstr_intern_get(table, kstr_view_text("label-0"));
+   bool const failed = allocs_until_failure == 0;
+   allocs_until_failure = 0;
+   if (found != first)
+      err("interned value not found");
+   if (failed || errno != 0)
+      err("finding an interned value allocated memory");
+
+   // a new value fails to be interned if the table can't grow
+   allocs_until_failure = 1;
+   kstr * const added = kstr_intern_get(table, kstr_view_text("label-48"));
+   allocs_until_failure = 0;
+   if (added != NULL || errno != ENOMEM)
+      err("new value interned without growing the table");
+   if (kstr_intern_size(table) != 48)
+      err("intern table size [%zu], expecting [48]", kstr_intern_size(table));
+
+   // and is interned once the table grows
+   if (kstr_intern_get(table, kstr_view_text("label-48")) == NULL)
+      err("new value not interned");
+   kstr_set_error_mode(kstr_error_abort);
+
+   if (kstr_intern_get(table, kstr_view_text("label-0")) != first)
+      err("interned value moved");
+   if (kstr_intern_size(table) != 49)
+      err("intern table size [%zu], expecting [49]", kstr_intern_size(table));
+
+   kstr_free(&str);
+   kstr_intern_free(&table);
+}
+
+static
+void
+test_error_mode(void)
+{
+   fputs("test: return errors instead of aborting\n", stderr);
+
+   if (kstr_set_error_mode(kstr_error_return) != kstr_error_abort)
+      err("the default error mode isn't kstr_error_abort");
+
+   kstr * str = kstr_new("intact");
+   size_t const capacity = kstr_capacity(str);
+
+   // sizes that can't be allocated fail without changing the string
+   errno = 0;
+   if (kstr_reserve(str, (size_t) -1) != NULL)
+      err("reserve of an impossible size succeeded");
+   if (errno != ENOMEM)
+      err("errno [%d], expecting [%d]", errno, ENOMEM);
+
+   errno = 0;
+   if (kstr_add_bytes(str, "x", (size_t) -1) != NULL)
+      err("add_bytes of an impossible size succeeded");
+   if (errno != ENOMEM)
+      err("errno [%d], expecting [%d]", errno, ENOMEM);
+
+   kstr_view const parts[] = { { "x", (size_t) -1 }, { "y", 2 } };
+   if (kstr_join(str, parts, 2, kstr_view_text("")) != NULL)
+      err("join of an impossible size succeeded");
+
+   // invalid arguments fail the same way
+   errno = 0;
+   if (kstr_add_fg(str, kstr_num_colors) != NULL)
+      err("add_fg of an invalid color succeeded");
+   if (errno != EINVAL)
+      err("errno [%d], expecting [%d]", errno, EINVAL);
+
+   kstr_style const style = { .bg = { .kind = kstr_num_color_kinds } };
+   errno = 0;
+   if (kstr_add_style(str, &style) != NULL || errno != EINVAL)
+      err("add_style of an invalid color didn't fail with EINVAL");
+
+   errno = 0;
+   if (kstr_set_growth(str, kstr_num_growths) != NULL || errno != EINVAL)
+      err("set_growth of an invalid policy didn't fail with EINVAL");
+
+   // replacing the end of the value fails before cutting it
+   errno = 0;
+   kstr_view const huge = { "x", (size_t) -1 };
+   if (kstr_replace_range(str, 2, kstr_npos, huge) != NULL || errno != ENOMEM)
+      err("replace_range of an impossible size didn't fail with ENOMEM");
+
+   if (strcmp(kstr_get(str), "intact") != 0 || kstr_width(str) != 6)
+      err("failed calls changed the string to [%s]", kstr_get(str));
+   if (kstr_capacity(str) != capacity)
+      err("failed calls changed the capacity");
+
+   // the string is still usable, and still doesn't recognize escape
+   // sequences
+   kstr_add_text(str, "!");
+   if (strcmp(kstr_get(str), "intact!") != 0)
+      err("append after failures result [%s]", kstr_get(str));
+   kstr_add_text(str, "\x1b[1m");
+   if (kstr_width(str) != 10)
+      err("width [%zu] after failures, expecting [10]", kstr_width(str));
+
+   // an invalid mode leaves the mode unchanged
+   errno = 0;
+   if (kstr_set_error_mode(kstr_num_error_modes) != kstr_error_return)
+      err("set_error_mode with an invalid mode changed the mode");
+   if (errno != EINVAL)
+      err("errno [%d], expecting [%d]", errno, EINVAL);
+
+   if (kstr_set_error_mode(kstr_error_abort) != kstr_error_return)
+      err("set_error_mode didn't return the previous mode");
+
+   kstr_free(&str);
+}
+
+static
+void
+test_escapes_disabled(void)
+{
+   fputs("test: count escape sequences unless recognized\n", stderr);
+
+   char const * const text = "\x1b[1mbold\x1b[0m";
+   kstr * str = kstr_new(text);
+
+   // only the escape characters are zero-width
+   size_t const expected = strlen(text) - 2;
+   size_t width = kstr_width(str);
+   if (width != expected)
+      err("width [%zu], expecting [%zu]", width, expected);
+
+   // recognizing escape sequences only affects text appended afterward
+   kstr_set_escapes(str, true);
+   kstr_add_text(str, text);
+   width = kstr_width(str);
+   if (width != expected + 4)
+      err("width [%zu], expecting [%zu]", width, expected + 4);
+
+   kstr * copy = kstr_copy(str);
+   kstr_add_text(copy, text);
+   width = kstr_width(copy);
+   if (width != expected + 8)
+      err("copy width [%zu], expecting [%zu]", width, expected + 8);
+
+   kstr_free(&copy);
+   kstr_free(&str);
+}
+
+static
+void
+test_escapes_fmt(void)
+{
+   fputs("test: append escape sequences with kstr_add_fmt()\n", stderr);
+
+   kstr * str = kstr_set_escapes(kstr_new(NULL), true);
+   kstr_add_fmt(str, "\x1b[%d;%dm%s\x1b[0m", 1, 31, "red");
+   kstr_add_fmt(str, "%s", text_long);
+
+   size_t const expected = 3 + strlen(text_long);
+   size_t const width = kstr_width(str);
+   if (width != expected)
+      err("width [%zu], expecting [%zu]", width, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_escapes_split(void)
+{
+   fputs("test: append escape sequences one byte at a time\n", stderr);
+
+   char const * const text =
+      "\x1b[38;5;208m" "\xe6\x96\x87" "\x1b]8;;file:///\x1b\\" "link"
+      "\x1b]8;;\x1b\\" "\x1b[0m";
+   kstr * str = kstr_set_escapes(kstr_new(NULL), true);
+   for (size_t i = 0; text[i] != '\0'; i++)
+      kstr_add_bytes(str, text + i, 1);
+
+   size_t const expected = 6;
+   size_t const width = kstr_width(str);
+   if (width != expected)
+      err("width [%zu], expecting [%zu]", width, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_escapes_text(void)
+{
+   fputs("test: append various kinds of escape sequences\n", stderr);
+
+   static struct
+   {
+      char const * text;
+      size_t width;
+   } const cases[] =
+   {
+      { "\x1b[1;31mred\x1b[0m", 3 },
+      { "a\x1b[2Kb", 2 },
+      { "\x1b]0;title\x07text", 4 },
+      { "\x1b]0;title\x1b\\text", 4 },
+      { "\x1bPdata\x1b\\text", 4 },
+      { "\x1b(Btext", 4 },
+      { "\x1b" "7text\x1b" "8", 4 },
+      { "\x1b\x1b[mtext", 4 },
+      { "\x1b[1m" "\xe9\x80\x99" "\x1b[0m", 2 }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr * str = kstr_set_escapes(kstr_new(NULL), true);
+      kstr_add_text(str, cases[i].text);
+
+      size_t const width = kstr_width(str);
+      if (width != cases[i].width)
+         err(
+               "width [%zu] of case [%zu], expecting [%zu]",
+               width,
+               i,
+               cases[i].width);
+
+      // the text is unchanged
+      if (strcmp(kstr_get(str), cases[i].text) != 0)
+         err("text of case [%zu] changed", i);
+
+      kstr_free(&str);
+   }
+
+   // a control code ends an unfinished escape sequence
+   kstr * str = kstr_set_escapes(kstr_new(NULL), true);
+   kstr_add_text(str, "\x1b[1");
+   kstr_add_reset(str);
+   kstr_add_text(str, "text");
+   size_t const width = kstr_width(str);
+   if (width != 4)
+      err("width [%zu] after control code, expecting [4]", width);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_extension(void)
+{
+   fputs("test: get the extension of a path\n", stderr);
+
+   static struct
+   {
+      char const * path;
+      char const * expected;
+   } const cases[] =
+   {
+      { "", "" },
+      { "file", "" },
+      { "file.txt", ".txt" },
+      { "/tmp/file.tar.gz", ".gz" },
+      { "/tmp/file.txt/", ".txt" },
+      { "/tmp.d/file", "" },
+      { ".profile", "" },
+      { "..profile", ".profile" },
+      { "file.", "." },
+      { ".", "" },
+      { "/one/..", "" }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr * str = kstr_new(cases[i].path);
+      kstr_view const view = kstr_extension(str);
+      if (!kstr_view_equal(view, kstr_view_text(cases[i].expected)))
+         err(
+               "extension of [%s] is [%.*s], expecting [%s]",
+               cases[i].path,
+               (int) view.len,
+               view.ptr,
+               cases[i].expected);
+
+      kstr_free(&str);
+   }
+}
+
+static
+void
+test_find(void)
+{
+   fputs("test: find bytes in a string\n", stderr);
 
-   size_t const func_length = sizeof(__func__) - 1;
-   char const * const value = kstr_get(str);
-   if (
-         strncmp(value, __func__, func_length) != 0 ||
-         strcmp(value + func_length, text) != 0)
-      err("value [%s], expecting [%s%s]", value, __func__, text);
+   kstr * str = kstr_new("one two one two");
+
+   static struct
+   {
+      char const * needle;
+      size_t pos;
+      size_t expected;
+   } const cases[] =
+   {
+      { "one", 0, 0 },
+      { "one", 1, 8 },
+      { "two", 5, 12 },
+      { "two", 13, kstr_npos },
+      { "", 15, 15 },
+      { "x", 0, kstr_npos }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      size_t const pos = kstr_find(
+            str, kstr_view_text(cases[i].needle), cases[i].pos);
+      if (pos != cases[i].expected)
+         err(
+               "find [%s] at [%zu] result [%zu], expecting [%zu]",
+               cases[i].needle,
+               cases[i].pos,
+               pos,
+               cases[i].expected);
+   }
+
+   size_t pos = kstr_find_char(str, 't', 5);
+   if (pos != 12)
+      err("find_char result [%zu], expecting [12]", pos);
+
+   // bytes after a nul byte are searched too
+   kstr_add_bytes(str, "\0z", 2);
+   pos = kstr_find_char(str, 'z', 0);
+   if (pos != 16)
+      err("find_char result [%zu], expecting [16]", pos);
+
+   pos = kstr_find(str, kstr_view_text("o z"), 0);
+   if (pos != kstr_npos)
+      err("find result [%zu], expecting [%zu]", pos, kstr_npos);
 
    kstr_free(&str);
 }
 
 static
 void
-test_add_fmt_empty(void)
+test_find_long(void)
 {
-   fputs(
-         "test: append a formatted string with an empty format string\n",
-         stderr);
+   fputs("test: find bytes in a long string\n", stderr);
 
-   kstr * str = kstr_new(__func__);
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wformat-zero-length"
-   kstr_add_fmt(str, "");
-#pragma GCC diagnostic pop
+   // a haystack full of false starts, with matches at every alignment
+   kstr * str = kstr_new(NULL);
+   for (int i = 0; i < 200; i++)
+      kstr_add_text(str, (i % 37 == 36) ? "aab" : "aac");
 
-   char const * const expected = __func__;
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   kstr_view const view = kstr_get_view(str, 0, kstr_npos);
+   static char const * const needles[] = { "aab", "ab", "aabaac", "ba", "b" };
+   for (size_t i = 0; i < sizeof(needles) / sizeof(*needles); i++)
+   {
+      kstr_view const needle = kstr_view_text(needles[i]);
+      for (size_t start = 0; start < view.len; start += 5)
+      {
+         // compare with a naive search
+         size_t expected = kstr_npos;
+         for (size_t j = start; j + needle.len <= view.len; j++)
+            if (memcmp(view.ptr + j, needle.ptr, needle.len) == 0)
+            {
+               expected = j;
+               break;
+            }
+
+         size_t const pos = kstr_find(str, needle, start);
+         if (pos != expected)
+            err(
+                  "find [%s] at [%zu] result [%zu], expecting [%zu]",
+                  needles[i],
+                  start,
+                  pos,
+                  expected);
+      }
+   }
 
    kstr_free(&str);
 }
 
 static
 void
-test_add_fmt_long(void)
+test_fmt_compile_invalid(void)
 {
-   fputs("test: append a formatted string with a long value\n", stderr);
+   fputs("test: compile format strings that can't be compiled\n", stderr);
 
-   char const * const text = text_long;
-   kstr * str = kstr_new(__func__);
-   kstr_add_fmt(str, "%s", text);
+   static char const * const fmts[] =
+   {
+      NULL, "%", "abc %", "%1$d", "%n", "%llf", "%hs", "%y", "%5%"
+   };
 
-   size_t const func_length = sizeof(__func__) - 1;
-   char const * const value = kstr_get(str);
-   if (
-         strncmp(value, __func__, func_length) != 0 ||
-         strcmp(value + func_length, text) != 0)
-      err("value [%s], expecting [%s%s]", value, __func__, text);
+   for (size_t i = 0; i < sizeof(fmts) / sizeof(*fmts); i++)
+   {
+      kstr_fmt * compiled = kstr_fmt_compile(fmts[i]);
+      if (compiled != NULL)
+         err("compiled [%s], expecting failure", fmts[i]);
+   }
+
+   // destroying nothing is fine, and nothing is added without a format
+   kstr_fmt * compiled = NULL;
+   kstr_fmt_free(&compiled);
+   kstr_fmt_free(NULL);
+
+   kstr * str = kstr_add_compiled(kstr_new(__func__), NULL);
+   if (strcmp(kstr_get(str), __func__) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str), __func__);
 
    kstr_free(&str);
 }
 
 static
 void
-test_add_fmt_no_args(void)
+test_free_new(void)
 {
-   fputs("test: append a formatted string with no format arguments\n", stderr);
+   fputs("test: free a string\n", stderr);
 
-   kstr * str = kstr_new(__func__);
-   kstr_add_fmt(str, __func__);
+   kstr * str = kstr_new(NULL);
+   if (str == NULL)
+      err("null str, expecting non-null");
 
-   size_t const func_length = sizeof(__func__) - 1;
-   char const * const value = kstr_get(str);
-   if (
-         strncmp(value, __func__, func_length) != 0 ||
-         strcmp(value + func_length, __func__) != 0)
-      err("value [%s], expecting [%s%s]", value, __func__, __func__);
+   kstr_free(&str);
+   if (str != NULL)
+      err("str at %p, expecting null", (void *) str);
+}
+
+static
+void
+test_free_null(void)
+{
+   fputs("test: free a null string\n", stderr);
 
+   kstr * str = NULL;
    kstr_free(&str);
+   if (str != NULL)
+      err("str at %p, expecting null", (void *) str);
 }
 
 static
 void
-test_add_fmt_null(void)
+test_free_null_ptr(void)
 {
-   fputs(
-         "test: append a formatted string with a null format string\n",
-         stderr);
+   fputs("test: free a null string pointer\n", stderr);
+   kstr_free(NULL);
+}
 
-   kstr * str = kstr_new(__func__);
-   kstr_add_fmt(str, NULL);
+static
+void
+test_get_copy(void)
+{
+   fputs("test: copy a string's value\n", stderr);
 
-   char const * const expected = __func__;
+   char const * const text = __func__;
+   kstr * str = kstr_new(text);
+
+   char const * const expected = text;
    char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
+   char * const value_copy = kstr_get_copy(str);
+
+   if (value == value_copy)
+      err("value at %p returned as copy", (void *) value_copy);
+   if (strcmp(value_copy, expected) != 0)
       err("value [%s], expecting [%s]", value, expected);
 
+   free(value_copy);
    kstr_free(&str);
 }
 
 static
 void
-test_add_fmt_simple(void)
+test_get_copy_nul(void)
 {
-   fputs("test: append a formatted string with a simple value\n", stderr);
+   fputs("test: copy a string's value including nul characters\n", stderr);
 
-   char const * const text = __func__;
-   kstr * str = kstr_new(__func__);
-   kstr_add_fmt(str, "%s", text);
+   char const bytes[] = "one\0two";
+   kstr * str = kstr_new_bytes(bytes, sizeof(bytes) - 1);
+   char * const value_copy = kstr_get_copy(str);
 
-   size_t const func_length = sizeof(__func__) - 1;
-   char const * const value = kstr_get(str);
-   if (
-         strncmp(value, __func__, func_length) != 0 ||
-         strcmp(value + func_length, text) != 0)
-      err("value [%s], expecting [%s%s]", value, __func__, text);
+   if (memcmp(value_copy, bytes, sizeof(bytes)) != 0)
+      err("value [%s], expecting [%s]", value_copy, bytes);
 
+   free(value_copy);
    kstr_free(&str);
 }
 
 static
 void
-test_add_fmt_utf8(void)
+test_getline(void)
 {
-   fputs("test: append a formatted string with a utf-8 value\n", stderr);
+   fputs("test: read lines from a file\n", stderr);
 
-   char const * const text = text_utf8;
-   kstr * str = kstr_new(__func__);
-   kstr_add_fmt(str, "%s", text);
+   FILE * file = tmpfile();
+   if (file == NULL)
+      err("can't create input file");
+   fprintf(file, "first\n\n%s\n\xc3\xa9t\xc3\xa9", text_long);
+   rewind(file);
 
-   size_t const func_length = sizeof(__func__) - 1;
+   static char const * const lines[] =
+   {
+      "first\n", "\n", NULL, "\xc3\xa9t\xc3\xa9"
+   };
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < sizeof(lines) / sizeof(*lines); i++)
+   {
+      kstr_set_text(str, NULL);
+      if (!kstr_getline(str, file))
+         err("no line [%zu]", i);
+
+      // the long line has to grow the buffer on the way
+      if (lines[i] == NULL)
+      {
+         if (
+               kstr_size(str) != sizeof(text_long) + 1 ||
+               strncmp(kstr_get(str), text_long, sizeof(text_long) - 1) != 0)
+            err(
+                  "line [%zu] [%s], expecting [%s\\n]",
+                  i,
+                  kstr_get(str),
+                  text_long);
+         continue;
+      }
+
+      if (strcmp(kstr_get(str), lines[i]) != 0)
+         err("line [%zu] [%s], expecting [%s]", i, kstr_get(str), lines[i]);
+   }
+
+   // the last line has no newline, and is measured as utf-8
+   if (kstr_width(str) != 3)
+      err("width [%zu], expecting [3]", kstr_width(str));
+
+   // nothing is appended at the end of the file
+   if (kstr_getline(str, file))
+      err("line read at the end of the file");
+   if (strcmp(kstr_get(str), lines[3]) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str), lines[3]);
+
+   kstr_free(&str);
+   fclose(file);
+}
+
+static
+void
+test_hash(void)
+{
+   fputs("test: hash the values of strings\n", stderr);
+
+   // equal values hash the same, however they were built
+   kstr * str1 = kstr_new(text_long);
+   kstr * str2 = kstr_new(NULL);
+   for (size_t i = 0; i < sizeof(text_long) - 1; i += 100)
+      kstr_add_view(str2, kstr_view_sub(kstr_view_text(text_long), i, 100));
+
+   if (kstr_hash(str1) != kstr_hash(str2))
+      err("hashes of equal values differ");
+   if (kstr_hash(str1) != kstr_view_hash(kstr_view_text(text_long)))
+      err("string and view hashes differ");
+
+   // every prefix of the value hashes differently, trailing nuls included
+   kstr_view const view = kstr_view_text(text_long);
+   for (size_t len = 1; len <= 64; len++)
+   {
+      uint64_t const hash = kstr_view_hash(kstr_view_sub(view, 0, len));
+      if (hash == kstr_view_hash(kstr_view_sub(view, 0, len - 1)))
+         err("prefixes of [%zu] and [%zu] bytes hash the same", len, len - 1);
+   }
+
+   kstr_view const zeros1 = { "\0", 1 };
+   kstr_view const zeros2 = { "\0\0", 2 };
+   if (kstr_view_hash(zeros1) == kstr_view_hash(zeros2))
+      err("nul bytes of different lengths hash the same");
+
+   kstr_free(&str2);
+   kstr_free(&str1);
+}
+
+static
+void
+test_hash_cached(void)
+{
+   fputs("test: cache the hash of a string\n", stderr);
+
+   kstr * str = kstr_new(text_long);
+   uint64_t const hash = kstr_hash(str);
+   if (kstr_hash(str) != hash)
+      err("cached hash differs");
+
+   // copies and clones keep a cached hash
+   kstr * str_copy = kstr_copy(str);
+   kstr * str_clone = kstr_clone(str);
+   if (kstr_hash(str_copy) != hash || kstr_hash(str_clone) != hash)
+      err("hash of a copy differs");
+
+   // any change to the value calculates the hash again
+   kstr_add_text(str, "!");
+   uint64_t const changed = kstr_hash(str);
+   if (changed == hash)
+      err("hash unchanged after appending");
+   if (changed != kstr_view_hash(kstr_get_view(str, 0, kstr_npos)))
+      err("hash differs from the hash of the new value");
+
+   kstr_set_text(str, text_long);
+   if (kstr_hash(str) != hash)
+      err("hash differs after restoring the value");
+
+   kstr_free(&str_clone);
+   kstr_free(&str_copy);
+   kstr_free(&str);
+}
+
+static
+void
+test_inline_add(void)
+{
+   fputs("test: append with the inline methods\n", stderr);
+
+   // the inline appends take the same path as the library's as needed
+   static char const * const texts[] =
+   {
+      "ascii", "", "\x1b[1m", "bold", "\xe2\x94\x80", "wide \xe4\xb8\x80", "\t",
+      "\xe2"
+   };
+
+   kstr * str = kstr_new(NULL);
+   kstr * expected = kstr_new(NULL);
+   for (int pass = 0; pass < 20; pass++)
+      for (size_t i = 0; i < sizeof(texts) / sizeof(*texts); i++)
+      {
+         kstr_add_text_inline(str, texts[i]);
+         kstr_add_text(expected, texts[i]);
+         kstr_add_bytes_inline(str, texts[i], 1);
+         kstr_add_bytes(expected, texts[i], 1);
+
+         if (kstr_width(str) != kstr_width(expected))
+            err(
+                  "inline width [%zu], expecting [%zu]",
+                  kstr_width(str),
+                  kstr_width(expected));
+      }
+
+   if (!kstr_equal(str, expected))
+      err("inline appends result differs from the library's");
+
+   kstr_add_text_inline(str, NULL);
+   kstr_add_bytes_inline(str, NULL, 3);
+   if (kstr_size(str) != kstr_size(expected))
+      err("inline append of a null pointer changed the size");
+
+   kstr_free(&expected);
+   kstr_free(&str);
+
+   // the value changes for everything that caches it
+   str = kstr_new("a");
+   uint64_t const hash = kstr_hash(str);
+   kstr_add_text_inline(str, "b");
+   if (kstr_hash(str) == hash)
+      err("inline append didn't change the cached hash");
+   if (strcmp(kstr_get_plain(str).ptr, "ab") != 0)
+      err("inline append plain value [%s]", kstr_get_plain(str).ptr);
+
+   // a clone's shared buffer isn't written to
+   kstr * clone = kstr_clone(kstr_add_text(str, text_long));
+   kstr_add_text_inline(clone, "c");
+   if (kstr_size(str) + 1 != kstr_size(clone))
+      err("inline append changed the original of a clone");
+
+   kstr_free(&clone);
+   kstr_free(&str);
+}
+
+static
+void
+test_inline_get(void)
+{
+   fputs("test: read strings with the inline methods\n", stderr);
+
+   kstr * str = kstr_new("\xe4\xb8\x80 and text");
+   if (kstr_get_inline(str) != kstr_get(str))
+      err("get_inline returned a different value");
+   if (kstr_size_inline(str) != kstr_size(str))
+      err(
+            "size_inline [%zu], expecting [%zu]",
+            kstr_size_inline(str),
+            kstr_size(str));
+   if (kstr_width_inline(str) != kstr_width(str))
+      err(
+            "width_inline [%zu], expecting [%zu]",
+            kstr_width_inline(str),
+            kstr_width(str));
+
+   // a chunked value is joined
+   kstr_set_growth(str, kstr_growth_chunked);
+   for (int i = 0; i < 1500; i++)
+      kstr_add_text(str, text_long);
+   if (kstr_get_chunks(str, NULL, 0) < 2)
+      err("value isn't chunked");
+
+   size_t const size = kstr_size_inline(str);
+   if (size != 12 + 1500 * strlen(text_long) + 1)
+      err("size_inline of a chunked value [%zu]", size);
+
+   char const * const value = kstr_get_inline(str);
+   if (kstr_get_chunks(str, NULL, 0) != 1 || strlen(value) + 1 != size)
+      err("get_inline didn't join the chunks");
+
+   kstr_free(&str);
+}
+
+static
+void
+test_insert_erase(void)
+{
+   fputs("test: insert, erase and truncate\n", stderr);
+
+   kstr * str = kstr_new("one three");
+   kstr_insert(str, 4, kstr_view_text("two "));
+   if (strcmp(kstr_get(str), "one two three") != 0)
+      err("value [%s], expecting [one two three]", kstr_get(str));
+
+   // text from the string's own value can be inserted into it
+   kstr_insert(str, 0, kstr_get_view(str, 4, 4));
+   if (strcmp(kstr_get(str), "two one two three") != 0)
+      err("value [%s], expecting [two one two three]", kstr_get(str));
+
+   kstr_insert(str, 8, kstr_get_view(str, 0, kstr_npos));
+   if (strcmp(kstr_get(str), "two one two one two threetwo three") != 0)
+      err(
+            "value [%s], expecting [two one two one two threetwo three]",
+            kstr_get(str));
+
+   kstr_erase(str, 25, 3);
+   kstr_erase(str, 0, 8);
+   if (strcmp(kstr_get(str), "two one two three three") != 0)
+      err("value [%s], expecting [two one two three three]", kstr_get(str));
+
+   kstr_truncate(str, 100);
+   kstr_truncate(str, 7);
+   if (strcmp(kstr_get(str), "two one") != 0)
+      err("value [%s], expecting [two one]", kstr_get(str));
+   if (kstr_width(str) != 7)
+      err("width [%zu], expecting [7]", kstr_width(str));
+
+   // an incomplete utf-8 sequence at the end is cut along with its width
+   kstr_add_bytes(str, "\xe4\xb8", 2);
+   kstr_truncate(str, 3);
+   kstr_add_text(str, "\xe4\xb8\xad");
+   if (kstr_width(str) != 5)
+      err("width [%zu], expecting [5]", kstr_width(str));
+
+   kstr_erase(str, 0, kstr_npos);
+   if (kstr_size(str) != 1 || kstr_width(str) != 0)
+      err(
+            "size [%zu] width [%zu] after erasing all",
+            kstr_size(str),
+            kstr_width(str));
+
+   kstr_free(&str);
+}
+
+static
+void
+test_intern(void)
+{
+   fputs("test: intern values\n", stderr);
+
+   kstr_intern * table = kstr_intern_new(NULL);
+
+   // equal values are interned as the same string
+   kstr * labels[1000];
+   for (size_t i = 0; i < sizeof(labels) / sizeof(*labels); i++)
+   {
+      kstr * str = kstr_new(NULL);
+      kstr_add_fmt(str, "label-%zu", i % 300);
+      labels[i] = kstr_intern_get(table, kstr_get_view(str, 0, kstr_npos));
+      if (strcmp(kstr_get(labels[i]), kstr_get(str)) != 0)
+         err(
+               "interned value [%s], expecting [%s]",
+               kstr_get(labels[i]),
+               kstr_get(str));
+      if (kstr_hash(labels[i]) != kstr_hash(str))
+         err("interned hash differs for [%s]", kstr_get(str));
+
+      kstr_free(&str);
+   }
+
+   for (size_t i = 300; i < sizeof(labels) / sizeof(*labels); i++)
+      if (labels[i] != labels[i % 300])
+         err("value [%s] interned twice", kstr_get(labels[i]));
+
+   size_t const size = kstr_intern_size(table);
+   if (size != 300)
+      err("intern table size [%zu], expecting [300]", size);
+
+   // bytes after nul bytes count, and the empty value can be interned
+   kstr_view const view1 = { "a\0b", 3 };
+   kstr_view const view2 = { "a\0c", 3 };
+   kstr_view const empty = { "", 0 };
+   if (kstr_intern_get(table, view1) == kstr_intern_get(table, view2))
+      err("different values interned as the same string");
+   if (kstr_size(kstr_intern_get(table, empty)) != 1)
+      err("empty value interned with the wrong size");
+
+   // destroying an interned string leaves it in the table
+   kstr * label = labels[0];
+   kstr_free(&label);
+   if (label != NULL)
+      err("pointer not cleared");
+   if (strcmp(kstr_get(labels[0]), "label-0") != 0)
+      err("value [%s], expecting [label-0]", kstr_get(labels[0]));
+
+   kstr_intern_free(&table);
+   if (table != NULL)
+      err("table pointer not cleared");
+   kstr_intern_free(&table);
+   kstr_intern_free(NULL);
+}
+
+static
+void
+test_intern_arena(void)
+{
+   fputs("test: intern values in an arena\n", stderr);
+
+   kstr_arena * arena = kstr_arena_new(0);
+   kstr_intern * table = kstr_intern_new(arena);
+
+   kstr * str1 = kstr_intern_get(table, kstr_view_text(text_long));
+   kstr * str2 = kstr_intern_get(table, kstr_view_text("short"));
+   if (kstr_intern_get(table, kstr_view_text(text_long)) != str1)
+      err("long value interned twice");
+   if (strcmp(kstr_get(str2), "short") != 0)
+      err("value [%s], expecting [short]", kstr_get(str2));
+
+   kstr_intern_free(&table);
+   kstr_arena_free(&arena);
+}
+
+static
+void
+test_join(void)
+{
+   fputs("test: join views\n", stderr);
+
+   kstr * str = kstr_set_escapes(kstr_new("list: "), true);
+   kstr_view const parts[] =
+   {
+      kstr_view_text("a"),
+      kstr_view_text(""),
+      kstr_view_text("\x1b[1m" "bold" "\x1b[0m")
+   };
+
+   kstr_join(str, parts, 3, kstr_view_text(", "));
+   char const * expected = "list: a, , \x1b[1m" "bold" "\x1b[0m";
+   if (strcmp(kstr_get(str), expected) != 0)
+      err("join result [%s], expecting [%s]", kstr_get(str), expected);
+   if (kstr_width(str) != 15)
+      err("join width [%zu], expecting [15]", kstr_width(str));
+
+   // joining nothing adds nothing
+   size_t const size = kstr_size(str);
+   kstr_join(str, parts, 0, kstr_view_text(", "));
+   if (kstr_size(str) != size)
+      err("join size [%zu], expecting [%zu]", kstr_size(str), size);
+
+   kstr_free(&str);
+
+   // the views and separator may point into the string's own buffer, which
+   // moves when it grows past the inline buffer
+   str = kstr_new("abcdefghij");
+   kstr_view self[16];
+   for (size_t i = 0; i < 16; i++)
+      self[i] = kstr_get_view(str, 0, 10);
+
+   kstr_join(str, self, 16, kstr_get_view(str, 0, 1));
+   kstr * expected_str = kstr_new("abcdefghij");
+   for (size_t i = 0; i < 16; i++)
+      kstr_add_text(expected_str, (i == 0) ? "abcdefghij" : "aabcdefghij");
+
+   if (strcmp(kstr_get(str), kstr_get(expected_str)) != 0)
+      err(
+            "join self result [%s], expecting [%s]",
+            kstr_get(str),
+            kstr_get(expected_str));
+
+   kstr_free(&expected_str);
+   kstr_free(&str);
+}
+
+static
+void
+test_new_bytes(void)
+{
+   fputs("test: create a string with all 8-bit characters\n", stderr);
+
+   char const * const text = text_bytes;
+   kstr * str = kstr_new(text);
+
+   char const * const expected = text;
    char const * const value = kstr_get(str);
-   if (
-         strncmp(value, __func__, func_length) != 0 ||
-         strcmp(value + func_length, text) != 0)
-      err("value [%s], expecting [%s%s]", value, __func__, text);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_add_text_bytes(void)
+test_new_bytes_nul(void)
 {
    fputs(
-         "test: append a string value including all 8-bit characters\n",
+         "test: create a string from bytes including nul characters\n",
          stderr);
 
-   char const * const text = text_bytes;
-   kstr * str = kstr_new(__func__);
-   kstr_add_text(str, text);
+   char const bytes[] = "one\0two";
+   kstr * str = kstr_new_bytes(bytes, sizeof(bytes) - 1);
 
-   size_t const func_length = sizeof(__func__) - 1;
-   char const * const value = kstr_get(str);
-   if (
-         strncmp(value, __func__, func_length) != 0 ||
-         strcmp(value + func_length, text) != 0)
-      err("value [%s], expecting [%s%s]", value, __func__, text);
+   size_t const expected = sizeof(bytes);
+   size_t const size = kstr_size(str);
+   if (size != expected)
+      err("size [%zu], expecting [%zu]", size, expected);
+
+   if (memcmp(kstr_get(str), bytes, sizeof(bytes)) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str), bytes);
+
+   kstr_free(&str);
+
+   str = kstr_new_bytes(NULL, 1);
+   if (kstr_size(str) != 1)
+      err("size [%zu], expecting [1]", kstr_size(str));
 
    kstr_free(&str);
 }
 
 static
 void
-test_add_text_empty(void)
+test_new_empty(void)
 {
-   fputs("test: append an empty string value\n", stderr);
+   fputs("test: create a string with an empty initial value\n", stderr);
 
    char const * const text = "";
-   kstr * str = kstr_new(__func__);
-   kstr_add_text(str, text);
+   kstr * str = kstr_new(text);
 
-   size_t const func_length = sizeof(__func__) - 1;
+   char const * const expected = text;
    char const * const value = kstr_get(str);
-   if (
-         strncmp(value, __func__, func_length) != 0 ||
-         strcmp(value + func_length, text) != 0)
-      err("value [%s], expecting [%s%s]", value, __func__, text);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_add_text_long(void)
+test_new_long(void)
 {
-   fputs("test: append a long string value\n", stderr);
+   fputs("test: create a string with a long initial value\n", stderr);
 
    char const * const text = text_long;
-   kstr * str = kstr_new(__func__);
-   kstr_add_text(str, text);
+   kstr * str = kstr_new(text);
 
-   size_t const func_length = sizeof(__func__) - 1;
+   char const * const expected = text;
    char const * const value = kstr_get(str);
-   if (
-         strncmp(value, __func__, func_length) != 0 ||
-         strcmp(value + func_length, text) != 0)
-      err("value [%s], expecting [%s%s]", value, __func__, text);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_add_text_null(void)
+test_new_null_ptr(void)
 {
-   fputs("test: append a null string value\n", stderr);
+   fputs("test: create a string with a null pointer\n", stderr);
 
    char const * const text = NULL;
-   kstr * str = kstr_new(__func__);
-   kstr_add_text(str, text);
+   kstr * str = kstr_new(text);
+   if (str == NULL)
+      err("null str, expecting non-null");
 
-   char const * const expected = __func__;
+   char const * const expected = "";
    char const * const value = kstr_get(str);
+   if (value == NULL)
+      err("null value, expecting non-null");
    if (strcmp(value, expected) != 0)
       err("value [%s], expecting [%s]", value, expected);
 
@@ -575,158 +4696,359 @@ test_add_text_null(void)
 
 static
 void
-test_add_text_simple(void)
+test_new_simple(void)
 {
-   fputs("test: append a simple string value\n", stderr);
+   fputs("test: create a string with a simple initial value\n", stderr);
 
    char const * const text = __func__;
-   kstr * str = kstr_new(__func__);
-   kstr_add_text(str, text);
+   kstr * str = kstr_new(text);
 
-   size_t const func_length = sizeof(__func__) - 1;
+   char const * const expected = text;
    char const * const value = kstr_get(str);
-   if (
-         strncmp(value, __func__, func_length) != 0 ||
-         strcmp(value + func_length, text) != 0)
-      err("value [%s], expecting [%s%s]", value, __func__, text);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_add_text_utf8(void)
+test_new_utf8(void)
 {
-   fputs("test: append a utf-8 string value\n", stderr);
+   fputs("test: create a string with a utf-8 initial value\n", stderr);
 
    char const * const text = text_utf8;
-   kstr * str = kstr_new(__func__);
-   kstr_add_text(str, text);
+   kstr * str = kstr_new(text);
 
-   size_t const func_length = sizeof(__func__) - 1;
+   char const * const expected = text;
    char const * const value = kstr_get(str);
-   if (
-         strncmp(value, __func__, func_length) != 0 ||
-         strcmp(value + func_length, text) != 0)
-      err("value [%s], expecting [%s%s]", value, __func__, text);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_basename_absolute(void)
+test_plain(void)
 {
-   fputs("test: get the basename of an absolute path\n", stderr);
-
-   kstr * str = kstr_new(NULL);
-   kstr_set_fmt(str, "/one/two/%s", __func__);
-
-   char const * const expected = __func__;
-   char const * const value = kstr_basename(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
-
+   fputs("test: get a value without control codes\n", stderr);
+
+   // without control codes, the value itself is returned
+   kstr * str = kstr_new("plain text");
+   kstr_view plain = kstr_get_plain(str);
+   if (plain.ptr != kstr_get(str) || plain.len != 10)
+      err("plain value of plain text is a copy");
+
+   // codes appended by every function are removed
+   kstr_add_fg(str, kstr_color_red);
+   kstr_add_text(str, " red");
+   kstr_style const style =
+   {
+      .set_bold = true,
+      .bold = true,
+      .bg = kstr_style_256(9)
+   };
+
+   kstr_add_style(str, &style);
+   kstr_add_iov(
+         str,
+         (kstr_piece[])
+         {
+            { .kind = kstr_piece_text, .chars = " bold" },
+            { .kind = kstr_piece_reset }
+         },
+         2);
+
+   // escape sequences in text are control codes only if recognized
+   kstr_add_text(str, " \x1b[4m" "raw");
+   kstr_set_escapes(str, true);
+   kstr_add_text(str, " \x1b[4m" "esc\x1b]0;title\x07" "!");
+
+   char const * expected =
+      "plain text red bold \x1b[4m" "raw esc!";
+   plain = kstr_get_plain(str);
+   if (plain.len != strlen(expected) || strcmp(plain.ptr, expected) != 0)
+      err("plain result [%s], expecting [%s]", plain.ptr, expected);
+
+   // the copy is cached until the value changes
+   if (kstr_get_plain(str).ptr != plain.ptr)
+      err("plain value was copied again");
+
+   kstr_add_text(str, "\x1b[0m" "?");
+   plain = kstr_get_plain(str);
+   if (strcmp(plain.ptr + strlen(expected), "?") != 0)
+      err("plain result [%s] wasn't updated", plain.ptr);
+
+   // copies and clones know where the codes are
+   kstr * copy = kstr_copy(str);
+   kstr * clone = kstr_clone(str);
+   if (strcmp(kstr_get_plain(copy).ptr, plain.ptr) != 0)
+      err("plain result of copy [%s]", kstr_get_plain(copy).ptr);
+   if (strcmp(kstr_get_plain(clone).ptr, plain.ptr) != 0)
+      err("plain result of clone [%s]", kstr_get_plain(clone).ptr);
+
+   kstr_free(&clone);
+   kstr_free(&copy);
    kstr_free(&str);
 }
 
 static
 void
-test_basename_changed(void)
+test_plain_edit(void)
 {
-   fputs("test: get the basename after changing a string\n", stderr);
-
-   char const * const text1 = "/one/two/three";
-   char const * const text2 = "/four/five/six";
-   kstr * str = kstr_new(text1);
-
-   kstr_basename(str);
-   kstr_set_text(str, text2);
-
-   char const * const expected = "six";
-   char const * const value = kstr_basename(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   fputs("test: get a value without control codes after edits\n", stderr);
+
+   kstr * str = kstr_new("ab");
+   kstr_add_fg(str, kstr_color_red);
+   kstr_add_text(str, "cd");
+   kstr_add_reset(str);
+
+   // cutting off the end keeps the codes before it, even partly cut ones
+   kstr_truncate(str, 4);
+   kstr_add_text(str, "x");
+   kstr_view plain = kstr_get_plain(str);
+   if (strcmp(plain.ptr, "abx") != 0)
+      err("plain result after truncate [%s], expecting [abx]", plain.ptr);
+
+   // replacing the end keeps track of the codes too, including escape
+   // sequences recognized in the new text as they are in appended text
+   kstr_set_escapes(str, true);
+   kstr_replace_range(str, 2, kstr_npos, kstr_view_text("\x1b[1m" "y"));
+   kstr_set_escapes(str, false);
+   plain = kstr_get_plain(str);
+   if (strcmp(plain.ptr, "aby") != 0)
+      err("plain result after replace [%s], expecting [aby]", plain.ptr);
+
+   // after an edit in the middle, escape sequences are removed instead
+   kstr_insert(str, 1, kstr_view_text("\x1b[32m" "-"));
+   plain = kstr_get_plain(str);
+   if (strcmp(plain.ptr, "a-by") != 0)
+      err("plain result after insert [%s], expecting [a-by]", plain.ptr);
+
+   // clearing the value starts tracking again
+   kstr_set_text(str, "\x1b[1m");
+   plain = kstr_get_plain(str);
+   if (plain.len != 4 || plain.ptr != kstr_get(str))
+      err("plain result after set_text has [%zu] bytes", plain.len);
 
    kstr_free(&str);
 }
 
 static
 void
-test_basename_cwd(void)
+test_read_fd(void)
 {
-   fputs("test: get the basename of the current directory\n", stderr);
+   fputs("test: read from a file descriptor\n", stderr);
+
+   int fds[2];
+   if (pipe(fds) != 0)
+      err("can't create pipe");
+   if (write(fds[1], text_long, sizeof(text_long) - 1) < 0)
+      err("can't write to pipe");
+   close(fds[1]);
+
+   // reading stops after the maximum number of bytes
+   kstr * str = kstr_new("<");
+   if (!kstr_read_fd(str, fds[0], 10))
+      err("read failed");
+   if (kstr_size(str) != 12 || strncmp(kstr_get(str) + 1, text_long, 10) != 0)
+      err("value [%s], expecting [<%.10s]", kstr_get(str), text_long);
+
+   // and otherwise at the end of the file
+   if (!kstr_read_fd(str, fds[0], kstr_npos))
+      err("read failed");
+   if (
+         kstr_size(str) != sizeof(text_long) + 1 ||
+         strcmp(kstr_get(str) + 1, text_long) != 0)
+      err("value [%s], expecting [<%s]", kstr_get(str), text_long);
+   if (kstr_width(str) != sizeof(text_long))
+      err("width [%zu], expecting [%zu]", kstr_width(str), sizeof(text_long));
 
-   char const * const text = ".";
-   kstr * str = kstr_new(text);
+   close(fds[0]);
 
-   char const * const expected = text;
-   char const * const value = kstr_basename(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   // errors are reported through errno
+   errno = 0;
+   if (kstr_read_fd(str, -1, kstr_npos))
+      err("read from an invalid file descriptor succeeded");
+   if (errno != EBADF)
+      err("errno [%d], expecting [%d]", errno, EBADF);
 
    kstr_free(&str);
 }
 
 static
 void
-test_basename_empty(void)
+test_replace_all(void)
 {
-   fputs("test: get the basename of an empty path\n", stderr);
+   fputs("test: replace every occurrence of bytes\n", stderr);
+
+   static struct
+   {
+      char const * text;
+      char const * needle;
+      char const * replacement;
+      char const * expected;
+   } const cases[] =
+   {
+      { "a-b-c", "-", "--", "a--b--c" },
+      { "a--b--c", "--", "-", "a-b-c" },
+      { "a-b-c", "-", "+", "a+b+c" },
+      { "aaaa", "aa", "b", "bb" },
+      { "aaa", "aa", "bbb", "bbba" },
+      { "-a-", "-", "", "a" },
+      { "abc", "x", "y", "abc" },
+      { "abc", "", "y", "abc" },
+      { "abc", "abc", "\xe4\xb8\xad", "\xe4\xb8\xad" }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr * str = kstr_new(cases[i].text);
+      kstr * expected = kstr_new(cases[i].expected);
+      kstr_replace_all(
+            str,
+            kstr_view_text(cases[i].needle),
+            kstr_view_text(cases[i].replacement));
+
+      if (strcmp(kstr_get(str), kstr_get(expected)) != 0)
+         err(
+               "replace [%s] in [%s] result [%s], expecting [%s]",
+               cases[i].needle,
+               cases[i].text,
+               kstr_get(str),
+               kstr_get(expected));
+      if (kstr_width(str) != kstr_width(expected))
+         err(
+               "width [%zu], expecting [%zu]",
+               kstr_width(str),
+               kstr_width(expected));
+
+      kstr_free(&expected);
+      kstr_free(&str);
+   }
 
+   // a long value grows once, and the needle can come from the value
    kstr * str = kstr_new(NULL);
+   kstr * expected = kstr_new(NULL);
+   for (int i = 0; i < 500; i++)
+   {
+      kstr_add_text(str, "x,");
+      kstr_add_text(expected, "x, ");
+   }
 
-   char const * const expected = ".";
-   char const * const value = kstr_basename(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   kstr_replace_all(str, kstr_get_view(str, 1, 1), kstr_view_text(", "));
+   if (strcmp(kstr_get(str), kstr_get(expected)) != 0)
+      err("long value differs from the expected value");
+   if (kstr_width(str) != kstr_width(expected))
+      err(
+            "width [%zu], expecting [%zu]",
+            kstr_width(str),
+            kstr_width(expected));
 
+   kstr_free(&expected);
    kstr_free(&str);
 }
 
 static
 void
-test_basename_file(void)
+test_replace_range(void)
 {
-   fputs("test: get the basename of a filename\n", stderr);
-
-   kstr * str = kstr_new(__func__);
+   fputs("test: replace a range of a string\n", stderr);
 
-   char const * const expected = __func__;
-   char const * const value = kstr_basename(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
-
-   kstr_free(&str);
+   static struct
+   {
+      char const * text;
+      size_t pos;
+      size_t count;
+      char const * replacement;
+      char const * expected;
+   } const cases[] =
+   {
+      { "hello world", 6, 5, "there", "hello there" },
+      { "hello world", 0, 5, "hi", "hi world" },
+      { "hello world", 5, 0, ",", "hello, world" },
+      { "hello world", 5, kstr_npos, "", "hello" },
+      { "hello world", 20, 3, "!", "hello world!" },
+      {
+         "hello world", 2, 3, "\xe4\xb8\xad\xe6\x96\x87",
+         "he\xe4\xb8\xad\xe6\x96\x87 world"
+      },
+      { "", 0, 0, "", "" },
+      { "abc", 1, 1, "", "ac" }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr * str = kstr_new(cases[i].text);
+      kstr * expected = kstr_new(cases[i].expected);
+      kstr_replace_range(
+            str,
+            cases[i].pos,
+            cases[i].count,
+            kstr_view_text(cases[i].replacement));
+
+      if (strcmp(kstr_get(str), kstr_get(expected)) != 0)
+         err(
+               "replace in [%s] result [%s], expecting [%s]",
+               cases[i].text,
+               kstr_get(str),
+               kstr_get(expected));
+      if (kstr_size(str) != kstr_size(expected))
+         err(
+               "size [%zu], expecting [%zu]",
+               kstr_size(str),
+               kstr_size(expected));
+      if (kstr_width(str) != kstr_width(expected))
+         err(
+               "width [%zu], expecting [%zu]",
+               kstr_width(str),
+               kstr_width(expected));
+
+      kstr_free(&expected);
+      kstr_free(&str);
+   }
 }
 
 static
 void
-test_basename_null(void)
+test_set_bytes_nul(void)
 {
-   fputs("test: get the basename of a null path\n", stderr);
+   fputs(
+         "test: set a string value from bytes including nul characters\n",
+         stderr);
 
-   kstr * str = kstr_new(NULL);
+   char const bytes[] = "one\0two";
+   kstr * str = kstr_new(__func__);
+   kstr_set_bytes(str, bytes, sizeof(bytes) - 1);
 
-   char const * const expected = ".";
-   char const * const value = kstr_basename(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   size_t const expected = sizeof(bytes);
+   size_t const size = kstr_size(str);
+   if (size != expected)
+      err("size [%zu], expecting [%zu]", size, expected);
+
+   if (memcmp(kstr_get(str), bytes, sizeof(bytes)) != 0)
+      err("value [%s], expecting [%s]", kstr_get(str), bytes);
+
+   kstr_set_bytes(str, NULL, sizeof(bytes));
+   if (kstr_size(str) != 1)
+      err("size [%zu], expecting [1]", kstr_size(str));
 
    kstr_free(&str);
 }
 
 static
 void
-test_basename_relative(void)
+test_set_fmt_bytes(void)
 {
-   fputs("test: get the basename of a relative path\n", stderr);
+   fputs("test: format a string with all 8-bit characters\n", stderr);
 
+   char const * const text = text_bytes;
    kstr * str = kstr_new(NULL);
-   kstr_set_fmt(str, "one/two/%s", __func__);
+   kstr_set_fmt(str, "%s", text);
 
-   char const * const expected = __func__;
-   char const * const value = kstr_basename(str);
+   char const * const expected = text;
+   char const * const value = kstr_get(str);
    if (strcmp(value, expected) != 0)
       err("value [%s], expecting [%s]", value, expected);
 
@@ -735,148 +5057,121 @@ test_basename_relative(void)
 
 static
 void
-test_basename_root(void)
+test_set_fmt_empty(void)
 {
-   fputs("test: get the basename of the root directory\n", stderr);
+   fputs("test: format a string with an empty format string\n", stderr);
 
-   char const * const text = "/";
-   kstr * str = kstr_new(text);
+   kstr * str = kstr_new(NULL);
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-zero-length"
+   kstr_set_fmt(str, "");
+#pragma GCC diagnostic pop
 
-   char const * const expected = text;
-   char const * const value = kstr_basename(str);
+   char const * const expected = "";
+   char const * const value = kstr_get(str);
    if (strcmp(value, expected) != 0)
       err("value [%s], expecting [%s]", value, expected);
 
    kstr_free(&str);
 }
 
-//! test appending control codes to a string
 static
 void
-test_control_codes(void)
+test_set_fmt_long(void)
 {
-   fputs("test: append control codes to a string\n", stderr);
+   fputs("test: format a string with a long value\n", stderr);
 
-   char const * const text = "x";
+   char const * const text = text_long;
    kstr * str = kstr_new(NULL);
+   kstr_set_fmt(str, "%s", text);
 
-   // print a line for each foreground color
-   for (kstr_color fg = 0; fg < kstr_num_colors; fg++)
-   {
-      // clear the string for this line of output
-      kstr_set_text(str, NULL);
-
-      // for each background color, add the fg/bg color attributes, normal
-      // text, bold text, and unbolded text
-      for (kstr_color bg = 0; bg < kstr_num_colors; bg++)
-      {
-         kstr_add_fg(str, fg);
-         kstr_add_bg(str, bg);
-         kstr_add_text(str, text);
-         kstr_add_bold(str, true);
-         kstr_add_text(str, text);
-         kstr_add_bold(str, false);
-         kstr_add_text(str, text);
-      }
-
-      // reset the attributes and add the last text before printing the line
-      kstr_add_bold(str, true);
-      kstr_add_reset(str);
-      kstr_add_text(str, text);
-      kstr_add_text(str, "\n");
-      fputs(kstr_get(str), stderr);
-   }
+   char const * const expected = text;
+   char const * const value = kstr_get(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_copy(void)
+test_set_fmt_no_args(void)
 {
-   fputs("test: copy a string\n", stderr);
-
-   char const * const text = __func__;
-   kstr * str = kstr_new(text);
-   kstr * str_copy = kstr_copy(str);
+   fputs("test: format a string with no format arguments\n", stderr);
 
-   if (str == str_copy)
-      err("str at %p returned self as copy", (void *) str);
+   kstr * str = kstr_new(NULL);
+   kstr_set_fmt(str, __func__);
 
-   char const * const expected = text;
-   char const * const value = kstr_get(str_copy);
+   char const * const expected = __func__;
+   char const * const value = kstr_get(str);
    if (strcmp(value, expected) != 0)
       err("value [%s], expecting [%s]", value, expected);
 
    kstr_free(&str);
-   kstr_free(&str_copy);
 }
 
 static
 void
-test_free_new(void)
+test_set_fmt_null(void)
 {
-   fputs("test: free a string\n", stderr);
+   fputs("test: format a string with a null format string\n", stderr);
 
    kstr * str = kstr_new(NULL);
-   if (str == NULL)
-      err("null str, expecting non-null");
-
-   kstr_free(&str);
-   if (str != NULL)
-      err("str at %p, expecting null", (void *) str);
-}
+   kstr_set_fmt(str, NULL);
 
-static
-void
-test_free_null(void)
-{
-   fputs("test: free a null string\n", stderr);
+   char const * const expected = "";
+   char const * const value = kstr_get(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
 
-   kstr * str = NULL;
    kstr_free(&str);
-   if (str != NULL)
-      err("str at %p, expecting null", (void *) str);
 }
 
 static
 void
-test_free_null_ptr(void)
+test_set_fmt_simple(void)
 {
-   fputs("test: free a null string pointer\n", stderr);
-   kstr_free(NULL);
+   fputs("test: format a string with a simple value\n", stderr);
+
+   char const * const text = __func__;
+   kstr * str = kstr_new(NULL);
+   kstr_set_fmt(str, "%s", text);
+
+   char const * const expected = text;
+   char const * const value = kstr_get(str);
+   if (strcmp(value, expected) != 0)
+      err("value [%s], expecting [%s]", value, expected);
+
+   kstr_free(&str);
 }
 
 static
 void
-test_get_copy(void)
+test_set_fmt_utf8(void)
 {
-   fputs("test: copy a string's value\n", stderr);
+   fputs("test: format a string with a utf-8 value\n", stderr);
 
-   char const * const text = __func__;
-   kstr * str = kstr_new(text);
+   char const * const text = text_utf8;
+   kstr * str = kstr_new(NULL);
+   kstr_set_fmt(str, "%s", text);
 
    char const * const expected = text;
    char const * const value = kstr_get(str);
-   char * const value_copy = kstr_get_copy(str);
-
-   if (value == value_copy)
-      err("value at %p returned as copy", (void *) value_copy);
-   if (strcmp(value_copy, expected) != 0)
+   if (strcmp(value, expected) != 0)
       err("value [%s], expecting [%s]", value, expected);
 
-   free(value_copy);
    kstr_free(&str);
 }
 
 static
 void
-test_new_bytes(void)
+test_set_text_bytes(void)
 {
-   fputs("test: create a string with all 8-bit characters\n", stderr);
+   fputs("test: set a string value including all 8-bit characters\n", stderr);
 
    char const * const text = text_bytes;
-   kstr * str = kstr_new(text);
+   kstr * str = kstr_new(__func__);
+   kstr_set_text(str, text);
 
    char const * const expected = text;
    char const * const value = kstr_get(str);
@@ -888,12 +5183,13 @@ test_new_bytes(void)
 
 static
 void
-test_new_empty(void)
+test_set_text_empty(void)
 {
-   fputs("test: create a string with an empty initial value\n", stderr);
+   fputs("test: set an empty string value\n", stderr);
 
    char const * const text = "";
-   kstr * str = kstr_new(text);
+   kstr * str = kstr_new(__func__);
+   kstr_set_text(str, text);
 
    char const * const expected = text;
    char const * const value = kstr_get(str);
@@ -905,12 +5201,13 @@ test_new_empty(void)
 
 static
 void
-test_new_long(void)
+test_set_text_long(void)
 {
-   fputs("test: create a string with a long initial value\n", stderr);
+   fputs("test: set a long string value\n", stderr);
 
    char const * const text = text_long;
-   kstr * str = kstr_new(text);
+   kstr * str = kstr_new(__func__);
+   kstr_set_text(str, text);
 
    char const * const expected = text;
    char const * const value = kstr_get(str);
@@ -922,19 +5219,16 @@ test_new_long(void)
 
 static
 void
-test_new_null_ptr(void)
+test_set_text_null(void)
 {
-   fputs("test: create a string with a null pointer\n", stderr);
+   fputs("test: set a null string value\n", stderr);
 
    char const * const text = NULL;
-   kstr * str = kstr_new(text);
-   if (str == NULL)
-      err("null str, expecting non-null");
+   kstr * str = kstr_new(__func__);
+   kstr_set_text(str, text);
 
    char const * const expected = "";
    char const * const value = kstr_get(str);
-   if (value == NULL)
-      err("null value, expecting non-null");
    if (strcmp(value, expected) != 0)
       err("value [%s], expecting [%s]", value, expected);
 
@@ -943,12 +5237,13 @@ test_new_null_ptr(void)
 
 static
 void
-test_new_simple(void)
+test_set_text_simple(void)
 {
-   fputs("test: create a string with a simple initial value\n", stderr);
+   fputs("test: set a simple string value\n", stderr);
 
    char const * const text = __func__;
-   kstr * str = kstr_new(text);
+   kstr * str = kstr_new(NULL);
+   kstr_set_text(str, text);
 
    char const * const expected = text;
    char const * const value = kstr_get(str);
@@ -960,12 +5255,13 @@ test_new_simple(void)
 
 static
 void
-test_new_utf8(void)
+test_set_text_utf8(void)
 {
-   fputs("test: create a string with a utf-8 initial value\n", stderr);
+   fputs("test: set a utf-8 string value\n", stderr);
 
    char const * const text = text_utf8;
-   kstr * str = kstr_new(text);
+   kstr * str = kstr_new(__func__);
+   kstr_set_text(str, text);
 
    char const * const expected = text;
    char const * const value = kstr_get(str);
@@ -977,408 +5273,1126 @@ test_new_utf8(void)
 
 static
 void
-test_set_fmt_bytes(void)
+test_size_control(void)
 {
-   fputs("test: format a string with all 8-bit characters\n", stderr);
+   fputs("test: get the size of a string of control codes\n", stderr);
 
-   char const * const text = text_bytes;
    kstr * str = kstr_new(NULL);
-   kstr_set_fmt(str, "%s", text);
+   kstr_add_bold(str, true);
+   kstr_add_bold(str, false);
 
-   char const * const expected = text;
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   size_t const size = kstr_size(str);
+   if (size == 0)
+      err("size [0], expecting [>0]");
 
    kstr_free(&str);
 }
 
 static
 void
-test_set_fmt_empty(void)
+test_size_empty(void)
 {
-   fputs("test: format a string with an empty format string\n", stderr);
+   fputs("test: get the size of an empty string\n", stderr);
+
+   char const text[] = "";
+   kstr * str = kstr_new(text);
+
+   size_t const expected = sizeof(text);
+   size_t const size = kstr_size(str);
+   if (size != expected)
+      err("size [%zu], expecting [%zu]", size, expected);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_size_mixed(void)
+{
+   fputs("test: get the size of a string of text and control codes\n", stderr);
 
    kstr * str = kstr_new(NULL);
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wformat-zero-length"
-   kstr_set_fmt(str, "");
-#pragma GCC diagnostic pop
+   kstr_add_bold(str, true);
+   kstr_add_text(str, __func__);
+   kstr_add_bold(str, false);
 
-   char const * const expected = "";
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   size_t const size = kstr_size(str);
+   if (size <= sizeof(__func__))
+      err("size [%zu], expecting [>%zu]", size, sizeof(__func__));
 
    kstr_free(&str);
 }
 
 static
 void
-test_set_fmt_long(void)
+test_size_null(void)
 {
-   fputs("test: format a string with a long value\n", stderr);
+   fputs("test: get the size of a null string\n", stderr);
 
-   char const * const text = text_long;
+   char const text[] = "";
    kstr * str = kstr_new(NULL);
-   kstr_set_fmt(str, "%s", text);
 
-   char const * const expected = text;
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   size_t const expected = sizeof(text);
+   size_t const size = kstr_size(str);
+   if (size != expected)
+      err("size [%zu], expecting [%zu]", size, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_set_fmt_no_args(void)
+test_size_text(void)
 {
-   fputs("test: format a string with no format arguments\n", stderr);
+   fputs("test: get the size of a string of text\n", stderr);
+
+   kstr * str = kstr_new(__func__);
+
+   size_t const expected = sizeof(__func__);
+   size_t const size = kstr_size(str);
+   if (size != expected)
+      err("size [%zu], expecting [%zu]", size, expected);
+
+   kstr_free(&str);
+}
 
+static
+void
+test_slurp_file(void)
+{
+   fputs("test: read a whole file\n", stderr);
+
+   char path[] = "/tmp/test-kstr-XXXXXX";
+   int const fd = mkstemp(path);
+   if (fd < 0)
+      err("can't create input file");
+
+   kstr * expected = kstr_new(NULL);
+   for (int i = 0; i < 100; i++)
+      kstr_add_text(expected, text_long);
+   if (!kstr_write(expected, fd))
+      err("can't write input file");
+   close(fd);
+
+   // the buffer is sized for the whole file at once
    kstr * str = kstr_new(NULL);
-   kstr_set_fmt(str, __func__);
+   if (!kstr_slurp_file(str, path))
+      err("slurp failed");
+   if (strcmp(kstr_get(str), kstr_get(expected)) != 0)
+      err("value differs from the file's contents");
+   if (kstr_capacity(str) != kstr_size(str) + 1)
+      err(
+            "capacity [%zu], expecting [%zu]",
+            kstr_capacity(str),
+            kstr_size(str) + 1);
+
+   unlink(path);
+
+   // errors are reported through errno
+   errno = 0;
+   if (kstr_slurp_file(str, path))
+      err("slurp of a missing file succeeded");
+   if (errno != ENOENT)
+      err("errno [%d], expecting [%d]", errno, ENOENT);
 
-   char const * const expected = __func__;
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   kstr_free(&str);
+   kstr_free(&expected);
+}
+
+static
+void
+test_split(void)
+{
+   fputs("test: split a string at delimiters\n", stderr);
+
+   static struct
+   {
+      char const * text;
+      char const * delimiters;
+      size_t count;
+      char const * expected;
+   } const cases[] =
+   {
+      { "a,b,c", ",", 3, "[a][b][c]" },
+      { ",a,,b,", ",", 5, "[][a][][b][]" },
+      { "", ",", 1, "[]" },
+      { "a b\tc", " \t", 3, "[a][b][c]" },
+      { "a=1;b=2", "=;", 4, "[a][1][b][2]" },
+      { "a,b", "", 1, "[a,b]" }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr * str = kstr_new(cases[i].text);
+      kstr_view pieces[8];
+      size_t const count = kstr_split(
+            str, kstr_view_text(cases[i].delimiters), pieces, 8);
+      if (count != cases[i].count)
+         err(
+               "split [%s] count [%zu], expecting [%zu]",
+               cases[i].text,
+               count,
+               cases[i].count);
+
+      // every piece points into the string's own buffer
+      kstr * joined = kstr_new(NULL);
+      for (size_t k = 0; k < count; k++)
+      {
+         if (pieces[k].ptr < kstr_get(str)
+               || pieces[k].ptr + pieces[k].len > kstr_get(str)
+                  + kstr_size(str))
+            err("split piece [%zu] of [%s] is a copy", k, cases[i].text);
+
+         kstr_add_text(joined, "[");
+         kstr_add_bytes(joined, pieces[k].ptr, pieces[k].len);
+         kstr_add_text(joined, "]");
+      }
+
+      if (strcmp(kstr_get(joined), cases[i].expected) != 0)
+         err(
+               "split [%s] result [%s], expecting [%s]",
+               cases[i].text,
+               kstr_get(joined),
+               cases[i].expected);
+
+      kstr_free(&joined);
+      kstr_free(&str);
+   }
+
+   // only as many pieces as fit are stored
+   kstr * str = kstr_new("a,b,c,d");
+   kstr_view pieces[3] = { { NULL, 0 }, { NULL, 0 }, { NULL, 0 } };
+   size_t count = kstr_split(str, kstr_view_text(","), pieces, 2);
+   if (count != 4)
+      err("split count [%zu], expecting [4]", count);
+   if (pieces[1].len != 1 || pieces[1].ptr[0] != 'b' || pieces[2].ptr != NULL)
+      err("split stored pieces beyond the maximum");
+
+   count = kstr_split(str, kstr_view_text(","), NULL, 0);
+   if (count != 4)
+      err("split count [%zu], expecting [4]", count);
+
+   // tokens are the same pieces, one at a time
+   kstr_view rest = kstr_get_view(str, 0, kstr_npos);
+   kstr_view token;
+   count = 0;
+   while (kstr_view_token(&rest, kstr_view_text(","), &token))
+   {
+      if (token.len != 1 || token.ptr[0] != "abcd"[count])
+         err("token [%zu] is [%.*s]", count, (int) token.len, token.ptr);
+      count++;
+   }
+
+   if (count != 4)
+      err("token count [%zu], expecting [4]", count);
+   if (kstr_view_token(&rest, kstr_view_text(","), &token))
+      err("token returned a piece after the last one");
+
+   // an empty view has one empty piece, even with a null pointer
+   kstr_view const empties[] = { kstr_view_text(""), kstr_view_text(NULL) };
+   for (size_t i = 0; i < sizeof(empties) / sizeof(*empties); i++)
+   {
+      count = kstr_view_split(empties[i], kstr_view_text(","), pieces, 3);
+      if (count != 1 || pieces[0].len != 0)
+         err("empty view [%zu] split into [%zu] pieces", i, count);
+
+      rest = empties[i];
+      count = 0;
+      while (kstr_view_token(&rest, kstr_view_text(","), &token))
+         count++;
+      if (count != 1)
+         err("empty view [%zu] has [%zu] tokens", i, count);
+   }
 
    kstr_free(&str);
 }
 
 static
 void
-test_set_fmt_null(void)
+test_split_long(void)
 {
-   fputs("test: format a string with a null format string\n", stderr);
+   fputs("test: split long views\n", stderr);
+
+   // delimiters at every offset within and across 16-byte blocks, for one
+   // delimiter, a few delimiters, and more than are compared at once
+   static char const * const delimiters[] = { ",", ",;", ",;:|", ",;:|/!" };
+
+   char text[256];
+   for (size_t d = 0; d < sizeof(delimiters) / sizeof(*delimiters); d++)
+   {
+      size_t const n = strlen(delimiters[d]);
+      for (size_t step = 1; step < 40; step++)
+      {
+         size_t expected = 1;
+         for (size_t i = 0; i < sizeof(text); i++)
+         {
+            if (i % step == step - 1)
+            {
+               text[i] = delimiters[d][i % n];
+               expected++;
+            }
+            else
+               text[i] = 'x';
+         }
+
+         kstr_view const view = { text, sizeof(text) };
+         kstr_view pieces[257];
+         size_t const count = kstr_view_split(
+               view, kstr_view_text(delimiters[d]), pieces, 257);
+         if (count != expected)
+            err(
+                  "split [%s] every [%zu] count [%zu], expecting [%zu]",
+                  delimiters[d],
+                  step,
+                  count,
+                  expected);
+
+         for (size_t k = 0; k + 1 < count; k++)
+            if (pieces[k].len != step - 1)
+               err(
+                     "split [%s] every [%zu] piece [%zu] size [%zu]",
+                     delimiters[d],
+                     step,
+                     k,
+                     pieces[k].len);
+      }
+   }
+}
+
+static
+void
+test_stats(void)
+{
+   fputs("test: per-thread counters\n", stderr);
 
+   kstr_stats_reset();
    kstr * str = kstr_new(NULL);
-   kstr_set_fmt(str, NULL);
+   for (int i = 0; i < 10; i++)
+      kstr_add_fmt(str, "%d%s", i, text_long);
+   kstr_free(&str);
 
-   char const * const expected = "";
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   // only the basename of a path with trailing slashes is cached
+   str = kstr_new("/usr/lib/");
+   kstr_basename(str);
+   kstr_basename(str);
+
+   kstr_stats stats;
+   kstr_stats_get(&stats);
+
+   uint64_t freed = 0;
+   for (size_t i = 0; i < kstr_waste_buckets; i++)
+      freed += stats.waste[i];
+
+#ifdef kstr_instrument
+   if (stats.allocs < 2 || stats.resizes < 2 || stats.bytes_copied == 0)
+      err(
+            "counted [%llu] allocations, [%llu] resizes, [%llu] bytes copied",
+            (unsigned long long) stats.allocs,
+            (unsigned long long) stats.resizes,
+            (unsigned long long) stats.bytes_copied);
+
+   // appends that grow the buffer format twice
+   if (stats.fmt_passes != 10 + stats.resizes)
+      err(
+            "counted [%llu] format passes, expecting [%llu]",
+            (unsigned long long) stats.fmt_passes,
+            (unsigned long long) (10 + stats.resizes));
+
+   if (stats.basename_hits != 1 || stats.basename_misses != 1)
+      err(
+            "counted [%llu] basename hits and [%llu] misses, expecting [1]",
+            (unsigned long long) stats.basename_hits,
+            (unsigned long long) stats.basename_misses);
+
+   if (freed != 1)
+      err("counted [%llu] freed strings", (unsigned long long) freed);
+
+   // cloning allocates the shared buffer, and growing it once the clone is gone
+   // resizes it
+   size_t const old_limit = kstr_cache_limit(0);
+   kstr * shared = kstr_new(text_long);
+   kstr_stats_reset();
+   kstr * clone = kstr_clone(shared);
+   kstr_free(&clone);
+   kstr_add_text(shared, text_long);
+   kstr_stats_get(&stats);
+   if (stats.allocs != 2 || stats.resizes != 1)
+      err(
+            "counted [%llu] allocations, [%llu] resizes for a clone",
+            (unsigned long long) stats.allocs,
+            (unsigned long long) stats.resizes);
+
+   kstr_free(&shared);
+   kstr_cache_limit(old_limit);
+#else
+   // without instrumentation, nothing is counted
+   if (stats.allocs != 0 || stats.fmt_passes != 0 || freed != 0)
+      err("uninstrumented counters aren't zero");
+#endif
+
+   kstr_stats_reset();
+   kstr_stats_get(&stats);
+   if (stats.allocs != 0 || stats.fmt_passes != 0)
+      err("counters weren't reset");
 
    kstr_free(&str);
 }
 
 static
 void
-test_set_fmt_simple(void)
+test_style_colors(void)
 {
-   fputs("test: format a string with a simple value\n", stderr);
+   fputs("test: style colors\n", stderr);
+
+   static struct
+   {
+      kstr_style_color fg;
+      kstr_style_color bg;
+      char const * expected;
+   } const cases[] =
+   {
+      { { .kind = kstr_color_kind_basic, .basic = kstr_color_default },
+         { .kind = kstr_color_kind_none }, "\x1b[39m" },
+      { { .kind = kstr_color_kind_none },
+         { .kind = kstr_color_kind_basic, .basic = kstr_color_yellow },
+         "\x1b[43m" },
+      { { .kind = kstr_color_kind_256, .index = 0 },
+         { .kind = kstr_color_kind_256, .index = 255 },
+         "\x1b[38;5;0;48;5;255m" },
+      { { .kind = kstr_color_kind_256, .index = 42 },
+         { .kind = kstr_color_kind_none }, "\x1b[38;5;42m" },
+      { { .kind = kstr_color_kind_rgb, .red = 255, .green = 128, .blue = 0 },
+         { .kind = kstr_color_kind_rgb, .red = 1, .green = 22, .blue = 203 },
+         "\x1b[38;2;255;128;0;48;2;1;22;203m" }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr * str = kstr_new(NULL);
+      kstr_style const style = { .fg = cases[i].fg, .bg = cases[i].bg };
+      kstr_add_style(str, &style);
+      if (strcmp(kstr_get(str), cases[i].expected) != 0)
+         err(
+               "style [%zu] result [%s], expecting [%s]",
+               i,
+               kstr_get(str) + 1,
+               cases[i].expected + 1);
+
+      kstr_free(&str);
+   }
+
+   // the constructors make the same colors
+   kstr_style_color color = kstr_style_rgb(1, 2, 3);
+   if (color.kind != kstr_color_kind_rgb || color.red != 1 || color.green != 2
+         || color.blue != 3)
+      err("style_rgb made the wrong color");
+
+   color = kstr_style_256(208);
+   if (color.kind != kstr_color_kind_256 || color.index != 208)
+      err("style_256 made the wrong color");
+
+   color = kstr_style_basic(kstr_color_cyan);
+   if (color.kind != kstr_color_kind_basic || color.basic != kstr_color_cyan)
+      err("style_basic made the wrong color");
+}
+
+static
+void
+test_style_combined(void)
+{
+   fputs("test: combined style control code\n", stderr);
+
+   kstr * str = kstr_new("[");
+   kstr_style const style =
+   {
+      .set_bold = true,
+      .bold = true,
+      .fg = kstr_style_basic(kstr_color_red),
+      .bg = kstr_style_basic(kstr_color_blue)
+   };
+
+   kstr_add_style(str, &style);
+   kstr_add_text(str, "ok]");
+
+   char const * expected = "[\x1b[1;31;44mok]";
+   if (strcmp(kstr_get(str), expected) != 0)
+      err("style result [%s], expecting [%s]", kstr_get(str), expected);
+   if (kstr_width(str) != 4)
+      err("style width [%zu], expecting [4]", kstr_width(str));
+
+   // an empty style appends nothing
+   size_t const size = kstr_size(str);
+   kstr_add_style(str, &(kstr_style) { .set_bold = false });
+   kstr_add_style(str, NULL);
+   if (kstr_size(str) != size)
+      err("empty style size [%zu], expecting [%zu]", kstr_size(str), size);
+
+   kstr_free(&str);
+}
+
+static
+void
+test_style_tracking(void)
+{
+   fputs("test: skip active style attributes\n", stderr);
+
+   kstr_style const red_bold =
+   {
+      .set_bold = true,
+      .bold = true,
+      .fg = kstr_style_basic(kstr_color_red)
+   };
+
+   kstr_style const red_on_blue =
+   {
+      .fg = kstr_style_basic(kstr_color_red),
+      .bg = kstr_style_256(21)
+   };
 
-   char const * const text = __func__;
    kstr * str = kstr_new(NULL);
-   kstr_set_fmt(str, "%s", text);
+   kstr_add_style(str, &red_bold);
+   kstr_add_text(str, "a");
+   kstr_add_style(str, &red_bold);
+   kstr_add_text(str, "b");
+   kstr_add_style(str, &red_on_blue);
+   kstr_add_text(str, "c");
+
+   // attributes set with the other functions are tracked too
+   kstr_add_fg(str, kstr_color_green);
+   kstr_add_style(str, &red_on_blue);
+   kstr_add_reset(str);
+   kstr_add_style(
+         str,
+         &(kstr_style)
+         {
+            .set_bold = true,
+            .fg = kstr_style_basic(kstr_color_default),
+            .bg = kstr_style_basic(kstr_color_green)
+         });
+
+   char const * expected =
+      "\x1b[1;31m" "ab" "\x1b[48;5;21m" "c" "\x1b[32m" "\x1b[31m" "\x1b[0m"
+      "\x1b[42m";
+   if (strcmp(kstr_get(str), expected) != 0)
+      err("style result [%s], expecting [%s]", kstr_get(str), expected);
+
+   // after the end of the value is cut, nothing is known to be active
+   kstr_truncate(str, 0);
+   kstr_add_style(str, &red_bold);
+   if (strcmp(kstr_get(str), "\x1b[1;31m") != 0)
+      err("style result after truncate [%s]", kstr_get(str) + 1);
+
+   // clearing the value forgets the attributes too
+   kstr_set_text(str, "x");
+   kstr_add_style(str, &red_bold);
+   if (strcmp(kstr_get(str), "x\x1b[1;31m") != 0)
+      err("style result after set_text [%s]", kstr_get(str) + 1);
+
+   // copies know what is active at the end of their value
+   kstr * copy = kstr_copy(str);
+   kstr_add_style(copy, &red_bold);
+   if (kstr_size(copy) != kstr_size(str))
+      err("style added to copy [%s]", kstr_get(copy) + 1);
+
+   // untracked control codes make the active attributes unknown
+   kstr_style const red = { .fg = kstr_style_basic(kstr_color_red) };
+   kstr * colored = kstr_add_fg(kstr_new(NULL), kstr_color_red);
+   kstr_add_text(colored, "\x1b[0m");
+   kstr_view const reset = kstr_get_view(colored, 5, 4);
+   struct
+   {
+      char const * desc;
+      kstr * (* add)(kstr * str, kstr_view codes);
+   } const untracked[] =
+   {
+      { "text", add_view_bytes },
+      { "view", kstr_add_view },
+      { "join", add_view_joined },
+      { "concurrent append", add_view_concurrent }
+   };
 
-   char const * const expected = text;
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   for (size_t i = 0; i < sizeof(untracked) / sizeof(*untracked); i++)
+   {
+      kstr_set_text(str, NULL);
+      kstr_add_fg(str, kstr_color_red);
+      untracked[i].add(str, reset);
+      kstr_add_style(str, &red);
+      if (strcmp(kstr_get(str), "\x1b[31m\x1b[0m\x1b[31m") != 0)
+         err("style result after untracked %s [%s]",
+               untracked[i].desc, kstr_get(str) + 1);
+   }
 
+   kstr_free(&colored);
+   kstr_free(&copy);
    kstr_free(&str);
 }
 
 static
 void
-test_set_fmt_utf8(void)
+test_width_control(void)
 {
-   fputs("test: format a string with a utf-8 value\n", stderr);
+   fputs("test: get the width of a string of control codes\n", stderr);
 
-   char const * const text = text_utf8;
    kstr * str = kstr_new(NULL);
-   kstr_set_fmt(str, "%s", text);
+   kstr_add_bold(str, true);
+   kstr_add_bold(str, false);
 
-   char const * const expected = text;
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   size_t const expected = 0;
+   size_t const width = kstr_width(str);
+   if (width != expected)
+      err("width [%zu], expecting [%zu]", width, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_set_text_bytes(void)
+test_width_empty(void)
 {
-   fputs("test: set a string value including all 8-bit characters\n", stderr);
+   fputs("test: get the width of an empty string\n", stderr);
 
-   char const * const text = text_bytes;
-   kstr * str = kstr_new(__func__);
-   kstr_set_text(str, text);
+   kstr * str = kstr_new("");
 
-   char const * const expected = text;
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   size_t const expected = 0;
+   size_t const width = kstr_width(str);
+   if (width != expected)
+      err("width [%zu], expecting [%zu]", width, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_set_text_empty(void)
+test_width_invalid(void)
 {
-   fputs("test: set an empty string value\n", stderr);
+   fputs("test: get the width of a string with invalid utf-8 bytes\n", stderr);
 
-   char const * const text = "";
-   kstr * str = kstr_new(__func__);
-   kstr_set_text(str, text);
+   static struct
+   {
+      char const * text;
+      size_t expected;
+   } const cases[] =
+   {
+      { "\xff", 1 },
+      { "a\x80" "b", 3 },
+      { "\xc3", 0 },
+      { "\xc3x", 2 },
+      { "\xe6\x96x", 2 },
+      { "\xf0\x9f\x98\x80", 2 },
+      { "\xf5\xc0", 2 }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr * str = kstr_new(cases[i].text);
+      size_t const width = kstr_width(str);
+      if (width != cases[i].expected)
+         err(
+               "width of case %zu [%zu], expecting [%zu]",
+               i,
+               width,
+               cases[i].expected);
+
+      kstr_free(&str);
+   }
 
-   char const * const expected = text;
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   // a control code ends an incomplete sequence
+   kstr * str = kstr_new("\xe6\x96");
+   kstr_add_bold(str, true);
+   kstr_add_text(str, "\x87");
+
+   size_t const expected = 2;
+   size_t const width = kstr_width(str);
+   if (width != expected)
+      err("width [%zu], expecting [%zu]", width, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_set_text_long(void)
+test_width_long(void)
 {
-   fputs("test: set a long string value\n", stderr);
+   fputs(
+         "test: get the width of a long string with control characters\n",
+         stderr);
 
-   char const * const text = text_long;
-   kstr * str = kstr_new(__func__);
-   kstr_set_text(str, text);
+   // put a zero-width character at every position of a long value
+   size_t const length = strlen(text_long);
+   for (size_t pos = 0; pos < 40; pos++)
+   {
+      kstr * str = kstr_new(NULL);
+      kstr_add_bytes(str, text_long, pos);
+      kstr_add_text(str, "\t");
+      kstr_add_text(str, text_long + pos);
 
-   char const * const expected = text;
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+      size_t const expected = length;
+      size_t const width = kstr_width(str);
+      if (width != expected)
+         err("width [%zu], expecting [%zu]", width, expected);
 
-   kstr_free(&str);
+      kstr_free(&str);
+   }
 }
 
 static
 void
-test_set_text_null(void)
+test_width_mixed(void)
 {
-   fputs("test: set a null string value\n", stderr);
+   fputs(
+         "test: get the width of a string of text and control codes\n",
+         stderr);
 
-   char const * const text = NULL;
-   kstr * str = kstr_new(__func__);
-   kstr_set_text(str, text);
+   char const * const text = __func__;
+   kstr * str = kstr_new(NULL);
+   kstr_add_bold(str, true);
+   kstr_add_text(str, text);
+   kstr_add_bold(str, false);
 
-   char const * const expected = "";
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   size_t const expected = strlen(text);
+   size_t const width = kstr_width(str);
+   if (width != expected)
+      err("width [%zu], expecting [%zu]", width, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_set_text_simple(void)
+test_width_null(void)
 {
-   fputs("test: set a simple string value\n", stderr);
+   fputs("test: get the width of a null string\n", stderr);
 
-   char const * const text = __func__;
    kstr * str = kstr_new(NULL);
-   kstr_set_text(str, text);
 
-   char const * const expected = text;
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   size_t const expected = 0;
+   size_t const width = kstr_width(str);
+   if (width != expected)
+      err("width [%zu], expecting [%zu]", width, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_set_text_utf8(void)
+test_width_scripts(void)
 {
-   fputs("test: set a utf-8 string value\n", stderr);
+   fputs(
+         "test: get the width of marks and symbols from several scripts\n",
+         stderr);
 
-   char const * const text = text_utf8;
-   kstr * str = kstr_new(__func__);
-   kstr_set_text(str, text);
+   static struct
+   {
+      char const * text;
+      size_t expected;
+   } const cases[] =
+   {
+      // combining marks
+      { "\xe0\xa8\xbc", 0 }, // gurmukhi sign nukta
+      { "\xe0\xaa\xbc", 0 }, // gujarati sign nukta
+      { "\xe0\xaf\x8d", 0 }, // tamil sign virama
+      { "\xe0\xb0\xbe", 0 }, // telugu vowel sign aa
+      { "\xe0\xbd\xb1", 0 }, // tibetan vowel sign aa
+      { "\xe1\x80\xad", 0 }, // myanmar vowel sign i
+      { "\xe1\x9e\xb7", 0 }, // khmer vowel sign i
+      { "\xe1\xa0\x8b", 0 }, // mongolian free variation selector one
+      { "\xf0\x96\xbf\xa4", 0 }, // khitan small script filler
+
+      // narrow symbols next to wide ones
+      { "\xf0\x9f\x8c\xa1", 1 }, // thermometer
+      { "\xf0\x9f\x95\xa8", 1 }, // right speaker
+
+      // wide and fullwidth characters
+      { "\xf0\x9f\x98\x80", 2 }, // grinning face
+      { "\xf0\x9f\x8f\xbb", 2 }, // emoji modifier fitzpatrick type-1-2
+      { "\xe4\xb7\x80", 2 }, // hexagram for the creative heaven
+      { "\xf0\x96\xbf\xb0", 2 }, // vietnamese alternate reading mark ca
+      { "\xf0\x9a\xbf\xb0", 2 }, // katakana letter minnan tone-2
+      { "\xef\xbc\xa1", 2 } // fullwidth latin capital letter a
+   };
 
-   char const * const expected = text;
-   char const * const value = kstr_get(str);
-   if (strcmp(value, expected) != 0)
-      err("value [%s], expecting [%s]", value, expected);
+   kstr * str = kstr_new(NULL);
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr_set_text(str, cases[i].text);
+      size_t const width = kstr_width(str);
+      if (width != cases[i].expected)
+         err(
+               "width [%zu] of case [%zu], expecting [%zu]",
+               width,
+               i,
+               cases[i].expected);
+   }
 
    kstr_free(&str);
 }
 
 static
 void
-test_size_control(void)
+test_width_split(void)
 {
-   fputs("test: get the size of a string of control codes\n", stderr);
+   fputs(
+         "test: get the width of utf-8 text appended one byte at a time\n",
+         stderr);
 
+   char const * const text = text_utf8;
    kstr * str = kstr_new(NULL);
-   kstr_add_bold(str, true);
-   kstr_add_bold(str, false);
+   for (size_t i = 0; text[i] != '\0'; i++)
+      kstr_add_bytes(str, text + i, 1);
 
-   size_t const size = kstr_size(str);
-   if (size == 0)
-      err("size [0], expecting [>0]");
+   size_t const expected = 13;
+   size_t const width = kstr_width(str);
+   if (width != expected)
+      err("width [%zu], expecting [%zu]", width, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_size_empty(void)
+test_width_text(void)
 {
-   fputs("test: get the size of an empty string\n", stderr);
+   fputs("test: get the width of a string of text\n", stderr);
 
-   char const text[] = "";
+   char const * const text = __func__;
    kstr * str = kstr_new(text);
 
-   size_t const expected = sizeof(text);
-   size_t const size = kstr_size(str);
-   if (size != expected)
-      err("size [%zu], expecting [%zu]", size, expected);
+   size_t const expected = strlen(text);
+   size_t const width = kstr_width(str);
+   if (width != expected)
+      err("width [%zu], expecting [%zu]", width, expected);
 
    kstr_free(&str);
 }
 
 static
 void
-test_size_mixed(void)
+test_view_compare(void)
 {
-   fputs("test: get the size of a string of text and control codes\n", stderr);
+   fputs("test: compare views\n", stderr);
 
-   kstr * str = kstr_new(NULL);
-   kstr_add_bold(str, true);
-   kstr_add_text(str, __func__);
-   kstr_add_bold(str, false);
-
-   size_t const size = kstr_size(str);
-   if (size <= sizeof(__func__))
-      err("size [%zu], expecting [>%zu]", size, sizeof(__func__));
-
-   kstr_free(&str);
+   static struct
+   {
+      char const * text1;
+      char const * text2;
+      int expected;
+   } const cases[] =
+   {
+      { "", "", 0 },
+      { "abc", "abc", 0 },
+      { "abc", "abd", -1 },
+      { "abd", "abc", 1 },
+      { "ab", "abc", -1 },
+      { "abc", "ab", 1 },
+      { "", "a", -1 },
+      { "\xff", "\x01", 1 }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr_view const view1 = kstr_view_text(cases[i].text1);
+      kstr_view const view2 = kstr_view_text(cases[i].text2);
+
+      int const result = kstr_view_compare(view1, view2);
+      int const sign = (result > 0) - (result < 0);
+      if (sign != cases[i].expected)
+         err(
+               "compare [%s] [%s] result [%d], expecting [%d]",
+               cases[i].text1,
+               cases[i].text2,
+               sign,
+               cases[i].expected);
+
+      bool const equal = kstr_view_equal(view1, view2);
+      if (equal != (cases[i].expected == 0))
+         err(
+               "equal [%s] [%s] result [%d], expecting [%d]",
+               cases[i].text1,
+               cases[i].text2,
+               equal,
+               cases[i].expected == 0);
+   }
 }
 
 static
 void
-test_size_null(void)
+test_view_find(void)
 {
-   fputs("test: get the size of a null string\n", stderr);
+   fputs("test: find bytes in a view\n", stderr);
 
-   char const text[] = "";
-   kstr * str = kstr_new(NULL);
+   kstr * str = kstr_new("one two one two");
+   kstr_view const view = kstr_get_view(str, 0, kstr_npos);
 
-   size_t const expected = sizeof(text);
-   size_t const size = kstr_size(str);
-   if (size != expected)
-      err("size [%zu], expecting [%zu]", size, expected);
+   static struct
+   {
+      char const * needle;
+      size_t pos;
+      size_t expected;
+   } const cases[] =
+   {
+      { "one", 0, 0 },
+      { "one", 1, 8 },
+      { "two", 0, 4 },
+      { "two", 5, 12 },
+      { "two", 13, kstr_npos },
+      { "one two one two!", 0, kstr_npos },
+      { "", 3, 3 },
+      { "", 15, 15 },
+      { "", 16, kstr_npos },
+      { "x", 0, kstr_npos }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      size_t const pos = kstr_view_find(
+            view, kstr_view_text(cases[i].needle), cases[i].pos);
+      if (pos != cases[i].expected)
+         err(
+               "find [%s] at [%zu] result [%zu], expecting [%zu]",
+               cases[i].needle,
+               cases[i].pos,
+               pos,
+               cases[i].expected);
+   }
+
+   size_t pos = kstr_view_find_char(view, 't', 0);
+   if (pos != 4)
+      err("find_char result [%zu], expecting [4]", pos);
+
+   pos = kstr_view_find_char(view, 't', 5);
+   if (pos != 12)
+      err("find_char result [%zu], expecting [12]", pos);
+
+   pos = kstr_view_find_char(view, 'x', 0);
+   if (pos != kstr_npos)
+      err("find_char result [%zu], expecting [%zu]", pos, kstr_npos);
 
    kstr_free(&str);
 }
 
 static
 void
-test_size_text(void)
+test_view_get(void)
 {
-   fputs("test: get the size of a string of text\n", stderr);
+   fputs("test: get a view of part of a string\n", stderr);
 
-   kstr * str = kstr_new(__func__);
+   kstr * str = kstr_new("one two three");
 
-   size_t const expected = sizeof(__func__);
-   size_t const size = kstr_size(str);
-   if (size != expected)
-      err("size [%zu], expecting [%zu]", size, expected);
+   static struct
+   {
+      size_t pos;
+      size_t count;
+      char const * expected;
+   } const cases[] =
+   {
+      { 0, kstr_npos, "one two three" },
+      { 4, 3, "two" },
+      { 8, 100, "three" },
+      { 13, 1, "" },
+      { 100, 1, "" }
+   };
+
+   for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+   {
+      kstr_view const view = kstr_get_view(str, cases[i].pos, cases[i].count);
+      if (!kstr_view_equal(view, kstr_view_text(cases[i].expected)))
+         err(
+               "view [%.*s], expecting [%s]",
+               (int) view.len,
+               view.ptr,
+               cases[i].expected);
+   }
 
    kstr_free(&str);
 }
 
 static
 void
-test_width_control(void)
+test_view_sub(void)
 {
-   fputs("test: get the width of a string of control codes\n", stderr);
+   fputs("test: get views of text and of other views\n", stderr);
 
-   kstr * str = kstr_new(NULL);
-   kstr_add_bold(str, true);
-   kstr_add_bold(str, false);
+   kstr_view const view = kstr_view_text(__func__);
+   if (view.ptr != __func__ || view.len != sizeof(__func__) - 1)
+      err("view [%.*s], expecting [%s]", (int) view.len, view.ptr, __func__);
 
-   size_t const expected = 0;
-   size_t const width = kstr_width(str);
-   if (width != expected)
-      err("width [%zu], expecting [%zu]", width, expected);
+   kstr_view const sub = kstr_view_sub(kstr_view_sub(view, 5, 100), 0, 4);
+   if (!kstr_view_equal(sub, kstr_view_text("view")))
+      err("view [%.*s], expecting [view]", (int) sub.len, sub.ptr);
 
-   kstr_free(&str);
+   kstr_view const empty = kstr_view_text(NULL);
+   if (empty.len != 0)
+      err("view length [%zu], expecting [0]", empty.len);
 }
 
 static
 void
-test_width_empty(void)
+test_width_utf8(void)
 {
-   fputs("test: get the width of an empty string\n", stderr);
+   fputs("test: get the width of a string of utf-8 text\n", stderr);
 
-   kstr * str = kstr_new("");
+   // four wide characters and five narrow ones
+   char const * const text = text_utf8;
+   kstr * str = kstr_new(text);
 
-   size_t const expected = 0;
-   size_t const width = kstr_width(str);
+   size_t const expected = 13;
+   size_t width = kstr_width(str);
+   if (width != expected)
+      err("width [%zu], expecting [%zu]", width, expected);
+
+   kstr_set_fmt(str, "%s", text);
+   width = kstr_width(str);
    if (width != expected)
       err("width [%zu], expecting [%zu]", width, expected);
 
+   // combining marks take no columns
+   kstr_set_text(str, "e\xcc\x81");
+   width = kstr_width(str);
+   if (width != 1)
+      err("width [%zu], expecting [1]", width);
+
    kstr_free(&str);
 }
 
 static
 void
-test_width_mixed(void)
+test_write(void)
 {
-   fputs(
-         "test: get the width of a string of text and control codes\n",
-         stderr);
+   fputs("test: write a string to a file descriptor\n", stderr);
 
-   char const * const text = __func__;
+   // a chunked value is written from each of its chunks
    kstr * str = kstr_new(NULL);
-   kstr_add_bold(str, true);
-   kstr_add_text(str, text);
-   kstr_add_bold(str, false);
+   kstr_set_growth(str, kstr_growth_chunked);
+   for (int i = 0; i < 1500; i++)
+   {
+      kstr_add_fg(str, kstr_color_green);
+      kstr_add_text(str, text_long);
+      kstr_add_reset(str);
+   }
 
-   size_t const expected = strlen(text);
-   size_t const width = kstr_width(str);
-   if (width != expected)
-      err("width [%zu], expecting [%zu]", width, expected);
+   FILE * file = tmpfile();
+   if (file == NULL)
+      err("can't create output file");
+   if (!kstr_write(str, fileno(file)))
+      err("write failed");
+   if (kstr_get_chunks(str, NULL, 0) < 2)
+      err("write joined the chunks");
+
+   check_output(file, str);
+   fclose(file);
+
+   // errors are reported through errno
+   errno = 0;
+   if (kstr_write(str, -1))
+      err("write to an invalid file descriptor succeeded");
+   if (errno != EBADF)
+      err("errno [%d], expecting [%d]", errno, EBADF);
 
    kstr_free(&str);
 }
 
 static
 void
-test_width_null(void)
+test_write_plain(void)
 {
-   fputs("test: get the width of a null string\n", stderr);
+   fputs("test: write a value without control codes\n", stderr);
 
+   // the codes of a chunked value are skipped in each of its chunks
    kstr * str = kstr_new(NULL);
+   kstr * expected = kstr_new(NULL);
+   kstr_set_growth(str, kstr_growth_chunked);
+   for (int i = 0; i < 1500; i++)
+   {
+      kstr_add_fg(str, kstr_color_green);
+      kstr_add_text(str, text_long);
+      kstr_add_reset(str);
+      kstr_add_text(expected, text_long);
+   }
 
-   size_t const expected = 0;
-   size_t const width = kstr_width(str);
-   if (width != expected)
-      err("width [%zu], expecting [%zu]", width, expected);
-
+   FILE * file = tmpfile();
+   if (file == NULL)
+      err("can't create output file");
+   if (!kstr_write_plain(str, fileno(file)))
+      err("write_plain failed");
+   if (kstr_get_chunks(str, NULL, 0) < 2)
+      err("write_plain joined the chunks");
+
+   check_output(file, expected);
+   fclose(file);
+
+   // after an edit, the plain copy is written
+   kstr_set_text(str, "\x1b[1m" "a");
+   kstr_add_text(str, "b");
+   kstr_insert(str, 0, kstr_view_text("\x1b[0m"));
+   kstr_set_text(expected, "ab");
+   if ((file = tmpfile()) == NULL)
+      err("can't create output file");
+   if (!kstr_write_plain(str, fileno(file)))
+      err("write_plain failed");
+
+   check_output(file, expected);
+   fclose(file);
+
+   kstr_free(&expected);
    kstr_free(&str);
 }
 
 static
 void
-test_width_text(void)
+test_writev(void)
 {
-   fputs("test: get the width of a string of text\n", stderr);
+   fputs("test: write many strings to a file descriptor at once\n", stderr);
 
-   char const * const text = __func__;
-   kstr * str = kstr_new(text);
+   // more strings than fit in a single writev() call, some of them empty
+   enum { num_strs = 200 };
+   kstr * strs[num_strs];
+   kstr * expected = kstr_new(NULL);
+   for (size_t i = 0; i < num_strs; i++)
+   {
+      strs[i] = kstr_new(NULL);
+      if (i % 7 != 0)
+         kstr_add_fmt(strs[i], "line %zu: %s\n", i, text_long + i);
 
-   size_t const expected = strlen(text);
-   size_t const width = kstr_width(str);
-   if (width != expected)
-      err("width [%zu], expecting [%zu]", width, expected);
+      kstr_add_bytes(expected, kstr_get(strs[i]), kstr_size(strs[i]) - 1);
+   }
 
-   kstr_free(&str);
+   FILE * file = tmpfile();
+   if (file == NULL)
+      err("can't create output file");
+   if (!kstr_writev(strs, num_strs, fileno(file)))
+      err("writev failed");
+
+   check_output(file, expected);
+   fclose(file);
+
+   // writing no strings writes nothing
+   if (!kstr_writev(strs, 0, -1))
+      err("writev of no strings failed");
+
+   for (size_t i = 0; i < num_strs; i++)
+      kstr_free(&strs[i]);
+   kstr_free(&expected);
+}
+
+void *
+__wrap_calloc(
+      size_t count,
+      size_t size)
+{
+   return fail_allocation() ? NULL : __real_calloc(count, size);
+}
+
+void *
+__wrap_malloc(
+      size_t size)
+{
+   return fail_allocation() ? NULL : __real_malloc(size);
+}
+
+void *
+__wrap_realloc(
+      void * ptr,
+      size_t size)
+{
+   return fail_allocation() ? NULL : __real_realloc(ptr, size);
 }